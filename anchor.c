@@ -0,0 +1,224 @@
+/*
+    Timestamp anchors (see anchor.h)
+*/
+#include <string.h>
+#include "anchor.h"
+
+// Queue an anchor; the slot is written before head publishes it
+void anchor_ring_push(anchor_ring_t *ring, const sdat_anchor_t *anchor)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    ring->slots[head % ANCHOR_RING_SIZE] = *anchor;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Copy the anchor at *cursor without taking it. Anchors the producer has
+// overwritten, or may be overwriting, are skipped.
+static bool ring_peek(const anchor_ring_t *ring, uint64_t *cursor, sdat_anchor_t *out)
+{
+    for (;;)
+    {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - *cursor > ANCHOR_RING_SIZE)
+            *cursor = head - ANCHOR_RING_SIZE;
+        if (*cursor >= head)
+            return false;
+        *out = ring->slots[*cursor % ANCHOR_RING_SIZE];
+
+        // The slot is reused once head reaches cursor + ANCHOR_RING_SIZE
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - *cursor < ANCHOR_RING_SIZE)
+            return true;
+    }
+}
+
+// Start with the anchors still in the ring
+void anchor_track_reset(anchor_track_t *t, const anchor_ring_t *ring, uint32_t num_channels)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    memset(t, 0, sizeof(*t));
+    t->cursor = head > ANCHOR_RING_SIZE ? head - ANCHOR_RING_SIZE : 0;
+    t->num_channels = num_channels > 0 ? num_channels : 1;
+}
+
+// The recent block holding ring position, or NULL
+static const anchor_block_t* find_block(const anchor_track_t *t, uint64_t position)
+{
+    for (uint32_t i = t->num_blocks; i-- > 0; )
+    {
+        const anchor_block_t *b = &t->blocks[i];
+        if (position >= b->position && position - b->position < b->count)
+            return b;
+    }
+    return NULL;
+}
+
+// Remember a block read from the ring
+static void add_block(anchor_track_t *t, uint64_t position, uint64_t sample, size_t count)
+{
+    if (t->num_blocks > 0)
+    {
+        anchor_block_t *last = &t->blocks[t->num_blocks - 1];
+        if (position != last->position + last->count)
+            t->gap = true;
+        else if (sample == last->sample + last->count)
+        {
+            last->count += count;
+            return;
+        }
+    }
+    if (t->num_blocks == ANCHOR_BLOCKS)
+    {
+        memmove(t->blocks, t->blocks + 1, (ANCHOR_BLOCKS - 1) * sizeof(anchor_block_t));
+        t->num_blocks--;
+    }
+    t->blocks[t->num_blocks++] = (anchor_block_t){ position, sample, count };
+}
+
+// Map the anchors whose reads end in a block just read
+void anchor_track_block(anchor_track_t *t, const anchor_ring_t *ring, uint64_t position,
+                        uint64_t sample, size_t count)
+{
+    if (count == 0)
+        return;
+    add_block(t, position, sample, count);
+
+    sdat_anchor_t a;
+    while (ring_peek(ring, &t->cursor, &a))
+    {
+        // Anchors are pushed before their samples, so later ones wait
+        if (a.index > position + count)
+            break;
+        t->cursor++;
+
+        // Dropped with its samples, or read before tracking began
+        const anchor_block_t *b = a.index > 0 ? find_block(t, a.index - 1) : NULL;
+        if (b == NULL)
+            continue;
+        a.index = (b->sample + (a.index - 1 - b->position)) / t->num_channels;
+        if (t->gap)
+        {
+            a.flags |= SDAT_ANCHOR_GAP;
+            t->gap = false;
+        }
+        t->history[t->history_head++ % ANCHOR_HISTORY] = a;
+    }
+}
+
+// Anchors of frames [first, end) and their neighbours
+uint32_t anchor_collect(const anchor_track_t *t, uint64_t first, uint64_t end,
+                        sdat_anchor_t *out, uint32_t max)
+{
+    sdat_anchor_t found[ANCHOR_HISTORY];
+    uint32_t kept = t->history_head < ANCHOR_HISTORY ? t->history_head : ANCHOR_HISTORY;
+    uint32_t count = 0;
+
+    for (uint32_t head = t->history_head, k = head - kept; k != head; k++)
+    {
+        const sdat_anchor_t *a = &t->history[k % ANCHOR_HISTORY];
+        if (a->index < first)
+        {
+            // Only the nearest one before the span
+            found[0] = *a;
+            count = 1;
+            continue;
+        }
+        found[count++] = *a;
+        if (a->index >= end)
+            break;
+    }
+    count = anchor_thin(found, count, max);
+    memcpy(out, found, count * sizeof(sdat_anchor_t));
+    return count;
+}
+
+// Keep the ends and the breaks, spread the others evenly
+uint32_t anchor_thin(sdat_anchor_t *anchors, uint32_t count, uint32_t max)
+{
+    if (count <= max)
+        return count;
+    if (max < 2)
+        return max;
+
+    uint32_t breaks = 0;
+    for (uint32_t i = 1; i + 1 < count; i++)
+    {
+        if (anchors[i].flags & SDAT_ANCHOR_BREAK)
+            breaks++;
+    }
+    uint32_t others = count - 2 - breaks;
+    uint32_t room = max - 2 > breaks ? max - 2 - breaks : 0;
+    uint32_t kept = 1, seen = 0;
+    for (uint32_t i = 1; i + 1 < count && kept < max - 1; i++)
+    {
+        bool take = (anchors[i].flags & SDAT_ANCHOR_BREAK) != 0;
+        if (!take)
+        {
+            // Bresenham: room of the others, evenly apart
+            take = (uint64_t)(seen + 1) * room / others > (uint64_t)seen * room / others;
+            seen++;
+        }
+        if (take)
+            anchors[kept++] = anchors[i];
+    }
+    anchors[kept++] = anchors[count - 1];
+    return kept;
+}
+
+// Seconds per frame from anchor j - 1 to anchor j, 0 if that is no piece
+static double piece_slope(const sdat_anchor_t *a, uint32_t n, uint32_t j)
+{
+    if (j == 0 || j >= n || (a[j].flags & SDAT_ANCHOR_BREAK) || a[j].index <= a[j - 1].index)
+        return 0.0;
+    return (double)(a[j].time_ns - a[j - 1].time_ns) * 1e-9 / (double)(a[j].index - a[j - 1].index);
+}
+
+// Piecewise-linear times between anchors
+int anchor_times(const sdat_anchor_t *anchors, uint32_t num_anchors, uint64_t first, uint32_t step,
+                 uint32_t count, double rate, int64_t origin_ns, double *out)
+{
+    if (num_anchors == 0)
+        return -1;
+    if (step == 0)
+        step = 1;
+
+    uint32_t k = 0, j = 0;
+    while (k < count)
+    {
+        uint64_t x = first + (uint64_t)k * step;
+        while (j < num_anchors && anchors[j].index < x)
+            j++;
+
+        // The anchor the frames up to it are timed from, and the slope
+        const sdat_anchor_t *ref;
+        double slope;
+        uint32_t end = count;
+        if (j == num_anchors)
+        {
+            // After the last anchor: on with the last piece
+            ref = &anchors[j - 1];
+            slope = piece_slope(anchors, num_anchors, j - 1);
+        }
+        else
+        {
+            // Between anchors j - 1 and j; back from a break or the first
+            // anchor with the piece after it
+            ref = &anchors[j];
+            bool inside = j > 0 && !(anchors[j].flags & SDAT_ANCHOR_BREAK);
+            slope = piece_slope(anchors, num_anchors, inside ? j : j + 1);
+            uint64_t last = (ref->index - first) / step + 1;
+            end = last < count ? (uint32_t)last : count;
+        }
+        if (slope <= 0.0)
+            slope = rate > 0.0 ? 1.0 / rate : 0.0;
+
+        // One multiply-add per frame, vectorized
+        double base = (double)(ref->time_ns - origin_ns) * 1e-9 -
+                      slope * (double)(int64_t)(ref->index - first);
+        double dt = slope * step;
+        for (int i = (int)k; i < (int)end; i++)
+            out[i] = base + dt * (double)i;
+        k = end;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+    Timestamp anchors: when each sample was taken.
+
+    A chunk header only records the whole second it was closed in. Within
+    a capture the board's clock is steady, but reads come back late by a
+    varying amount, the ring may drop samples when the consumer falls
+    behind, the board may overrun, and STOP/START or a rate change
+    restarts the scan. So each chunk carries a small table of anchors
+    (SDAT_EXT_ANCHORS, see sdat.h): the host time right after a device
+    read, the index of the last frame that read delivered, the device
+    status, and flags for what broke the clock since the anchor before.
+
+    The producer takes an anchor after a read once anchor_interval frames
+    have passed since the last one, and after every read that starts a
+    scan or reports an overrun:
+
+        anchor_interval = <frames>      default 0: 16 per chunk
+                                        (1: every read)
+
+    Anchors travel to the consumer beside the samples in an anchor ring:
+    in process memory, or in the shared-memory ring header between the
+    acquisition and writer processes (see shm_ring.h). There an anchor is
+    keyed by the ring position one past its read, which the consumer maps
+    to a frame index as it reads the blocks around it; a block that does
+    not start where the last one ended means the ring dropped samples,
+    and the next anchor is flagged as a gap. Every chunk, full-rate or
+    derived, gets the anchors inside its span plus the nearest one on
+    either side that is known when it is closed.
+
+    Readers interpolate between neighbouring anchors to time every frame
+    (anchor_times()), and extrapolate at a break or the end of the table
+    with the slope of the next piece, or the nominal rate. Nothing is
+    stored per sample.
+*/
+
+#ifndef ANCHOR_H_
+#define ANCHOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdat.h"
+
+#define ANCHOR_RING_SIZE 256            // power of two
+#define ANCHOR_HISTORY 256              // mapped anchors kept for chunks still open
+#define ANCHOR_BLOCKS 16                // recent ring blocks kept for mapping
+#define ANCHORS_PER_CHUNK 16            // anchor_interval = 0
+
+// Single-producer, single-consumer ring of anchors. Slot index is the
+// ring position one past the read, not yet a frame index. It works in
+// shared memory: head is the only field written after creation.
+typedef struct {
+    uint64_t head;                      // anchors ever pushed
+    uint8_t pad[64 - 8];
+    sdat_anchor_t slots[ANCHOR_RING_SIZE];
+} anchor_ring_t;
+
+// A block of samples read from the ring: ring position to sample number
+typedef struct {
+    uint64_t position;                  // ring position of the first sample
+    uint64_t sample;                    // full-rate sample number (frame x channels)
+    uint64_t count;                     // samples
+} anchor_block_t;
+
+// Consumer side: maps ring anchors to frame indices and keeps the recent ones
+typedef struct {
+    uint64_t cursor;                    // next ring anchor to look at
+    uint32_t num_channels;
+    bool gap;                           // the ring dropped samples since the last anchor
+    anchor_block_t blocks[ANCHOR_BLOCKS];
+    uint32_t num_blocks;
+    sdat_anchor_t history[ANCHOR_HISTORY];
+    uint32_t history_head;              // anchors ever kept
+} anchor_track_t;
+
+// Producer: queue an anchor (index = ring position one past its read)
+void anchor_ring_push(anchor_ring_t *ring, const sdat_anchor_t *anchor);
+
+// Consumer: start with the next anchor pushed to ring, forget the rest
+void anchor_track_reset(anchor_track_t *t, const anchor_ring_t *ring, uint32_t num_channels);
+
+// Consumer: count samples read from ring position became full-rate sample
+// numbers sample, sample + 1, ...; maps the anchors they complete
+void anchor_track_block(anchor_track_t *t, const anchor_ring_t *ring, uint64_t position,
+                        uint64_t sample, size_t count);
+
+// Copy into out the anchors of full-rate frames [first, end) plus the
+// nearest known on either side, thinned to at most max. Returns the count.
+uint32_t anchor_collect(const anchor_track_t *t, uint64_t first, uint64_t end,
+                        sdat_anchor_t *out, uint32_t max);
+
+// Reduce count anchors to at most max, keeping the first, the last and
+// the breaks, and spreading the others evenly. Returns the new count.
+uint32_t anchor_thin(sdat_anchor_t *anchors, uint32_t count, uint32_t max);
+
+// Times of count frames at full-rate indices first, first + step, ... in
+// seconds after origin_ns, from count anchors sorted by index. rate is the
+// nominal full-rate frame rate, for tables without a usable slope.
+// Returns 0, or -1 if there are no anchors.
+int anchor_times(const sdat_anchor_t *anchors, uint32_t num_anchors, uint64_t first, uint32_t step,
+                 uint32_t count, double rate, int64_t origin_ns, double *out);
+
+#endif /* ANCHOR_H_ */
@@ -0,0 +1,127 @@
+/*
+    Memory budget (see budget.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "budget.h"
+#include "config.h"
+
+static const char *g_area_names[BUDGET_AREAS] = { "ring", "chunks", "queues", "history", "analysis" };
+static size_t g_budget = BUDGET_DEFAULT_BYTES;
+static size_t g_used[BUDGET_AREAS];
+static size_t g_total = 0;
+static pthread_mutex_t g_budget_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Format a byte count as "1.5M"
+static void format_bytes(size_t bytes, char *buf, size_t len)
+{
+    if (bytes >= ((size_t)1 << 20))
+        snprintf(buf, len, "%.1fM", bytes / 1048576.0);
+    else if (bytes >= 1024)
+        snprintf(buf, len, "%.1fK", bytes / 1024.0);
+    else
+        snprintf(buf, len, "%zu", bytes);
+}
+
+// Read the budget from the config
+int budget_init(void)
+{
+    const char *value = config_get("memory_budget");
+    if (value == NULL)
+        return 0;
+
+    char *end;
+    double bytes = strtod(value, &end);
+    const char *suffixes = "KMG";
+    const char *suffix = *end ? strchr(suffixes, *end & ~0x20) : NULL;
+    if (suffix != NULL)
+    {
+        for (const char *s = suffixes; s <= suffix; s++)
+            bytes *= 1024.0;
+        end++;
+    }
+    if (end == value || *end != '\0' || bytes < 1048576.0)
+    {
+        fprintf(stderr, "Error: Invalid memory_budget \"%s\" (at least 1M)\n", value);
+        return -1;
+    }
+    g_budget = (size_t)bytes;
+    return 0;
+}
+
+// Reserve bytes against the budget
+int budget_reserve(budget_area_t area, size_t bytes, const char *what)
+{
+    pthread_mutex_lock(&g_budget_mutex);
+    bool fits = g_total + bytes <= g_budget;
+    if (fits)
+    {
+        g_used[area] += bytes;
+        g_total += bytes;
+    }
+    size_t total = g_total;
+    pthread_mutex_unlock(&g_budget_mutex);
+
+    if (!fits)
+    {
+        char need[16], used[16], budget[16];
+        format_bytes(bytes, need, sizeof(need));
+        format_bytes(total, used, sizeof(used));
+        format_bytes(g_budget, budget, sizeof(budget));
+        fprintf(stderr, "Error: Memory budget exceeded: %s needs %s, %s of %s already reserved "
+                "(raise memory_budget or shrink the configuration)\n", what, need, used, budget);
+        return -1;
+    }
+    return 0;
+}
+
+// Return a reservation
+void budget_release(budget_area_t area, size_t bytes)
+{
+    pthread_mutex_lock(&g_budget_mutex);
+    if (bytes > g_used[area])
+        bytes = g_used[area];
+    g_used[area] -= bytes;
+    g_total -= bytes;
+    pthread_mutex_unlock(&g_budget_mutex);
+}
+
+// Bytes reserved in one area
+size_t budget_used(budget_area_t area)
+{
+    pthread_mutex_lock(&g_budget_mutex);
+    size_t used = g_used[area];
+    pthread_mutex_unlock(&g_budget_mutex);
+    return used;
+}
+
+// Check a change of reservations without making it
+bool budget_fits(size_t release, size_t reserve)
+{
+    pthread_mutex_lock(&g_budget_mutex);
+    size_t after = (release < g_total ? g_total - release : 0) + reserve;
+    pthread_mutex_unlock(&g_budget_mutex);
+    return after <= g_budget;
+}
+
+// Summary for STATUS: "used/budget(area=..,...)"
+void budget_status(char *buf, size_t len)
+{
+    char total[16], budget[16];
+
+    pthread_mutex_lock(&g_budget_mutex);
+    format_bytes(g_total, total, sizeof(total));
+    format_bytes(g_budget, budget, sizeof(budget));
+    int n = snprintf(buf, len, "%s/%s(", total, budget);
+    for (int i = 0; i < BUDGET_AREAS && n >= 0 && (size_t)n < len; i++)
+    {
+        char used[16];
+        format_bytes(g_used[i], used, sizeof(used));
+        n += snprintf(buf + n, len - n, "%s%s=%s", i ? "," : "", g_area_names[i], used);
+    }
+    if (n >= 0 && (size_t)n < len)
+        snprintf(buf + n, len - n, ")");
+    pthread_mutex_unlock(&g_budget_mutex);
+}
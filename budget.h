@@ -0,0 +1,51 @@
+/*
+    Memory budget shared by every pipeline buffer.
+
+    Buffers whose size follows from the configuration (the sample ring,
+    chunk buffers, sink queues, pre-event history and derived-stream
+    buffers, analysis workspaces) reserve their bytes here before they are
+    allocated. A reservation that would exceed the budget fails with an
+    error naming the buffer, so a bad configuration is rejected up front
+    instead of getting the process OOM-killed later. Commands that would
+    grow buffers (SET_RATE) check budget_fits() first.
+
+    Per-area usage is reported through STATUS.
+
+    Configuration:
+        memory_budget = 256M        (bytes, or with a K, M or G suffix)
+*/
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BUDGET_DEFAULT_BYTES ((size_t)256 << 20)
+
+typedef enum {
+    BUDGET_RING,        // sample ring (local or shared memory)
+    BUDGET_CHUNKS,      // chunk being assembled
+    BUDGET_QUEUES,      // chunks waiting in the sink queues
+    BUDGET_HISTORY,     // pre-event history and derived-stream buffers
+    BUDGET_ANALYSIS,    // spectrum workspaces
+    BUDGET_AREAS
+} budget_area_t;
+
+// Read "memory_budget" from the config. Returns -1 if it is invalid.
+int budget_init(void);
+
+// Reserve bytes for what. Returns 0, or -1 (with an error) if over budget.
+int budget_reserve(budget_area_t area, size_t bytes, const char *what);
+void budget_release(budget_area_t area, size_t bytes);
+
+// Bytes currently reserved in area
+size_t budget_used(budget_area_t area);
+
+// True if releasing release bytes and reserving reserve bytes would fit
+bool budget_fits(size_t release, size_t reserve);
+
+// One-line summary for STATUS
+void budget_status(char *buf, size_t len);
+
+#endif /* BUDGET_H_ */
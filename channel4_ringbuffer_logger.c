@@ -6,6 +6,8 @@
         Acquire data from channel 4 using ring buffer and save to binary files.
         Controlled via Unix domain socket: START, STOP, STATUS, SET_RATE.
         Uses three threads: control (socket listener), producer (sensor reader), consumer (file writer).
+        Can also run split into two processes sharing a shared-memory ring:
+        an acquisition process (control + producer) and a writer process (consumer).
     
     Description:
         - Control thread: Listens on Unix socket for commands
@@ -15,10 +17,10 @@
         - Files saved to: DAD_Files/
         - File format: Binary with header (as per specification)
         - Default scan rate: 120 Hz
+        - Modes: --mode combined (default), --mode acquire, --mode writer
 
 *****************************************************************************/
-#define _POSIX_C_SOURCE 200809L
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,28 +34,62 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 #include <daqhats/daqhats.h>
 #include <daqhats/mcc118.h>
 #include "daqhats_utils.h"
+#include "shm_ring.h"
+#include "sdat.h"
+#include "sink.h"
+#include "config.h"
+#include "dsp.h"
+#include "detector.h"
+#include "spectrum.h"
+#include "flat.h"
+#include "dualrate.h"
+#include "vstream.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "budget.h"
+#include "pace.h"
+#include "compact.h"
+#include "device.h"
+#include "upgrade.h"
+#include "fetch.h"
+#include "kernel.h"
+#include "anchor.h"
+#include "util.h"
 
 // Constants
 #define DEFAULT_SCAN_RATE_HZ 120.0
 #define CHUNK_DURATION_SEC 2.0
-#define RECORD_SIZE 8  // sizeof(double) = 8 bytes per sample
 #define RING_BUFFER_SIZE (4 * 1024 * 1024)  // 4 MB ring buffer
 #define OUTPUT_DIR_RELATIVE "DAD_Files"
 #define SOCKET_PATH "/tmp/sensor_ctrl.sock"
 #define MAX_COMMAND_LEN 256
+#define MAX_CONTROL_CONNS 16            // open control connections, sessions included
+#define CONTROL_BUF_SIZE (4 * MAX_COMMAND_LEN)
+#define ACQUIRE_RT_PRIORITY 50  // SCHED_FIFO priority of the producer in acquire mode
+#define WRITER_ATTACH_RETRY_US 500000
+#define MAX_SUBSCRIBERS 16
+#define MAX_SCAN_CHANNELS 8
+#define STATUS_MAX_LEN 4096     // STATUS reply, newline included (SENSORCTL_MAX_REPLY)
+#define DEFAULT_READ_INTERVAL_SEC 0.25  // single-threaded engine: device read period
+#define DEFAULT_MAX_CHUNK_AGE_SEC 0.0   // 0 = chunks close only when full
 
 // Global variable for output directory path
 static char g_output_dir[512] = {0};
 
-// Binary file format constants
-#define MAGIC "SDAT"
-#define VERSION 1
-
 // Ring buffer structure
 typedef struct {
     uint8_t *buffer;
@@ -61,6 +97,8 @@ typedef struct {
     size_t write_pos;
     size_t read_pos;
     size_t available;  // bytes available to read
+    uint64_t write_total;  // bytes ever written: stream offset of write_pos
+    uint64_t read_total;   // bytes read or dropped: stream offset of read_pos
     pthread_mutex_t mutex;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
@@ -68,32 +106,179 @@ typedef struct {
     bool consumer_done;
 } ring_buffer_t;
 
+// Deployment modes
+typedef enum {
+    MODE_COMBINED,  // control + producer + consumer in one process
+    MODE_ACQUIRE,   // control + producer, samples go to the shared-memory ring
+    MODE_WRITER     // consumer only, samples come from the shared-memory ring
+} run_mode_t;
+
+// Execution engines
+typedef enum {
+    ENGINE_THREADED,    // control, producer and consumer threads
+    ENGINE_SINGLE       // one epoll loop (combined mode only)
+} engine_t;
+
+// Device side of the capture
+typedef struct {
+    double *read_buf;
+    uint32_t read_frames;           // frames per read
+    uint8_t num_channels;
+    uint8_t channel_mask;
+    bool scan_active;
+    bool from_timer;                // the schedule started this capture
+    uint64_t frames_left;           // SCHEDULE_UNLIMITED for an open-ended capture
+    double actual_scan_rate;
+    bool awaiting_first;            // scan started, no sample read yet
+    uint32_t anchor_interval;       // frames between timestamp anchors
+    uint32_t anchor_frames;         // frames read since the last anchor
+    uint16_t anchor_flags;          // SDAT_ANCHOR_* for the next anchor
+    snapshot_t settings;            // capture settings as last seen
+} producer_t;
+
+// A control connection: one command, or a session of pipelined commands
+typedef struct {
+    int fd;                         // -1 = free slot
+    bool session;                   // after SESSION: one command per line until closed
+    size_t len;                     // bytes of an incomplete line in buf
+    char buf[CONTROL_BUF_SIZE];
+} control_conn_t;
+
+// What to do with a connection after serving it
+typedef enum {
+    CONTROL_KEEP,       // a session waiting for more commands
+    CONTROL_CLOSE,      // done or gone: close it
+    CONTROL_HANDED_OFF  // now a subscriber or a fetch: stop reading, keep it open
+} control_result_t;
+
+// Chunk assembly on the consumer side
+typedef struct {
+    sdat_chunk_t *chunk;
+    uint32_t samples_collected;
+    uint32_t samples_per_chunk;
+    double current_rate;
+    size_t chunk_reserved;          // budget bytes for the chunk buffer
+    size_t queue_reserved;          // budget bytes for chunks in the sink queues
+    double chunk_opened;            // monotonic time of the chunk's first sample (estimated)
+    snapshot_t settings;            // capture settings as last seen
+} consumer_t;
+
+// Writer mode: full-rate chunks, in seq order, whose samples are still in
+// the shared ring. The oldest is committed once no chunk on the sinks
+// starts in it and the derived streams are not filling a chunk from it.
+typedef struct {
+    uint64_t seq_end;               // frame after the chunk
+    uint64_t cursor;                // ring position after the chunk
+    uint32_t holds;                 // chunks on the sinks starting in it, or 1 while dispatching
+} commit_entry_t;
+
+typedef struct {
+    commit_entry_t *entries;        // ring of capacity entries
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    uint64_t seq_start;             // first frame of the oldest entry
+    uint64_t first_id;              // id of the oldest entry; ids are never reused
+    uint64_t derived_from;          // first frame the derived streams still hold
+} commit_ledger_t;
+
 // Global variables
 static ring_buffer_t g_ring_buffer;
+static run_mode_t g_mode = MODE_COMBINED;
+static char g_shm_name[64] = SHM_RING_DEFAULT_NAME;
+static shm_ring_t g_shm_ring;
+static uint64_t g_shm_cursor = 0;  // writer mode: next sample index to read
+static pthread_mutex_t g_commit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static commit_ledger_t g_commits;  // writer mode, guarded by g_commit_mutex
+static const char *g_config_path = NULL;
+static uint8_t g_scan_channels[MAX_SCAN_CHANNELS] = { 4 };  // hardware channels in each frame
+static uint32_t g_num_scan_channels = 1;
+static dsp_chain_t g_dsp;
+static detector_t g_detector;
+static spectrum_t g_spectrum;
+static flat_t g_flat;
+static dualrate_t g_dualrate;
+static vstream_set_t g_vstreams;
+static schedule_t g_schedule;
+static int g_subscribers[MAX_SUBSCRIBERS];  // SUBSCRIBE clients receiving events
+static int g_subscriber_count = 0;
+static pthread_mutex_t g_subscriber_mutex = PTHREAD_MUTEX_INITIALIZER;
 static uint8_t g_hat_addr = 0;
+static device_t g_device;
 static uint64_t g_boot_id = 0;
 static uint64_t g_seq_counter = 0;
-static bool g_running = true;
-static bool g_capture_enabled = false;
-static double g_scan_rate = DEFAULT_SCAN_RATE_HZ;
-static pthread_mutex_t g_state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_running = true;  // read and written with __atomic builtins
 static int g_socket_fd = -1;
+static char g_socket_path[108] = SOCKET_PATH;  // sizeof(sun_path)
+static uint32_t g_device_id = 0;               // device_id of every chunk
+static engine_t g_engine = ENGINE_THREADED;
+static double g_read_interval = DEFAULT_READ_INTERVAL_SEC;
+static double g_max_chunk_age = DEFAULT_MAX_CHUNK_AGE_SEC;
+static bool g_planar_layout = false;        // payload_layout = planar
+static const kernel_t *g_kernels = NULL;    // finishing kernels of the layout, by channel count
+static double *g_planar_buffer = NULL;      // spare payload buffer for the planar rewrite
+static uint32_t g_planar_capacity = 0;      // samples
+static uint32_t g_anchor_interval = 0;      // frames, 0 = ANCHORS_PER_CHUNK per chunk
+static anchor_ring_t g_anchor_ring;         // combined mode: anchors beside g_ring_buffer
+static anchor_track_t g_anchors;            // consumer: anchors mapped to frame indices
+static bool g_producer_reading = false;  // a device read may still add samples (__atomic)
+static uint64_t g_loop_wakeups = 0;
+static double g_process_start = 0.0;        // monotonic time main() was entered
+static uint64_t g_start_requested_us = 0;   // monotonic time of the last START (__atomic)
+static double g_first_sample_process_ms = -1.0;  // first sample after process start
+static double g_first_sample_start_ms = -1.0;    // first sample after the last START
+static int g_control_wake_fd = -1;          // wakes the control thread at shutdown
+static upgrade_state_t g_upgrade;           // state handed to, or taken over from, another binary
+static bool g_upgrade_requested = false;    // UPGRADE accepted (__atomic)
+static char g_upgrade_path[UPGRADE_PATH_MAX];
+static int g_takeover_fd = -1;              // --takeover: the old process's state
+static double g_takeover_ms = -1.0;         // UPGRADE to ready in the new process
+static double g_takeover_gap_ms = -1.0;     // scan stopped to scan resumed
+static uint64_t g_takeover_lost = 0;        // frames missed between the two scans
 
 // Function prototypes
 static int init_ring_buffer(ring_buffer_t *rb, size_t size);
 static void destroy_ring_buffer(ring_buffer_t *rb);
 static size_t ring_buffer_write(ring_buffer_t *rb, const void *data, size_t len);
-static size_t ring_buffer_read(ring_buffer_t *rb, void *data, size_t len);
+static size_t ring_buffer_read(ring_buffer_t *rb, void *data, size_t len, uint64_t *offset);
 static size_t ring_buffer_available(ring_buffer_t *rb);
+static void note_start_requested(void);
+static void note_first_sample(void);
+static int producer_init(producer_t *p);
+static void producer_stop_scan(producer_t *p);
+static void producer_free(producer_t *p);
+static void producer_window_started(producer_t *p);
+static int producer_read(producer_t *p);
 static void* producer_thread(void *arg);
+static int consumer_emit(consumer_t *c, bool end_of_capture);
+static int consumer_step(consumer_t *c);
+static void consumer_finish(consumer_t *c);
+static void consumer_wait(consumer_t *c);
 static void* consumer_thread(void *arg);
+static int run_event_loop(const sigset_t *sigset);
 static void* control_thread(void *arg);
 static uint64_t generate_boot_id(void);
 static int ensure_output_dir(const char *path);
-static int write_chunk_file(uint64_t seq_start, double *samples, uint32_t sample_count, double actual_rate);
+static int dispatch_chunk(sdat_chunk_t *chunk, uint32_t sample_count, double actual_rate);
+static void on_chunk_done(const sdat_chunk_t *chunk, bool written);
+static void on_derived_chunk(sdat_chunk_t *chunk, void *user);
 static int setup_unix_socket(const char *path);
-static void handle_command(const char *command, int client_fd);
+static bool handle_command(const char *command, int client_fd);
+static control_conn_t* control_add(control_conn_t *conns, int fd);
+static control_conn_t* control_find(control_conn_t *conns, int fd);
+static control_result_t control_serve(control_conn_t *conn);
 static void send_status(int client_fd);
+static void publish_state(void);
+static void broadcast_event(const char *msg);
+static void on_detector_event(const detector_transition_t *tr, void *user);
+static void tag_open_events(sdat_chunk_t *chunk);
+static void get_capture_state(snapshot_t *cache, bool *capturing, double *rate);
+static bool is_running(void);
+static void stop_running(void);
+static bool is_upgrading(void);
+static size_t consumer_read(double *dst, size_t max_samples, uint64_t *position);
+static size_t consumer_backlog(void);
+static int writer_attach(void);
 
 // Initialize ring buffer
 static int init_ring_buffer(ring_buffer_t *rb, size_t size)
@@ -106,12 +291,19 @@ static int init_ring_buffer(ring_buffer_t *rb, size_t size)
     rb->write_pos = 0;
     rb->read_pos = 0;
     rb->available = 0;
+    rb->write_total = 0;
+    rb->read_total = 0;
     rb->producer_done = false;
     rb->consumer_done = false;
     
+    // not_empty is waited on with a monotonic deadline (consumer_wait)
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
     pthread_mutex_init(&rb->mutex, NULL);
-    pthread_cond_init(&rb->not_empty, NULL);
+    pthread_cond_init(&rb->not_empty, &attr);
     pthread_cond_init(&rb->not_full, NULL);
+    pthread_condattr_destroy(&attr);
     
     return 0;
 }
@@ -141,6 +333,7 @@ static size_t ring_buffer_write(ring_buffer_t *rb, const void *data, size_t len)
         size_t drop_bytes = len - free_space;
         rb->read_pos = (rb->read_pos + drop_bytes) % rb->size;
         rb->available -= drop_bytes;
+        rb->read_total += drop_bytes;
         free_space = rb->size - rb->available;
     }
     
@@ -159,6 +352,7 @@ static size_t ring_buffer_write(ring_buffer_t *rb, const void *data, size_t len)
         
         rb->write_pos = (rb->write_pos + write_len) % rb->size;
         rb->available += write_len;
+        rb->write_total += write_len;
     }
     
     pthread_cond_signal(&rb->not_empty);
@@ -167,8 +361,8 @@ static size_t ring_buffer_write(ring_buffer_t *rb, const void *data, size_t len)
     return write_len;
 }
 
-// Read from ring buffer
-static size_t ring_buffer_read(ring_buffer_t *rb, void *data, size_t len)
+// Read from ring buffer; *offset is the stream offset of the first byte
+static size_t ring_buffer_read(ring_buffer_t *rb, void *data, size_t len, uint64_t *offset)
 {
     pthread_mutex_lock(&rb->mutex);
     
@@ -194,8 +388,10 @@ static size_t ring_buffer_read(ring_buffer_t *rb, void *data, size_t len)
         memcpy((uint8_t*)data + first_part, rb->buffer, read_len - first_part);
     }
     
+    *offset = rb->read_total;
     rb->read_pos = (rb->read_pos + read_len) % rb->size;
     rb->available -= read_len;
+    rb->read_total += read_len;
     
     pthread_cond_signal(&rb->not_full);
     pthread_mutex_unlock(&rb->mutex);
@@ -212,6 +408,267 @@ static size_t ring_buffer_available(ring_buffer_t *rb)
     return avail;
 }
 
+// Publish capture state to the shared-memory ring (acquire mode)
+static void publish_state(void)
+{
+    if (g_mode != MODE_ACQUIRE || g_shm_ring.hdr == NULL)
+        return;
+
+    snapshot_t settings;
+    snapshot_copy(&settings);
+    uint32_t capturing = settings.capture_enabled ? 1 : 0;
+    double rate = settings.scan_rate;
+
+    __atomic_store(&g_shm_ring.hdr->scan_rate, &rate, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_shm_ring.hdr->capture_enabled, capturing, __ATOMIC_RELEASE);
+}
+
+// True until shutdown begins
+static bool is_running(void)
+{
+    return __atomic_load_n(&g_running, __ATOMIC_ACQUIRE);
+}
+
+// Begin shutdown
+static void stop_running(void)
+{
+    __atomic_store_n(&g_running, false, __ATOMIC_RELEASE);
+}
+
+// True if this shutdown hands the capture to a new binary
+static bool is_upgrading(void)
+{
+    return __atomic_load_n(&g_upgrade_requested, __ATOMIC_ACQUIRE);
+}
+
+// Get capture state as seen by the consumer
+static void get_capture_state(snapshot_t *cache, bool *capturing, double *rate)
+{
+    if (g_mode == MODE_WRITER)
+    {
+        __atomic_load(&g_shm_ring.hdr->scan_rate, rate, __ATOMIC_ACQUIRE);
+        *capturing = __atomic_load_n(&g_shm_ring.hdr->capture_enabled, __ATOMIC_ACQUIRE) != 0;
+        if (*rate <= 0.0)
+            *rate = DEFAULT_SCAN_RATE_HZ;
+        return;
+    }
+
+    const snapshot_t *settings = snapshot_get(cache, SNAPSHOT_READER_CONSUMER);
+    *rate = settings->scan_rate;
+    *capturing = settings->capture_enabled;
+}
+
+// Read samples for the consumer from whichever ring feeds this process.
+// *position is the ring position of the first one (see anchor.h).
+static size_t consumer_read(double *dst, size_t max_samples, uint64_t *position)
+{
+    if (g_mode != MODE_WRITER)
+    {
+        uint64_t offset = 0;
+        size_t n = ring_buffer_read(&g_ring_buffer, dst, max_samples * sizeof(double), &offset) / sizeof(double);
+        *position = offset / sizeof(double);
+        return n;
+    }
+
+    uint64_t lost = 0;
+    size_t n = shm_ring_read(&g_shm_ring, &g_shm_cursor, dst, max_samples, &lost);
+    if (lost > 0)
+    {
+        fprintf(stderr, "Warning: Writer fell behind, %llu samples overwritten in shared ring\n",
+                (unsigned long long)lost);
+    }
+    *position = g_shm_cursor - n;
+    return n;
+}
+
+// Anchor ring beside whichever sample ring feeds the consumer
+static anchor_ring_t* anchor_ring(void)
+{
+    return g_mode == MODE_COMBINED ? &g_anchor_ring : &g_shm_ring.hdr->anchors;
+}
+
+// Samples waiting to be consumed
+static size_t consumer_backlog(void)
+{
+    if (g_mode != MODE_WRITER)
+        return ring_buffer_available(&g_ring_buffer) / sizeof(double);
+
+    uint64_t head = __atomic_load_n(&g_shm_ring.hdr->head, __ATOMIC_ACQUIRE);
+    return (head > g_shm_cursor) ? (size_t)(head - g_shm_cursor) : 0;
+}
+
+// Share of the ring holding unconsumed samples, in percent
+static int consumer_ring_fill(void)
+{
+    size_t capacity = (g_mode == MODE_WRITER) ? (size_t)g_shm_ring.hdr->capacity
+                                              : g_ring_buffer.size / sizeof(double);
+    return capacity > 0 ? (int)(consumer_backlog() * 100 / capacity) : 0;
+}
+
+// Forget the chunks of a ring the writer no longer reads. Their tokens
+// are stale from now on. Caller holds g_commit_mutex (or nothing has been
+// dispatched yet).
+static void commit_reset(uint64_t seq_start)
+{
+    g_commits.first_id += g_commits.count;
+    g_commits.head = 0;
+    g_commits.count = 0;
+    g_commits.seq_start = seq_start;
+    g_commits.derived_from = UINT64_MAX;
+}
+
+// Commit the oldest chunks that nothing holds any more
+static void commit_advance(void)
+{
+    commit_entry_t done = { 0, 0, 0 };
+    bool advanced = false;
+
+    while (g_commits.count > 0)
+    {
+        commit_entry_t *e = &g_commits.entries[g_commits.head];
+        if (e->holds > 0 || e->seq_end > g_commits.derived_from)
+            break;
+        done = *e;
+        advanced = true;
+        g_commits.seq_start = e->seq_end;
+        g_commits.head = (g_commits.head + 1) % g_commits.capacity;
+        g_commits.count--;
+        g_commits.first_id++;
+    }
+    if (advanced && g_shm_ring.hdr != NULL)
+        shm_ring_commit(&g_shm_ring, done.cursor, done.seq_end);
+}
+
+// Add a dispatched full-rate chunk ending at seq_end and ring position
+// cursor, held until commit_release(). Returns its token, 0 on failure.
+static uint64_t commit_add(uint64_t seq_end, uint64_t cursor)
+{
+    uint64_t token = 0;
+
+    pthread_mutex_lock(&g_commit_mutex);
+    if (g_commits.count == g_commits.capacity)
+    {
+        // Grow and unwrap the ring
+        uint32_t capacity = g_commits.capacity ? g_commits.capacity * 2 : 16;
+        commit_entry_t *entries = (commit_entry_t*)malloc(capacity * sizeof(commit_entry_t));
+        if (entries == NULL)
+        {
+            pthread_mutex_unlock(&g_commit_mutex);
+            fprintf(stderr, "Error: Failed to grow the commit ledger\n");
+            return 0;
+        }
+        for (uint32_t i = 0; i < g_commits.count; i++)
+            entries[i] = g_commits.entries[(g_commits.head + i) % g_commits.capacity];
+        free(g_commits.entries);
+        g_commits.entries = entries;
+        g_commits.capacity = capacity;
+        g_commits.head = 0;
+    }
+    g_commits.entries[(g_commits.head + g_commits.count) % g_commits.capacity] =
+        (commit_entry_t){ seq_end, cursor, 1 };
+    g_commits.count++;
+    token = g_commits.first_id + g_commits.count;  // id + 1
+    pthread_mutex_unlock(&g_commit_mutex);
+    return token;
+}
+
+// Hold the chunk that full-rate frame belongs to while a derived chunk
+// starting there is on the sinks. Returns its token, 0 if that chunk is
+// already committed.
+static uint64_t commit_hold(uint64_t frame)
+{
+    uint64_t token = 0;
+
+    pthread_mutex_lock(&g_commit_mutex);
+    if (frame >= g_commits.seq_start)
+    {
+        for (uint32_t i = 0; i < g_commits.count; i++)
+        {
+            commit_entry_t *e = &g_commits.entries[(g_commits.head + i) % g_commits.capacity];
+            if (frame < e->seq_end || i + 1 == g_commits.count)
+            {
+                e->holds++;
+                token = g_commits.first_id + i + 1;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_commit_mutex);
+    return token;
+}
+
+// Drop a hold taken by commit_add() or commit_hold() and commit what is free
+static void commit_release(uint64_t token)
+{
+    pthread_mutex_lock(&g_commit_mutex);
+    if (token > g_commits.first_id && token - g_commits.first_id <= g_commits.count)
+    {
+        uint32_t i = (uint32_t)(token - 1 - g_commits.first_id);
+        g_commits.entries[(g_commits.head + i) % g_commits.capacity].holds--;
+        commit_advance();
+    }
+    pthread_mutex_unlock(&g_commit_mutex);
+}
+
+// Keep the hold of a chunk the sinks failed to write, so the ring is not
+// committed past it, and count it in the ring header for STATUS. Returns
+// false if the token belongs to a ring the writer no longer reads.
+static bool commit_fail(uint64_t token)
+{
+    bool held = false;
+
+    pthread_mutex_lock(&g_commit_mutex);
+    if (token > g_commits.first_id && token - g_commits.first_id <= g_commits.count)
+    {
+        __atomic_add_fetch(&g_shm_ring.hdr->write_errors, 1, __ATOMIC_RELAXED);
+        held = true;
+    }
+    pthread_mutex_unlock(&g_commit_mutex);
+    return held;
+}
+
+// Record the first frame the derived streams still hold and commit what is free
+static void commit_derived(void)
+{
+    uint64_t from = dualrate_pending(&g_dualrate);
+    uint64_t vfrom = vstream_pending(&g_vstreams);
+
+    pthread_mutex_lock(&g_commit_mutex);
+    g_commits.derived_from = vfrom < from ? vfrom : from;
+    commit_advance();
+    pthread_mutex_unlock(&g_commit_mutex);
+}
+
+// Attach the writer to the shared-memory ring and resume at its committed tail
+static int writer_attach(void)
+{
+    if (shm_ring_attach(&g_shm_ring, g_shm_name) != 0)
+        return -1;
+
+    g_boot_id = g_shm_ring.hdr->boot_id;
+    g_shm_cursor = __atomic_load_n(&g_shm_ring.hdr->tail, __ATOMIC_ACQUIRE);
+    g_seq_counter = __atomic_load_n(&g_shm_ring.hdr->seq_counter, __ATOMIC_ACQUIRE);
+    commit_reset(g_seq_counter);
+    
+    // The acquisition process decides which channels are scanned
+    uint32_t mask = g_shm_ring.hdr->channel_mask;
+    if (mask != 0)
+    {
+        g_num_scan_channels = 0;
+        for (uint8_t ch = 0; ch < MAX_SCAN_CHANNELS; ch++)
+        {
+            if (mask & (1u << ch))
+                g_scan_channels[g_num_scan_channels++] = ch;
+        }
+    }
+    anchor_track_reset(&g_anchors, &g_shm_ring.hdr->anchors, g_num_scan_channels);
+    printf("Writer: attached to %s (boot ID %016llx), resuming at sample %llu, seq=%llu\n",
+           g_shm_name, (unsigned long long)g_boot_id,
+           (unsigned long long)g_shm_cursor, (unsigned long long)g_seq_counter);
+    fflush(stdout);
+    return 0;
+}
+
 // Setup Unix domain socket
 static int setup_unix_socket(const char *path)
 {
@@ -256,31 +713,170 @@ static int setup_unix_socket(const char *path)
     return fd;
 }
 
-// Send status information
+// Consumer buffers whose size follows the scan rate: the chunk, the chunks
+// the sinks may hold, and the pre-event history
+static size_t rate_memory(double rate)
+{
+    uint32_t chunk_frames = (uint32_t)(rate * CHUNK_DURATION_SEC);
+    size_t chunk_bytes = sdat_chunk_footprint(chunk_frames * g_num_scan_channels);
+    return chunk_bytes * (1 + sink_max_queued()) +
+           dualrate_memory(g_num_scan_channels, rate, chunk_frames);
+}
+
+// True if the rate-dependent buffers, rebuilt for rate, stay within the budget
+static bool rate_fits_budget(double rate)
+{
+    if (g_mode != MODE_COMBINED)
+        return true;  // the writer process holds the chunk buffers
+    size_t current = budget_used(BUDGET_CHUNKS) + budget_used(BUDGET_QUEUES) +
+                     budget_used(BUDGET_HISTORY);
+    return budget_fits(current, rate_memory(rate));
+}
+
+// Append to a status line, truncating so that the newline always fits
+static void status_append(char *buf, size_t *len, const char *fmt, ...)
+{
+    size_t room = STATUS_MAX_LEN - 1 - *len;   // leaves room for "\n"
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *len, room, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        *len += (size_t)n < room ? (size_t)n : room - 1;
+}
+
+// Reply to a control client without ever blocking the caller. A client
+// that does not read its replies is dropped: the shutdown makes its next
+// read see the end of the connection.
+static void send_reply(int fd, const char *msg, size_t len)
+{
+    if (send(fd, msg, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len)
+        shutdown(fd, SHUT_RDWR);
+}
+
+// Send status information as one line
 static void send_status(int client_fd)
 {
-    char status_msg[512];
-    size_t available_bytes = ring_buffer_available(&g_ring_buffer);
-    uint32_t available_samples = available_bytes / sizeof(double);
+    char status_msg[STATUS_MAX_LEN];
+    size_t len = 0;
+    uint32_t available_samples;
+    uint64_t seq_counter = g_seq_counter;
+    
+    if (g_mode == MODE_ACQUIRE)
+    {
+        available_samples = (uint32_t)shm_ring_pending(&g_shm_ring);
+        seq_counter = __atomic_load_n(&g_shm_ring.hdr->seq_counter, __ATOMIC_ACQUIRE);
+    }
+    else
+    {
+        available_samples = ring_buffer_available(&g_ring_buffer) / sizeof(double);
+    }
+    
+    snapshot_t settings;
+    snapshot_copy(&settings);
+    bool capturing = settings.capture_enabled;
+    double rate = settings.scan_rate;
+    
+    status_append(status_msg, &len,
+                  "STATUS: capture=%s, rate=%.2f Hz, buffer_samples=%u, seq_counter=%llu",
+                  capturing ? "ON" : "OFF",
+                  rate,
+                  available_samples,
+                  (unsigned long long)seq_counter);
+    
+    char schedule[160];
+    schedule_status(&g_schedule, schedule, sizeof(schedule));
+    status_append(status_msg, &len, ", schedule=%s", schedule);
+    
+    char memory[160];
+    budget_status(memory, sizeof(memory));
+    status_append(status_msg, &len, ", memory=%s", memory);
+    
+    // Process cost, to compare the execution engines
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    status_append(status_msg, &len, ", engine=%s, cpu_s=%.3f, ctx_switches=%ld",
+                  g_engine == ENGINE_SINGLE ? "single" : "threaded",
+                  usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                  (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6,
+                  usage.ru_nvcsw + usage.ru_nivcsw);
+    if (g_device.is_open)
+    {
+        char device[128];
+        device_status(&g_device, capturing, device, sizeof(device));
+        status_append(status_msg, &len, ", device=%s, first_sample_ms=process:%.1f,start:%.1f",
+                      device, g_first_sample_process_ms, g_first_sample_start_ms);
+    }
+    if (g_takeover_ms >= 0.0)
+    {
+        status_append(status_msg, &len, ", upgrade=takeover_ms:%.1f,scan_gap_ms:%.1f,lost:%llu",
+                      g_takeover_ms, g_takeover_gap_ms, (unsigned long long)g_takeover_lost);
+    }
+    if (g_engine == ENGINE_SINGLE)
+    {
+        status_append(status_msg, &len, ", loop_wakeups=%llu",
+                      (unsigned long long)__atomic_load_n(&g_loop_wakeups, __ATOMIC_RELAXED));
+    }
     
-    pthread_mutex_lock(&g_state_mutex);
-    bool capturing = g_capture_enabled;
-    double rate = g_scan_rate;
-    pthread_mutex_unlock(&g_state_mutex);
+    if (g_mode == MODE_COMBINED)
+    {
+        char sinks[SINK_MAX * 128], pacing[64], compaction[96], fetch[96];
+        sink_status(sinks, sizeof(sinks));
+        pace_status(pacing, sizeof(pacing));
+        compact_status(compaction, sizeof(compaction));
+        fetch_status(fetch, sizeof(fetch));
+        status_append(status_msg, &len,
+                      ", sinks=%s, pacing=%s, compaction=%s, fetch=%s, events=%llu, subscribers=%d, flat_chunks=%llu, flat_saved_bytes=%llu",
+                      sinks, pacing, compaction, fetch, (unsigned long long)g_detector.event_count, g_subscriber_count,
+                      (unsigned long long)g_flat.elided_chunks, (unsigned long long)g_flat.elided_bytes);
+        for (uint32_t i = 0; i < g_vstreams.num_streams; i++)
+        {
+            status_append(status_msg, &len, "%s%s:%llu",
+                          i == 0 ? ", stream_chunks=" : ",", g_vstreams.streams[i].name,
+                          (unsigned long long)g_vstreams.streams[i].chunks);
+        }
+        if (g_dualrate.enabled)
+        {
+            status_append(status_msg, &len, ", low_chunks=%llu, windows=%llu, window_chunks=%llu",
+                          (unsigned long long)g_dualrate.low_chunks, (unsigned long long)g_dualrate.windows,
+                          (unsigned long long)g_dualrate.window_chunks);
+        }
+    }
+    else if (g_mode == MODE_ACQUIRE)
+    {
+        status_append(status_msg, &len, ", mode=acquire, ring_dropped=%llu, writer_pid=%d, writer_errors=%llu",
+                      (unsigned long long)__atomic_load_n(&g_shm_ring.hdr->dropped, __ATOMIC_RELAXED),
+                      (int)g_shm_ring.hdr->writer_pid,
+                      (unsigned long long)__atomic_load_n(&g_shm_ring.hdr->write_errors, __ATOMIC_RELAXED));
+    }
     
-    snprintf(status_msg, sizeof(status_msg),
-             "STATUS: capture=%s, rate=%.2f Hz, buffer_samples=%u, seq_counter=%llu",
-             capturing ? "ON" : "OFF",
-             rate,
-             available_samples,
-             (unsigned long long)g_seq_counter);
+    // The reply is always exactly one line
+    status_msg[len++] = '\n';
+    send_reply(client_fd, status_msg, len);
+}
+
+// Send an event line to every subscriber, dropping those that went away
+static void broadcast_event(const char *msg)
+{
+    size_t len = strlen(msg);
     
-    strncat(status_msg, "\n", sizeof(status_msg) - strlen(status_msg) - 1);
-    send(client_fd, status_msg, strlen(status_msg), 0);
+    pthread_mutex_lock(&g_subscriber_mutex);
+    for (int i = 0; i < g_subscriber_count; )
+    {
+        ssize_t n = send(g_subscribers[i], msg, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n != (ssize_t)len)
+        {
+            close(g_subscribers[i]);
+            g_subscribers[i] = g_subscribers[--g_subscriber_count];
+            continue;
+        }
+        i++;
+    }
+    pthread_mutex_unlock(&g_subscriber_mutex);
 }
 
-// Handle command from socket
-static void handle_command(const char *command, int client_fd)
+// Handle command from socket. Returns true if the connection stays open.
+static bool handle_command(const char *command, int client_fd)
 {
     char cmd_copy[MAX_COMMAND_LEN];
     char *token;
@@ -295,24 +891,24 @@ static void handle_command(const char *command, int client_fd)
     
     token = strtok(cmd_copy, " \t");
     if (token == NULL)
-        return;
+        return false;
     
     if (strcmp(token, "START") == 0)
     {
-        pthread_mutex_lock(&g_state_mutex);
-        g_capture_enabled = true;
-        pthread_mutex_unlock(&g_state_mutex);
+        note_start_requested();
+        snapshot_set_capture(true);
+        publish_state();
+        schedule_wake(&g_schedule);
         const char *response = "OK: Acquisition started\n";
-        send(client_fd, response, strlen(response), 0);
+        send_reply(client_fd, response, strlen(response));
         printf("Command received: START\n");
     }
     else if (strcmp(token, "STOP") == 0)
     {
-        pthread_mutex_lock(&g_state_mutex);
-        g_capture_enabled = false;
-        pthread_mutex_unlock(&g_state_mutex);
+        snapshot_set_capture(false);
+        publish_state();
         const char *response = "OK: Acquisition stopped\n";
-        send(client_fd, response, strlen(response), 0);
+        send_reply(client_fd, response, strlen(response));
         printf("Command received: STOP\n");
     }
     else if (strcmp(token, "STATUS") == 0)
@@ -326,69 +922,342 @@ static void handle_command(const char *command, int client_fd)
         if (token != NULL)
         {
             double new_rate = atof(token);
-            if (new_rate > 0 && new_rate <= 100000.0)
+            if (g_vstreams.num_streams > 0)
+            {
+                const char *response = "ERROR: Scan rate is set by the stream definitions\n";
+                send_reply(client_fd, response, strlen(response));
+            }
+            else if (new_rate > 0 && new_rate <= 100000.0 &&
+                     !device_rate_supported(&g_device, new_rate))
+            {
+                char response[160];
+                snprintf(response, sizeof(response),
+                         "ERROR: The device cannot scan %u channel(s) at %.2f Hz\n",
+                         g_num_scan_channels, new_rate);
+                send_reply(client_fd, response, strlen(response));
+            }
+            else if (new_rate > 0 && new_rate <= 100000.0 && !rate_fits_budget(new_rate))
+            {
+                char response[160];
+                snprintf(response, sizeof(response),
+                         "ERROR: Buffers at %.2f Hz would exceed the memory budget\n", new_rate);
+                send_reply(client_fd, response, strlen(response));
+            }
+            else if (new_rate > 0 && new_rate <= 100000.0)
             {
-                pthread_mutex_lock(&g_state_mutex);
-                g_scan_rate = new_rate;
-                pthread_mutex_unlock(&g_state_mutex);
+                snapshot_set_rate(new_rate);
+                publish_state();
                 char response[128];
                 snprintf(response, sizeof(response), "OK: Rate set to %.2f Hz\n", new_rate);
-                send(client_fd, response, strlen(response), 0);
+                send_reply(client_fd, response, strlen(response));
                 printf("Command received: SET_RATE %.2f\n", new_rate);
             }
             else
             {
                 const char *response = "ERROR: Invalid rate (must be > 0 and <= 100000)\n";
-                send(client_fd, response, strlen(response), 0);
+                send_reply(client_fd, response, strlen(response));
             }
         }
         else
         {
             const char *response = "ERROR: SET_RATE requires a value\n";
-            send(client_fd, response, strlen(response), 0);
+            send_reply(client_fd, response, strlen(response));
+        }
+    }
+    else if (strcmp(token, "SCHEDULE") == 0)
+    {
+        const char *args = strtok(NULL, "");
+        if (args == NULL || schedule_set_duty(&g_schedule, args) != 0)
+        {
+            const char *response = "ERROR: Usage: SCHEDULE every=<time> duration=<time> | SCHEDULE off "
+                                   "(times like 10s, 5m, 1h; duration <= every)\n";
+            send_reply(client_fd, response, strlen(response));
+        }
+        else
+        {
+            char summary[160];
+            char response[192];
+            schedule_status(&g_schedule, summary, sizeof(summary));
+            snprintf(response, sizeof(response), "OK: Schedule %s\n", summary);
+            send_reply(client_fd, response, strlen(response));
+            printf("Command received: SCHEDULE %s\n", args);
+        }
+    }
+    else if (strcmp(token, "START_AT") == 0)
+    {
+        token = strtok(NULL, " \t");
+        if (token == NULL || schedule_set_start_at(&g_schedule, token) != 0)
+        {
+            const char *response = "ERROR: START_AT requires epoch seconds or +seconds\n";
+            send_reply(client_fd, response, strlen(response));
+        }
+        else
+        {
+            char response[128];
+            snprintf(response, sizeof(response), "OK: Acquisition starts at %.3f\n", g_schedule.start_at);
+            send_reply(client_fd, response, strlen(response));
+            printf("Command received: START_AT %s\n", token);
+        }
+    }
+    else if (strcmp(token, "STOP_AFTER") == 0)
+    {
+        token = strtok(NULL, " \t");
+        long long frames = token ? atoll(token) : 0;
+        if (frames <= 0)
+        {
+            const char *response = "ERROR: STOP_AFTER requires a sample count > 0\n";
+            send_reply(client_fd, response, strlen(response));
+        }
+        else
+        {
+            schedule_set_stop_after(&g_schedule, (uint64_t)frames);
+            char response[128];
+            snprintf(response, sizeof(response), "OK: Capture stops after %lld samples per channel\n", frames);
+            send_reply(client_fd, response, strlen(response));
+            printf("Command received: STOP_AFTER %lld\n", frames);
+        }
+    }
+    else if (strcmp(token, "TRIGGER") == 0)
+    {
+        token = strtok(NULL, " \t");
+        double seconds = token ? atof(token) : DUALRATE_DEFAULT_TRIGGER_SEC;
+        if (g_mode != MODE_COMBINED || !g_dualrate.enabled)
+        {
+            const char *response = "ERROR: TRIGGER needs dualrate in combined mode\n";
+            send_reply(client_fd, response, strlen(response));
+        }
+        else if (seconds <= 0.0 || seconds > 3600.0)
+        {
+            const char *response = "ERROR: Invalid trigger length (must be > 0 and <= 3600 s)\n";
+            send_reply(client_fd, response, strlen(response));
+        }
+        else
+        {
+            dualrate_trigger(&g_dualrate, seconds);
+            char response[128];
+            snprintf(response, sizeof(response), "OK: Event window of %.2f s requested\n", seconds);
+            send_reply(client_fd, response, strlen(response));
+            printf("Command received: TRIGGER %.2f\n", seconds);
+        }
+    }
+    else if (strcmp(token, "FETCH") == 0)
+    {
+        const char *args = strtok(NULL, "");
+        char response[256];
+        if (g_mode != MODE_COMBINED)
+        {
+            snprintf(response, sizeof(response), "ERROR: FETCH needs combined mode\n");
         }
+        else if (fetch_start(client_fd, args, response, sizeof(response)) == 0)
+        {
+            printf("Command received: FETCH %s\n", args);
+            return true;
+        }
+        send_reply(client_fd, response, strlen(response));
+    }
+    else if (strcmp(token, "UPGRADE") == 0)
+    {
+        token = strtok(NULL, " \t");
+        const char *path = token ? token : upgrade_self_path();
+        char response[UPGRADE_PATH_MAX + 64];
+        if (is_upgrading())
+        {
+            snprintf(response, sizeof(response), "ERROR: Upgrade already in progress\n");
+        }
+        else if (path[0] == '\0' || strlen(path) >= sizeof(g_upgrade_path) || access(path, X_OK) != 0)
+        {
+            snprintf(response, sizeof(response), "ERROR: Cannot execute %s\n", path);
+        }
+        else
+        {
+            strcpy(g_upgrade_path, path);
+            g_upgrade.requested_at = now_mono();
+            __atomic_store_n(&g_upgrade_requested, true, __ATOMIC_RELEASE);
+            snprintf(response, sizeof(response), "OK: Upgrading to %s\n", path);
+            printf("Command received: UPGRADE %s\n", path);
+            // Both engines shut down on SIGTERM
+            kill(getpid(), SIGTERM);
+        }
+        send_reply(client_fd, response, strlen(response));
+    }
+    else if (strcmp(token, "SUBSCRIBE") == 0)
+    {
+        bool added = false;
+        pthread_mutex_lock(&g_subscriber_mutex);
+        if (g_subscriber_count < MAX_SUBSCRIBERS)
+        {
+            g_subscribers[g_subscriber_count++] = client_fd;
+            added = true;
+        }
+        pthread_mutex_unlock(&g_subscriber_mutex);
+        
+        const char *response = added ? "OK: Subscribed to events\n"
+                                     : "ERROR: Too many subscribers\n";
+        send_reply(client_fd, response, strlen(response));
+        printf("Command received: SUBSCRIBE\n");
+        return added;
     }
     else
     {
         char response[128];
         snprintf(response, sizeof(response), "ERROR: Unknown command: %s\n", token);
-        send(client_fd, response, strlen(response), 0);
+        send_reply(client_fd, response, strlen(response));
+    }
+    return false;
+}
+
+// Take a new control connection into a free slot, or turn it away
+static control_conn_t* control_add(control_conn_t *conns, int fd)
+{
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+    {
+        if (conns[i].fd < 0)
+        {
+            conns[i].fd = fd;
+            conns[i].session = false;
+            conns[i].len = 0;
+            return &conns[i];
+        }
+    }
+    
+    const char *response = "ERROR: Too many control connections\n";
+    send_reply(fd, response, strlen(response));
+    close(fd);
+    return NULL;
+}
+
+// Connection slot holding fd
+static control_conn_t* control_find(control_conn_t *conns, int fd)
+{
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+    {
+        if (conns[i].fd == fd)
+            return &conns[i];
+    }
+    return NULL;
+}
+
+// Read from a control connection and run the commands that are complete.
+// A plain connection carries one command, with or without a newline, and
+// is closed after the reply. "SESSION" keeps it open: from then on every
+// line is a command, answered by one line in order, so a client can
+// pipeline commands without waiting for each reply.
+static control_result_t control_serve(control_conn_t *conn)
+{
+    ssize_t n = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - 1 - conn->len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return CONTROL_KEEP;
+    if (n <= 0)
+        return CONTROL_CLOSE;
+    conn->len += (size_t)n;
+    
+    size_t used = 0;
+    while (used < conn->len)
+    {
+        char *line = conn->buf + used;
+        char *newline = memchr(line, '\n', conn->len - used);
+        if (newline == NULL && conn->session)
+            break;  // the rest of the line is still on its way
+        
+        size_t line_len = newline ? (size_t)(newline - line) : conn->len - used;
+        used += line_len + (newline ? 1 : 0);
+        line[line_len] = '\0';
+        if (line_len > 0 && line[line_len - 1] == '\r')
+            line[--line_len] = '\0';
+        
+        if (strcmp(line, "SESSION") == 0)
+        {
+            const char *response = "OK: Session open\n";
+            send_reply(conn->fd, response, strlen(response));
+            conn->session = true;
+            continue;
+        }
+        if (line_len == 0 && conn->session)
+            continue;
+        if (handle_command(line, conn->fd))
+            return CONTROL_HANDED_OFF;
+        if (!conn->session)
+            return CONTROL_CLOSE;
+    }
+    
+    memmove(conn->buf, conn->buf + used, conn->len - used);
+    conn->len -= used;
+    if (conn->len == sizeof(conn->buf) - 1)
+    {
+        const char *response = "ERROR: Command too long\n";
+        send_reply(conn->fd, response, strlen(response));
+        return CONTROL_CLOSE;
     }
+    return CONTROL_KEEP;
 }
 
-// Control thread: Listen for socket commands
+// Control thread: Listen for socket commands. One poll() covers the
+// listening socket and every open session.
 static void* control_thread(void *arg)
 {
-    struct sockaddr_un client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    char cmd_buffer[MAX_COMMAND_LEN];
-    ssize_t n;
+    control_conn_t conns[MAX_CONTROL_CONNS];
+    struct pollfd fds[MAX_CONTROL_CONNS + 2];
     
-    printf("Control thread started. Listening on %s\n", SOCKET_PATH);
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+        conns[i].fd = -1;
+    
+    printf("Control thread started. Listening on %s\n", g_socket_path);
     fflush(stdout);
     
-    while (g_running)
+    while (is_running())
     {
-        // Accept connection (blocking)
-        int client_fd = accept(g_socket_fd, (struct sockaddr *)&client_addr, &client_len);
-        if (client_fd < 0)
+        fds[0].fd = g_socket_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < MAX_CONTROL_CONNS; i++)
         {
-            if (g_running && errno != EINTR)
-            {
-                perror("accept");
-            }
+            fds[i + 1].fd = conns[i].fd;  // poll() skips negative fds
+            fds[i + 1].events = POLLIN;
+        }
+        fds[MAX_CONTROL_CONNS + 1].fd = g_control_wake_fd;
+        fds[MAX_CONTROL_CONNS + 1].events = POLLIN;
+        
+        if (poll(fds, MAX_CONTROL_CONNS + 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
             break;
         }
+        if (!is_running())
+            break;
         
-        // Read command
-        n = recv(client_fd, cmd_buffer, sizeof(cmd_buffer) - 1, 0);
-        if (n > 0)
+        if (fds[0].revents)
         {
-            cmd_buffer[n] = '\0';
-            handle_command(cmd_buffer, client_fd);
+            // Accept connection
+            int client_fd = accept4(g_socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_fd < 0)
+            {
+                if (is_running() && errno != EINTR)
+                {
+                    perror("accept");
+                }
+                break;
+            }
+            control_add(conns, client_fd);
         }
         
-        close(client_fd);
+        for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+        {
+            if (conns[i].fd < 0 || fds[i + 1].fd != conns[i].fd || fds[i + 1].revents == 0)
+                continue;
+            
+            control_result_t result = control_serve(&conns[i]);
+            if (result == CONTROL_CLOSE)
+                close(conns[i].fd);
+            if (result != CONTROL_KEEP)
+                conns[i].fd = -1;
+        }
+    }
+    
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+    {
+        if (conns[i].fd >= 0)
+            close(conns[i].fd);
     }
     
     printf("Control thread stopped.\n");
@@ -413,417 +1282,1608 @@ static uint64_t generate_boot_id(void)
     return id;
 }
 
-// Ensure output directory exists
+// Ensure output directory exists, creating missing parents like mkdir -p
 static int ensure_output_dir(const char *path)
 {
-    struct stat st = {0};
-    if (stat(path, &st) == -1)
+    char partial[512];
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(partial))
     {
-        if (mkdir(path, 0755) != 0)
-        {
-            // Try to create parent directories
-            char cmd[512];
-            snprintf(cmd, sizeof(cmd), "mkdir -p %s", path);
-            if (system(cmd) != 0)
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(partial, path, len + 1);
+    
+    // Each prefix ending at a '/', then the whole path
+    for (size_t i = 1; i <= len; i++)
+    {
+        if (partial[i] != '/' && partial[i] != '\0')
+            continue;
+        char saved = partial[i];
+        partial[i] = '\0';
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST)
+            return -1;
+        partial[i] = saved;
+    }
+    
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    if (!S_ISDIR(st.st_mode))
+    {
+        errno = ENOTDIR;
+        return -1;
+    }
+    return 0;
+}
+
+// Make sure the spare payload buffer holds capacity samples
+static bool reserve_planar_buffer(uint32_t capacity)
+{
+    if (capacity <= g_planar_capacity)
+        return true;
+    size_t grow = (size_t)(capacity - g_planar_capacity) * sizeof(double);
+    if (budget_reserve(BUDGET_CHUNKS, grow, "planar layout buffer") != 0)
+        return false;
+    double *buffer = (double*)realloc(g_planar_buffer, (size_t)capacity * sizeof(double));
+    if (buffer == NULL)
+    {
+        budget_release(BUDGET_CHUNKS, grow);
+        return false;
+    }
+    g_planar_buffer = buffer;
+    g_planar_capacity = capacity;
+    return true;
+}
+
+// Last pass over a chunk before it is queued, once every stage that reads
+// frames is done with it: one kernel for its channel count and layout
+// takes the stats for flat elision and the payload CRC and, with
+// payload_layout = planar, rewrites the payload one channel after
+// another. A chunk that cannot be rewritten stays interleaved, which its
+// flags record.
+static void finish_chunk(sdat_chunk_t *chunk, bool check_flat)
+{
+    uint32_t nch = chunk->num_channels;
+    if (chunk->sample_count == 0 || nch == 0 || nch > SDAT_MAX_CHANNELS)
+        return;
+    
+    const kernel_t *kernel = &g_kernels[nch];
+    if (kernel->planar && !reserve_planar_buffer(chunk->capacity))
+        kernel = &kernel_table(false)[nch];
+    kernel_stats_t stats;
+    kernel->finish(chunk->samples, g_planar_buffer, chunk->sample_count / nch, &stats);
+    
+    if (check_flat && flat_process(&g_flat, chunk, &stats))
+        return;
+    chunk->payload_crc = stats.crc;
+    if (!kernel->planar)
+        return;
+    
+    if (chunk->capacity == g_planar_capacity)
+    {
+        // Swap buffers: the interleaved one is the spare for the next chunk
+        double *samples = chunk->samples;
+        chunk->samples = g_planar_buffer;
+        g_planar_buffer = samples;
+    }
+    else
+    {
+        memcpy(chunk->samples, g_planar_buffer, (size_t)chunk->sample_count * sizeof(double));
+    }
+    chunk->flags |= SDAT_FLAG_PLANAR;
+}
+
+// Fill in chunk metadata and queue it on every sink
+static int dispatch_chunk(sdat_chunk_t *chunk, uint32_t sample_count, double actual_rate)
+{
+    time_t now = time(NULL);
+    
+    chunk->device_id = g_device_id;
+    chunk->boot_id = g_boot_id;
+    chunk->seq_start = g_seq_counter;
+    chunk->sample_rate = actual_rate;
+    chunk->sample_count = sample_count;
+    chunk->time_start = (uint64_t)now;
+    chunk->time_end = (uint64_t)now;
+    chunk->num_channels = (uint8_t)g_num_scan_channels;
+    memcpy(chunk->channels, g_scan_channels, g_num_scan_channels);
+    g_seq_counter += sample_count / g_num_scan_channels;  // seq counts scan frames
+    chunk->commit_token = g_mode == MODE_WRITER ? commit_add(g_seq_counter, g_shm_cursor) : 0;
+    chunk->anchor_count = anchor_collect(&g_anchors, chunk->seq_start, g_seq_counter,
+                                         chunk->anchors, SDAT_MAX_ANCHORS);
+    
+    // Carry the latest peak of events still open at the end of the chunk
+    tag_open_events(chunk);
+    
+    // Dual-rate and virtual streams: only the derived streams reach the
+    // sinks, and they hold the chunk's samples in the ring until written
+    if (g_dualrate.enabled || vstream_enabled(&g_vstreams))
+    {
+        vstream_process(&g_vstreams, chunk);
+        dualrate_process(&g_dualrate, chunk);
+        if (g_mode == MODE_WRITER)
+        {
+            commit_derived();
+            commit_release(chunk->commit_token);
+        }
+        sdat_chunk_free(chunk);
+        return 0;
+    }
+    
+    spectrum_process(&g_spectrum, chunk);
+    finish_chunk(chunk, true);
+    
+    return sink_dispatch(chunk);
+}
+
+// Format detector kinds as "sta_lta|threshold|slope"
+static void format_kinds(uint8_t kinds, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s%s%s%s%s",
+             (kinds & SDAT_EVENT_STA_LTA) ? "sta_lta" : "",
+             (kinds & SDAT_EVENT_STA_LTA) && (kinds & ~SDAT_EVENT_STA_LTA) ? "|" : "",
+             (kinds & SDAT_EVENT_THRESHOLD) ? "threshold" : "",
+             (kinds & SDAT_EVENT_THRESHOLD) && (kinds & SDAT_EVENT_SLOPE) ? "|" : "",
+             (kinds & SDAT_EVENT_SLOPE) ? "slope" : "");
+}
+
+// Detector callback: tag the chunk being assembled and notify subscribers
+static void on_detector_event(const detector_transition_t *tr, void *user)
+{
+    sdat_chunk_t *chunk = (sdat_chunk_t*)user;
+    const sdat_event_t *ev = &tr->event;
+    char kinds[32];
+    char msg[192];
+    uint32_t i;
+    
+    // Update the chunk's entry for this event, or add one
+    for (i = 0; i < chunk->event_count; i++)
+    {
+        if (chunk->events[i].onset == ev->onset && chunk->events[i].channel == ev->channel)
+            break;
+    }
+    if (i < chunk->event_count || chunk->event_count < SDAT_MAX_EVENTS)
+    {
+        chunk->events[i] = *ev;
+        if (i == chunk->event_count)
+            chunk->event_count++;
+    }
+    chunk->flags |= SDAT_FLAG_EVENT;
+    
+    format_kinds(ev->kinds, kinds, sizeof(kinds));
+    if (tr->start)
+    {
+        snprintf(msg, sizeof(msg), "EVENT ON onset=%llu ch=%u kinds=%s value=%.6f\n",
+                 (unsigned long long)ev->onset, ev->channel, kinds, ev->peak);
+    }
+    else
+    {
+        snprintf(msg, sizeof(msg), "EVENT OFF onset=%llu ch=%u duration=%u kinds=%s peak=%.6f\n",
+                 (unsigned long long)ev->onset, ev->channel, ev->duration, kinds, ev->peak);
+    }
+    printf("%s", msg);
+    broadcast_event(msg);
+}
+
+// Refresh the chunk's entries for events that are still open
+static void tag_open_events(sdat_chunk_t *chunk)
+{
+    sdat_event_t open_events[DETECTOR_MAX_CHANNELS];
+    uint32_t n = detector_open_events(&g_detector, open_events, DETECTOR_MAX_CHANNELS);
+    
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint32_t i;
+        for (i = 0; i < chunk->event_count; i++)
+        {
+            if (chunk->events[i].onset == open_events[k].onset &&
+                chunk->events[i].channel == open_events[k].channel)
+                break;
+        }
+        if (i == chunk->event_count && chunk->event_count >= SDAT_MAX_EVENTS)
+            continue;
+        chunk->events[i] = open_events[k];
+        if (i == chunk->event_count)
+            chunk->event_count++;
+        chunk->flags |= SDAT_FLAG_EVENT;
+    }
+}
+
+// Called by the sinks once every sink is done with a chunk
+static void on_chunk_done(const sdat_chunk_t *chunk, bool written)
+{
+    if (g_mode != MODE_WRITER)
+        return;
+
+    // Writer mode: once the chunk is on disk, the samples it holds in the
+    // ring may be released as soon as the chunks before them are. If it
+    // is not, its hold stays and the ring is not committed past it, so a
+    // restarted writer writes it again.
+    if (written)
+        commit_release(chunk->commit_token);
+    else
+        fprintf(stderr, "Error: Stream %u chunk seq %llu not written%s\n", chunk->stream,
+                (unsigned long long)chunk->seq_start,
+                commit_fail(chunk->commit_token) ? ", shared ring held from here" : "");
+}
+
+// Channel mask of the hardware scan
+static uint8_t scan_channel_mask(void)
+{
+    uint8_t mask = 0;
+    for (uint32_t i = 0; i < g_num_scan_channels; i++)
+        mask |= (uint8_t)(1u << g_scan_channels[i]);
+    return mask;
+}
+
+// Dual-rate and virtual stream callback: queue a derived chunk
+static void on_derived_chunk(sdat_chunk_t *chunk, void *user)
+{
+    (void)user;
+    if (chunk->num_channels == 0)
+    {
+        chunk->num_channels = (uint8_t)g_num_scan_channels;
+        memcpy(chunk->channels, g_scan_channels, g_num_scan_channels);
+    }
+    uint64_t first = chunk->seq_start * chunk->decimation;
+    uint64_t end = first + (uint64_t)(chunk->sample_count / chunk->num_channels) * chunk->decimation;
+    chunk->anchor_count = anchor_collect(&g_anchors, first, end, chunk->anchors, SDAT_MAX_ANCHORS);
+    chunk->commit_token = g_mode == MODE_WRITER ? commit_hold(first) : 0;
+    finish_chunk(chunk, chunk->num_channels == g_num_scan_channels);
+    
+    uint64_t seq_start = chunk->seq_start;
+    uint32_t sample_count = chunk->sample_count;
+    char stream[SDAT_MAX_STREAM_NAME];
+    strcpy(stream, chunk->stream_name);
+    if (sink_dispatch(chunk) == 0)
+    {
+        printf("Chunk queued: stream=%s, seq=%llu, samples=%u\n",
+               stream, (unsigned long long)seq_start, sample_count);
+    }
+    else
+    {
+        fprintf(stderr, "Error: Chunk stream=%s seq=%llu was not accepted by any sink\n",
+                stream, (unsigned long long)seq_start);
+    }
+}
+
+// Capture was switched on: time-to-first-sample counts from here
+static void note_start_requested(void)
+{
+    __atomic_store_n(&g_start_requested_us, (uint64_t)(now_mono() * 1e6), __ATOMIC_RELAXED);
+}
+
+// The first samples of a scan arrived
+static void note_first_sample(void)
+{
+    double now = now_mono();
+    uint64_t requested_us = __atomic_load_n(&g_start_requested_us, __ATOMIC_RELAXED);
+    g_first_sample_start_ms = requested_us ? now * 1000.0 - requested_us / 1000.0 : -1.0;
+    if (g_first_sample_process_ms < 0.0)
+    {
+        g_first_sample_process_ms = (now - g_process_start) * 1000.0;
+        printf("Producer: First sample %.1f ms after START, %.1f ms after process start\n",
+               g_first_sample_start_ms, g_first_sample_process_ms);
+    }
+    else
+    {
+        printf("Producer: First sample %.1f ms after START\n", g_first_sample_start_ms);
+    }
+}
+
+// Set up the device side of the capture
+static int producer_init(producer_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->num_channels = (uint8_t)g_num_scan_channels;
+    p->channel_mask = scan_channel_mask();
+    p->frames_left = SCHEDULE_UNLIMITED;
+    p->read_frames = 1000;  // Read 1000 frames at a time
+    p->read_buf = (double*)malloc(p->read_frames * p->num_channels * sizeof(double));
+    if (!p->read_buf)
+    {
+        fprintf(stderr, "Error: Failed to allocate read buffer\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the scan if one is running and keep the device in warm standby,
+// validated for the current rate
+static void producer_stop_scan(producer_t *p)
+{
+    if (p->scan_active)
+    {
+        device_scan_stop(&g_device);
+        p->scan_active = false;
+        printf("Producer: Scan stopped\n");
+    }
+    device_actual_rate(&g_device, snapshot_get(&p->settings, SNAPSHOT_READER_PRODUCER)->scan_rate);
+}
+
+// Stop the scan and release the read buffer. The scan position is kept
+// for an upgrade to resume from.
+static void producer_free(producer_t *p)
+{
+    if (p->scan_active)
+    {
+        device_scan_stop(&g_device);
+        p->scan_active = false;
+        g_upgrade.scan_active = true;
+        g_upgrade.frames_left = p->frames_left;
+        g_upgrade.stopped_at = now_mono();
+    }
+    free(p->read_buf);
+    p->read_buf = NULL;
+}
+
+// An upgrade resumed the scan: report what the handover cost
+static void producer_scan_resumed(producer_t *p)
+{
+    double now = now_mono();
+    g_takeover_gap_ms = (now - g_upgrade.stopped_at) * 1000.0;
+    
+    // The synthetic source picks up at the next frame; a board scan restarts
+    if (g_device.source == DEVICE_MCC118)
+        g_takeover_lost = (uint64_t)((now - g_upgrade.stopped_at) * p->actual_scan_rate);
+    if (p->frames_left != SCHEDULE_UNLIMITED && p->frames_left > g_takeover_lost)
+        p->frames_left -= g_takeover_lost;
+    printf("Producer: Scan resumed %.1f ms after it stopped, %llu samples per channel lost\n",
+           g_takeover_gap_ms, (unsigned long long)g_takeover_lost);
+}
+
+// A scheduled window started: switch the capture on
+static void producer_window_started(producer_t *p)
+{
+    note_start_requested();
+    bool already = snapshot_set_capture(true);
+    if (!already)
+    {
+        p->from_timer = true;
+        publish_state();
+        printf("Producer: Scheduled window started\n");
+    }
+}
+
+// Time the last frame of a read, before its samples reach the ring, once
+// the interval is up or when the read starts a scan or reports an overrun
+static void producer_anchor(producer_t *p, uint32_t frames, uint16_t status, int64_t time_ns)
+{
+    uint16_t flags = p->anchor_flags;
+    if (status & (STATUS_HW_OVERRUN | STATUS_BUFFER_OVERRUN))
+        flags |= SDAT_ANCHOR_OVERRUN;
+    p->anchor_frames += frames;
+    if (flags == 0 && p->anchor_frames < p->anchor_interval)
+        return;
+    
+    // Ring position one past the read's samples
+    uint64_t position = g_mode == MODE_ACQUIRE ? __atomic_load_n(&g_shm_ring.hdr->head, __ATOMIC_RELAXED)
+                                               : g_ring_buffer.write_total / sizeof(double);
+    sdat_anchor_t anchor = {
+        .index = position + (uint64_t)frames * p->num_channels,
+        .time_ns = time_ns,
+        .status = status,
+        .flags = flags,
+    };
+    anchor_ring_push(anchor_ring(), &anchor);
+    p->anchor_frames = 0;
+    p->anchor_flags = 0;
+}
+
+// Start the scan if needed and move one read of samples to the ring.
+// Returns the frames read, or -1 on a device error.
+static int producer_read(producer_t *p)
+{
+    int result = RESULT_SUCCESS;
+    uint16_t read_status = 0;
+    uint32_t samples_read = 0;
+    
+    if (!p->scan_active)
+    {
+        // Get current rate
+        double current_rate = snapshot_get(&p->settings, SNAPSHOT_READER_PRODUCER)->scan_rate;
+        
+        // Actual scan rate, validated in standby
+        p->actual_scan_rate = device_actual_rate(&g_device, current_rate);
+        
+        if (g_upgrade.scan_active)
+        {
+            // Continue the scan the old binary was running
+            g_upgrade.scan_active = false;
+            p->frames_left = g_upgrade.frames_left;
+            result = device_scan_resume(&g_device, g_upgrade.scan_t0, g_upgrade.scan_frames, current_rate);
+            if (result == RESULT_SUCCESS)
+                producer_scan_resumed(p);
+        }
+        else
+        {
+            // Windows of known length run as finite scans
+            p->frames_left = schedule_take_limit(&g_schedule, p->actual_scan_rate, p->from_timer);
+            p->from_timer = false;
+            bool finite = p->frames_left != SCHEDULE_UNLIMITED && p->frames_left <= UINT32_MAX;
+            
+            // Start continuous scan
+            result = device_scan_start(&g_device, p->channel_mask,
+                                       finite ? (uint32_t)p->frames_left : 0,
+                                       current_rate, finite ? OPTS_DEFAULT : OPTS_CONTINUOUS);
+        }
+        if (result == RESULT_SUCCESS)
+        {
+            p->scan_active = true;
+            p->awaiting_first = true;
+            p->anchor_interval = g_anchor_interval > 0 ? g_anchor_interval :
+                                 (uint32_t)(p->actual_scan_rate * CHUNK_DURATION_SEC / ANCHORS_PER_CHUNK);
+            p->anchor_frames = 0;
+            p->anchor_flags = SDAT_ANCHOR_START;
+            printf("Producer: Scan started at %.2f Hz (requested: %.2f Hz)\n", 
+                   p->actual_scan_rate, current_rate);
+            if (p->frames_left != SCHEDULE_UNLIMITED)
+                printf("Producer: Capture ends after %llu samples per channel\n",
+                       (unsigned long long)p->frames_left);
+        }
+        else
+        {
+            fprintf(stderr, "Error starting scan: %d\n", result);
+            print_error(result);
+            snapshot_set_capture(false);
+            publish_state();
+            return 0;
+        }
+    }
+    
+    // STOP_AFTER on a running capture counts from here
+    uint64_t stop_after = schedule_take_stop_after(&g_schedule);
+    if (stop_after != SCHEDULE_UNLIMITED)
+    {
+        p->frames_left = stop_after;
+        printf("Producer: Capture ends after %llu more samples per channel\n",
+               (unsigned long long)p->frames_left);
+    }
+    
+    // Read from device
+    result = device_scan_read(&g_device, &read_status, p->read_buf, p->read_frames, &samples_read);
+    struct timespec read_time;
+    clock_gettime(CLOCK_REALTIME, &read_time);
+    
+    if (result != RESULT_SUCCESS)
+    {
+        if (result != RESULT_TIMEOUT)
+        {
+            fprintf(stderr, "Error reading from device: %d\n", result);
+            return -1;
+        }
+        return 0;
+    }
+    
+    if (read_status & (STATUS_HW_OVERRUN | STATUS_BUFFER_OVERRUN))
+    {
+        fprintf(stderr, "Warning: Overrun detected\n");
+    }
+    
+    // Never pass the end of the window
+    if (samples_read > p->frames_left)
+        samples_read = (uint32_t)p->frames_left;
+    if (p->frames_left != SCHEDULE_UNLIMITED)
+        p->frames_left -= samples_read;
+    uint32_t frames_read = samples_read;
+    if (frames_read > 0 && p->awaiting_first)
+    {
+        p->awaiting_first = false;
+        note_first_sample();
+    }
+    
+    if (frames_read > 0)
+        producer_anchor(p, frames_read, read_status,
+                        (int64_t)read_time.tv_sec * 1000000000 + read_time.tv_nsec);
+    
+    // samples_read counts frames; the ring holds interleaved samples
+    samples_read *= p->num_channels;
+    
+    // Write to ring buffer
+    if (samples_read > 0 && g_mode == MODE_ACQUIRE)
+    {
+        uint64_t dropped = shm_ring_write(&g_shm_ring, p->read_buf, samples_read);
+        if (dropped > 0)
+        {
+            fprintf(stderr, "Warning: Shared ring overflow, dropped %llu samples\n",
+                    (unsigned long long)dropped);
+        }
+    }
+    else if (samples_read > 0)
+    {
+        size_t bytes_written = ring_buffer_write(&g_ring_buffer, p->read_buf, 
+                                                 samples_read * sizeof(double));
+        if (bytes_written < samples_read * sizeof(double))
+        {
+            fprintf(stderr, "Warning: Ring buffer overflow, dropped %zu bytes\n",
+                    samples_read * sizeof(double) - bytes_written);
+        }
+    }
+    
+    // End of the window: capture goes off only after its last samples
+    if (p->frames_left == 0)
+    {
+        device_scan_stop(&g_device);
+        p->scan_active = false;
+        snapshot_set_capture(false);
+        publish_state();
+        printf("Producer: Capture window complete, scan stopped\n");
+    }
+    return (int)frames_read;
+}
+
+// Producer thread: Read from MCC 118 and write to ring buffer
+static void* producer_thread(void *arg)
+{
+    producer_t producer;
+    if (producer_init(&producer) != 0)
+        return NULL;
+    
+    printf("Producer thread started (waiting for START command)...\n");
+    
+    while (is_running())
+    {
+        // Raised before the settings are read, so a consumer that sees
+        // capture off and this flag down has all samples of the capture
+        __atomic_store_n(&g_producer_reading, true, __ATOMIC_SEQ_CST);
+        bool should_capture = snapshot_get(&producer.settings, SNAPSHOT_READER_PRODUCER)->capture_enabled;
+        
+        // Check if capture is enabled
+        if (should_capture)
+        {
+            int frames = producer_read(&producer);
+            __atomic_store_n(&g_producer_reading, false, __ATOMIC_SEQ_CST);
+            if (frames < 0)
+                break;
+            
+            // Small sleep to prevent CPU spinning
+            usleep(1000);  // 1 ms
+        }
+        else
+        {
+            __atomic_store_n(&g_producer_reading, false, __ATOMIC_SEQ_CST);
+            
+            // Wake a consumer waiting to close the capture's last chunk
+            if (g_mode == MODE_COMBINED)
             {
-                return -1;
+                pthread_mutex_lock(&g_ring_buffer.mutex);
+                pthread_cond_signal(&g_ring_buffer.not_empty);
+                pthread_mutex_unlock(&g_ring_buffer.mutex);
             }
+            
+            // Capture disabled - stop scan if running
+            producer_stop_scan(&producer);
+            
+            // Sleep until a scheduled window starts or a command arrives
+            if (schedule_wait(&g_schedule, -1) == SCHEDULE_FIRE)
+                producer_window_started(&producer);
         }
     }
+    
+    // Stop scan if still active
+    producer_free(&producer);
+    
+    // Mark producer as done
+    pthread_mutex_lock(&g_ring_buffer.mutex);
+    g_ring_buffer.producer_done = true;
+    pthread_cond_signal(&g_ring_buffer.not_empty);
+    pthread_mutex_unlock(&g_ring_buffer.mutex);
+    
+    printf("Producer thread stopped.\n");
+    return NULL;
+}
+
+// Hand the collected samples to the sinks and start a new chunk
+static int consumer_emit(consumer_t *c, bool end_of_capture)
+{
+    uint64_t seq_start = g_seq_counter;
+    uint32_t sample_count = c->samples_collected;
+    
+    // Tell readers why a chunk is short and whether the next one follows on
+    if (sample_count < c->samples_per_chunk)
+        c->chunk->flags |= SDAT_FLAG_PARTIAL;
+    if (end_of_capture)
+        c->chunk->flags |= SDAT_FLAG_CAPTURE_END;
+    int dispatch_result = dispatch_chunk(c->chunk, sample_count, c->current_rate);
+    if (dispatch_result != 0)
+    {
+        fprintf(stderr, "Error: Chunk seq=%llu was not accepted by any sink\n",
+                (unsigned long long)seq_start);
+    }
+    else if (!g_dualrate.enabled && !vstream_enabled(&g_vstreams))  // see on_derived_chunk()
+    {
+        printf("Chunk queued: seq=%llu, samples=%u, rate=%.2f Hz%s\n",
+               (unsigned long long)seq_start, sample_count, c->current_rate,
+               end_of_capture ? " (end of capture)" :
+               sample_count < c->samples_per_chunk ? " (max age)" : "");
+    }
+    
+    // The sinks own the dispatched chunk now
+    c->chunk = sdat_chunk_create(c->samples_per_chunk);
+    if (!c->chunk)
+    {
+        fprintf(stderr, "Error: Failed to allocate chunk buffer\n");
+        return -1;
+    }
+    c->samples_collected = 0;
     return 0;
 }
 
-// Write chunk file with binary format
-static int write_chunk_file(uint64_t seq_start, double *samples, uint32_t sample_count, double actual_rate)
+// Account for the chunk buffer and the chunks the sinks may hold at its size
+static int consumer_reserve(consumer_t *c)
 {
-    char filename_part[512];
-    char filename_final[512];
-    time_t now = time(NULL);
+    budget_release(BUDGET_CHUNKS, c->chunk_reserved);
+    budget_release(BUDGET_QUEUES, c->queue_reserved);
+    c->chunk_reserved = 0;
+    c->queue_reserved = 0;
+    
+    size_t chunk_bytes = sdat_chunk_footprint(c->samples_per_chunk);
+    size_t queue_bytes = chunk_bytes * sink_max_queued();
+    if (budget_reserve(BUDGET_CHUNKS, chunk_bytes, "chunk buffer") != 0)
+        return -1;
+    c->chunk_reserved = chunk_bytes;
+    if (budget_reserve(BUDGET_QUEUES, queue_bytes, "sink queues") != 0)
+        return -1;
+    c->queue_reserved = queue_bytes;
+    return 0;
+}
+
+// Move one block of samples from the ring into the chunk being assembled,
+// handing it over when full. Returns -1 if no chunk could be allocated.
+static int consumer_step(consumer_t *c)
+{
+    // Get current rate and calculate samples per chunk
+    double requested_rate;
+    bool should_capture;
+    get_capture_state(&c->settings, &should_capture, &requested_rate);
+    
+    // Recalculate samples per chunk if rate changed
+    if (requested_rate != c->current_rate || c->chunk == NULL)
+    {
+        c->current_rate = requested_rate;
+        c->samples_per_chunk = (uint32_t)(c->current_rate * CHUNK_DURATION_SEC) * g_num_scan_channels;
+        
+        // Filters are designed for the sample rate, so rebuild the chain
+        dsp_configure(&g_dsp, g_scan_channels, g_num_scan_channels, c->current_rate);
+        detector_configure(&g_detector, g_scan_channels, g_num_scan_channels, c->current_rate);
+        spectrum_configure(&g_spectrum, g_scan_channels, g_num_scan_channels, c->current_rate);
+        flat_configure(&g_flat, g_scan_channels, g_num_scan_channels);
+        dualrate_configure(&g_dualrate, g_num_scan_channels, c->current_rate,
+                           c->samples_per_chunk / g_num_scan_channels, on_derived_chunk, NULL);
+        vstream_configure(&g_vstreams, g_scan_channels, g_num_scan_channels, c->current_rate,
+                          CHUNK_DURATION_SEC, on_derived_chunk, NULL);
+        if (g_mode == MODE_WRITER)
+            commit_derived();
+        
+        // Reallocate buffer if needed
+        sdat_chunk_free(c->chunk);
+        c->chunk = NULL;
+        if (consumer_reserve(c) != 0)
+            return -1;
+        c->chunk = sdat_chunk_create(c->samples_per_chunk);
+        if (!c->chunk)
+        {
+            fprintf(stderr, "Error: Failed to allocate chunk buffer\n");
+            return -1;
+        }
+        c->samples_collected = 0;
+    }
     
-    // Format: chunk_<sequence>_.bin.part
-    snprintf(filename_part, sizeof(filename_part), 
-             "%s/chunk_%llu_.bin.part", 
-             g_output_dir, (unsigned long long)seq_start);
-    snprintf(filename_final, sizeof(filename_final), 
-             "%s/chunk_%llu_.bin", 
-             g_output_dir, (unsigned long long)seq_start);
+    // Only collect data if capturing (or draining what a stop left behind)
+    if (!should_capture && c->samples_collected == 0 && consumer_backlog() == 0)
+        return 0;
     
-    FILE *f = fopen(filename_part, "wb");
-    if (!f)
+    // A filling ring turns write pacing off until the sinks catch up
+    pace_set_ring_fill(consumer_ring_fill());
+    
+    // Try to read enough samples for a chunk. An empty ring is not waited
+    // on, so the age and end-of-capture checks below still run.
+    sdat_chunk_t *chunk = c->chunk;
+    size_t samples_read = 0;
+    uint64_t position = 0;
+    if (consumer_backlog() > 0)
     {
-        fprintf(stderr, "Error: Failed to open file %s: %s (current dir: ", 
-                filename_part, strerror(errno));
-        char cwd[512];
-        if (getcwd(cwd, sizeof(cwd)) != NULL)
+        samples_read = consumer_read(chunk->samples + c->samples_collected,
+                                     c->samples_per_chunk - c->samples_collected, &position);
+    }
+    
+    if (samples_read > 0)
+    {
+        size_t frames_read = samples_read / g_num_scan_channels;
+        
+        // Timestamp anchors of the reads these samples came from
+        anchor_track_block(&g_anchors, anchor_ring(), position,
+                           g_seq_counter * g_num_scan_channels + c->samples_collected, samples_read);
+        
+        // Filter state carries over from the previous block and chunk
+        if (dsp_enabled(&g_dsp))
+            dsp_process(&g_dsp, chunk->samples + c->samples_collected, frames_read);
+        
+        // Events still open from the previous chunk overlap this one
+        if (c->samples_collected == 0)
+        {
+            tag_open_events(chunk);
+            c->chunk_opened = now_mono() - frames_read / c->current_rate;
+        }
+        if (detector_enabled(&g_detector))
+        {
+            detector_process(&g_detector, chunk->samples + c->samples_collected, frames_read,
+                             g_seq_counter + c->samples_collected / g_num_scan_channels,
+                             on_detector_event, chunk);
+        }
+        c->samples_collected += samples_read;
+    }
+    
+    // If we have enough samples for a chunk, hand it to the sinks
+    if (c->samples_collected >= c->samples_per_chunk)
+        return consumer_emit(c, false);
+    
+    // Capture ended: the partial chunk closes its window once the last
+    // device read is in the ring
+    if (!should_capture && c->samples_collected > 0 && consumer_backlog() == 0 &&
+        !__atomic_load_n(&g_producer_reading, __ATOMIC_SEQ_CST))
+        return consumer_emit(c, true);
+    
+    // Slow rates: commit what has arrived once the oldest sample is too old
+    if (g_max_chunk_age > 0.0 && c->samples_collected > 0 &&
+        now_mono() - c->chunk_opened >= g_max_chunk_age)
+        return consumer_emit(c, false);
+    return 0;
+}
+
+// Write what is left and release the chunk and the derived streams
+static void consumer_finish(consumer_t *c)
+{
+    // Write remaining samples if any. In writer mode they stay uncommitted
+    // in the shared ring so the next writer picks them up without a gap.
+    if (c->chunk && c->samples_collected > 0 && g_mode != MODE_WRITER)
+    {
+        // After an upgrade the new binary continues the capture
+        c->chunk->flags |= SDAT_FLAG_PARTIAL | (is_upgrading() ? 0 : SDAT_FLAG_CAPTURE_END);
+        dispatch_chunk(c->chunk, c->samples_collected, c->current_rate);
+        c->chunk = NULL;
+    }
+    
+    sdat_chunk_free(c->chunk);
+    c->chunk = NULL;
+    budget_release(BUDGET_CHUNKS, c->chunk_reserved);
+    budget_release(BUDGET_QUEUES, c->queue_reserved);
+    c->chunk_reserved = 0;
+    c->queue_reserved = 0;
+    spectrum_free(&g_spectrum);
+    dualrate_free(&g_dualrate);
+    vstream_release(&g_vstreams);
+    if (g_mode == MODE_WRITER)
+        commit_derived();   // the derived streams handed over what they held
+    free(g_planar_buffer);
+    budget_release(BUDGET_CHUNKS, (size_t)g_planar_capacity * sizeof(double));
+    g_planar_buffer = NULL;
+    g_planar_capacity = 0;
+}
+
+// Threaded consumer with nothing to read: sleep until samples arrive, the
+// open chunk reaches max_chunk_age or the capture has ended
+static void consumer_wait(consumer_t *c)
+{
+    // The shared ring is filled by another process and cannot be waited on
+    if (g_mode == MODE_WRITER)
+    {
+        usleep(10000);  // 10 ms
+        return;
+    }
+    
+    ring_buffer_t *rb = &g_ring_buffer;
+    bool capturing;
+    double rate;
+    pthread_mutex_lock(&rb->mutex);
+    
+    // Checked under the mutex the producer signals on, so the end of a
+    // capture that consumer_step() just missed is not slept through
+    get_capture_state(&c->settings, &capturing, &rate);
+    bool ended = !capturing && c->samples_collected > 0 &&
+                 !__atomic_load_n(&g_producer_reading, __ATOMIC_SEQ_CST);
+    bool done = rb->producer_done;
+    if (rb->available == 0 && !done && !ended)
+    {
+        if (g_max_chunk_age > 0.0 && c->samples_collected > 0)
         {
-            fprintf(stderr, "%s)\n", cwd);
+            double due = c->chunk_opened + g_max_chunk_age;
+            struct timespec until = { (time_t)due, (long)((due - (double)(time_t)due) * 1e9) };
+            pthread_cond_timedwait(&rb->not_empty, &rb->mutex, &until);
         }
         else
         {
-            fprintf(stderr, "unknown)\n");
+            pthread_cond_wait(&rb->not_empty, &rb->mutex);
+        }
+    }
+    pthread_mutex_unlock(&rb->mutex);
+    
+    // Shutting down: nothing more arrives, so only the loop condition matters
+    if (done)
+        usleep(10000);  // 10 ms
+}
+
+// Consumer thread: Read from ring buffer and write to files
+static void* consumer_thread(void *arg)
+{
+    printf("Consumer thread started.\n");
+    
+    consumer_t consumer = { .current_rate = DEFAULT_SCAN_RATE_HZ };
+    uint32_t reattach_check = 0;
+    
+    // Writer mode: wait for the acquisition process to create the ring
+    if (g_mode == MODE_WRITER)
+    {
+        while (is_running() && writer_attach() != 0)
+        {
+            usleep(WRITER_ATTACH_RETRY_US);
+        }
+        if (!is_running())
+        {
+            printf("Consumer thread stopped.\n");
+            return NULL;
         }
-        return -1;
     }
     
-    // Write header (little-endian)
-    fwrite(MAGIC, 4, 1, f);  // magic
-    uint16_t version = VERSION;
-    fwrite(&version, sizeof(version), 1, f);  // version
-    uint32_t device_id = 0;  // Can be set to actual device ID
-    fwrite(&device_id, sizeof(device_id), 1, f);  // device_id
-    fwrite(&g_boot_id, sizeof(g_boot_id), 1, f);  // boot_id
-    fwrite(&seq_start, sizeof(seq_start), 1, f);  // seq_start
-    uint32_t sample_rate = (uint32_t)actual_rate;
-    fwrite(&sample_rate, sizeof(sample_rate), 1, f);  // sample_rate_hz
-    uint16_t record_size = RECORD_SIZE;
-    fwrite(&record_size, sizeof(record_size), 1, f);  // record_size
-    fwrite(&sample_count, sizeof(sample_count), 1, f);  // sample_count
-    uint64_t sensor_time_start = (uint64_t)now;
-    fwrite(&sensor_time_start, sizeof(sensor_time_start), 1, f);  // sensor_time_start
-    uint64_t sensor_time_end = (uint64_t)now;
-    fwrite(&sensor_time_end, sizeof(sensor_time_end), 1, f);  // sensor_time_end
-    uint32_t payload_crc32 = 0;  // Optional, can be calculated if needed
-    fwrite(&payload_crc32, sizeof(payload_crc32), 1, f);  // payload_crc32
+    while (is_running() || (g_mode != MODE_WRITER && ring_buffer_available(&g_ring_buffer) > 0))
+    {
+        // Writer mode: follow the acquisition process if it was restarted
+        if (g_mode == MODE_WRITER && ++reattach_check >= 100)
+        {
+            reattach_check = 0;
+            if (shm_ring_replaced(&g_shm_ring))
+            {
+                printf("Writer: shared ring was recreated, re-attaching\n");
+                pthread_mutex_lock(&g_commit_mutex);
+                shm_ring_close(&g_shm_ring, false);
+                while (is_running() && writer_attach() != 0)
+                {
+                    usleep(WRITER_ATTACH_RETRY_US);
+                }
+                pthread_mutex_unlock(&g_commit_mutex);
+                if (!is_running())
+                    break;
+                consumer.samples_collected = 0;
+            }
+        }
+        
+        if (consumer_step(&consumer) != 0)
+            return NULL;
+        
+        if (consumer_backlog() == 0)
+            consumer_wait(&consumer);
+    }
     
-    // Write payload (samples)
-    fwrite(samples, RECORD_SIZE, sample_count, f);
+    consumer_finish(&consumer);
     
-    fclose(f);
+    printf("Consumer thread stopped.\n");
+    return NULL;
+}
+
+// Single-threaded engine: read the device and assemble chunks until the
+// ring is empty. Returns -1 on a device or allocation error.
+static int service_capture(producer_t *p, consumer_t *c)
+{
+    bool should_capture = snapshot_get(&p->settings, SNAPSHOT_READER_PRODUCER)->capture_enabled;
     
-    // Atomic rename: .part -> .bin
-    if (rename(filename_part, filename_final) != 0)
+    if (should_capture)
     {
-        fprintf(stderr, "Error: Failed to rename %s to %s: %s\n", 
-                filename_part, filename_final, strerror(errno));
-        unlink(filename_part);  // Clean up
-        return -1;
+        // Drain the device buffer without blocking
+        int frames;
+        do
+        {
+            frames = producer_read(p);
+            if (frames < 0)
+                return -1;
+        } while (frames == (int)p->read_frames && p->scan_active);
+    }
+    else
+    {
+        producer_stop_scan(p);
     }
     
+    do
+    {
+        if (consumer_step(c) != 0)
+            return -1;
+    } while (consumer_backlog() > 0);
     return 0;
 }
 
-// Producer thread: Read from MCC 118 and write to ring buffer
-static void* producer_thread(void *arg)
+// Arm the periodic device read timer, or disarm it with interval 0
+static void set_read_timer(int fd, double interval)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_sec = (time_t)interval;
+    its.it_interval.tv_nsec = (long)((interval - (double)(time_t)interval) * 1e9);
+    its.it_value = its.it_interval;
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+// Arm the age timer for when the open chunk reaches max_chunk_age, or
+// disarm it if no chunk is open. *armed is the deadline currently set.
+static void set_age_timer(int fd, const consumer_t *c, double *armed)
+{
+    double due = (g_max_chunk_age > 0.0 && c->samples_collected > 0) ? c->chunk_opened + g_max_chunk_age
+                                                                    : 0.0;
+    if (due == *armed)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)due;
+    its.it_value.tv_nsec = (long)((due - (double)(time_t)due) * 1e9);
+    if (due > 0.0 && its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+        its.it_value.tv_nsec = 1;   // 0 would disarm it
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+    *armed = due;
+}
+
+// Single-threaded engine: one epoll loop multiplexes the control socket,
+// timer-driven device reads, the schedule and chunk assembly. The sink
+// workers still write asynchronously behind their queues.
+static int run_event_loop(const sigset_t *sigset)
 {
-    int result = RESULT_SUCCESS;
-    double actual_scan_rate = 0.0;
-    uint8_t num_channels = 1;
-    uint8_t channel_mask = CHAN4;
-    bool scan_active = false;
-    double current_rate = DEFAULT_SCAN_RATE_HZ;
+    producer_t producer;
+    consumer_t consumer = { .current_rate = DEFAULT_SCAN_RATE_HZ };
+    control_conn_t conns[MAX_CONTROL_CONNS];
+    int status = 0;
+    
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
+        conns[i].fd = -1;
+    
+    if (producer_init(&producer) != 0)
+        return -1;
+    
+    // No producer thread to wait for: ring reads return what is there
+    pthread_mutex_lock(&g_ring_buffer.mutex);
+    g_ring_buffer.producer_done = true;
+    pthread_mutex_unlock(&g_ring_buffer.mutex);
     
-    uint32_t read_buffer_size = 1000;  // Read 1000 samples at a time
-    double *read_buf = (double*)malloc(read_buffer_size * sizeof(double));
-    if (!read_buf)
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int signal_fd = signalfd(-1, sigset, SFD_CLOEXEC);
+    int read_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    int age_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (epoll_fd < 0 || signal_fd < 0 || read_fd < 0 || age_fd < 0)
     {
-        fprintf(stderr, "Error: Failed to allocate read buffer\n");
-        return NULL;
+        perror("event loop");
+        status = -1;
     }
     
-    uint16_t read_status = 0;
-    uint32_t samples_read = 0;
-    double timeout = 1.0;
+    int watched[] = { g_socket_fd, signal_fd, read_fd, age_fd, g_schedule.timer_fd, g_schedule.wake_fd };
+    for (size_t i = 0; status == 0 && i < sizeof(watched) / sizeof(watched[0]); i++)
+    {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = watched[i] };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched[i], &ev) != 0)
+        {
+            perror("epoll_ctl");
+            status = -1;
+        }
+    }
     
-    printf("Producer thread started (waiting for START command)...\n");
+    printf("Event loop started (single-threaded, device reads every %.0f ms while capturing)\n",
+           g_read_interval * 1000.0);
+    fflush(stdout);
     
-    while (g_running)
+    bool reading = false;
+    double age_due = 0.0;
+    while (status == 0 && is_running())
     {
-        pthread_mutex_lock(&g_state_mutex);
-        bool should_capture = g_capture_enabled;
-        double requested_rate = g_scan_rate;
-        pthread_mutex_unlock(&g_state_mutex);
+        // The read timer only runs while capturing, so idle costs no wakeups
+        bool should_capture = snapshot_get(&producer.settings, SNAPSHOT_READER_PRODUCER)->capture_enabled;
+        if (should_capture != reading)
+        {
+            set_read_timer(read_fd, should_capture ? g_read_interval : 0.0);
+            reading = should_capture;
+        }
+        // Wake when the open chunk is due, not at the next device read
+        set_age_timer(age_fd, &consumer, &age_due);
         
-        // Check if capture is enabled
-        if (should_capture)
+        struct epoll_event events[8];
+        int n = epoll_wait(epoll_fd, events, 8, -1);
+        if (n < 0)
         {
-            if (!scan_active)
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            status = -1;
+            break;
+        }
+        __atomic_add_fetch(&g_loop_wakeups, 1, __ATOMIC_RELAXED);
+        
+        bool service = false;
+        bool schedule_ready = false;
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            uint64_t expirations;
+            
+            if (fd == signal_fd)
             {
-                // Get current rate
-                pthread_mutex_lock(&g_state_mutex);
-                double current_rate = g_scan_rate;
-                pthread_mutex_unlock(&g_state_mutex);
-                
-                // Calculate actual scan rate
-                mcc118_a_in_scan_actual_rate(num_channels, current_rate, &actual_scan_rate);
-                
-                // Start continuous scan
-                result = mcc118_a_in_scan_start(g_hat_addr, channel_mask, 0, 
-                                                 current_rate, OPTS_CONTINUOUS);
-                if (result == RESULT_SUCCESS)
-                {
-                    scan_active = true;
-                    printf("Producer: Scan started at %.2f Hz (requested: %.2f Hz)\n", 
-                           actual_scan_rate, current_rate);
-                }
-                else
-                {
-                    fprintf(stderr, "Error starting scan: %d\n", result);
-                    print_error(result);
-                    pthread_mutex_lock(&g_state_mutex);
-                    g_capture_enabled = false;
-                    pthread_mutex_unlock(&g_state_mutex);
-                    usleep(100000);  // 100 ms before retry
-                    continue;
-                }
+                struct signalfd_siginfo si;
+                read(signal_fd, &si, sizeof(si));
+                stop_running();
             }
-            
-            // Read from device
-            result = mcc118_a_in_scan_read(g_hat_addr, &read_status, 
-                                           READ_ALL_AVAILABLE, timeout,
-                                           read_buf, read_buffer_size, &samples_read);
-            
-            if (result != RESULT_SUCCESS)
+            else if (fd == read_fd || fd == age_fd)
             {
-                if (result != RESULT_TIMEOUT)
-                {
-                    fprintf(stderr, "Error reading from device: %d\n", result);
-                    break;
-                }
-                continue;
+                read(fd, &expirations, sizeof(expirations));
+                service = true;
             }
-            
-            if (read_status & (STATUS_HW_OVERRUN | STATUS_BUFFER_OVERRUN))
+            else if (fd == g_schedule.timer_fd || fd == g_schedule.wake_fd)
             {
-                fprintf(stderr, "Warning: Overrun detected\n");
+                schedule_ready = true;
             }
-            
-            // Write to ring buffer
-            if (samples_read > 0)
+            else if (fd == g_socket_fd)
             {
-                size_t bytes_written = ring_buffer_write(&g_ring_buffer, read_buf, 
-                                                         samples_read * sizeof(double));
-                if (bytes_written < samples_read * sizeof(double))
+                // Non-blocking, so a client that stops reading cannot stall the loop
+                int client_fd = accept4(g_socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                control_conn_t *conn = client_fd >= 0 ? control_add(conns, client_fd) : NULL;
+                struct epoll_event ev = { .events = EPOLLIN, .data.fd = client_fd };
+                if (conn != NULL && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) != 0)
                 {
-                    fprintf(stderr, "Warning: Ring buffer overflow, dropped %zu bytes\n",
-                            samples_read * sizeof(double) - bytes_written);
+                    close(client_fd);
+                    conn->fd = -1;
                 }
             }
-        }
-        else
-        {
-            // Capture disabled - stop scan if running
-            if (scan_active)
+            else
             {
-                mcc118_a_in_scan_stop(g_hat_addr);
-                mcc118_a_in_scan_cleanup(g_hat_addr);
-                scan_active = false;
-                printf("Producer: Scan stopped\n");
+                // Commands from a connected client
+                control_conn_t *conn = control_find(conns, fd);
+                control_result_t result = conn ? control_serve(conn) : CONTROL_CLOSE;
+                
+                // Subscribers are only written to from now on
+                if (result != CONTROL_KEEP)
+                {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                    if (result == CONTROL_CLOSE)
+                        close(fd);
+                    if (conn != NULL)
+                        conn->fd = -1;
+                }
+                service = true;
             }
-            usleep(100000);  // 100 ms sleep when not capturing
         }
         
-        // Small sleep to prevent CPU spinning
-        usleep(1000);  // 1 ms
+        if (schedule_ready)
+        {
+            if (schedule_wait(&g_schedule, 0) == SCHEDULE_FIRE)
+                producer_window_started(&producer);
+            service = true;
+        }
+        if (service && service_capture(&producer, &consumer) != 0)
+            status = -1;
     }
     
-    // Stop scan if still active
-    if (scan_active)
+    // Flush what the device and the ring still hold
+    if (!is_upgrading())
+        snapshot_set_capture(false);
+    producer_free(&producer);
+    while (consumer_backlog() > 0 && consumer_step(&consumer) == 0)
+        ;
+    consumer_finish(&consumer);
+    
+    for (int i = 0; i < MAX_CONTROL_CONNS; i++)
     {
-        mcc118_a_in_scan_stop(g_hat_addr);
-        mcc118_a_in_scan_cleanup(g_hat_addr);
+        if (conns[i].fd >= 0)
+            close(conns[i].fd);
     }
-    
-    // Mark producer as done
-    pthread_mutex_lock(&g_ring_buffer.mutex);
-    g_ring_buffer.producer_done = true;
-    pthread_cond_signal(&g_ring_buffer.not_empty);
-    pthread_mutex_unlock(&g_ring_buffer.mutex);
-    
-    free(read_buf);
-    
-    printf("Producer thread stopped.\n");
-    return NULL;
+    if (read_fd >= 0)
+        close(read_fd);
+    if (age_fd >= 0)
+        close(age_fd);
+    if (signal_fd >= 0)
+        close(signal_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    printf("Event loop stopped.\n");
+    return status;
 }
 
-// Consumer thread: Read from ring buffer and write to files
-static void* consumer_thread(void *arg)
+// Print command-line usage
+static void print_usage(const char *prog)
 {
-    printf("Consumer thread started.\n");
-    
-    uint32_t samples_collected = 0;
-    double current_rate = DEFAULT_SCAN_RATE_HZ;
-    uint32_t samples_per_chunk = 0;
-    double *chunk_buffer = NULL;
-    
-    while (g_running || ring_buffer_available(&g_ring_buffer) > 0)
+    fprintf(stderr, "Usage: %s [--mode combined|acquire|writer] [--shm-name NAME] [--config FILE]\n", prog);
+    fprintf(stderr, "  (--takeover FD is added by UPGRADE when the new binary is started)\n");
+    fprintf(stderr, "  combined  control, producer and consumer in one process (default)\n");
+    fprintf(stderr, "  acquire   control and producer; samples go to the shared-memory ring\n");
+    fprintf(stderr, "  writer    consumer only; writes chunk files from the shared-memory ring\n");
+}
+
+// Parse command-line options
+static int parse_args(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
     {
-        // Get current rate and calculate samples per chunk
-        pthread_mutex_lock(&g_state_mutex);
-        double requested_rate = g_scan_rate;
-        bool should_capture = g_capture_enabled;
-        pthread_mutex_unlock(&g_state_mutex);
-        
-        // Recalculate samples per chunk if rate changed
-        if (requested_rate != current_rate || chunk_buffer == NULL)
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
         {
-            current_rate = requested_rate;
-            samples_per_chunk = (uint32_t)(current_rate * CHUNK_DURATION_SEC);
-            
-            // Reallocate buffer if needed
-            if (chunk_buffer)
-                free(chunk_buffer);
-            chunk_buffer = (double*)malloc(samples_per_chunk * sizeof(double));
-            if (!chunk_buffer)
+            const char *mode = argv[++i];
+            if (strcmp(mode, "combined") == 0)
+                g_mode = MODE_COMBINED;
+            else if (strcmp(mode, "acquire") == 0)
+                g_mode = MODE_ACQUIRE;
+            else if (strcmp(mode, "writer") == 0)
+                g_mode = MODE_WRITER;
+            else
             {
-                fprintf(stderr, "Error: Failed to allocate chunk buffer\n");
-                return NULL;
+                fprintf(stderr, "Error: Unknown mode: %s\n", mode);
+                return -1;
             }
-            samples_collected = 0;
         }
-        
-        // Only collect data if capturing
-        if (should_capture || samples_collected > 0)
+        else if (strcmp(argv[i], "--shm-name") == 0 && i + 1 < argc)
         {
-            // Try to read enough samples for a chunk
-            size_t needed_bytes = (samples_per_chunk - samples_collected) * sizeof(double);
-            size_t bytes_read = ring_buffer_read(&g_ring_buffer, 
-                                                 chunk_buffer + samples_collected,
-                                                 needed_bytes);
-            
-            if (bytes_read > 0)
-            {
-                samples_collected += bytes_read / sizeof(double);
-            }
-            
-            // If we have enough samples for a chunk, write it
-            if (samples_collected >= samples_per_chunk)
-            {
-                uint64_t seq_start = g_seq_counter;
-                int write_result = write_chunk_file(seq_start, chunk_buffer, samples_per_chunk, current_rate);
-                if (write_result == 0)
-                {
-                    printf("Chunk written: seq=%llu, samples=%u, rate=%.2f Hz\n", 
-                           (unsigned long long)seq_start, samples_per_chunk, current_rate);
-                    g_seq_counter += samples_per_chunk;
-                }
-                else
-                {
-                    fprintf(stderr, "Error writing chunk file (error code: %d)\n", write_result);
-                }
-                
-                samples_collected = 0;
-            }
+            strncpy(g_shm_name, argv[++i], sizeof(g_shm_name) - 1);
         }
-        
-        // Small sleep if buffer is empty
-        if (ring_buffer_available(&g_ring_buffer) == 0)
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            g_config_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--takeover") == 0 && i + 1 < argc)
+        {
+            g_takeover_fd = atoi(argv[++i]);
+        }
+        else
         {
-            usleep(10000);  // 10 ms
+            print_usage(argv[0]);
+            return -1;
         }
     }
+    if (g_takeover_fd >= 0 && g_mode == MODE_WRITER)
+    {
+        fprintf(stderr, "Error: --takeover needs --mode combined or acquire\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Acquire mode: lock memory and raise the producer to real-time priority
+static void make_producer_realtime(pthread_t producer_tid)
+{
+    struct sched_param param;
     
-    // Write remaining samples if any
-    if (chunk_buffer && samples_collected > 0)
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
     {
-        uint64_t seq_start = g_seq_counter;
-        write_chunk_file(seq_start, chunk_buffer, samples_collected, current_rate);
-        g_seq_counter += samples_collected;
+        fprintf(stderr, "Warning: mlockall failed: %s\n", strerror(errno));
     }
     
-    if (chunk_buffer)
-        free(chunk_buffer);
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = ACQUIRE_RT_PRIORITY;
+    int err = pthread_setschedparam(producer_tid, SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        fprintf(stderr, "Warning: Could not set SCHED_FIFO for producer: %s\n", strerror(err));
+    }
+    else
+    {
+        printf("Producer running with SCHED_FIFO priority %d\n", ACQUIRE_RT_PRIORITY);
+    }
+}
+
+// Configure the output sinks from the config file (default: chunk files)
+static int setup_sinks(void)
+{
+    char spec[CONFIG_MAX_VALUE + 16];
+    const char *value;
+    int iter = 0;
     
-    printf("Consumer thread stopped.\n");
-    return NULL;
+    while ((value = config_next("sink", &iter)) != NULL)
+    {
+        if (sink_add(value) != 0)
+            return -1;
+    }
+    
+    if (sink_count() == 0)
+    {
+        snprintf(spec, sizeof(spec), "file dir=%s", g_output_dir);
+        if (sink_add(spec) != 0)
+            return -1;
+    }
+    
+    return sink_start_all(on_chunk_done);
+}
+
+// Release the sample ring used by this process
+static void release_ring(void)
+{
+    if (g_mode == MODE_ACQUIRE)
+        shm_ring_close(&g_shm_ring, true);
+    else
+        destroy_ring_buffer(&g_ring_buffer);
+}
+
+// Threads are stopped and the sinks flushed: exec the new binary with the
+// capture state. Returns only if it could not be started.
+static void hand_over(void)
+{
+    snapshot_t settings;
+    snapshot_copy(&settings);
+    
+    // scan_active, frames_left and stopped_at come from producer_free()
+    g_upgrade.magic = UPGRADE_MAGIC;
+    g_upgrade.version = UPGRADE_VERSION;
+    g_upgrade.socket_fd = g_socket_fd;
+    g_upgrade.boot_id = g_boot_id;
+    g_upgrade.seq_counter = g_mode == MODE_ACQUIRE ?
+        __atomic_load_n(&g_shm_ring.hdr->seq_counter, __ATOMIC_ACQUIRE) : g_seq_counter;
+    g_upgrade.capture_enabled = settings.capture_enabled;
+    g_upgrade.scan_rate = settings.scan_rate;
+    g_upgrade.source = (uint8_t)g_device.source;
+    g_upgrade.address = g_device.address;
+    g_upgrade.scan_t0 = g_device.scan_t0;
+    g_upgrade.scan_frames = g_device.scan_frames;
+    
+    // Subscribers reconnect to the new process
+    pthread_mutex_lock(&g_subscriber_mutex);
+    for (int i = 0; i < g_subscriber_count; i++)
+        close(g_subscribers[i]);
+    g_subscriber_count = 0;
+    pthread_mutex_unlock(&g_subscriber_mutex);
+    
+    // The shared ring stays for the new process and the attached writer
+    device_close(&g_device);
+    if (g_mode == MODE_ACQUIRE)
+        shm_ring_close(&g_shm_ring, false);
+    else
+        destroy_ring_buffer(&g_ring_buffer);
+    schedule_destroy(&g_schedule);
+    snapshot_free();
+    
+    printf("Upgrade: handing over to %s (seq_counter=%llu, capture=%s)\n", g_upgrade_path,
+           (unsigned long long)g_upgrade.seq_counter, g_upgrade.capture_enabled ? "ON" : "OFF");
+    upgrade_exec(g_upgrade_path, &g_upgrade);
+    
+    // Keep the capture going on the binary already running
+    if (strcmp(g_upgrade_path, upgrade_self_path()) != 0)
+    {
+        fprintf(stderr, "Error: Upgrade failed, restarting %s\n", upgrade_self_path());
+        upgrade_exec(upgrade_self_path(), &g_upgrade);
+    }
+    close(g_socket_fd);
+    unlink(g_socket_path);
+    if (g_mode == MODE_ACQUIRE)
+        shm_unlink(g_shm_name);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
     int result = RESULT_SUCCESS;
     pthread_t producer_tid, consumer_tid, control_tid;
     
-    printf("\n=== MCC 118 Channel 4 Ring Buffer Logger ===\n");
-    printf("Default scan rate: %.0f Hz\n", DEFAULT_SCAN_RATE_HZ);
-    printf("Chunk duration: %.1f seconds\n", CHUNK_DURATION_SEC);
-    printf("Socket path: %s\n", SOCKET_PATH);
+    g_process_start = now_mono();
+    upgrade_init(argc, argv);
+    if (parse_args(argc, argv) != 0)
+        return -1;
+    if (g_config_path != NULL && config_load(g_config_path) != 0)
+        return -1;
+    
+    // Started by UPGRADE: continue where the old binary stopped
+    bool taken_over = g_takeover_fd >= 0;
+    if (taken_over && upgrade_receive(g_takeover_fd, &g_upgrade) != 0)
+        return -1;
+    if (budget_init() != 0)
+        return -1;
+    
+    // Virtual streams decide the scan channels and rate
+    double scan_rate = DEFAULT_SCAN_RATE_HZ;
+    int num_streams = vstream_load(&g_vstreams);
+    if (num_streams < 0)
+        return -1;
+    if (num_streams > 0 && g_mode != MODE_WRITER)
+    {
+        if (vstream_scan_plan(&g_vstreams, g_scan_channels, &g_num_scan_channels, &scan_rate) != 0)
+            return -1;
+        printf("Streams: %d, scanning %u channel(s) at %.0f Hz\n",
+               num_streams, g_num_scan_channels, scan_rate);
+    }
+    if (taken_over)
+        scan_rate = g_upgrade.scan_rate;
+    if (snapshot_init(taken_over && g_upgrade.capture_enabled, scan_rate) != 0)
+        return -1;
+    bool has_device = (g_mode != MODE_WRITER);
     
-    // Build absolute path for output directory
-    char cwd[512];
-    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    // Execution engine
+    const char *engine = config_get("engine");
+    if (engine != NULL && strcmp(engine, "single") == 0)
+        g_engine = ENGINE_SINGLE;
+    else if (engine != NULL && strcmp(engine, "threaded") != 0)
+    {
+        fprintf(stderr, "Error: Unknown engine: %s (threaded or single)\n", engine);
+        return -1;
+    }
+    const char *layout = config_get("payload_layout");
+    if (layout != NULL && strcmp(layout, "planar") == 0)
+        g_planar_layout = true;
+    else if (layout != NULL && strcmp(layout, "interleaved") != 0)
+    {
+        fprintf(stderr, "Error: Unknown payload_layout: %s (interleaved or planar)\n", layout);
+        return -1;
+    }
+    g_kernels = kernel_table(g_planar_layout);
+    long anchor_interval = config_get_long("anchor_interval", 0);
+    if (anchor_interval < 0)
+    {
+        fprintf(stderr, "Error: Invalid anchor_interval %ld (frames, 0 = %d per chunk)\n",
+                anchor_interval, ANCHORS_PER_CHUNK);
+        return -1;
+    }
+    g_anchor_interval = (uint32_t)anchor_interval;
+    g_read_interval = config_get_double("read_interval", DEFAULT_READ_INTERVAL_SEC);
+    g_device_id = (uint32_t)config_get_long("device_id", 0);
+    const char *socket_path = config_get("control_socket");
+    if (socket_path != NULL && strlen(socket_path) >= sizeof(g_socket_path))
+    {
+        fprintf(stderr, "Error: control_socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    if (socket_path != NULL)
+        strcpy(g_socket_path, socket_path);
+    g_max_chunk_age = config_get_double("max_chunk_age", DEFAULT_MAX_CHUNK_AGE_SEC);
+    if (g_max_chunk_age < 0.0)
+    {
+        fprintf(stderr, "Error: Invalid max_chunk_age %g (seconds, 0 = off)\n", g_max_chunk_age);
+        return -1;
+    }
+    if (g_engine == ENGINE_SINGLE && (g_mode != MODE_COMBINED || g_read_interval < 0.001))
     {
-        fprintf(stderr, "Error: Failed to get current working directory: %s\n", strerror(errno));
+        fprintf(stderr, "Error: engine = single needs --mode combined and read_interval >= 0.001 s\n");
         return -1;
     }
     
-    // Build full path: current_dir/DAD_Files
-    snprintf(g_output_dir, sizeof(g_output_dir), "%s/%s", cwd, OUTPUT_DIR_RELATIVE);
-    printf("Output directory: %s\n", g_output_dir);
+    printf("\n=== MCC 118 Channel 4 Ring Buffer Logger ===\n");
+    printf("Mode: %s\n", g_mode == MODE_ACQUIRE ? "acquire" :
+                         g_mode == MODE_WRITER ? "writer" : "combined");
+    printf("Default scan rate: %.0f Hz\n", DEFAULT_SCAN_RATE_HZ);
+    printf("Chunk duration: %.1f seconds\n", CHUNK_DURATION_SEC);
+    if (g_max_chunk_age > 0.0)
+        printf("Max chunk age: %.3f seconds\n", g_max_chunk_age);
+    if (has_device)
+        printf("Socket path: %s\n", g_socket_path);
+    if (g_mode != MODE_COMBINED)
+        printf("Shared ring: %s\n", g_shm_name);
+    if (g_engine == ENGINE_SINGLE)
+        printf("Engine: single-threaded event loop\n");
+    
+    // The ring is the largest buffer; writer mode maps the same size
+    if (budget_reserve(BUDGET_RING, RING_BUFFER_SIZE, "sample ring") != 0)
+        return -1;
     
-    // Generate boot ID
-    g_boot_id = generate_boot_id();
-    g_seq_counter = 0;
-    printf("Boot ID: %016llx\n", (unsigned long long)g_boot_id);
+    // Block termination signals before creating threads so only sigwait sees them
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigset, NULL);
     
-    // Ensure output directory exists
-    if (ensure_output_dir(g_output_dir) != 0)
+    if (g_mode != MODE_ACQUIRE)
     {
-        fprintf(stderr, "Error: Failed to create output directory: %s (errno: %s)\n", 
-                g_output_dir, strerror(errno));
-        return -1;
+        // Build absolute path for output directory
+        char cwd[512];
+        if (getcwd(cwd, sizeof(cwd)) == NULL)
+        {
+            fprintf(stderr, "Error: Failed to get current working directory: %s\n", strerror(errno));
+            return -1;
+        }
+        
+        // Build full path: current_dir/DAD_Files (or output_dir from the config)
+        const char *configured_dir = config_get("output_dir");
+        if (configured_dir != NULL)
+            strncpy(g_output_dir, configured_dir, sizeof(g_output_dir) - 1);
+        else
+            snprintf(g_output_dir, sizeof(g_output_dir), "%s/%s", cwd, OUTPUT_DIR_RELATIVE);
+        printf("Output directory: %s\n", g_output_dir);
+        
+        // Ensure output directory exists
+        if (ensure_output_dir(g_output_dir) != 0)
+        {
+            fprintf(stderr, "Error: Failed to create output directory: %s (errno: %s)\n", 
+                    g_output_dir, strerror(errno));
+            return -1;
+        }
+        
+        // Verify directory was created
+        struct stat st;
+        if (stat(g_output_dir, &st) != 0)
+        {
+            fprintf(stderr, "Error: Output directory does not exist: %s (errno: %s)\n", 
+                    g_output_dir, strerror(errno));
+            return -1;
+        }
+        printf("Output directory verified: %s\n", g_output_dir);
+        
+        if (setup_sinks() != 0)
+        {
+            fprintf(stderr, "Error: Failed to set up output sinks\n");
+            sink_stop_all();
+            return -1;
+        }
+        
+        // Queue depths are known now, so the starting rate can be checked
+        if (g_mode == MODE_COMBINED && !rate_fits_budget(scan_rate))
+        {
+            fprintf(stderr, "Error: Buffers at %.0f Hz exceed the memory budget\n", scan_rate);
+            sink_stop_all();
+            return -1;
+        }
+        
+        // Old chunk files are packed into daily archives in the background
+        if (compact_start(g_output_dir) != 0)
+        {
+            sink_stop_all();
+            return -1;
+        }
+        
+        // FETCH serves the files of the file and segment sinks
+        fetch_init(g_output_dir);
     }
     
-    // Verify directory was created
-    struct stat st;
-    if (stat(g_output_dir, &st) != 0)
+    if (g_mode == MODE_WRITER)
     {
-        fprintf(stderr, "Error: Output directory does not exist: %s (errno: %s)\n", 
-                g_output_dir, strerror(errno));
-        return -1;
+        // Writer: boot ID and seq counter come from the shared ring
+        if (pthread_create(&consumer_tid, NULL, consumer_thread, NULL) != 0)
+        {
+            fprintf(stderr, "Error: Failed to create consumer thread\n");
+            compact_stop();
+            sink_stop_all();
+            return -1;
+        }
+        
+        printf("\n=== Ready ===\n");
+        printf("Writing chunks from shared ring %s\n", g_shm_name);
+        printf("Press Ctrl+C to exit...\n\n");
+        fflush(stdout);
+        
+        int sig;
+        sigwait(&sigset, &sig);
+        
+        printf("\nShutting down writer...\n");
+        stop_running();
+        pthread_join(consumer_tid, NULL);
+        compact_stop();
+        sink_stop_all();
+        // Less than the seq counter if a chunk could not be written
+        uint64_t committed = __atomic_load_n(&g_shm_ring.hdr->seq_counter, __ATOMIC_ACQUIRE);
+        shm_ring_close(&g_shm_ring, false);
+        snapshot_free();
+        
+        printf("\nWriter stopped. Committed seq counter: %llu\n", 
+               (unsigned long long)committed);
+        return 0;
     }
-    printf("Output directory verified: %s\n", g_output_dir);
+    
+    // Generate boot ID (an upgrade keeps the old one and its sequence)
+    g_boot_id = taken_over ? g_upgrade.boot_id : generate_boot_id();
+    g_seq_counter = taken_over ? g_upgrade.seq_counter : 0;
+    printf("Boot ID: %016llx%s\n", (unsigned long long)g_boot_id, taken_over ? " (taken over)" : "");
     
     // Initialize ring buffer
-    if (init_ring_buffer(&g_ring_buffer, RING_BUFFER_SIZE) != 0)
+    if (g_mode == MODE_ACQUIRE && taken_over)
+    {
+        // The writer keeps reading the ring across the upgrade
+        if (shm_ring_adopt(&g_shm_ring, g_shm_name) != 0 ||
+            g_shm_ring.hdr->channel_mask != scan_channel_mask())
+        {
+            fprintf(stderr, "Error: Cannot take over shared ring %s\n", g_shm_name);
+            return -1;
+        }
+        publish_state();
+        printf("Shared ring taken over: %llu samples pending\n",
+               (unsigned long long)shm_ring_pending(&g_shm_ring));
+    }
+    else if (g_mode == MODE_ACQUIRE)
+    {
+        // Whole frames only, so overflow never splits one
+        uint64_t capacity = RING_BUFFER_SIZE / sizeof(double) / g_num_scan_channels * g_num_scan_channels;
+        if (shm_ring_create(&g_shm_ring, g_shm_name, capacity, g_boot_id) != 0)
+        {
+            fprintf(stderr, "Error: Failed to create shared ring %s\n", g_shm_name);
+            return -1;
+        }
+        g_shm_ring.hdr->channel_mask = scan_channel_mask();
+        publish_state();
+        printf("Shared ring initialized: %u bytes\n", (unsigned int)RING_BUFFER_SIZE);
+    }
+    else
+    {
+        size_t frame_bytes = g_num_scan_channels * sizeof(double);
+        if (init_ring_buffer(&g_ring_buffer, RING_BUFFER_SIZE / frame_bytes * frame_bytes) != 0)
+        {
+            fprintf(stderr, "Error: Failed to initialize ring buffer\n");
+            return -1;
+        }
+        anchor_track_reset(&g_anchors, &g_anchor_ring, g_num_scan_channels);
+        printf("Ring buffer initialized: %u bytes\n", (unsigned int)RING_BUFFER_SIZE);
+    }
+    
+    // Timer and wake descriptors the idle producer sleeps on
+    if (schedule_init(&g_schedule) != 0)
     {
-        fprintf(stderr, "Error: Failed to initialize ring buffer\n");
+        release_ring();
         return -1;
     }
-    printf("Ring buffer initialized: %u bytes\n", (unsigned int)RING_BUFFER_SIZE);
     
-    // Setup Unix socket
-    g_socket_fd = setup_unix_socket(SOCKET_PATH);
+    // Setup Unix socket; after an upgrade it is still open and listening
+    g_socket_fd = taken_over ? g_upgrade.socket_fd : setup_unix_socket(g_socket_path);
     if (g_socket_fd < 0)
     {
         fprintf(stderr, "Error: Failed to setup Unix socket\n");
-        destroy_ring_buffer(&g_ring_buffer);
+        release_ring();
         return -1;
     }
     
-    // Select MCC 118 device
-    if (select_hat_device(HAT_ID_MCC_118, &g_hat_addr))
+    // Open the configured MCC 118 (never prompts; stops a stale scan)
+    if (device_open(&g_device) != 0)
     {
-        fprintf(stderr, "Error: No MCC 118 device found\n");
         close(g_socket_fd);
-        unlink(SOCKET_PATH);
-        destroy_ring_buffer(&g_ring_buffer);
+        unlink(g_socket_path);
+        release_ring();
         return -1;
     }
+    g_hat_addr = g_device.address;
     
-    printf("Selected MCC 118 device at address %d\n", g_hat_addr);
+    // Without device_id, chunks carry the board's serial number
+    if (config_get("device_id") == NULL)
+        g_device_id = (uint32_t)strtoul(g_device.serial, NULL, 16);
     
-    // Open device
-    result = mcc118_open(g_hat_addr);
-    if (result != RESULT_SUCCESS)
+    // Warm standby: the first START only has to start the scan
+    if (device_prepare(&g_device, scan_channel_mask(), (uint8_t)g_num_scan_channels, scan_rate) != 0)
     {
-        print_error(result);
+        fprintf(stderr, "Error: The MCC 118 cannot scan %u channel(s) at %.2f Hz\n",
+                g_num_scan_channels, scan_rate);
+        device_close(&g_device);
         close(g_socket_fd);
-        unlink(SOCKET_PATH);
-        destroy_ring_buffer(&g_ring_buffer);
+        unlink(g_socket_path);
+        release_ring();
         return -1;
     }
+    printf("Device in standby, ready %.1f ms after process start\n",
+           (now_mono() - g_process_start) * 1000.0);
+    if (taken_over)
+    {
+        g_takeover_ms = (now_mono() - g_upgrade.requested_at) * 1000.0;
+        printf("Upgrade: took over %.1f ms after UPGRADE (capture %s)\n",
+               g_takeover_ms, g_upgrade.capture_enabled ? "ON" : "OFF");
+    }
     
-    // Cleanup any existing scan (in case of previous crash)
-    mcc118_a_in_scan_stop(g_hat_addr);
-    mcc118_a_in_scan_cleanup(g_hat_addr);
+    if (g_engine == ENGINE_SINGLE)
+    {
+        printf("\n=== Ready ===\n");
+        printf("Send commands via socket: START, STOP, STATUS, SET_RATE <value>, SCHEDULE, START_AT, STOP_AFTER\n");
+        printf("Press Ctrl+C to exit...\n\n");
+        fflush(stdout);
+        
+        // Runs until SIGINT/SIGTERM
+        result = run_event_loop(&sigset);
+        printf("\nShutting down...\n");
+        
+        fetch_stop();
+        compact_stop();
+        sink_stop_all();
+        if (result == 0 && is_upgrading())
+        {
+            hand_over();
+            return -1;
+        }
+        device_close(&g_device);
+        close(g_socket_fd);
+        unlink(g_socket_path);
+        release_ring();
+        schedule_destroy(&g_schedule);
+        snapshot_free();
+        
+        printf("\nProgram stopped. Total chunks: %llu\n", 
+               (unsigned long long)g_seq_counter);
+        return result == 0 ? 0 : -1;
+    }
     
     // Create control thread (socket listener)
-    if (pthread_create(&control_tid, NULL, control_thread, NULL) != 0)
+    g_control_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (g_control_wake_fd < 0 || pthread_create(&control_tid, NULL, control_thread, NULL) != 0)
     {
         fprintf(stderr, "Error: Failed to create control thread\n");
-        mcc118_close(g_hat_addr);
+        device_close(&g_device);
         close(g_socket_fd);
-        unlink(SOCKET_PATH);
-        destroy_ring_buffer(&g_ring_buffer);
+        unlink(g_socket_path);
+        release_ring();
         return -1;
     }
     
@@ -831,67 +2891,96 @@ int main(void)
     if (pthread_create(&producer_tid, NULL, producer_thread, NULL) != 0)
     {
         fprintf(stderr, "Error: Failed to create producer thread\n");
-        g_running = false;
+        stop_running();
         pthread_join(control_tid, NULL);
-        mcc118_close(g_hat_addr);
+        device_close(&g_device);
         close(g_socket_fd);
-        unlink(SOCKET_PATH);
-        destroy_ring_buffer(&g_ring_buffer);
+        unlink(g_socket_path);
+        release_ring();
         return -1;
     }
     
-    // Create consumer thread
-    if (pthread_create(&consumer_tid, NULL, consumer_thread, NULL) != 0)
+    if (g_mode == MODE_ACQUIRE)
+    {
+        make_producer_realtime(producer_tid);
+    }
+    
+    // Create consumer thread (the writer process does this in acquire mode)
+    if (g_mode == MODE_COMBINED &&
+        pthread_create(&consumer_tid, NULL, consumer_thread, NULL) != 0)
     {
         fprintf(stderr, "Error: Failed to create consumer thread\n");
-        g_running = false;
+        stop_running();
         pthread_join(producer_tid, NULL);
         pthread_join(control_tid, NULL);
-        mcc118_close(g_hat_addr);
+        device_close(&g_device);
         close(g_socket_fd);
-        unlink(SOCKET_PATH);
-        destroy_ring_buffer(&g_ring_buffer);
+        unlink(g_socket_path);
+        release_ring();
         return -1;
     }
     
     printf("\n=== Ready ===\n");
-    printf("Send commands via socket: START, STOP, STATUS, SET_RATE <value>\n");
+    printf("Send commands via socket: START, STOP, STATUS, SET_RATE <value>, SCHEDULE, START_AT, STOP_AFTER\n");
+    if (g_mode == MODE_ACQUIRE)
+        printf("Start a writer with: --mode writer --shm-name %s\n", g_shm_name);
     printf("Press Ctrl+C to exit...\n\n");
+    fflush(stdout);
     
     // Wait for Ctrl+C or termination signal
-    sigset_t sigset;
-    sigemptyset(&sigset);
-    sigaddset(&sigset, SIGINT);
-    sigaddset(&sigset, SIGTERM);
-    sigprocmask(SIG_BLOCK, &sigset, NULL);
-    
     int sig;
     sigwait(&sigset, &sig);
     
-    printf("\nShutting down...\n");
+    bool upgrading = is_upgrading();
+    printf(upgrading ? "\nUpgrading...\n" : "\nShutting down...\n");
     
-    // Stop acquisition
-    g_running = false;
-    pthread_mutex_lock(&g_state_mutex);
-    g_capture_enabled = false;
-    pthread_mutex_unlock(&g_state_mutex);
+    // Stop acquisition; an upgrade leaves the capture on for the new binary
+    stop_running();
+    if (!upgrading)
+    {
+        snapshot_set_capture(false);
+        publish_state();
+    }
+    schedule_wake(&g_schedule);
     
-    // Close socket to wake up control thread
-    close(g_socket_fd);
-    unlink(SOCKET_PATH);
+    // Wake up the control thread. An upgrade keeps the socket listening, so
+    // clients queue for the new process instead of being refused.
+    uint64_t one = 1;
+    write(g_control_wake_fd, &one, sizeof(one));
+    if (!upgrading)
+    {
+        shutdown(g_socket_fd, SHUT_RDWR);
+        close(g_socket_fd);
+        unlink(g_socket_path);
+    }
     
     // Wait for threads to finish
     pthread_join(control_tid, NULL);
+    close(g_control_wake_fd);
     pthread_join(producer_tid, NULL);
-    pthread_join(consumer_tid, NULL);
+    if (g_mode == MODE_COMBINED)
+    {
+        pthread_join(consumer_tid, NULL);
+        fetch_stop();
+        compact_stop();
+        sink_stop_all();
+    }
+    if (upgrading)
+    {
+        hand_over();
+        return -1;
+    }
     
     // Cleanup
-    mcc118_close(g_hat_addr);
-    destroy_ring_buffer(&g_ring_buffer);
+    device_close(&g_device);
+    if (g_mode == MODE_ACQUIRE)
+        g_seq_counter = __atomic_load_n(&g_shm_ring.hdr->seq_counter, __ATOMIC_ACQUIRE);
+    release_ring();
+    schedule_destroy(&g_schedule);
+    snapshot_free();
     
     printf("\nProgram stopped. Total chunks: %llu\n", 
            (unsigned long long)g_seq_counter);
     
     return 0;
 }
-
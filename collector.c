@@ -0,0 +1,575 @@
+/*
+    sensor_collector: receives the chunk streams of many loggers over TCP
+    and keeps them in one store, indexed per device (see store.h)
+
+    Usage:
+        sensor_collector [-l [HOST:]PORT] [-d DIR] [-w WORKERS] [-r KBPS]
+            -l  listen address (default 0.0.0.0:7600)
+            -d  store directory (default ./collector_store)
+            -w  event-loop threads (default one per online core)
+            -r  receive limit per connection in KB/s (default unlimited)
+    Loggers push to it with a socket sink, one connection each:
+        sink = socket addr=tcp:<collector host>:7600
+    and tell themselves apart by device_id (config device_id, else the
+    board serial number).
+
+    Every worker thread runs its own epoll loop on its own SO_REUSEPORT
+    listening socket, so the kernel spreads the loggers over the cores and
+    no lock is taken on the receive path. A chunk is stored once the whole
+    of it has arrived; chunks already in the store (same boot_id, stream
+    and seq_start) are counted and dropped.
+
+    Fairness and backpressure: a connection gets at most one
+    COLLECTOR_RECV_SIZE read per loop iteration, so a fast logger cannot
+    starve the others on its worker. A connection over its rate limit, or
+    whose chunk could not be stored (disk full), stops being read until
+    the next tick; TCP flow control then pushes back on that logger alone,
+    whose socket sink blocks and whose sink queue applies its policy.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "sdat.h"
+#include "store.h"
+#include "util.h"
+
+#define COLLECTOR_DEFAULT_LISTEN "0.0.0.0:7600"
+#define COLLECTOR_DEFAULT_DIR "./collector_store"
+#define COLLECTOR_MAX_WORKERS 64
+#define COLLECTOR_MAX_CONNS 256             // per worker
+#define COLLECTOR_RECV_SIZE 65536           // per connection and wakeup
+#define COLLECTOR_MAX_CHUNK (64u << 20)     // larger lengths mean a corrupt stream
+#define COLLECTOR_TICK_MS 100               // retry paused connections
+#define COLLECTOR_SYNC_SEC 1.0
+
+// One logger connection
+typedef struct {
+    int fd;
+    char peer[64];
+    uint8_t *buf;
+    size_t capacity;
+    size_t used;
+    bool paused;                // not polled for input until the next tick
+    double tokens;              // bytes it may still receive (rate limit)
+    double refilled_at;
+    uint32_t device_id;
+    uint64_t chunks;
+    uint64_t duplicates;
+} conn_t;
+
+// One event-loop thread
+typedef struct {
+    int index;
+    pthread_t thread;
+    int epoll_fd;
+    int listen_fd;
+    int timer_fd;
+    conn_t *conns[COLLECTOR_MAX_CONNS];
+} worker_t;
+
+static volatile sig_atomic_t g_running = 1;
+static int g_wake_fd = -1;              // readable once shutdown begins
+static double g_rate_limit = 0.0;       // bytes/s per connection, 0 = none
+static worker_t g_workers[COLLECTOR_MAX_WORKERS];
+
+// Print command-line usage
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-l [HOST:]PORT] [-d DIR] [-w WORKERS] [-r KBPS]\n", prog);
+}
+
+// Listening socket of one worker; all of them share the port
+static int open_listener(const char *listen_addr)
+{
+    char host[256];
+    strncpy(host, listen_addr, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    char *port = strrchr(host, ':');
+    if (port != NULL)
+        *port++ = '\0';
+    else
+    {
+        port = (char*)listen_addr;  // just a port: all interfaces
+        host[0] = '\0';
+    }
+
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int rc = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Error: Listen address %s: %s\n", listen_addr, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+        bind(fd, res->ai_addr, res->ai_addrlen) != 0 ||
+        listen(fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", listen_addr, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Poll a connection for input or stop doing so
+static void set_paused(worker_t *w, conn_t *c, bool paused)
+{
+    if (c->paused == paused)
+        return;
+    struct epoll_event ev = { .events = paused ? 0 : EPOLLIN, .data.ptr = c };
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->paused = paused;
+}
+
+// Accept the pending connections of a worker's listener
+static void accept_conns(worker_t *w)
+{
+    for (;;)
+    {
+        struct sockaddr_storage sa;
+        socklen_t sa_len = sizeof(sa);
+        int fd = accept4(w->listen_fd, (struct sockaddr*)&sa, &sa_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = 0;
+        while (slot < COLLECTOR_MAX_CONNS && w->conns[slot] != NULL)
+            slot++;
+        conn_t *c = slot < COLLECTOR_MAX_CONNS ? (conn_t*)calloc(1, sizeof(conn_t)) : NULL;
+        if (c == NULL)
+        {
+            fprintf(stderr, "Warning: Worker %d refused a connection (%d open)\n", w->index, slot);
+            close(fd);
+            continue;
+        }
+
+        c->fd = fd;
+        c->tokens = g_rate_limit;
+        c->refilled_at = now_mono();
+        char host[INET6_ADDRSTRLEN] = "?";
+        int port = 0;
+        if (sa.ss_family == AF_INET)
+        {
+            struct sockaddr_in *in = (struct sockaddr_in*)&sa;
+            inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+            port = ntohs(in->sin_port);
+        }
+        else if (sa.ss_family == AF_INET6)
+        {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6*)&sa;
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            port = ntohs(in6->sin6_port);
+        }
+        snprintf(c->peer, sizeof(c->peer), "%s:%d", host, port);
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(c);
+            continue;
+        }
+        w->conns[slot] = c;
+        printf("Worker %d: %s connected\n", w->index, c->peer);
+    }
+}
+
+// Close a connection and forget it
+static void drop_conn(worker_t *w, conn_t *c, const char *why)
+{
+    printf("Worker %d: %s %s (device %u, %llu chunks stored, %llu duplicates)\n", w->index, c->peer,
+           why, c->device_id, (unsigned long long)c->chunks, (unsigned long long)c->duplicates);
+    if (c->used > 0)
+        printf("Worker %d: %s left %zu bytes of an incomplete chunk\n", w->index, c->peer, c->used);
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    for (int i = 0; i < COLLECTOR_MAX_CONNS; i++)
+    {
+        if (w->conns[i] == c)
+            w->conns[i] = NULL;
+    }
+    free(c->buf);
+    free(c);
+}
+
+// Length of the chunk starting at buf once its header is in: 0 while more
+// header bytes are needed, -1 if the stream is not SDAT
+static long chunk_length(const uint8_t *buf, size_t used)
+{
+    if (used < SDAT_HEADER_SIZE)
+        return 0;
+    uint16_t version = (uint16_t)get_le(buf + 4, 2);
+    if (memcmp(buf, SDAT_MAGIC, 4) != 0 || version < 1 || version > SDAT_VERSION)
+        return -1;
+
+    size_t header_len = SDAT_HEADER_SIZE;
+    uint32_t flags = 0;
+    if (version >= 2)
+    {
+        if (used < SDAT_HEADER_V2_SIZE)
+            return 0;
+        flags = (uint32_t)get_le(buf + 56, 4);
+        header_len = SDAT_HEADER_V2_SIZE + get_le(buf + 60, 4);
+    }
+    uint64_t payload = (flags & SDAT_FLAG_FLAT) ? 0 :
+                       get_le(buf + 32, 4) * get_le(buf + 30, 2);
+    uint64_t total = header_len + payload;
+    return total <= COLLECTOR_MAX_CHUNK ? (long)total : -1;
+}
+
+// Describe a complete chunk for the store
+static void chunk_entry(const uint8_t *chunk, uint32_t length, store_entry_t *entry)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->boot_id = get_le(chunk + 10, 8);
+    entry->seq_start = get_le(chunk + 18, 8);
+    entry->sample_count = (uint32_t)get_le(chunk + 32, 4);
+    entry->time_start = get_le(chunk + 36, 8);
+    entry->length = length;
+    if (get_le(chunk + 4, 2) < 2)
+        return;
+
+    entry->flags = (uint32_t)get_le(chunk + 56, 4);
+    size_t pos = SDAT_HEADER_V2_SIZE;
+    size_t end = SDAT_HEADER_V2_SIZE + get_le(chunk + 60, 4);
+    while (pos + SDAT_EXT_HEADER_SIZE <= end)
+    {
+        uint16_t type = (uint16_t)get_le(chunk + pos, 2);
+        uint32_t ext_len = (uint32_t)get_le(chunk + pos + 4, 4);
+        pos += SDAT_EXT_HEADER_SIZE;
+        if (ext_len > end - pos)
+            break;
+        if (type == SDAT_EXT_STREAM && ext_len >= 2)
+            entry->stream = (uint16_t)get_le(chunk + pos, 2);
+        pos += ext_len;
+    }
+}
+
+// Store the complete chunks at the front of the buffer. Returns -1 if the
+// connection must be dropped; pauses it if the store refused a chunk.
+static int store_chunks(worker_t *w, conn_t *c)
+{
+    size_t pos = 0;
+    int rc = 0;
+
+    while (!c->paused)
+    {
+        long length = chunk_length(c->buf + pos, c->used - pos);
+        if (length < 0)
+        {
+            fprintf(stderr, "Error: %s sent something that is not an SDAT chunk\n", c->peer);
+            rc = -1;
+            break;
+        }
+        if (length == 0 || (size_t)length > c->used - pos)
+            break;  // the rest is still on its way
+
+        store_entry_t entry;
+        const uint8_t *chunk = c->buf + pos;
+        chunk_entry(chunk, (uint32_t)length, &entry);
+        c->device_id = (uint32_t)get_le(chunk + 6, 4);
+        store_device_t *dev = store_device(c->device_id);
+        int stored = dev != NULL ? store_append(dev, chunk, &entry) : -1;
+        if (stored < 0)
+        {
+            // Keep the chunk and stop reading until the next tick
+            set_paused(w, c, true);
+            break;
+        }
+        if (stored > 0)
+            c->chunks++;
+        else
+            c->duplicates++;
+        pos += (size_t)length;
+    }
+
+    if (pos > 0)
+    {
+        memmove(c->buf, c->buf + pos, c->used - pos);
+        c->used -= pos;
+    }
+    return rc;
+}
+
+// Refill the rate limit of a connection; false while it has no budget
+static bool refill(conn_t *c, double now)
+{
+    if (g_rate_limit <= 0.0)
+        return true;
+    c->tokens += (now - c->refilled_at) * g_rate_limit;
+    c->refilled_at = now;
+    if (c->tokens > g_rate_limit)
+        c->tokens = g_rate_limit;        // at most one second of burst
+    return c->tokens > 0.0;
+}
+
+// Read once from a connection and store what completed
+static void serve_conn(worker_t *w, conn_t *c)
+{
+    if (!refill(c, now_mono()))
+    {
+        set_paused(w, c, true);
+        return;
+    }
+
+    if (c->capacity - c->used < COLLECTOR_RECV_SIZE)
+    {
+        size_t capacity = c->used + COLLECTOR_RECV_SIZE;
+        uint8_t *buf = (uint8_t*)realloc(c->buf, capacity);
+        if (buf == NULL)
+        {
+            drop_conn(w, c, "dropped (out of memory)");
+            return;
+        }
+        c->buf = buf;
+        c->capacity = capacity;
+    }
+
+    size_t want = COLLECTOR_RECV_SIZE;
+    if (g_rate_limit > 0.0 && c->tokens < (double)want)
+        want = (size_t)c->tokens + 1;
+    ssize_t n = recv(c->fd, c->buf + c->used, want, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0)
+    {
+        drop_conn(w, c, n == 0 ? "disconnected" : "failed");
+        return;
+    }
+    c->used += (size_t)n;
+    c->tokens -= (double)n;
+
+    if (store_chunks(w, c) != 0)
+        drop_conn(w, c, "dropped");
+}
+
+// Resume paused connections that may go on
+static void tick(worker_t *w)
+{
+    double now = now_mono();
+    for (int i = 0; i < COLLECTOR_MAX_CONNS; i++)
+    {
+        conn_t *c = w->conns[i];
+        if (c == NULL || !c->paused || !refill(c, now))
+            continue;
+        set_paused(w, c, false);
+        if (store_chunks(w, c) != 0)
+            drop_conn(w, c, "dropped");
+    }
+}
+
+// Event loop of one worker
+static void* worker_thread(void *arg)
+{
+    worker_t *w = (worker_t*)arg;
+    double synced_at = now_mono();
+
+    while (g_running)
+    {
+        struct epoll_event events[64];
+        int n = epoll_wait(w->epoll_fd, events, 64, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &w->listen_fd)
+            {
+                accept_conns(w);
+            }
+            else if (ptr == &w->timer_fd)
+            {
+                uint64_t expirations;
+                read(w->timer_fd, &expirations, sizeof(expirations));
+                tick(w);
+                if (w->index == 0 && now_mono() - synced_at >= COLLECTOR_SYNC_SEC)
+                {
+                    store_sync();
+                    synced_at = now_mono();
+                }
+            }
+            else if (ptr == &g_wake_fd)
+            {
+                break;  // g_running is already cleared
+            }
+            else
+            {
+                conn_t *c = (conn_t*)ptr;
+                if (c->paused)
+                    drop_conn(w, c, "disconnected while paused");  // only ERR/HUP arrive
+                else
+                    serve_conn(w, c);
+            }
+        }
+    }
+
+    for (int i = 0; i < COLLECTOR_MAX_CONNS; i++)
+    {
+        if (w->conns[i] != NULL)
+            drop_conn(w, w->conns[i], "closed at shutdown");
+    }
+    return NULL;
+}
+
+// Set up the sockets and timer of one worker
+static int worker_init(worker_t *w, int index, const char *listen_addr)
+{
+    memset(w, 0, sizeof(*w));
+    w->index = index;
+    w->listen_fd = open_listener(listen_addr);
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    w->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (w->listen_fd < 0 || w->epoll_fd < 0 || w->timer_fd < 0)
+        return -1;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_nsec = COLLECTOR_TICK_MS * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(w->timer_fd, 0, &its, NULL);
+
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = &w->listen_fd };
+    struct epoll_event timer_ev = { .events = EPOLLIN, .data.ptr = &w->timer_fd };
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.ptr = &g_wake_fd };
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fd, &listen_ev) != 0 ||
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->timer_fd, &timer_ev) != 0 ||
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, g_wake_fd, &wake_ev) != 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *listen_addr = COLLECTOR_DEFAULT_LISTEN;
+    const char *dir = COLLECTOR_DEFAULT_DIR;
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    double rate_kb = 0.0;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        const char *opt = argv[arg];
+        bool has_value = arg + 1 < argc;
+        if (strcmp(opt, "-l") == 0 && has_value)
+            listen_addr = argv[++arg];
+        else if (strcmp(opt, "-d") == 0 && has_value)
+            dir = argv[++arg];
+        else if (strcmp(opt, "-w") == 0 && has_value)
+            num_workers = atol(argv[++arg]);
+        else if (strcmp(opt, "-r") == 0 && has_value)
+            rate_kb = atof(argv[++arg]);
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (num_workers < 1)
+        num_workers = 1;
+    if (num_workers > COLLECTOR_MAX_WORKERS)
+        num_workers = COLLECTOR_MAX_WORKERS;
+    if (rate_kb < 0.0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    g_rate_limit = rate_kb * 1024.0;
+
+    // Signals are taken by sigwait() below; workers never see them
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    if (store_init(dir) != 0)
+        return 1;
+    g_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (g_wake_fd < 0)
+    {
+        perror("eventfd");
+        return 1;
+    }
+
+    int started = 0;
+    int status = 0;
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (worker_init(&g_workers[i], i, listen_addr) != 0 ||
+            pthread_create(&g_workers[i].thread, NULL, worker_thread, &g_workers[i]) != 0)
+        {
+            status = 1;
+            break;
+        }
+        started++;
+    }
+
+    if (status == 0)
+    {
+        printf("Collector listening on %s, %ld workers, store %s", listen_addr, num_workers, dir);
+        if (g_rate_limit > 0.0)
+            printf(", %.0f KB/s per connection", rate_kb);
+        printf("\n");
+        fflush(stdout);
+
+        int sig;
+        sigwait(&sigset, &sig);
+        printf("\nShutting down...\n");
+    }
+
+    // Every worker sees the eventfd readable (it is never read)
+    g_running = 0;
+    uint64_t one = 1;
+    write(g_wake_fd, &one, sizeof(one));
+    for (int i = 0; i < started; i++)
+        pthread_join(g_workers[i].thread, NULL);
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (g_workers[i].listen_fd > 0)
+            close(g_workers[i].listen_fd);
+        if (g_workers[i].epoll_fd > 0)
+            close(g_workers[i].epoll_fd);
+        if (g_workers[i].timer_fd > 0)
+            close(g_workers[i].timer_fd);
+    }
+
+    char summary[256];
+    store_status(summary, sizeof(summary));
+    store_close();
+    close(g_wake_fd);
+    printf("Collector stopped: %s\n", summary);
+    return status;
+}
@@ -0,0 +1,655 @@
+/*
+    Background compaction into daily archives (see compact.h)
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include "compact.h"
+#include "config.h"
+#include "sdat.h"
+#include "sink.h"
+#include "util.h"
+
+// Linux I/O priority, not wrapped by glibc
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+#define INDEX_ENTRY_SIZE 46     // fixed part of an index entry, before the name
+
+typedef struct {
+    char dir[512];
+    double after;               // seconds since the file was written
+    double rate;                // archive bytes per second
+    bool any_upload;            // compact without an upload mark
+} compact_dir_t;
+
+typedef struct {
+    char name[64];
+    uint64_t offset;
+    uint32_t stored;
+    uint32_t size;
+    uint32_t crc;
+    uint64_t boot_id;
+    uint64_t seq_start;
+    uint64_t time_start;
+} member_t;
+
+typedef struct {
+    member_t *members;
+    size_t count;
+    size_t capacity;
+} archive_index_t;
+
+static compact_dir_t g_dirs[COMPACT_MAX_DIRS];
+static int g_dir_count = 0;
+static pthread_t g_tid;
+static bool g_started = false;
+static bool g_stop = false;
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+
+// Statistics (under g_mutex)
+static uint64_t g_archived = 0;
+static uint64_t g_archives = 0;
+static uint64_t g_errors = 0;
+
+// Sleep up to ms, returning true once compact_stop() was called
+static bool pause_for(long ms)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ms / 1000;
+    until.tv_nsec += (ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    while (!g_stop && pthread_cond_timedwait(&g_cond, &g_mutex, &until) != ETIMEDOUT)
+        ;
+    bool stop = g_stop;
+    pthread_mutex_unlock(&g_mutex);
+    return stop;
+}
+
+// True once compact_stop() was called
+static bool stopping(void)
+{
+    pthread_mutex_lock(&g_mutex);
+    bool stop = g_stop;
+    pthread_mutex_unlock(&g_mutex);
+    return stop;
+}
+
+// Wait until the sinks have nothing to write. Returns -1 on stop.
+static int wait_idle(void)
+{
+    while (!sink_idle())
+    {
+        if (pause_for(COMPACT_IDLE_WAIT_MS))
+            return -1;
+    }
+    return 0;
+}
+
+// Count an outcome for STATUS
+static void add_stat(uint64_t *counter, uint64_t n)
+{
+    pthread_mutex_lock(&g_mutex);
+    *counter += n;
+    pthread_mutex_unlock(&g_mutex);
+}
+
+// Write everything, then wait so the average stays at the rate limit
+static int write_throttled(const compact_dir_t *cd, int fd, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    size_t left = len;
+    while (left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    return pause_for((long)(len * 1000.0 / cd->rate)) ? -1 : 0;
+}
+
+// Read a whole file; returns the buffer (caller frees) or NULL
+static uint8_t* read_file(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    uint8_t *buf = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= UINT32_MAX)
+        buf = (uint8_t*)malloc((size_t)st.st_size);
+    if (buf != NULL && pread(fd, buf, (size_t)st.st_size, 0) != st.st_size)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    close(fd);
+    *size = buf ? (size_t)st.st_size : 0;
+    return buf;
+}
+
+// Add an entry to an index
+static int index_add(archive_index_t *index, const member_t *m)
+{
+    if (index->count == index->capacity)
+    {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        member_t *members = (member_t*)realloc(index->members, capacity * sizeof(member_t));
+        if (members == NULL)
+            return -1;
+        index->members = members;
+        index->capacity = capacity;
+    }
+    index->members[index->count++] = *m;
+    return 0;
+}
+
+// Load the index of an existing archive. Returns 0 with an empty index
+// if there is none, -1 if it is unreadable.
+static int index_load(int fd, archive_index_t *index)
+{
+    uint8_t header[COMPACT_HEADER_SIZE];
+    if (pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header, COMPACT_MAGIC, 4) != 0 || get_le(header + 4, 2) != COMPACT_VERSION)
+        return -1;
+
+    uint32_t entries = (uint32_t)get_le(header + 8, 4);
+    uint64_t offset = get_le(header + 16, 8);
+    uint64_t size = get_le(header + 24, 8);
+    uint8_t *buf = size <= UINT32_MAX ? (uint8_t*)malloc(size ? size : 1) : NULL;
+    if (buf == NULL || pread(fd, buf, size, (off_t)offset) != (ssize_t)size)
+    {
+        free(buf);
+        return -1;
+    }
+
+    const uint8_t *p = buf;
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        member_t m;
+        memset(&m, 0, sizeof(m));
+        if (p + INDEX_ENTRY_SIZE > buf + size)
+            break;
+        m.offset = get_le(p, 8);
+        m.stored = (uint32_t)get_le(p + 8, 4);
+        m.size = (uint32_t)get_le(p + 12, 4);
+        m.crc = (uint32_t)get_le(p + 16, 4);
+        m.boot_id = get_le(p + 20, 8);
+        m.seq_start = get_le(p + 28, 8);
+        m.time_start = get_le(p + 36, 8);
+        size_t name_len = (size_t)get_le(p + 44, 2);
+        p += INDEX_ENTRY_SIZE;
+        if (name_len >= sizeof(m.name) || p + name_len > buf + size)
+            break;
+        memcpy(m.name, p, name_len);
+        p += name_len;
+        if (index_add(index, &m) != 0)
+            break;
+    }
+    free(buf);
+    return index->count == entries ? 0 : -1;
+}
+
+// Write the index and the final header
+static int index_write(int fd, const archive_index_t *index, uint64_t offset)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < index->count; i++)
+        size += INDEX_ENTRY_SIZE + strlen(index->members[i].name);
+
+    uint8_t *buf = (uint8_t*)malloc(size ? size : 1);
+    if (buf == NULL)
+        return -1;
+    uint8_t *p = buf;
+    for (size_t i = 0; i < index->count; i++)
+    {
+        const member_t *m = &index->members[i];
+        size_t name_len = strlen(m->name);
+        p = put_le(p, m->offset, 8);
+        p = put_le(p, m->stored, 4);
+        p = put_le(p, m->size, 4);
+        p = put_le(p, m->crc, 4);
+        p = put_le(p, m->boot_id, 8);
+        p = put_le(p, m->seq_start, 8);
+        p = put_le(p, m->time_start, 8);
+        p = put_le(p, name_len, 2);
+        memcpy(p, m->name, name_len);
+        p += name_len;
+    }
+
+    uint8_t header[COMPACT_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, COMPACT_MAGIC, 4);
+    put_le(header + 4, COMPACT_VERSION, 2);
+    put_le(header + 8, index->count, 4);
+    put_le(header + 16, offset, 8);
+    put_le(header + 24, size, 8);
+
+    int rc = (pwrite(fd, buf, size, (off_t)offset) == (ssize_t)size &&
+              pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header)) ? 0 : -1;
+    free(buf);
+    return rc;
+}
+
+// Find an identical member
+static bool index_has(const archive_index_t *index, const char *name, uint32_t size, uint32_t crc)
+{
+    for (size_t i = 0; i < index->count; i++)
+    {
+        const member_t *m = &index->members[i];
+        if (m->size == size && m->crc == crc && strcmp(m->name, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Make a rename or unlink durable
+static void sync_dir(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Copy the members of the previous archive unchanged
+static int copy_members(const compact_dir_t *cd, int from, int to, archive_index_t *old,
+                        archive_index_t *out, uint64_t *offset)
+{
+    for (size_t i = 0; i < old->count; i++)
+    {
+        member_t m = old->members[i];
+        uint8_t *buf = (uint8_t*)malloc(m.stored ? m.stored : 1);
+        if (buf == NULL || pread(from, buf, m.stored, (off_t)m.offset) != (ssize_t)m.stored ||
+            wait_idle() != 0 || write_throttled(cd, to, buf, m.stored) != 0)
+        {
+            free(buf);
+            return -1;
+        }
+        free(buf);
+        m.offset = *offset;
+        *offset += m.stored;
+        if (index_add(out, &m) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Compress one chunk file into the archive. Returns 1 if added, 0 if it is
+// already archived, -1 on error.
+static int add_member(const compact_dir_t *cd, int to, const char *name, const archive_index_t *old,
+                      archive_index_t *out, uint64_t *offset)
+{
+    char path[600];
+    size_t size;
+    snprintf(path, sizeof(path), "%s/%s", cd->dir, name);
+    uint8_t *data = read_file(path, &size);
+    if (data == NULL || size < SDAT_HEADER_SIZE || memcmp(data, SDAT_MAGIC, 4) != 0)
+    {
+        free(data);
+        return -1;
+    }
+
+    uint32_t crc = (uint32_t)crc32(0L, data, (uInt)size);
+    if (index_has(old, name, (uint32_t)size, crc) || index_has(out, name, (uint32_t)size, crc))
+    {
+        free(data);
+        return 0;
+    }
+
+    uLongf stored = compressBound((uLong)size);
+    uint8_t *packed = (uint8_t*)malloc(stored);
+    int rc = -1;
+    if (packed != NULL && compress2(packed, &stored, data, (uLong)size, Z_BEST_COMPRESSION) == Z_OK &&
+        wait_idle() == 0 && write_throttled(cd, to, packed, stored) == 0)
+    {
+        member_t m;
+        memset(&m, 0, sizeof(m));
+        strncpy(m.name, name, sizeof(m.name) - 1);
+        m.offset = *offset;
+        m.stored = (uint32_t)stored;
+        m.size = (uint32_t)size;
+        m.crc = crc;
+        m.boot_id = get_le(data + 10, 8);
+        m.seq_start = get_le(data + 18, 8);
+        m.time_start = get_le(data + 36, 8);
+        *offset += stored;
+        rc = index_add(out, &m) == 0 ? 1 : -1;
+    }
+    free(packed);
+    free(data);
+    return rc;
+}
+
+// Pack the chunk files of one day into its archive, then remove them
+static int compact_day(const compact_dir_t *cd, const char *day, char (*names)[64], size_t count)
+{
+    char archive_dir[560], final_path[600], part_path[610];
+    snprintf(archive_dir, sizeof(archive_dir), "%s/archive", cd->dir);
+    snprintf(final_path, sizeof(final_path), "%s/archive_%s.sdar", archive_dir, day);
+    snprintf(part_path, sizeof(part_path), "%s.part", final_path);
+    if (mkdir(archive_dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: Failed to create %s: %s\n", archive_dir, strerror(errno));
+        return -1;
+    }
+
+    archive_index_t old = { NULL, 0, 0 };
+    archive_index_t out = { NULL, 0, 0 };
+    int old_fd = open(final_path, O_RDONLY);
+    if (old_fd >= 0 && index_load(old_fd, &old) != 0)
+    {
+        fprintf(stderr, "Error: Unreadable archive %s, leaving its chunks alone\n", final_path);
+        close(old_fd);
+        free(old.members);
+        return -1;
+    }
+
+    int fd = open(part_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool *archived = (bool*)calloc(count, sizeof(bool));
+    uint8_t blank[COMPACT_HEADER_SIZE] = { 0 };
+    uint64_t offset = COMPACT_HEADER_SIZE;
+    size_t added = 0;
+    int rc = (fd >= 0 && archived != NULL && write(fd, blank, sizeof(blank)) == (ssize_t)sizeof(blank)) ? 0 : -1;
+    if (rc == 0 && old_fd >= 0)
+        rc = copy_members(cd, old_fd, fd, &old, &out, &offset);
+    for (size_t i = 0; rc == 0 && i < count; i++)
+    {
+        int result = add_member(cd, fd, names[i], &old, &out, &offset);
+        if (result < 0 && stopping())
+        {
+            rc = -1;
+        }
+        else if (result < 0)
+        {
+            fprintf(stderr, "Error: Could not archive %s/%s, kept\n", cd->dir, names[i]);
+            add_stat(&g_errors, 1);
+        }
+        archived[i] = (result >= 0);
+        added += (result == 1);
+    }
+    if (old_fd >= 0)
+        close(old_fd);
+
+    // The new archive must be on disk before any chunk file goes away
+    if (rc == 0 && added > 0)
+    {
+        rc = (index_write(fd, &out, offset) == 0 && fsync(fd) == 0) ? 0 : -1;
+        if (close(fd) != 0)
+            rc = -1;
+        fd = -1;
+        if (rc == 0 && rename(part_path, final_path) == 0)
+            sync_dir(archive_dir);
+        else
+            rc = -1;
+    }
+    if (fd >= 0)
+        close(fd);
+    if (rc != 0 || added == 0)
+        unlink(part_path);
+
+    size_t removed = 0;
+    for (size_t i = 0; rc == 0 && i < count; i++)
+    {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%s", cd->dir, names[i]);
+        if (archived[i] && unlink(path) == 0)
+            removed++;
+    }
+    if (removed > 0)
+    {
+        sync_dir(cd->dir);
+        printf("Compacted %zu chunk(s) into %s (%zu new)\n", removed, final_path, added);
+        add_stat(&g_archived, removed);
+        add_stat(&g_archives, added > 0);
+    }
+    free(archived);
+    free(old.members);
+    free(out.members);
+    return rc;
+}
+
+// UTC day of a file time as YYYYMMDD
+static void day_of(time_t t, char *day)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(day, 9, "%Y%m%d", &tm);
+}
+
+// Chunk files of a day that is past the threshold as a whole, so the day
+// gets no more files and its archive is written once
+static bool eligible(const compact_dir_t *cd, DIR *d, const struct dirent *de, char *day,
+                     time_t *mtime)
+{
+    size_t len = strlen(de->d_name);
+    if (strncmp(de->d_name, "chunk_", 6) != 0 || len < 11 || len >= 64 ||
+        strcmp(de->d_name + len - 5, "_.bin") != 0)
+        return false;
+
+    struct stat st;
+    if (fstatat(dirfd(d), de->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    time_t day_end = st.st_mtime - st.st_mtime % 86400 + 86400;
+    if (difftime(time(NULL), day_end) < cd->after)
+        return false;
+    day_of(st.st_mtime, day);
+    *mtime = st.st_mtime;
+    return true;
+}
+
+// Upload mark of a directory, -1 if there is none
+static double upload_mark(const compact_dir_t *cd)
+{
+    char path[600];
+    snprintf(path, sizeof(path), "%s/%s", cd->dir, COMPACT_UPLOAD_MARK);
+    FILE *f = fopen(path, "r");
+    double mark = -1.0;
+    if (f != NULL)
+    {
+        if (fscanf(f, "%lf", &mark) != 1)
+            mark = -1.0;
+        fclose(f);
+    }
+    return mark;
+}
+
+// Compact one directory, oldest day first
+static void compact_dir(const compact_dir_t *cd)
+{
+    while (!stopping())
+    {
+        double mark = upload_mark(cd);
+        if (!cd->any_upload && mark < 0.0)
+            return;
+
+        // Oldest eligible day
+        char oldest[9] = "", day[9];
+        time_t mtime;
+        DIR *d = opendir(cd->dir);
+        if (d == NULL)
+            return;
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL)
+        {
+            if (eligible(cd, d, de, day, &mtime) && (oldest[0] == '\0' || strcmp(day, oldest) < 0))
+                memcpy(oldest, day, sizeof(day));
+        }
+        if (oldest[0] == '\0')
+        {
+            closedir(d);
+            return;
+        }
+
+        // Its files, all of them uploaded (later days are not either if not)
+        char (*names)[64] = NULL;
+        size_t count = 0, capacity = 0;
+        bool uploaded = true;
+        rewinddir(d);
+        while ((de = readdir(d)) != NULL)
+        {
+            if (!eligible(cd, d, de, day, &mtime) || strcmp(day, oldest) != 0)
+                continue;
+            if (!cd->any_upload && (double)mtime > mark)
+            {
+                uploaded = false;
+                break;
+            }
+            if (count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 1024;
+                char (*grown)[64] = realloc(names, capacity * sizeof(*names));
+                if (grown == NULL)
+                    break;
+                names = grown;
+            }
+            strcpy(names[count++], de->d_name);
+        }
+        closedir(d);
+        if (!uploaded)
+        {
+            free(names);
+            return;
+        }
+
+        int rc = compact_day(cd, oldest, names, count);
+        free(names);
+        if (rc != 0)
+            return;  // stopping, or retried on the next pass
+    }
+}
+
+// Drop priority to the idle I/O class and nice 19 (this thread only)
+static void lower_priority(void)
+{
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0)
+        fprintf(stderr, "Warning: Compaction could not use the idle I/O class: %s\n", strerror(errno));
+    setpriority(PRIO_PROCESS, (id_t)tid, 19);
+}
+
+// Compaction thread: one pass over every directory, then sleep
+static void* compact_thread(void *arg)
+{
+    (void)arg;
+    lower_priority();
+    do
+    {
+        for (int i = 0; i < g_dir_count && !stopping(); i++)
+            compact_dir(&g_dirs[i]);
+    } while (!pause_for(COMPACT_SCAN_SEC * 1000L));
+    return NULL;
+}
+
+// Parse the config lines and start the thread
+int compact_start(const char *default_dir)
+{
+    int iter = 0;
+    const char *args;
+    while ((args = config_next("compact", &iter)) != NULL)
+    {
+        if (g_dir_count >= COMPACT_MAX_DIRS)
+        {
+            fprintf(stderr, "Error: Too many compact lines (max %d)\n", COMPACT_MAX_DIRS);
+            return -1;
+        }
+        compact_dir_t *cd = &g_dirs[g_dir_count];
+        char value[32];
+        memset(cd, 0, sizeof(*cd));
+        if (!config_arg(args, "dir", cd->dir, sizeof(cd->dir)))
+            strncpy(cd->dir, default_dir, sizeof(cd->dir) - 1);
+        cd->after = config_arg(args, "after", value, sizeof(value)) ? parse_seconds(value)
+                                                                    : COMPACT_DEFAULT_AFTER_SEC;
+        cd->rate = config_arg_double(args, "rate", COMPACT_DEFAULT_RATE_KB) * 1024.0;
+        cd->any_upload = config_arg(args, "uploaded", value, sizeof(value)) && strcmp(value, "any") == 0;
+        if (cd->after < 0.0 || cd->rate <= 0.0)
+        {
+            fprintf(stderr, "Error: Invalid compact settings \"%s\"\n", args);
+            return -1;
+        }
+
+        // Leftovers of an interrupted run hold nothing that is not elsewhere
+        char archive_dir[560];
+        snprintf(archive_dir, sizeof(archive_dir), "%s/archive", cd->dir);
+        DIR *d = opendir(archive_dir);
+        struct dirent *de;
+        while (d != NULL && (de = readdir(d)) != NULL)
+        {
+            size_t len = strlen(de->d_name);
+            if (len > 10 && strcmp(de->d_name + len - 10, ".sdar.part") == 0)
+                unlinkat(dirfd(d), de->d_name, 0);
+        }
+        if (d != NULL)
+            closedir(d);
+
+        printf("Compaction: %s after %.0f s%s, %.0f KB/s\n", cd->dir, cd->after,
+               cd->any_upload ? "" : " once uploaded", cd->rate / 1024.0);
+        g_dir_count++;
+    }
+    if (g_dir_count == 0)
+        return 0;
+
+    g_stop = false;
+    if (pthread_create(&g_tid, NULL, compact_thread, NULL) != 0)
+    {
+        fprintf(stderr, "Error: Failed to create compaction thread\n");
+        return -1;
+    }
+    g_started = true;
+    return 0;
+}
+
+// Stop the thread
+void compact_stop(void)
+{
+    if (!g_started)
+        return;
+    pthread_mutex_lock(&g_mutex);
+    g_stop = true;
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_mutex);
+    pthread_join(g_tid, NULL);
+    g_started = false;
+}
+
+// Summary for STATUS
+void compact_status(char *buf, size_t len)
+{
+    pthread_mutex_lock(&g_mutex);
+    snprintf(buf, len, "archived=%llu,archives=%llu,errors=%llu",
+             (unsigned long long)g_archived, (unsigned long long)g_archives,
+             (unsigned long long)g_errors);
+    pthread_mutex_unlock(&g_mutex);
+}
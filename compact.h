@@ -0,0 +1,71 @@
+/*
+    Background compaction of old chunk files into daily archives.
+
+    Months of 2-second chunk files cost an inode each and make every
+    directory scan slow. A low-priority thread packs chunk files that are
+    older than a threshold and already uploaded into one compressed
+    archive per UTC day of their file time,
+    <dir>/archive/archive_YYYYMMDD.sdar, and then removes them.
+
+    A day is packed once all of it is older than the threshold and every
+    chunk file of it is uploaded, so it gets no more files and its archive
+    is written once rather than rebuilt on every pass as files age. (A
+    file that still turns up for an archived day, e.g. after a clock step,
+    rebuilds the archive.)
+
+    The thread runs in the idle I/O class at nice 19, only works while no
+    sink has a chunk queued or being written, and limits its own write
+    rate, so live chunks are never delayed.
+
+    Uploaded: the uploader writes the epoch time of the newest chunk file
+    it has uploaded (mtime, all older ones done) to <dir>/.uploaded.
+    Without that file nothing is compacted, unless uploaded=any.
+
+    Archive format (little-endian):
+        header   magic "SDAR", version u16, reserved u16, count u32,
+                 reserved u32, index_offset u64, index_size u64   (32 bytes)
+        members  one zlib stream per chunk file, as it was on disk
+        index    per member: offset u64, stored u32, size u32, crc32 u32,
+                 boot_id u64, seq_start u64, time_start u64,
+                 name_len u16, name
+    A member is found through the index and inflated on its own.
+
+    Atomicity: an archive is rebuilt as archive_YYYYMMDD.sdar.part (the
+    members of the previous version copied as they are, plus the new
+    ones), synced and renamed over the old one before any chunk file is
+    removed. After a crash the leftover .part is discarded; chunk files
+    already in the archive (same name, size and CRC) are just removed.
+
+    Configuration (one line per directory):
+        compact = dir=/data/DAD_Files after=7d rate=512 uploaded=mark|any
+    dir defaults to the output directory, after to 7d (s, m, h, d
+    suffixes), rate to COMPACT_DEFAULT_RATE_KB KB/s of archive writes.
+*/
+
+#ifndef COMPACT_H_
+#define COMPACT_H_
+
+#include <stddef.h>
+
+#define COMPACT_MAX_DIRS 4
+#define COMPACT_DEFAULT_AFTER_SEC (7 * 86400.0)
+#define COMPACT_DEFAULT_RATE_KB 512
+#define COMPACT_SCAN_SEC 600            // between passes over the directories
+#define COMPACT_IDLE_WAIT_MS 100        // retry interval while the sinks are busy
+#define COMPACT_MAGIC "SDAR"
+#define COMPACT_VERSION 1
+#define COMPACT_HEADER_SIZE 32
+#define COMPACT_UPLOAD_MARK ".uploaded"
+
+// Start the compaction thread for every "compact" config line.
+// default_dir is used when a line has no dir=. Returns 0 on success
+// (also when nothing is configured), -1 on invalid settings.
+int compact_start(const char *default_dir);
+
+// Stop the thread; a running archive is finished or discarded safely
+void compact_stop(void);
+
+// One-line summary for STATUS
+void compact_status(char *buf, size_t len);
+
+#endif /* COMPACT_H_ */
@@ -0,0 +1,159 @@
+/*
+    Configuration file for the logger (see config.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "config.h"
+
+typedef struct {
+    char key[CONFIG_MAX_KEY];
+    char value[CONFIG_MAX_VALUE];
+} config_entry_t;
+
+static config_entry_t g_entries[CONFIG_MAX_ENTRIES];
+static int g_entry_count = 0;
+
+// Strip leading and trailing whitespace in place
+static char* trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1]))
+        s[--len] = '\0';
+    return s;
+}
+
+// Load a configuration file
+int config_load(const char *path)
+{
+    char line[CONFIG_MAX_KEY + CONFIG_MAX_VALUE];
+    int line_no = 0;
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Failed to open config file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_no++;
+
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *text = trim(line);
+        if (*text == '\0')
+            continue;
+
+        char *eq = strchr(text, '=');
+        if (eq == NULL)
+        {
+            fprintf(stderr, "Error: %s:%d: expected 'key = value'\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        *eq = '\0';
+
+        if (g_entry_count >= CONFIG_MAX_ENTRIES)
+        {
+            fprintf(stderr, "Error: %s:%d: too many entries\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+
+        config_entry_t *e = &g_entries[g_entry_count++];
+        strncpy(e->key, trim(text), sizeof(e->key) - 1);
+        strncpy(e->value, trim(eq + 1), sizeof(e->value) - 1);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// Last value of key
+const char* config_get(const char *key)
+{
+    for (int i = g_entry_count - 1; i >= 0; i--)
+    {
+        if (strcmp(g_entries[i].key, key) == 0)
+            return g_entries[i].value;
+    }
+    return NULL;
+}
+
+// Next value of a repeated key
+const char* config_next(const char *key, int *iter)
+{
+    for (int i = *iter; i < g_entry_count; i++)
+    {
+        if (strcmp(g_entries[i].key, key) == 0)
+        {
+            *iter = i + 1;
+            return g_entries[i].value;
+        }
+    }
+    *iter = g_entry_count;
+    return NULL;
+}
+
+double config_get_double(const char *key, double def)
+{
+    const char *v = config_get(key);
+    return v ? atof(v) : def;
+}
+
+long config_get_long(const char *key, long def)
+{
+    const char *v = config_get(key);
+    return v ? strtol(v, NULL, 0) : def;
+}
+
+bool config_get_bool(const char *key, bool def)
+{
+    const char *v = config_get(key);
+    if (v == NULL)
+        return def;
+    return strcmp(v, "1") == 0 || strcmp(v, "true") == 0 ||
+           strcmp(v, "yes") == 0 || strcmp(v, "on") == 0;
+}
+
+// Look up "name=value" in a space-separated argument string
+bool config_arg(const char *args, const char *name, char *out, size_t out_len)
+{
+    size_t name_len = strlen(name);
+    const char *p = args;
+
+    while (p && *p)
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        const char *end = p;
+        while (*end && !isspace((unsigned char)*end))
+            end++;
+
+        if ((size_t)(end - p) > name_len && strncmp(p, name, name_len) == 0 && p[name_len] == '=')
+        {
+            size_t len = (size_t)(end - p) - name_len - 1;
+            if (len >= out_len)
+                len = out_len - 1;
+            memcpy(out, p + name_len + 1, len);
+            out[len] = '\0';
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
+
+double config_arg_double(const char *args, const char *name, double def)
+{
+    char value[64];
+    return config_arg(args, name, value, sizeof(value)) ? atof(value) : def;
+}
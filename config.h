@@ -0,0 +1,41 @@
+/*
+    Configuration file for the logger.
+
+    Format: one "key = value" per line, '#' starts a comment. Keys may
+    repeat (for example one "sink" line per output); config_get() returns
+    the last value and config_next() walks all of them in file order.
+
+    Values that carry several settings use space-separated "name=value"
+    arguments, read with config_arg() / config_arg_double().
+*/
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define CONFIG_MAX_ENTRIES 256
+#define CONFIG_MAX_KEY 64
+#define CONFIG_MAX_VALUE 512
+
+// Load a configuration file. Returns 0 on success, -1 on error.
+int config_load(const char *path);
+
+// Last value of key, or NULL if not set
+const char* config_get(const char *key);
+
+// Next value of a repeated key. Start with *iter = 0.
+const char* config_next(const char *key, int *iter);
+
+// Typed lookups with defaults
+double config_get_double(const char *key, double def);
+long config_get_long(const char *key, long def);
+bool config_get_bool(const char *key, bool def);
+
+// Look up "name=value" in a space-separated argument string. Copies the
+// value to out and returns true if found.
+bool config_arg(const char *args, const char *name, char *out, size_t out_len);
+double config_arg_double(const char *args, const char *name, double def);
+
+#endif /* CONFIG_H_ */
@@ -0,0 +1,176 @@
+/*
+    Online event detector (see detector.h)
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "detector.h"
+#include "config.h"
+
+// Configure one channel from its "detect" config line
+static void configure_channel(detector_channel_t *dc, const char *args, double rate)
+{
+    double sta = config_arg_double(args, "sta", 0.0);
+    double lta = config_arg_double(args, "lta", 0.0);
+
+    if (sta > 0.0 && lta > sta)
+    {
+        dc->sta_alpha = 1.0 / (sta * rate);
+        dc->lta_alpha = 1.0 / (lta * rate);
+        dc->warmup = (uint64_t)(lta * rate);
+        dc->ratio_on = config_arg_double(args, "on", 3.0);
+        dc->ratio_off = config_arg_double(args, "off", 1.5);
+        if (dc->sta_alpha > 1.0)
+            dc->sta_alpha = 1.0;
+    }
+    else if (sta > 0.0 || lta > 0.0)
+    {
+        fprintf(stderr, "Warning: detect ch=%u needs 0 < sta < lta, STA/LTA disabled\n", dc->channel);
+    }
+
+    dc->threshold = config_arg_double(args, "threshold", 0.0);
+    dc->slope_per_sample = config_arg_double(args, "slope", 0.0) / rate;
+    dc->hold = (uint64_t)(config_arg_double(args, "hold", DETECTOR_DEFAULT_HOLD_SEC) * rate);
+    dc->enabled = dc->sta_alpha > 0.0 || dc->threshold > 0.0 || dc->slope_per_sample > 0.0;
+}
+
+// Build the detector from the "detect" config lines
+int detector_configure(detector_t *det, const uint8_t *channels, uint32_t num_channels, double sample_rate)
+{
+    if (num_channels > DETECTOR_MAX_CHANNELS || sample_rate <= 0.0)
+        return -1;
+
+    memset(det, 0, sizeof(*det));
+    det->num_channels = num_channels;
+    for (uint32_t ch = 0; ch < num_channels; ch++)
+        det->channels[ch].channel = channels[ch];
+
+    const char *args;
+    int iter = 0;
+    while ((args = config_next("detect", &iter)) != NULL)
+    {
+        int hw_channel = (int)config_arg_double(args, "ch", -1);
+        for (uint32_t ch = 0; ch < num_channels; ch++)
+        {
+            if (channels[ch] == hw_channel)
+                configure_channel(&det->channels[ch], args, sample_rate);
+        }
+    }
+    return 0;
+}
+
+// True if any channel has a detector
+bool detector_enabled(const detector_t *det)
+{
+    for (uint32_t ch = 0; ch < det->num_channels; ch++)
+    {
+        if (det->channels[ch].enabled)
+            return true;
+    }
+    return false;
+}
+
+// Evaluate every criterion for one sample; returns the kinds that fired
+static uint8_t evaluate(detector_channel_t *dc, double x)
+{
+    uint8_t kinds = 0;
+
+    if (dc->sta_alpha > 0.0)
+    {
+        double energy = x * x;
+        dc->sta += (energy - dc->sta) * dc->sta_alpha;
+        dc->lta += (energy - dc->lta) * dc->lta_alpha;
+
+        if (dc->seen >= dc->warmup && dc->lta > 0.0)
+        {
+            double ratio = dc->sta / dc->lta;
+            if (!dc->sta_lta_on && ratio >= dc->ratio_on)
+                dc->sta_lta_on = true;
+            else if (dc->sta_lta_on && ratio < dc->ratio_off)
+                dc->sta_lta_on = false;
+        }
+        if (dc->sta_lta_on)
+            kinds |= SDAT_EVENT_STA_LTA;
+    }
+
+    if (dc->threshold > 0.0 && fabs(x) >= dc->threshold)
+        kinds |= SDAT_EVENT_THRESHOLD;
+
+    if (dc->slope_per_sample > 0.0 && dc->seen > 0 && fabs(x - dc->prev) >= dc->slope_per_sample)
+        kinds |= SDAT_EVENT_SLOPE;
+
+    dc->prev = x;
+    dc->seen++;
+    return kinds;
+}
+
+// Run over a block of interleaved frames
+void detector_process(detector_t *det, const double *frames, size_t frame_count,
+                      uint64_t first_index, detector_fn fn, void *user)
+{
+    uint32_t nch = det->num_channels;
+    detector_transition_t tr;
+
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        detector_channel_t *dc = &det->channels[ch];
+        if (!dc->enabled)
+            continue;
+
+        for (size_t f = 0; f < frame_count; f++)
+        {
+            double x = frames[f * nch + ch];
+            uint64_t index = first_index + f;
+            uint8_t kinds = evaluate(dc, x);
+
+            if (kinds)
+            {
+                if (!dc->active)
+                {
+                    dc->active = true;
+                    memset(&dc->current, 0, sizeof(dc->current));
+                    dc->current.onset = index;
+                    dc->current.channel = dc->channel;
+                    det->event_count++;
+                    tr.start = true;
+                    tr.event = dc->current;
+                    tr.event.kinds = kinds;
+                    tr.event.peak = fabs(x);
+                    if (fn)
+                        fn(&tr, user);
+                }
+                dc->current.kinds |= kinds;
+                dc->last_fired = index;
+            }
+
+            if (dc->active)
+            {
+                if (fabs(x) > dc->current.peak)
+                    dc->current.peak = fabs(x);
+
+                if (!kinds && index - dc->last_fired >= dc->hold)
+                {
+                    dc->active = false;
+                    dc->current.duration = (uint32_t)(dc->last_fired + 1 - dc->current.onset);
+                    tr.start = false;
+                    tr.event = dc->current;
+                    if (fn)
+                        fn(&tr, user);
+                }
+            }
+        }
+    }
+}
+
+// Events currently open
+uint32_t detector_open_events(const detector_t *det, sdat_event_t *events, uint32_t max_events)
+{
+    uint32_t n = 0;
+
+    for (uint32_t ch = 0; ch < det->num_channels && n < max_events; ch++)
+    {
+        if (det->channels[ch].active)
+            events[n++] = det->channels[ch].current;
+    }
+    return n;
+}
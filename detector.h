@@ -0,0 +1,86 @@
+/*
+    Online event detector run by the consumer on every block read from the
+    ring (after the DSP chain).
+
+    Per channel, any combination of:
+        STA/LTA     recursive short-term / long-term average of x^2;
+                    triggers when the ratio exceeds "on" and releases
+                    below "off"
+        threshold   |x| above an absolute level
+        slope       |dx/dt| above a rate of change (units per second)
+
+    An event opens at the first sample where any criterion fires and closes
+    once none has fired for "hold" seconds. Onset and end are exact sample
+    indices in the seq numbering.
+
+    Configuration, one "detect" line per channel:
+        detect = ch=4 sta=0.5 lta=10 on=3.0 off=1.5 threshold=2.5 slope=100 hold=0.5
+    Criteria whose parameter is missing are disabled.
+*/
+
+#ifndef DETECTOR_H_
+#define DETECTOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdat.h"
+
+#define DETECTOR_MAX_CHANNELS 8
+#define DETECTOR_DEFAULT_HOLD_SEC 0.5
+
+// A trigger transition reported by detector_process()
+typedef struct {
+    bool start;              // true when the event opens, false when it closes
+    sdat_event_t event;      // duration is set on close
+} detector_transition_t;
+
+typedef void (*detector_fn)(const detector_transition_t *transition, void *user);
+
+typedef struct {
+    bool enabled;
+    uint8_t channel;         // hardware channel
+
+    // Parameters
+    double sta_alpha;        // 1 / STA length in samples, 0 = disabled
+    double lta_alpha;
+    uint64_t warmup;         // samples before STA/LTA may trigger
+    double ratio_on;
+    double ratio_off;
+    double threshold;        // 0 = disabled
+    double slope_per_sample; // 0 = disabled
+    uint64_t hold;           // samples
+
+    // State
+    double sta;
+    double lta;
+    double prev;
+    uint64_t seen;
+    bool sta_lta_on;
+    bool active;
+    uint64_t last_fired;
+    sdat_event_t current;
+} detector_channel_t;
+
+typedef struct {
+    uint32_t num_channels;
+    detector_channel_t channels[DETECTOR_MAX_CHANNELS];
+    uint64_t event_count;
+} detector_t;
+
+// Build the detector from the "detect" config lines for the given scan
+// channels and rate. Clears all state.
+int detector_configure(detector_t *det, const uint8_t *channels, uint32_t num_channels, double sample_rate);
+
+// True if any channel has a detector
+bool detector_enabled(const detector_t *det);
+
+// Run over a block of interleaved frames whose first frame has sample
+// index first_index. Calls fn for every event that opens or closes.
+void detector_process(detector_t *det, const double *frames, size_t frame_count,
+                      uint64_t first_index, detector_fn fn, void *user);
+
+// Events currently open, for tagging a new chunk. Returns the count.
+uint32_t detector_open_events(const detector_t *det, sdat_event_t *events, uint32_t max_events);
+
+#endif /* DETECTOR_H_ */
@@ -0,0 +1,360 @@
+/*
+    MCC 118 discovery and warm standby (see device.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <daqhats/daqhats.h>
+#include <daqhats/mcc118.h>
+#include "device.h"
+#include "config.h"
+#include "util.h"
+
+// Configured cache file, NULL if disabled
+static const char* cache_path(void)
+{
+    const char *path = config_get("device_cache");
+    if (path == NULL)
+        return DEVICE_DEFAULT_CACHE;
+    return strcmp(path, "off") == 0 ? NULL : path;
+}
+
+// Read "address=N serial=S" from the cache
+static bool cache_load(uint8_t *address, char *serial)
+{
+    const char *path = cache_path();
+    FILE *f = path ? fopen(path, "r") : NULL;
+    if (f == NULL)
+        return false;
+
+    char line[128];
+    char value[DEVICE_SERIAL_LEN];
+    bool ok = fgets(line, sizeof(line), f) != NULL &&
+              config_arg(line, "address", value, sizeof(value)) &&
+              config_arg(line, "serial", serial, DEVICE_SERIAL_LEN);
+    fclose(f);
+    if (!ok)
+        return false;
+
+    serial[strcspn(serial, "\r\n")] = '\0';
+    int addr = atoi(value);
+    if (addr < 0 || addr > DEVICE_MAX_ADDRESS)
+        return false;
+    *address = (uint8_t)addr;
+    return true;
+}
+
+// Remember the board for the next start (written whole, then renamed)
+static void cache_store(const device_t *dev)
+{
+    const char *path = cache_path();
+    if (path == NULL)
+        return;
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Warning: Cannot write device cache %s\n", tmp);
+        return;
+    }
+    fprintf(f, "address=%u serial=%s\n", dev->address, dev->serial);
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+    {
+        fprintf(stderr, "Warning: Cannot write device cache %s\n", path);
+        remove(tmp);
+    }
+}
+
+// Open address and read its serial number
+static int open_address(device_t *dev, uint8_t address)
+{
+    if (mcc118_open(address) != RESULT_SUCCESS)
+        return -1;
+    if (mcc118_serial(address, dev->serial) != RESULT_SUCCESS)
+    {
+        mcc118_close(address);
+        return -1;
+    }
+    dev->address = address;
+    dev->is_open = true;
+    return 0;
+}
+
+// Enumerate the MCC 118 boards and open the configured one
+static int discover(device_t *dev, const char *want_serial)
+{
+    int count = hat_list(HAT_ID_MCC_118, NULL);
+    if (count <= 0)
+    {
+        fprintf(stderr, "Error: No MCC 118 device found\n");
+        return -1;
+    }
+    struct HatInfo *hats = (struct HatInfo*)malloc((size_t)count * sizeof(struct HatInfo));
+    if (hats == NULL)
+        return -1;
+    hat_list(HAT_ID_MCC_118, hats);
+
+    int result = -1;
+    if (want_serial == NULL && count > 1)
+    {
+        fprintf(stderr, "Error: %d MCC 118 devices found; set hat_address or hat_serial:\n", count);
+        for (int i = 0; i < count; i++)
+            fprintf(stderr, "  address %u: %s\n", hats[i].address, hats[i].product_name);
+    }
+    else if (want_serial == NULL)
+    {
+        result = open_address(dev, hats[0].address);
+    }
+    else
+    {
+        for (int i = 0; i < count && result != 0; i++)
+        {
+            if (open_address(dev, hats[i].address) != 0)
+                continue;
+            if (strcmp(dev->serial, want_serial) == 0)
+                result = 0;
+            else
+            {
+                mcc118_close(hats[i].address);
+                dev->is_open = false;
+            }
+        }
+        if (result != 0)
+            fprintf(stderr, "Error: No MCC 118 with serial %s\n", want_serial);
+    }
+    free(hats);
+    return result;
+}
+
+// Find and open the board
+int device_open(device_t *dev)
+{
+    double start = now_mono();
+    memset(dev, 0, sizeof(*dev));
+    
+    const char *source = config_get("source");
+    if (source != NULL && strcmp(source, "synthetic") == 0)
+    {
+        dev->source = DEVICE_SYNTHETIC;
+        strcpy(dev->serial, "SYNTHETIC");
+        dev->is_open = true;
+        printf("Device: synthetic source (sample values count frames)\n");
+        return 0;
+    }
+    if (source != NULL && strcmp(source, "mcc118") != 0)
+    {
+        fprintf(stderr, "Error: Unknown source: %s (mcc118 or synthetic)\n", source);
+        return -1;
+    }
+
+    const char *want_serial = config_get("hat_serial");
+    const char *address = config_get("hat_address");
+    if (address != NULL)
+    {
+        long addr = config_get_long("hat_address", -1);
+        if (addr < 0 || addr > DEVICE_MAX_ADDRESS)
+        {
+            fprintf(stderr, "Error: Invalid hat_address %s (0 to %d)\n", address, DEVICE_MAX_ADDRESS);
+            return -1;
+        }
+        if (open_address(dev, (uint8_t)addr) != 0)
+        {
+            fprintf(stderr, "Error: Cannot open MCC 118 at address %ld\n", addr);
+            return -1;
+        }
+        if (want_serial != NULL && strcmp(dev->serial, want_serial) != 0)
+        {
+            fprintf(stderr, "Error: MCC 118 at address %ld has serial %s, not %s\n",
+                    addr, dev->serial, want_serial);
+            device_close(dev);
+            return -1;
+        }
+    }
+    else
+    {
+        // The cached board is used if it is still there and still wanted
+        uint8_t cached_address;
+        char cached_serial[DEVICE_SERIAL_LEN];
+        if (cache_load(&cached_address, cached_serial) &&
+            (want_serial == NULL || strcmp(cached_serial, want_serial) == 0) &&
+            open_address(dev, cached_address) == 0)
+        {
+            dev->from_cache = strcmp(dev->serial, cached_serial) == 0;
+            if (!dev->from_cache)
+                device_close(dev);
+        }
+        if (!dev->from_cache)
+        {
+            if (discover(dev, want_serial) != 0)
+                return -1;
+            cache_store(dev);
+        }
+    }
+
+    // Only a scan that is really running needs stopping
+    uint16_t status = 0;
+    if (mcc118_a_in_scan_status(dev->address, &status, NULL) == RESULT_SUCCESS)
+    {
+        mcc118_a_in_scan_stop(dev->address);
+        mcc118_a_in_scan_cleanup(dev->address);
+        dev->stale_scan = true;
+    }
+
+    dev->open_ms = (now_mono() - start) * 1000.0;
+    printf("Device: MCC 118 at address %u, serial %s (%s, %.1f ms)%s\n",
+           dev->address, dev->serial, dev->from_cache ? "cached" : "discovered", dev->open_ms,
+           dev->stale_scan ? ", stopped a stale scan" : "");
+    return 0;
+}
+
+// The synthetic source accepts what the MCC 118 can scan
+static bool synthetic_rate_ok(uint8_t num_channels, double rate)
+{
+    return num_channels > 0 && rate > 0.0 && rate * num_channels <= DEVICE_MAX_AGGREGATE_RATE;
+}
+
+// Validate the next scan's parameters
+int device_prepare(device_t *dev, uint8_t channel_mask, uint8_t num_channels, double rate)
+{
+    dev->channel_mask = channel_mask;
+    dev->num_channels = num_channels;
+    dev->requested_rate = rate;
+    dev->actual_rate = 0.0;
+    if (dev->source == DEVICE_SYNTHETIC)
+    {
+        dev->actual_rate = synthetic_rate_ok(num_channels, rate) ? rate : 0.0;
+        return dev->actual_rate > 0.0 ? 0 : -1;
+    }
+    if (mcc118_a_in_scan_actual_rate(num_channels, rate, &dev->actual_rate) != RESULT_SUCCESS)
+    {
+        dev->actual_rate = 0.0;
+        return -1;
+    }
+    return 0;
+}
+
+// Actual rate, from the standby state when prepared for this rate
+double device_actual_rate(device_t *dev, double rate)
+{
+    if (rate != dev->requested_rate || dev->actual_rate <= 0.0)
+        device_prepare(dev, dev->channel_mask, dev->num_channels, rate);
+    return dev->actual_rate > 0.0 ? dev->actual_rate : rate;
+}
+
+// Check a rate without touching the standby state
+bool device_rate_supported(const device_t *dev, double rate)
+{
+    double actual;
+    if (dev->source == DEVICE_SYNTHETIC)
+        return synthetic_rate_ok(dev->num_channels, rate);
+    return mcc118_a_in_scan_actual_rate(dev->num_channels, rate, &actual) == RESULT_SUCCESS;
+}
+
+// Start a scan
+int device_scan_start(device_t *dev, uint8_t channel_mask, uint32_t frames, double rate, uint32_t options)
+{
+    if (dev->source == DEVICE_MCC118)
+    {
+        int result = mcc118_a_in_scan_start(dev->address, channel_mask, frames, rate, options);
+        dev->scanning = result == RESULT_SUCCESS;
+        return result;
+    }
+    
+    uint8_t num_channels = 0;
+    for (uint8_t mask = channel_mask; mask != 0; mask &= (uint8_t)(mask - 1))
+        num_channels++;
+    if (dev->scanning)
+        return RESULT_BUSY;
+    if (!synthetic_rate_ok(num_channels, rate))
+        return RESULT_BAD_PARAMETER;
+    dev->num_channels = num_channels;
+    dev->scan_t0 = now_mono();
+    dev->scan_frames = 0;
+    dev->scan_total = (options & OPTS_CONTINUOUS) ? 0 : frames;
+    dev->scan_rate = rate;
+    dev->scanning = true;
+    return RESULT_SUCCESS;
+}
+
+// Generate the synthetic frames that are due
+static int synthetic_read(device_t *dev, uint16_t *status, double *buf,
+                          uint32_t max_frames, uint32_t *frames_read)
+{
+    uint64_t due = (uint64_t)((now_mono() - dev->scan_t0) * dev->scan_rate);
+    if (dev->scan_total && due > dev->scan_total)
+        due = dev->scan_total;
+    
+    uint64_t frames = due > dev->scan_frames ? due - dev->scan_frames : 0;
+    if (frames > max_frames)
+        frames = max_frames;
+    for (uint64_t i = 0; i < frames; i++)
+    {
+        for (uint8_t ch = 0; ch < dev->num_channels; ch++)
+            buf[i * dev->num_channels + ch] = (double)(dev->scan_frames + i) + 0.001 * ch;
+    }
+    dev->scan_frames += frames;
+    *frames_read = (uint32_t)frames;
+    *status = (dev->scan_total && dev->scan_frames >= dev->scan_total) ? 0 : STATUS_RUNNING;
+    return RESULT_SUCCESS;
+}
+
+// Read from the running scan
+int device_scan_read(device_t *dev, uint16_t *status, double *buf,
+                     uint32_t max_frames, uint32_t *frames_read)
+{
+    *frames_read = 0;
+    if (dev->source == DEVICE_SYNTHETIC)
+        return dev->scanning ? synthetic_read(dev, status, buf, max_frames, frames_read)
+                             : RESULT_RESOURCE_UNAVAIL;
+    // -1 samples per channel: everything available, without waiting
+    return mcc118_a_in_scan_read(dev->address, status, -1, 0.0, buf,
+                                 max_frames * dev->num_channels, frames_read);
+}
+
+// Stop the scan; the synthetic position stays for a handover
+void device_scan_stop(device_t *dev)
+{
+    if (dev->source == DEVICE_MCC118)
+    {
+        mcc118_a_in_scan_stop(dev->address);
+        mcc118_a_in_scan_cleanup(dev->address);
+    }
+    dev->scanning = false;
+}
+
+// Continue a handed-over scan
+int device_scan_resume(device_t *dev, double scan_t0, uint64_t scan_frames, double rate)
+{
+    if (dev->source == DEVICE_MCC118)
+    {
+        // The daqhats scan thread ended with the old process: start anew
+        return device_scan_start(dev, dev->channel_mask, 0, rate, OPTS_CONTINUOUS);
+    }
+    if (!synthetic_rate_ok(dev->num_channels, rate))
+        return RESULT_BAD_PARAMETER;
+    dev->scan_t0 = scan_t0;
+    dev->scan_frames = scan_frames;
+    dev->scan_total = 0;
+    dev->scan_rate = rate;
+    dev->scanning = true;
+    return RESULT_SUCCESS;
+}
+
+// Close the board
+void device_close(device_t *dev)
+{
+    if (dev->is_open && dev->source == DEVICE_MCC118)
+        mcc118_close(dev->address);
+    dev->is_open = false;
+}
+
+// Summary for STATUS
+void device_status(const device_t *dev, bool scanning, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s(addr=%u,serial=%s,rate=%.2f)",
+             !dev->is_open ? "closed" : scanning ? "scanning" : "standby",
+             dev->address, dev->serial, dev->actual_rate);
+}
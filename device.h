@@ -0,0 +1,107 @@
+/*
+    MCC 118 discovery, opening and warm standby.
+
+    The logger runs as a headless service, so choosing the board never
+    prompts. The board is found in this order:
+        hat_address = 0..7          use that address, no enumeration
+        hat_serial = <serial>       the board with this serial number
+        (neither)                   the only MCC 118; several are an error
+    The address and serial found are cached in device_cache (default
+    DEVICE_DEFAULT_CACHE, "off" to disable). On the next start the cached
+    address is opened directly and only its serial number is checked; the
+    HAT list is enumerated again only when that check fails.
+
+    After opening, the device is kept in warm standby between captures:
+    open, no scan, the read buffer allocated and the scan parameters
+    (channels and rate) already validated with the driver, so START only
+    has to start the scan. A scan left behind by a crashed process is
+    stopped only if one is actually running.
+
+    Synthetic source: with "source = synthetic" no board is used. A
+    clock-driven generator stands in for the scan: sample k of a scan is
+    due at t0 + k / rate, and its value is k (plus 0.001 x its position in
+    the frame), so lost or repeated samples show up directly in the data.
+    Its scan position can be handed to another process (see upgrade.h).
+
+    Configuration:
+        source = mcc118 | synthetic     default mcc118
+        hat_address = 0
+        hat_serial = 01234567
+        device_cache = /tmp/sensor_device.cache
+*/
+
+#ifndef DEVICE_H_
+#define DEVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEVICE_DEFAULT_CACHE "/tmp/sensor_device.cache"
+#define DEVICE_MAX_ADDRESS 7
+#define DEVICE_SERIAL_LEN 16
+#define DEVICE_MAX_AGGREGATE_RATE 100000.0  // MCC 118 samples/s over all channels
+
+typedef enum {
+    DEVICE_MCC118,
+    DEVICE_SYNTHETIC
+} device_source_t;
+
+typedef struct {
+    device_source_t source;
+    uint8_t address;
+    char serial[DEVICE_SERIAL_LEN];
+    bool is_open;
+    bool from_cache;                // found through the cache, no enumeration
+    bool stale_scan;                // a scan from an earlier process was stopped
+    double open_ms;                 // discovery and open
+    // Standby: parameters validated for the next scan
+    uint8_t channel_mask;
+    uint8_t num_channels;
+    double requested_rate;
+    double actual_rate;             // 0 if the driver rejected requested_rate
+    // Running scan
+    bool scanning;
+    double scan_t0;                 // monotonic time of frame 0 (synthetic)
+    uint64_t scan_frames;           // frames read since frame 0 (synthetic)
+    uint64_t scan_total;            // 0 = continuous (synthetic)
+    double scan_rate;
+} device_t;
+
+// Find and open the board as configured. Returns 0 or -1 (reported).
+int device_open(device_t *dev);
+
+// Validate a scan of num_channels channels at rate and keep the result
+// for device_actual_rate(). Returns 0, or -1 if the driver rejects it.
+int device_prepare(device_t *dev, uint8_t channel_mask, uint8_t num_channels, double rate);
+
+// Actual scan rate for rate, from the standby state when it matches
+double device_actual_rate(device_t *dev, double rate);
+
+// True if the driver accepts a scan of the prepared channels at rate
+bool device_rate_supported(const device_t *dev, double rate);
+
+// Start a scan: frames per channel (0 with OPTS_CONTINUOUS), daqhats
+// options. Returns a daqhats result code.
+int device_scan_start(device_t *dev, uint8_t channel_mask, uint32_t frames, double rate, uint32_t options);
+
+// Read what the scan has buffered, at most max_frames frames, without
+// waiting. Returns a daqhats result code.
+int device_scan_read(device_t *dev, uint16_t *status, double *buf,
+                     uint32_t max_frames, uint32_t *frames_read);
+
+// Stop the scan and release its resources
+void device_scan_stop(device_t *dev);
+
+// Continue a scan handed over by another process. The synthetic source
+// resumes at frame scan_frames of the scan that started at scan_t0; the
+// board starts a new scan. Returns a daqhats result code.
+int device_scan_resume(device_t *dev, double scan_t0, uint64_t scan_frames, double rate);
+
+// Close the board
+void device_close(device_t *dev);
+
+// One-line summary for STATUS
+void device_status(const device_t *dev, bool scanning, char *buf, size_t len);
+
+#endif /* DEVICE_H_ */
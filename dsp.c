@@ -0,0 +1,278 @@
+/*
+    Streaming per-channel DSP chain (see dsp.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+#include "config.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef enum { BIQUAD_LOWPASS, BIQUAD_HIGHPASS, BIQUAD_NOTCH } biquad_type_t;
+
+// Set channel ch of a section to a pass-through
+static void section_identity(dsp_section_t *sec, uint32_t ch)
+{
+    sec->b0[ch] = 1.0;
+    sec->b1[ch] = 0.0;
+    sec->b2[ch] = 0.0;
+    sec->a1[ch] = 0.0;
+    sec->a2[ch] = 0.0;
+}
+
+// RBJ audio EQ cookbook biquad design, normalized by a0
+static int section_design(dsp_section_t *sec, uint32_t ch, biquad_type_t type,
+                          double freq, double q, double rate)
+{
+    if (freq <= 0.0 || freq >= rate / 2.0)
+    {
+        fprintf(stderr, "Warning: DSP filter at %.2f Hz is outside (0, %.2f) Hz, skipped\n",
+                freq, rate / 2.0);
+        return -1;
+    }
+
+    double w0 = 2.0 * M_PI * freq / rate;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    double a0 = 1.0 + alpha;
+    double b0, b1, b2;
+
+    switch (type)
+    {
+    case BIQUAD_LOWPASS:
+        b0 = (1.0 - cw) / 2.0;
+        b1 = 1.0 - cw;
+        b2 = (1.0 - cw) / 2.0;
+        break;
+    case BIQUAD_HIGHPASS:
+        b0 = (1.0 + cw) / 2.0;
+        b1 = -(1.0 + cw);
+        b2 = (1.0 + cw) / 2.0;
+        break;
+    default:
+        b0 = 1.0;
+        b1 = -2.0 * cw;
+        b2 = 1.0;
+        break;
+    }
+
+    sec->b0[ch] = b0 / a0;
+    sec->b1[ch] = b1 / a0;
+    sec->b2[ch] = b2 / a0;
+    sec->a1[ch] = -2.0 * cw / a0;
+    sec->a2[ch] = (1.0 - alpha) / a0;
+    return 0;
+}
+
+// Append a section for one channel; sections are shared across channels
+static void add_section(dsp_chain_t *chain, uint32_t *used, uint32_t ch,
+                        biquad_type_t type, double freq, double q)
+{
+    if (*used >= DSP_MAX_SECTIONS)
+    {
+        fprintf(stderr, "Warning: DSP chain limited to %d sections per channel\n", DSP_MAX_SECTIONS);
+        return;
+    }
+    if (section_design(&chain->sections[*used], ch, type, freq, q, chain->sample_rate) == 0)
+    {
+        (*used)++;
+        if (*used > chain->num_sections)
+            chain->num_sections = *used;
+    }
+}
+
+// Configure one channel from its "dsp" config line
+static void configure_channel(dsp_chain_t *chain, uint32_t ch, const char *args)
+{
+    char value[128];
+    uint32_t used = 0;
+
+    double hp = config_arg_double(args, "hp", 0.0);
+    if (hp > 0.0)
+        add_section(chain, &used, ch, BIQUAD_HIGHPASS, hp, DSP_BUTTERWORTH_Q);
+
+    if (config_arg(args, "notch", value, sizeof(value)))
+    {
+        double q = config_arg_double(args, "notch_q", DSP_DEFAULT_NOTCH_Q);
+        char *save = NULL;
+        for (char *tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+            add_section(chain, &used, ch, BIQUAD_NOTCH, atof(tok), q);
+    }
+
+    double lp = config_arg_double(args, "lp", 0.0);
+    if (lp > 0.0)
+        add_section(chain, &used, ch, BIQUAD_LOWPASS, lp, DSP_BUTTERWORTH_Q);
+
+    if (config_arg(args, "cal", value, sizeof(value)))
+    {
+        uint32_t n = 0;
+        char *save = NULL;
+        for (uint32_t k = 0; k < DSP_MAX_POLY; k++)
+            chain->poly[k][ch] = 0.0;
+        for (char *tok = strtok_r(value, ",", &save); tok && n < DSP_MAX_POLY; tok = strtok_r(NULL, ",", &save))
+            chain->poly[n++][ch] = atof(tok);
+        if (n > chain->poly_order)
+            chain->poly_order = n;
+    }
+}
+
+// Clear a chain to pass-through for every channel and section
+static void chain_reset(dsp_chain_t *chain, uint32_t num_channels, double sample_rate)
+{
+    memset(chain, 0, sizeof(*chain));
+    chain->num_channels = num_channels;
+    chain->sample_rate = sample_rate;
+
+    // Every channel starts as pass-through in every section, with the
+    // identity polynomial y = x
+    for (uint32_t s = 0; s < DSP_MAX_SECTIONS; s++)
+        for (uint32_t ch = 0; ch < DSP_MAX_CHANNELS; ch++)
+            section_identity(&chain->sections[s], ch);
+    for (uint32_t ch = 0; ch < DSP_MAX_CHANNELS; ch++)
+        chain->poly[1][ch] = 1.0;
+}
+
+// Build the chain from the "dsp" config lines
+int dsp_configure(dsp_chain_t *chain, const uint8_t *channels, uint32_t num_channels, double sample_rate)
+{
+    if (num_channels > DSP_MAX_CHANNELS)
+        return -1;
+
+    chain_reset(chain, num_channels, sample_rate);
+
+    const char *args;
+    int iter = 0;
+    while ((args = config_next("dsp", &iter)) != NULL)
+    {
+        int hw_channel = (int)config_arg_double(args, "ch", -1);
+        for (uint32_t ch = 0; ch < num_channels; ch++)
+        {
+            if (channels[ch] == hw_channel)
+                configure_channel(chain, ch, args);
+        }
+    }
+
+    // Channels without "cal" keep y = x, which needs at least two terms
+    if (chain->poly_order == 1)
+        chain->poly_order = 2;
+    return 0;
+}
+
+// Build a Butterworth low-pass of the given even order on every channel
+int dsp_configure_lowpass(dsp_chain_t *chain, uint32_t num_channels, double sample_rate,
+                          double cutoff, uint32_t order)
+{
+    if (num_channels > DSP_MAX_CHANNELS || order == 0 || order % 2 != 0 || order / 2 > DSP_MAX_SECTIONS)
+        return -1;
+
+    chain_reset(chain, num_channels, sample_rate);
+
+    // Section k gets the Q of pole pair k: 1 / (2 cos((2k + 1) pi / (2 order)))
+    for (uint32_t k = 0; k < order / 2; k++)
+    {
+        double q = 1.0 / (2.0 * cos((2.0 * k + 1.0) * M_PI / (2.0 * order)));
+        uint32_t used = k;
+        for (uint32_t ch = 0; ch < num_channels; ch++)
+        {
+            used = k;
+            add_section(chain, &used, ch, BIQUAD_LOWPASS, cutoff, q);
+        }
+        if (chain->num_sections != k + 1)
+            return -1;
+    }
+    return 0;
+}
+
+// True if the chain changes the samples at all
+bool dsp_enabled(const dsp_chain_t *chain)
+{
+    return chain->num_sections > 0 || chain->poly_order > 0;
+}
+
+// One biquad section over a block of interleaved frames
+static void biquad_block(dsp_section_t *restrict sec, double *restrict x,
+                         size_t frames, uint32_t nch)
+{
+    double z1[DSP_MAX_CHANNELS], z2[DSP_MAX_CHANNELS];
+    memcpy(z1, sec->z1, sizeof(z1));
+    memcpy(z2, sec->z2, sizeof(z2));
+
+    for (size_t f = 0; f < frames; f++)
+    {
+        double *frame = x + f * nch;
+        for (uint32_t c = 0; c < nch; c++)
+        {
+            double in = frame[c];
+            double out = sec->b0[c] * in + z1[c];
+            z1[c] = sec->b1[c] * in - sec->a1[c] * out + z2[c];
+            z2[c] = sec->b2[c] * in - sec->a2[c] * out;
+            frame[c] = out;
+        }
+    }
+
+    memcpy(sec->z1, z1, sizeof(z1));
+    memcpy(sec->z2, z2, sizeof(z2));
+}
+
+// Single-channel specialization: the state stays in registers
+static void biquad_block_mono(dsp_section_t *restrict sec, double *restrict x, size_t frames)
+{
+    double b0 = sec->b0[0], b1 = sec->b1[0], b2 = sec->b2[0];
+    double a1 = sec->a1[0], a2 = sec->a2[0];
+    double z1 = sec->z1[0], z2 = sec->z2[0];
+
+    for (size_t f = 0; f < frames; f++)
+    {
+        double in = x[f];
+        double out = b0 * in + z1;
+        z1 = b1 * in - a1 * out + z2;
+        z2 = b2 * in - a2 * out;
+        x[f] = out;
+    }
+
+    sec->z1[0] = z1;
+    sec->z2[0] = z2;
+}
+
+// Calibration polynomial (Horner) over a block of interleaved frames
+static void poly_block(const dsp_chain_t *restrict chain, double *restrict x, size_t frames, uint32_t nch)
+{
+    uint32_t order = chain->poly_order;
+
+    for (size_t f = 0; f < frames; f++)
+    {
+        double *frame = x + f * nch;
+        for (uint32_t c = 0; c < nch; c++)
+        {
+            double in = frame[c];
+            double acc = chain->poly[order - 1][c];
+            for (int k = (int)order - 2; k >= 0; k--)
+                acc = acc * in + chain->poly[k][c];
+            frame[c] = acc;
+        }
+    }
+}
+
+// Filter a block of interleaved frames in place
+void dsp_process(dsp_chain_t *chain, double *frames, size_t frame_count)
+{
+    uint32_t nch = chain->num_channels;
+
+    if (frame_count == 0 || nch == 0)
+        return;
+
+    for (uint32_t s = 0; s < chain->num_sections; s++)
+    {
+        if (nch == 1)
+            biquad_block_mono(&chain->sections[s], frames, frame_count);
+        else
+            biquad_block(&chain->sections[s], frames, frame_count, nch);
+    }
+
+    if (chain->poly_order > 0)
+        poly_block(chain, frames, frame_count, nch);
+}
@@ -0,0 +1,71 @@
+/*
+    Streaming per-channel DSP chain applied by the consumer to every block
+    read from the ring, before the samples are assembled into chunks.
+
+    Per channel: high-pass (DC removal), any number of notches, low-pass,
+    all as cascaded biquads, followed by a calibration polynomial to
+    engineering units. Filter state lives in the chain and is carried
+    across blocks and chunks, so chunk boundaries leave no artifacts.
+
+    Configuration, one "dsp" line per channel:
+        dsp = ch=4 hp=0.5 notch=50,100 notch_q=30 lp=45 cal=0.0,1.0
+    hp/lp are cutoff frequencies in Hz (Butterworth, Q = 0.707), notch is a
+    comma-separated list of centre frequencies, cal the polynomial
+    coefficients c0,c1,c2,... so that y = c0 + c1*x + c2*x^2 + ...
+
+    Kernels work on blocks of interleaved frames and loop over channels in
+    the innermost loop. Every channel runs the same number of sections
+    (unused ones are pass-through), so that loop has no branches and is
+    vectorized by the compiler (NEON/SSE).
+*/
+
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DSP_MAX_CHANNELS 8
+#define DSP_MAX_SECTIONS 8
+#define DSP_MAX_POLY 6
+#define DSP_BUTTERWORTH_Q 0.70710678118654752
+#define DSP_DEFAULT_NOTCH_Q 30.0
+
+// One biquad section for all channels (transposed direct form II)
+typedef struct {
+    double b0[DSP_MAX_CHANNELS];
+    double b1[DSP_MAX_CHANNELS];
+    double b2[DSP_MAX_CHANNELS];
+    double a1[DSP_MAX_CHANNELS];
+    double a2[DSP_MAX_CHANNELS];
+    double z1[DSP_MAX_CHANNELS];
+    double z2[DSP_MAX_CHANNELS];
+} dsp_section_t;
+
+typedef struct {
+    uint32_t num_channels;
+    uint32_t num_sections;
+    uint32_t poly_order;         // number of calibration coefficients, 0 = none
+    double sample_rate;
+    dsp_section_t sections[DSP_MAX_SECTIONS];
+    double poly[DSP_MAX_POLY][DSP_MAX_CHANNELS];
+} dsp_chain_t;
+
+// Build the chain for the given scan channels and rate from the "dsp"
+// config lines. Clears all filter state. Returns 0 on success.
+int dsp_configure(dsp_chain_t *chain, const uint8_t *channels, uint32_t num_channels, double sample_rate);
+
+// Build an anti-aliasing Butterworth low-pass of the given even order
+// (at most 2 * DSP_MAX_SECTIONS) on every channel, without calibration.
+// Used by decimators. Returns 0 on success.
+int dsp_configure_lowpass(dsp_chain_t *chain, uint32_t num_channels, double sample_rate,
+                          double cutoff, uint32_t order);
+
+// True if the chain changes the samples at all
+bool dsp_enabled(const dsp_chain_t *chain);
+
+// Filter a block of interleaved frames in place
+void dsp_process(dsp_chain_t *chain, double *frames, size_t frame_count);
+
+#endif /* DSP_H_ */
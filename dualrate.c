@@ -0,0 +1,379 @@
+/*
+    Dual-rate recording (see dualrate.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dualrate.h"
+#include "config.h"
+#include "budget.h"
+
+// Start a derived chunk that follows the metadata of its source
+static sdat_chunk_t* new_chunk(const dualrate_t *dr, uint16_t stream, uint32_t frames)
+{
+    sdat_chunk_t *chunk = sdat_chunk_create(frames * dr->num_channels);
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate %s chunk\n",
+                stream == DUALRATE_STREAM_LOW ? "low-rate" : "event window");
+        return NULL;
+    }
+    chunk->stream = stream;
+    if (stream == DUALRATE_STREAM_LOW)
+    {
+        chunk->decimation = dr->decimation;
+        chunk->sample_rate = dr->rate / dr->decimation;
+        strcpy(chunk->stream_name, "low");
+    }
+    else
+    {
+        chunk->decimation = 1;
+        chunk->sample_rate = dr->rate;
+        strcpy(chunk->stream_name, "events");
+    }
+    return chunk;
+}
+
+// Copy the source's events into a derived chunk
+static void merge_events(sdat_chunk_t *dst, const sdat_chunk_t *src)
+{
+    for (uint32_t k = 0; k < src->event_count; k++)
+    {
+        uint32_t i;
+        for (i = 0; i < dst->event_count; i++)
+        {
+            if (dst->events[i].onset == src->events[k].onset &&
+                dst->events[i].channel == src->events[k].channel)
+                break;
+        }
+        if (i == dst->event_count && dst->event_count >= SDAT_MAX_EVENTS)
+            continue;
+        dst->events[i] = src->events[k];
+        if (i == dst->event_count)
+            dst->event_count++;
+        dst->flags |= SDAT_FLAG_EVENT;
+    }
+}
+
+// Hand a derived chunk to the callback
+static void emit(dualrate_t *dr, sdat_chunk_t **chunk)
+{
+    if (*chunk == NULL || (*chunk)->sample_count == 0)
+        return;
+    if ((*chunk)->stream == DUALRATE_STREAM_LOW)
+        dr->low_chunks++;
+    else
+        dr->window_chunks++;
+    dr->fn(*chunk, dr->user);
+    *chunk = NULL;
+}
+
+// History, filter and chunk buffers for a scan
+size_t dualrate_memory(uint32_t num_channels, double rate, uint32_t chunk_frames)
+{
+    const char *args = config_get("dualrate");
+    uint32_t decimation = args ? (uint32_t)config_arg_double(args, "decimate", 0) : 0;
+    if (decimation < 2)
+        return 0;
+
+    double pre = config_arg_double(args, "pre", DUALRATE_DEFAULT_PRE_SEC);
+    uint64_t history_frames = pre > 0.0 ? (uint64_t)(pre * rate) : 1;
+    size_t frame_bytes = num_channels * sizeof(double);
+    return frame_bytes * ((size_t)chunk_frames + history_frames) +
+           sdat_chunk_footprint(chunk_frames / decimation * num_channels) +
+           sdat_chunk_footprint(chunk_frames * num_channels);
+}
+
+// Set up from the "dualrate" config line
+int dualrate_configure(dualrate_t *dr, uint32_t num_channels, double rate, uint32_t chunk_frames,
+                       dualrate_fn fn, void *user)
+{
+    dualrate_free(dr);
+
+    const char *args = config_get("dualrate");
+    if (args == NULL)
+        return 0;
+
+    uint32_t decimation = (uint32_t)config_arg_double(args, "decimate", 0);
+    double pre = config_arg_double(args, "pre", DUALRATE_DEFAULT_PRE_SEC);
+    double post = config_arg_double(args, "post", DUALRATE_DEFAULT_POST_SEC);
+    if (decimation < 2 || decimation > chunk_frames || pre < 0.0 || post < 0.0 || rate <= 0.0)
+    {
+        fprintf(stderr, "Error: Invalid dualrate settings (2 <= decimate <= samples per chunk, "
+                "pre and post >= 0)\n");
+        return -1;
+    }
+
+    double low_rate = rate / decimation;
+    if (dsp_configure_lowpass(&dr->aa, num_channels, rate, DUALRATE_AA_FRACTION * low_rate,
+                              DUALRATE_AA_ORDER) != 0)
+        return -1;
+
+    size_t bytes = dualrate_memory(num_channels, rate, chunk_frames);
+    if (budget_reserve(BUDGET_HISTORY, bytes, "dualrate history and buffers") != 0)
+        return -1;
+    dr->reserved = bytes;
+    dr->decimation = decimation;
+    dr->num_channels = num_channels;
+    dr->rate = rate;
+    dr->chunk_frames = chunk_frames;
+    dr->pre = (uint64_t)(pre * rate);
+    dr->post = (uint64_t)(post * rate);
+    dr->fn = fn;
+    dr->user = user;
+    dr->history_cap = dr->pre > 0 ? dr->pre : 1;
+
+    dr->filtered = (double*)malloc((size_t)chunk_frames * num_channels * sizeof(double));
+    dr->history = (double*)malloc((size_t)dr->history_cap * num_channels * sizeof(double));
+    if (dr->filtered == NULL || dr->history == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate dualrate buffers\n");
+        dualrate_free(dr);
+        return -1;
+    }
+
+    printf("Dual-rate: low stream at %.2f Hz (1/%u), event windows -%.2f s / +%.2f s\n",
+           low_rate, decimation, pre, post);
+    dr->enabled = true;
+    return 0;
+}
+
+// Hand over pending chunks and release buffers
+void dualrate_free(dualrate_t *dr)
+{
+    if (dr->enabled)
+    {
+        emit(dr, &dr->low);
+        emit(dr, &dr->win);
+    }
+    sdat_chunk_free(dr->low);
+    sdat_chunk_free(dr->win);
+    free(dr->filtered);
+    free(dr->history);
+    budget_release(BUDGET_HISTORY, dr->reserved);
+    memset(dr, 0, sizeof(*dr));
+}
+
+// Request a full-rate window starting at the next chunk
+void dualrate_trigger(dualrate_t *dr, double seconds)
+{
+    __atomic_store_n(&dr->trigger_ms, (uint64_t)(seconds * 1000.0), __ATOMIC_RELEASE);
+}
+
+// First full-rate frame of the chunks still being filled
+uint64_t dualrate_pending(const dualrate_t *dr)
+{
+    uint64_t pending = UINT64_MAX;
+    if (!dr->enabled)
+        return pending;
+    if (dr->low != NULL)
+        pending = dr->low->seq_start * dr->decimation;
+    if (dr->win != NULL && dr->win->seq_start < pending)
+        pending = dr->win->seq_start;
+    if (dr->window_open && dr->emit_pos < pending)
+        pending = dr->emit_pos;
+    return pending;
+}
+
+// Filter and decimate one source chunk into the low-rate stream
+static void process_low(dualrate_t *dr, const sdat_chunk_t *src, uint64_t start, uint32_t frames)
+{
+    uint32_t nch = dr->num_channels;
+    uint32_t low_frames = dr->chunk_frames / dr->decimation;
+
+    memcpy(dr->filtered, src->samples, (size_t)frames * nch * sizeof(double));
+    dsp_process(&dr->aa, dr->filtered, frames);
+
+    // Keep frames whose full-rate index is a multiple of the decimation
+    uint32_t first = (uint32_t)((dr->decimation - start % dr->decimation) % dr->decimation);
+    for (uint32_t f = first; f < frames; f += dr->decimation)
+    {
+        uint64_t low_index = (start + f) / dr->decimation;
+
+        // A jump in the scan (restart, new boot) starts a new chunk
+        if (dr->low && dr->low->seq_start + dr->low->sample_count / nch != low_index)
+            emit(dr, &dr->low);
+        if (dr->low == NULL)
+        {
+            dr->low = new_chunk(dr, DUALRATE_STREAM_LOW, low_frames);
+            if (dr->low == NULL)
+                return;
+            dr->low->seq_start = low_index;
+            dr->low->time_start = src->time_start;
+        }
+
+        sdat_chunk_t *low = dr->low;
+        memcpy(low->samples + low->sample_count, dr->filtered + (size_t)f * nch, nch * sizeof(double));
+        low->sample_count += nch;
+        low->device_id = src->device_id;
+        low->boot_id = src->boot_id;
+        low->time_end = src->time_end;
+
+        if (low->sample_count >= low_frames * nch)
+        {
+            merge_events(low, src);
+            emit(dr, &dr->low);
+        }
+    }
+    if (dr->low)
+        merge_events(dr->low, src);
+}
+
+// Frame at a full-rate index, from the source chunk or the history
+static const double* frame_at(const dualrate_t *dr, const sdat_chunk_t *src, uint64_t start, uint64_t index)
+{
+    if (index >= start)
+        return src->samples + (size_t)(index - start) * dr->num_channels;
+    return dr->history + (size_t)(index % dr->history_cap) * dr->num_channels;
+}
+
+// Copy window frames up to (not including) index until
+static void emit_window(dualrate_t *dr, const sdat_chunk_t *src, uint64_t start, uint64_t until)
+{
+    uint32_t nch = dr->num_channels;
+
+    while (dr->emit_pos < until)
+    {
+        if (dr->win == NULL)
+        {
+            dr->win = new_chunk(dr, DUALRATE_STREAM_EVENTS, dr->chunk_frames);
+            if (dr->win == NULL)
+                return;
+            dr->win->seq_start = dr->emit_pos;
+            dr->win->time_start = src->time_start;
+        }
+
+        sdat_chunk_t *win = dr->win;
+        memcpy(win->samples + win->sample_count, frame_at(dr, src, start, dr->emit_pos),
+               nch * sizeof(double));
+        win->sample_count += nch;
+        win->device_id = src->device_id;
+        win->boot_id = src->boot_id;
+        win->time_end = src->time_end;
+        dr->emit_pos++;
+
+        if (win->sample_count >= dr->chunk_frames * nch)
+        {
+            merge_events(win, src);
+            emit(dr, &dr->win);
+        }
+    }
+    if (dr->win)
+        merge_events(dr->win, src);
+}
+
+// Extend the open window to cover [from, to), or close it and open another
+static void add_window(dualrate_t *dr, const sdat_chunk_t *src, uint64_t start, uint64_t from, uint64_t to)
+{
+    if (dr->window_open && from <= dr->window_end)
+    {
+        if (to > dr->window_end)
+            dr->window_end = to;
+        return;
+    }
+
+    if (dr->window_open)
+    {
+        emit_window(dr, src, start, dr->window_end);
+        emit(dr, &dr->win);
+    }
+
+    // Never copy a frame twice: start after what earlier windows wrote
+    uint64_t oldest = dr->history_end - dr->history_len;
+    uint64_t begin = from > oldest ? from : oldest;
+    if (begin < dr->emit_pos)
+        begin = dr->emit_pos;
+    if (to <= begin)
+        return;
+    if (begin > dr->emit_pos || dr->windows == 0)
+        dr->windows++;
+    dr->window_open = true;
+    dr->emit_pos = begin;
+    dr->window_end = to;
+}
+
+// Remember the source frames as pre-event history
+static void update_history(dualrate_t *dr, const sdat_chunk_t *src, uint64_t start, uint32_t frames)
+{
+    uint32_t nch = dr->num_channels;
+
+    if (start != dr->history_end)
+        dr->history_len = 0;
+    uint32_t keep = frames < dr->history_cap ? frames : (uint32_t)dr->history_cap;
+    for (uint64_t i = start + frames - keep; i < start + frames; i++)
+    {
+        memcpy(dr->history + (size_t)(i % dr->history_cap) * nch,
+               src->samples + (size_t)(i - start) * nch, nch * sizeof(double));
+    }
+    dr->history_end = start + frames;
+    dr->history_len += frames;
+    if (dr->history_len > dr->history_cap)
+        dr->history_len = dr->history_cap;
+    if (dr->pre == 0)
+        dr->history_len = 0;
+}
+
+// Derive both streams from one full-rate chunk
+void dualrate_process(dualrate_t *dr, const sdat_chunk_t *src)
+{
+    if (!dr->enabled || src->sample_count == 0)
+        return;
+
+    uint32_t frames = src->sample_count / dr->num_channels;
+    uint64_t start = src->seq_start;
+    uint64_t end = start + frames;
+
+    process_low(dr, src, start, frames);
+
+    // A jump in the scan ends any window and invalidates the history
+    if (start != dr->history_end)
+    {
+        if (dr->window_open)
+            emit(dr, &dr->win);
+        dr->window_open = false;
+        dr->history_len = 0;
+        dr->history_end = start;
+        dr->emit_pos = start;
+    }
+
+    // Windows for events (sorted by onset) and commanded triggers
+    uint64_t from[SDAT_MAX_EVENTS + 1], to[SDAT_MAX_EVENTS + 1];
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < src->event_count; k++)
+    {
+        const sdat_event_t *ev = &src->events[k];
+        uint64_t stop = ev->duration ? ev->onset + ev->duration : end;
+        from[n] = ev->onset > dr->pre ? ev->onset - dr->pre : 0;
+        to[n] = stop + dr->post;
+        n++;
+    }
+    uint64_t trigger_ms = __atomic_exchange_n(&dr->trigger_ms, 0, __ATOMIC_ACQ_REL);
+    if (trigger_ms > 0)
+    {
+        from[n] = end > dr->pre ? end - dr->pre : 0;
+        to[n] = end + (uint64_t)(trigger_ms * dr->rate / 1000.0) + dr->post;
+        n++;
+    }
+    for (uint32_t i = 1; i < n; i++)
+    {
+        for (uint32_t j = i; j > 0 && from[j] < from[j - 1]; j--)
+        {
+            uint64_t t = from[j]; from[j] = from[j - 1]; from[j - 1] = t;
+            t = to[j]; to[j] = to[j - 1]; to[j - 1] = t;
+        }
+    }
+    for (uint32_t i = 0; i < n; i++)
+        add_window(dr, src, start, from[i], to[i]);
+
+    if (dr->window_open)
+    {
+        emit_window(dr, src, start, dr->window_end < end ? dr->window_end : end);
+        if (dr->emit_pos >= dr->window_end)
+        {
+            emit(dr, &dr->win);
+            dr->window_open = false;
+        }
+    }
+
+    update_history(dr, src, start, frames);
+}
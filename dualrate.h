@@ -0,0 +1,102 @@
+/*
+    Dual-rate recording. The hardware scans at the high rate; instead of
+    the full-rate chunks the consumer writes two derived streams:
+
+        low      every chunk, low-pass filtered and decimated by an integer
+                 factor (stream 1)
+        events   full-rate windows from "pre" seconds before to "post"
+                 seconds after every detected event or TRIGGER command,
+                 pulled from a pre-event history of the scan (stream 2)
+
+    Both streams keep their own seq numbering and chunk series. seq_start
+    times the chunk's decimation is the sample index in the full-rate scan,
+    which is also the numbering of event onsets, so the streams line up on
+    one timebase. Window chunks are contiguous inside a window and jump
+    between windows.
+
+    Configuration:
+        dualrate = decimate=10 pre=2.0 post=2.0
+    The anti-aliasing filter is an 8th-order Butterworth at 0.4 times the
+    low rate.
+*/
+
+#ifndef DUALRATE_H_
+#define DUALRATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdat.h"
+#include "dsp.h"
+
+#define DUALRATE_STREAM_LOW 1
+#define DUALRATE_STREAM_EVENTS 2
+#define DUALRATE_AA_ORDER 8
+#define DUALRATE_AA_FRACTION 0.4
+#define DUALRATE_DEFAULT_PRE_SEC 2.0
+#define DUALRATE_DEFAULT_POST_SEC 2.0
+#define DUALRATE_DEFAULT_TRIGGER_SEC 1.0
+
+// Receives every finished chunk of either stream; takes ownership
+typedef void (*dualrate_fn)(sdat_chunk_t *chunk, void *user);
+
+typedef struct {
+    bool enabled;
+    uint32_t decimation;
+    uint32_t num_channels;
+    double rate;                 // full scan rate
+    uint32_t chunk_frames;       // full-rate frames per source chunk
+    uint64_t pre;                // frames
+    uint64_t post;               // frames
+    dualrate_fn fn;
+    void *user;
+
+    // Low-rate stream
+    dsp_chain_t aa;              // anti-aliasing filter
+    double *filtered;            // chunk_frames * num_channels
+    sdat_chunk_t *low;
+
+    // Pre-event history: frame i lives in slot i % history_cap
+    double *history;
+    uint64_t history_cap;
+    uint64_t history_end;        // full-rate index after the newest frame
+    uint64_t history_len;
+
+    // Event windows
+    bool window_open;
+    uint64_t window_end;         // exclusive, may lie ahead of the data
+    uint64_t emit_pos;           // next full-rate index to copy
+    sdat_chunk_t *win;
+    uint64_t trigger_ms;         // pending TRIGGER length, set atomically
+    size_t reserved;             // bytes reserved in the memory budget
+
+    // Statistics
+    uint64_t windows;
+    uint64_t low_chunks;
+    uint64_t window_chunks;
+} dualrate_t;
+
+// Set up from the "dualrate" config line for a scan of num_channels at
+// rate, with source chunks of chunk_frames frames. Leaves the stage
+// disabled if there is no such line. Returns 0 on success.
+int dualrate_configure(dualrate_t *dr, uint32_t num_channels, double rate, uint32_t chunk_frames,
+                       dualrate_fn fn, void *user);
+
+// Bytes the configured stage needs for such a scan (0 if disabled),
+// reserved against the memory budget by dualrate_configure()
+size_t dualrate_memory(uint32_t num_channels, double rate, uint32_t chunk_frames);
+
+// Hand over pending chunks and release buffers
+void dualrate_free(dualrate_t *dr);
+
+// Derive both streams from one full-rate chunk. Does not keep src.
+void dualrate_process(dualrate_t *dr, const sdat_chunk_t *src);
+
+// Request a full-rate window of the given length starting at the next
+// chunk. Safe to call from any thread.
+void dualrate_trigger(dualrate_t *dr, double seconds);
+
+// First full-rate frame held in a chunk not yet handed over, or
+// UINT64_MAX if none. Frames kept only as pre-event history do not count.
+uint64_t dualrate_pending(const dualrate_t *dr);
+
+#endif /* DUALRATE_H_ */
@@ -0,0 +1,437 @@
+/*
+    Bulk fetch of stored data (see fetch.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include "fetch.h"
+#include "config.h"
+#include "util.h"
+
+#define FETCH_DIR_LEN 512
+#define FETCH_NAME_LEN 128
+
+// One file, or part of one, to send
+typedef struct {
+    char name[FETCH_NAME_LEN];
+    uint64_t id;
+    uint64_t size;
+} fetch_item_t;
+
+// A transfer and the connection it owns
+typedef struct {
+    int fd;
+    const char *dir;
+    fetch_item_t *items;
+    uint32_t count;
+    uint16_t kind;
+    uint64_t offset;                // into the first item
+    uint64_t end;                   // segment: end of the range
+} fetch_job_t;
+
+static char g_chunk_dir[FETCH_DIR_LEN] = ".";
+static char g_segment_dirs[FETCH_MAX_DIRS][FETCH_DIR_LEN];
+static int g_num_segment_dirs = 0;
+
+static pthread_mutex_t g_fetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_fetch_done = PTHREAD_COND_INITIALIZER;
+static int g_active_fds[FETCH_MAX_ACTIVE] = { -1, -1, -1, -1 };
+static int g_active = 0;
+static bool g_stopping = false;
+static uint64_t g_completed = 0;
+static uint64_t g_failed = 0;
+static uint64_t g_bytes_sent = 0;
+
+// Directories from the sink lines: the first file sink holds the chunks
+void fetch_init(const char *default_dir)
+{
+    bool have_file = false;
+    const char *spec;
+    int iter = 0;
+
+    g_num_segment_dirs = 0;
+    strncpy(g_chunk_dir, default_dir, sizeof(g_chunk_dir) - 1);
+    while ((spec = config_next("sink", &iter)) != NULL)
+    {
+        size_t type_len = strcspn(spec, " \t");
+        const char *args = spec + type_len;
+        char dir[FETCH_DIR_LEN];
+        if (!config_arg(args, "dir", dir, sizeof(dir)))
+            strcpy(dir, ".");
+
+        if (type_len == 4 && strncmp(spec, "file", 4) == 0 && !have_file)
+        {
+            strcpy(g_chunk_dir, dir);
+            have_file = true;
+        }
+        else if (type_len == 7 && strncmp(spec, "segment", 7) == 0 &&
+                 g_num_segment_dirs < FETCH_MAX_DIRS)
+        {
+            strcpy(g_segment_dirs[g_num_segment_dirs++], dir);
+        }
+    }
+}
+
+// Unsigned argument name=<value>
+static bool arg_u64(const char *args, const char *name, uint64_t *value)
+{
+    char text[32];
+    if (!config_arg(args, name, text, sizeof(text)))
+        return false;
+    char *end;
+    errno = 0;
+    *value = strtoull(text, &end, 10);
+    return errno == 0 && end != text && *end == '\0' && text[0] != '-';
+}
+
+// Sort items by id
+static int compare_items(const void *a, const void *b)
+{
+    uint64_t x = ((const fetch_item_t*)a)->id;
+    uint64_t y = ((const fetch_item_t*)b)->id;
+    return (x > y) - (x < y);
+}
+
+// Committed chunk files with seq_start in first..last, in order
+static int list_chunks(fetch_job_t *job, uint64_t first, uint64_t last, char *error, size_t len)
+{
+    DIR *dir = opendir(g_chunk_dir);
+    if (dir == NULL)
+    {
+        snprintf(error, len, "ERROR: Cannot read %s: %s\n", g_chunk_dir, strerror(errno));
+        return -1;
+    }
+
+    uint32_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        unsigned long long seq;
+        int used = 0;
+        if (sscanf(entry->d_name, "chunk_%llu_.bin%n", &seq, &used) != 1 ||
+            entry->d_name[used] != '\0' || seq < first || seq > last)
+            continue;
+
+        char path[FETCH_DIR_LEN + NAME_MAX + 2];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", g_chunk_dir, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (job->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            fetch_item_t *items = (fetch_item_t*)realloc(job->items, capacity * sizeof(fetch_item_t));
+            if (items == NULL)
+            {
+                closedir(dir);
+                snprintf(error, len, "ERROR: Out of memory\n");
+                return -1;
+            }
+            job->items = items;
+        }
+        fetch_item_t *item = &job->items[job->count++];
+        strncpy(item->name, entry->d_name, sizeof(item->name) - 1);
+        item->name[sizeof(item->name) - 1] = '\0';
+        item->id = seq;
+        item->size = (uint64_t)st.st_size;
+    }
+    closedir(dir);
+
+    if (job->count > 1)
+        qsort(job->items, job->count, sizeof(fetch_item_t), compare_items);
+
+    // A resume offset belongs to one particular chunk
+    if (job->offset > 0 && (job->count == 0 || job->items[0].id != first ||
+                            job->offset > job->items[0].size))
+    {
+        snprintf(error, len, "ERROR: offset=%llu does not fit chunk %llu\n",
+                 (unsigned long long)job->offset, (unsigned long long)first);
+        return -1;
+    }
+    job->dir = g_chunk_dir;
+    job->kind = FETCH_KIND_CHUNK;
+    return 0;
+}
+
+// A byte range of one segment file
+static int find_segment(fetch_job_t *job, const char *name, uint64_t length, char *error, size_t len)
+{
+    if (strchr(name, '/') != NULL || strncmp(name, "segment_", 8) != 0 ||
+        strlen(name) >= FETCH_NAME_LEN)
+    {
+        snprintf(error, len, "ERROR: Not a segment file: %s\n", name);
+        return -1;
+    }
+
+    for (int i = 0; i < g_num_segment_dirs; i++)
+    {
+        char path[FETCH_DIR_LEN + FETCH_NAME_LEN];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", g_segment_dirs[i], name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        uint64_t size = (uint64_t)st.st_size;
+        if (job->offset > size)
+        {
+            snprintf(error, len, "ERROR: offset=%llu is past the end of %s (%llu bytes)\n",
+                     (unsigned long long)job->offset, name, (unsigned long long)size);
+            return -1;
+        }
+        job->items = (fetch_item_t*)calloc(1, sizeof(fetch_item_t));
+        if (job->items == NULL)
+        {
+            snprintf(error, len, "ERROR: Out of memory\n");
+            return -1;
+        }
+        strcpy(job->items[0].name, name);
+        job->items[0].size = size;
+        job->count = 1;
+        job->dir = g_segment_dirs[i];
+        job->kind = FETCH_KIND_SEGMENT;
+        job->end = (length > 0 && length < size - job->offset) ? job->offset + length : size;
+        return 0;
+    }
+    snprintf(error, len, "ERROR: No segment file %s\n", name);
+    return -1;
+}
+
+// Encode a frame header (little-endian, see fetch.h)
+static void encode_frame(uint8_t *frame, uint16_t kind, uint64_t id, uint64_t offset, uint64_t length)
+{
+    memset(frame, 0, FETCH_FRAME_SIZE);
+    memcpy(frame, FETCH_MAGIC, 4);
+    put_le(frame + 4, kind, 2);
+    put_le(frame + 8, id, 8);
+    put_le(frame + 16, offset, 8);
+    put_le(frame + 24, length, 8);
+}
+
+// Send all of data; more says a payload follows
+static int send_all(int fd, const void *data, size_t len, bool more)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Send one frame: header, then the file range straight from the page cache
+static int send_item(fetch_job_t *job, const fetch_item_t *item, uint64_t start, uint64_t end)
+{
+    char path[FETCH_DIR_LEN + FETCH_NAME_LEN];
+    uint8_t frame[FETCH_FRAME_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", job->dir, item->name);
+
+    // Compacted since it was listed: sent empty so the count still holds
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        end = start;
+
+    encode_frame(frame, job->kind, item->id, start, end - start);
+    int rc = send_all(job->fd, frame, sizeof(frame), end > start);
+    off_t pos = (off_t)start;
+    while (rc == 0 && (uint64_t)pos < end)
+    {
+        ssize_t n = sendfile(job->fd, file, &pos, (size_t)(end - (uint64_t)pos));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            rc = -1;
+        else
+            __atomic_add_fetch(&g_bytes_sent, (uint64_t)n, __ATOMIC_RELAXED);
+    }
+    if (file >= 0)
+        close(file);
+    return rc;
+}
+
+// Transfer thread: stream every item, then the end frame
+static void* fetch_thread(void *arg)
+{
+    fetch_job_t *job = (fetch_job_t*)arg;
+
+    // A collector that goes away shows up as EPIPE, not as a signal
+    sigset_t pipe_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < job->count; i++)
+    {
+        uint64_t start = i == 0 ? job->offset : 0;
+        uint64_t end = job->kind == FETCH_KIND_SEGMENT ? job->end : job->items[i].size;
+        total += end - start;
+    }
+
+    char reply[96];
+    snprintf(reply, sizeof(reply), "OK: Fetch items=%u, bytes=%llu\n", job->count, (unsigned long long)total);
+    int rc = send_all(job->fd, reply, strlen(reply), false);
+
+    uint32_t sent = 0;
+    for (; rc == 0 && sent < job->count; sent++)
+    {
+        uint64_t start = sent == 0 ? job->offset : 0;
+        uint64_t end = job->kind == FETCH_KIND_SEGMENT ? job->end : job->items[sent].size;
+        rc = send_item(job, &job->items[sent], start, end);
+    }
+    if (rc == 0)
+    {
+        uint8_t frame[FETCH_FRAME_SIZE];
+        encode_frame(frame, FETCH_KIND_END, sent, 0, 0);
+        rc = send_all(job->fd, frame, sizeof(frame), false);
+    }
+
+    pthread_mutex_lock(&g_fetch_mutex);
+    for (int i = 0; i < FETCH_MAX_ACTIVE; i++)
+    {
+        if (g_active_fds[i] == job->fd)
+            g_active_fds[i] = -1;
+    }
+    close(job->fd);
+    if (rc == 0)
+        g_completed++;
+    else
+        g_failed++;
+    g_active--;
+    pthread_cond_broadcast(&g_fetch_done);
+    pthread_mutex_unlock(&g_fetch_mutex);
+
+    free(job->items);
+    free(job);
+    return NULL;
+}
+
+// Parse FETCH and hand the connection to a transfer thread
+int fetch_start(int fd, const char *args, char *error, size_t len)
+{
+    fetch_job_t *job = (fetch_job_t*)calloc(1, sizeof(fetch_job_t));
+    if (job == NULL)
+    {
+        snprintf(error, len, "ERROR: Out of memory\n");
+        return -1;
+    }
+    job->fd = fd;
+    if (args == NULL)
+        args = "";
+    arg_u64(args, "offset", &job->offset);
+
+    char segment[FETCH_NAME_LEN];
+    int rc;
+    if (config_arg(args, "segment", segment, sizeof(segment)))
+    {
+        uint64_t length = 0;
+        arg_u64(args, "length", &length);
+        rc = find_segment(job, segment, length, error, len);
+    }
+    else
+    {
+        unsigned long long first, last = UINT64_MAX;
+        int fields = sscanf(args, "%llu %llu", &first, &last);
+        if (fields < 1 || strchr(args, '-') != NULL || last < first)
+        {
+            snprintf(error, len, "ERROR: Usage: FETCH <first_seq> [<last_seq>] [offset=<bytes>] | "
+                                 "FETCH segment=<name> [offset=<bytes>] [length=<bytes>]\n");
+            rc = -1;
+        }
+        else
+        {
+            rc = list_chunks(job, first, last, error, len);
+        }
+    }
+
+    pthread_mutex_lock(&g_fetch_mutex);
+    int slot = -1;
+    for (int i = 0; rc == 0 && i < FETCH_MAX_ACTIVE && slot < 0; i++)
+    {
+        if (g_active_fds[i] < 0)
+            slot = i;
+    }
+    if (rc == 0 && (slot < 0 || g_stopping))
+    {
+        snprintf(error, len, "ERROR: Too many fetches running (at most %d)\n", FETCH_MAX_ACTIVE);
+        rc = -1;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (rc == 0)
+    {
+        // Blocking sends from here on (control connections are accepted
+        // non-blocking), but a collector that stops reading must not hold
+        // a slot forever
+        struct timeval timeout = { FETCH_SEND_TIMEOUT_SEC, 0 };
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (pthread_create(&thread, &attr, fetch_thread, job) == 0)
+        {
+            g_active_fds[slot] = fd;
+            g_active++;
+        }
+        else
+        {
+            snprintf(error, len, "ERROR: Cannot start the transfer\n");
+            rc = -1;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    pthread_mutex_unlock(&g_fetch_mutex);
+
+    if (rc != 0)
+    {
+        free(job->items);
+        free(job);
+    }
+    return rc;
+}
+
+// Cut the running transfers short and wait until their threads are gone
+void fetch_stop(void)
+{
+    pthread_mutex_lock(&g_fetch_mutex);
+    g_stopping = true;
+    for (int i = 0; i < FETCH_MAX_ACTIVE; i++)
+    {
+        if (g_active_fds[i] >= 0)
+            shutdown(g_active_fds[i], SHUT_RDWR);
+    }
+    while (g_active > 0)
+        pthread_cond_wait(&g_fetch_done, &g_fetch_mutex);
+    pthread_mutex_unlock(&g_fetch_mutex);
+}
+
+// Summary for STATUS
+void fetch_status(char *buf, size_t len)
+{
+    pthread_mutex_lock(&g_fetch_mutex);
+    snprintf(buf, len, "active=%d,done=%llu,failed=%llu,sent_bytes=%llu", g_active,
+             (unsigned long long)g_completed, (unsigned long long)g_failed,
+             (unsigned long long)__atomic_load_n(&g_bytes_sent, __ATOMIC_RELAXED));
+    pthread_mutex_unlock(&g_fetch_mutex);
+}
@@ -0,0 +1,64 @@
+/*
+    Bulk fetch of stored data over the control socket.
+
+    A collector on a slow link pulls many chunk files with one command
+    instead of one request per file:
+        FETCH <first_seq> [<last_seq>] [offset=<bytes>]
+            committed chunk files chunk_<seq>_.bin of the file sink whose
+            seq_start lies in first_seq..last_seq (default: all after)
+        FETCH segment=<name> [offset=<bytes>] [length=<bytes>]
+            a byte range of a segment file of a segment sink (the open
+            .log.part too, up to its current size)
+    The connection then carries the transfer and is closed at its end; a
+    session ends with it. A fetch runs in its own thread, so commands on
+    other connections are not held up.
+
+    Stream (little-endian): the reply line
+        OK: Fetch items=<n>, bytes=<payload bytes>\n
+    then per item a frame header and its payload, and a final header with
+    kind FETCH_KIND_END:
+        magic "SFRM", kind u16, reserved u16,
+        id u64      chunk: seq_start; segment: 0
+        offset u64  byte position in the item where the payload starts
+        length u64  payload bytes that follow               (32 bytes)
+    The end frame carries the number of items sent in id. Payloads go from
+    the page cache to the socket with sendfile(), without a copy through
+    user space.
+
+    Resume: offset= skips that many bytes of the first item. A collector
+    that lost the connection during the chunk with seq S after receiving
+    B of its payload bytes sends FETCH S <last> offset=B (for a segment:
+    the old offset plus the bytes received) and continues exactly there.
+*/
+
+#ifndef FETCH_H_
+#define FETCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FETCH_MAGIC "SFRM"
+#define FETCH_FRAME_SIZE 32
+#define FETCH_KIND_END 0
+#define FETCH_KIND_CHUNK 1
+#define FETCH_KIND_SEGMENT 2
+#define FETCH_MAX_ACTIVE 4              // transfers at once
+#define FETCH_MAX_DIRS 4                // segment sink directories
+#define FETCH_SEND_TIMEOUT_SEC 30       // a stalled collector is dropped
+
+// Find the chunk directory (the first file sink, default default_dir) and
+// the segment sink directories from the "sink" config lines
+void fetch_init(const char *default_dir);
+
+// Check a FETCH command's arguments and start the transfer on fd. On
+// success the transfer thread owns fd and returns 0. Otherwise -1 with
+// the ERROR reply in error; fd stays with the caller.
+int fetch_start(int fd, const char *args, char *error, size_t len);
+
+// Abort running transfers and wait for their threads
+void fetch_stop(void);
+
+// One-line summary for STATUS
+void fetch_status(char *buf, size_t len);
+
+#endif /* FETCH_H_ */
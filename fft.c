@@ -0,0 +1,383 @@
+/*
+    Small single-precision FFT (see fft.h)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/****************************************************************************
+ * Four-lane float vectors
+ ****************************************************************************/
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+typedef float32x4_t v4f;
+#define v4_load(p) vld1q_f32(p)
+#define v4_store(p, v) vst1q_f32(p, v)
+#define v4_set1(x) vdupq_n_f32(x)
+#define v4_add(a, b) vaddq_f32(a, b)
+#define v4_sub(a, b) vsubq_f32(a, b)
+#define v4_mul(a, b) vmulq_f32(a, b)
+
+static inline void v4_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+typedef __m128 v4f;
+#define v4_load(p) _mm_loadu_ps(p)
+#define v4_store(p, v) _mm_storeu_ps(p, v)
+#define v4_set1(x) _mm_set1_ps(x)
+#define v4_add(a, b) _mm_add_ps(a, b)
+#define v4_sub(a, b) _mm_sub_ps(a, b)
+#define v4_mul(a, b) _mm_mul_ps(a, b)
+
+static inline void v4_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    _MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3);
+}
+#else
+typedef struct { float v[4]; } v4f;
+
+static inline v4f v4_load(const float *p) { v4f r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void v4_store(float *p, v4f a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline v4f v4_set1(float x) { v4f r = {{ x, x, x, x }}; return r; }
+static inline v4f v4_add(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline v4f v4_sub(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline v4f v4_mul(v4f a, v4f b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+
+static inline void v4_transpose(v4f *r0, v4f *r1, v4f *r2, v4f *r3)
+{
+    v4f in[4] = { *r0, *r1, *r2, *r3 };
+    v4f *out[4] = { r0, r1, r2, r3 };
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            out[i]->v[j] = in[j].v[i];
+}
+#endif
+
+/****************************************************************************
+ * Radix-4 butterfly on four lanes
+ *
+ * Inputs a, b, c, d; outputs
+ *   y0 = (a + c) + (b + d)
+ *   y1 = w1 * ((a - c) - i(b - d))
+ *   y2 = w2 * ((a + c) - (b + d))
+ *   y3 = w3 * ((a - c) + i(b - d))
+ ****************************************************************************/
+typedef struct {
+    v4f re, im;
+} cv4_t;
+
+static inline cv4_t cmul(cv4_t a, v4f wr, v4f wi)
+{
+    cv4_t r;
+    r.re = v4_sub(v4_mul(a.re, wr), v4_mul(a.im, wi));
+    r.im = v4_add(v4_mul(a.im, wr), v4_mul(a.re, wi));
+    return r;
+}
+
+static inline void butterfly4(cv4_t a, cv4_t b, cv4_t c, cv4_t d,
+                              const v4f *w, cv4_t *y)
+{
+    cv4_t apc = { v4_add(a.re, c.re), v4_add(a.im, c.im) };
+    cv4_t amc = { v4_sub(a.re, c.re), v4_sub(a.im, c.im) };
+    cv4_t bpd = { v4_add(b.re, d.re), v4_add(b.im, d.im) };
+    cv4_t bmd = { v4_sub(b.re, d.re), v4_sub(b.im, d.im) };
+
+    cv4_t t1 = { v4_add(amc.re, bmd.im), v4_sub(amc.im, bmd.re) };
+    cv4_t t2 = { v4_sub(apc.re, bpd.re), v4_sub(apc.im, bpd.im) };
+    cv4_t t3 = { v4_sub(amc.re, bmd.im), v4_add(amc.im, bmd.re) };
+
+    y[0].re = v4_add(apc.re, bpd.re);
+    y[0].im = v4_add(apc.im, bpd.im);
+    y[1] = cmul(t1, w[0], w[1]);
+    y[2] = cmul(t2, w[2], w[3]);
+    y[3] = cmul(t3, w[4], w[5]);
+}
+
+// Scalar radix-4 butterfly for the tiny sizes the vector paths skip
+static void butterfly4_scalar(const float *xr, const float *xi, float *yr, float *yi,
+                              uint32_t ia, uint32_t step_in, uint32_t oa, uint32_t step_out,
+                              const float *w)
+{
+    float ar = xr[ia], ai = xi[ia];
+    float br = xr[ia + step_in], bi = xi[ia + step_in];
+    float cr = xr[ia + 2 * step_in], ci = xi[ia + 2 * step_in];
+    float dr = xr[ia + 3 * step_in], di = xi[ia + 3 * step_in];
+
+    float apcr = ar + cr, apci = ai + ci, amcr = ar - cr, amci = ai - ci;
+    float bpdr = br + dr, bpdi = bi + di, bmdr = br - dr, bmdi = bi - di;
+    float t1r = amcr + bmdi, t1i = amci - bmdr;
+    float t2r = apcr - bpdr, t2i = apci - bpdi;
+    float t3r = amcr - bmdi, t3i = amci + bmdr;
+
+    yr[oa] = apcr + bpdr;
+    yi[oa] = apci + bpdi;
+    yr[oa + step_out] = t1r * w[0] - t1i * w[1];
+    yi[oa + step_out] = t1i * w[0] + t1r * w[1];
+    yr[oa + 2 * step_out] = t2r * w[2] - t2i * w[3];
+    yi[oa + 2 * step_out] = t2i * w[2] + t2r * w[3];
+    yr[oa + 3 * step_out] = t3r * w[4] - t3i * w[5];
+    yi[oa + 3 * step_out] = t3i * w[4] + t3r * w[5];
+}
+
+/****************************************************************************
+ * Stockham stages. A stage of length n and stride s reads
+ * x[q + s*(p + k*m)] and writes y[q + s*(4p + k)], m = n / 4.
+ * Twiddles for the stage are stored as six arrays of m floats:
+ * w1re, w1im, w2re, w2im, w3re, w3im.
+ ****************************************************************************/
+
+// First stage (s = 1): lanes run over p, outputs are transposed into place
+static void radix4_first(uint32_t n, const float *tw,
+                         const float *xr, const float *xi, float *yr, float *yi)
+{
+    uint32_t m = n / 4;
+
+    if (m < 4)
+    {
+        for (uint32_t p = 0; p < m; p++)
+        {
+            float w[6] = { tw[p], tw[m + p], tw[2 * m + p], tw[3 * m + p], tw[4 * m + p], tw[5 * m + p] };
+            butterfly4_scalar(xr, xi, yr, yi, p, m, 4 * p, 1, w);
+        }
+        return;
+    }
+
+    for (uint32_t p = 0; p < m; p += 4)
+    {
+        cv4_t a = { v4_load(xr + p), v4_load(xi + p) };
+        cv4_t b = { v4_load(xr + p + m), v4_load(xi + p + m) };
+        cv4_t c = { v4_load(xr + p + 2 * m), v4_load(xi + p + 2 * m) };
+        cv4_t d = { v4_load(xr + p + 3 * m), v4_load(xi + p + 3 * m) };
+        v4f w[6];
+        for (int k = 0; k < 6; k++)
+            w[k] = v4_load(tw + k * m + p);
+
+        cv4_t y[4];
+        butterfly4(a, b, c, d, w, y);
+
+        v4_transpose(&y[0].re, &y[1].re, &y[2].re, &y[3].re);
+        v4_transpose(&y[0].im, &y[1].im, &y[2].im, &y[3].im);
+        for (int k = 0; k < 4; k++)
+        {
+            v4_store(yr + 4 * p + 4 * k, y[k].re);
+            v4_store(yi + 4 * p + 4 * k, y[k].im);
+        }
+    }
+}
+
+// Later stages (s >= 4): lanes run over q, twiddles are broadcast
+static void radix4_stage(uint32_t n, uint32_t s, const float *tw,
+                         const float *xr, const float *xi, float *yr, float *yi)
+{
+    uint32_t m = n / 4;
+
+    for (uint32_t p = 0; p < m; p++)
+    {
+        v4f w[6];
+        for (int k = 0; k < 6; k++)
+            w[k] = v4_set1(tw[k * m + p]);
+
+        const uint32_t in0 = s * p, in_step = s * m;
+        const uint32_t out0 = s * 4 * p;
+        for (uint32_t q = 0; q < s; q += 4)
+        {
+            uint32_t i = in0 + q;
+            cv4_t a = { v4_load(xr + i), v4_load(xi + i) };
+            cv4_t b = { v4_load(xr + i + in_step), v4_load(xi + i + in_step) };
+            cv4_t c = { v4_load(xr + i + 2 * in_step), v4_load(xi + i + 2 * in_step) };
+            cv4_t d = { v4_load(xr + i + 3 * in_step), v4_load(xi + i + 3 * in_step) };
+
+            cv4_t y[4];
+            butterfly4(a, b, c, d, w, y);
+
+            uint32_t o = out0 + q;
+            for (int k = 0; k < 4; k++)
+            {
+                v4_store(yr + o + k * s, y[k].re);
+                v4_store(yi + o + k * s, y[k].im);
+            }
+        }
+    }
+}
+
+// Final radix-2 stage (n = 2, s = half / 2)
+static void radix2_last(uint32_t s, const float *xr, const float *xi, float *yr, float *yi)
+{
+    if (s < 4)
+    {
+        for (uint32_t q = 0; q < s; q++)
+        {
+            yr[q] = xr[q] + xr[q + s];
+            yi[q] = xi[q] + xi[q + s];
+            yr[q + s] = xr[q] - xr[q + s];
+            yi[q + s] = xi[q] - xi[q + s];
+        }
+        return;
+    }
+
+    for (uint32_t q = 0; q < s; q += 4)
+    {
+        v4f ar = v4_load(xr + q), ai = v4_load(xi + q);
+        v4f br = v4_load(xr + q + s), bi = v4_load(xi + q + s);
+        v4_store(yr + q, v4_add(ar, br));
+        v4_store(yi + q, v4_add(ai, bi));
+        v4_store(yr + q + s, v4_sub(ar, br));
+        v4_store(yi + q + s, v4_sub(ai, bi));
+    }
+}
+
+/****************************************************************************
+ * Plans and transforms
+ ****************************************************************************/
+int fft_plan_init(fft_plan_t *plan, uint32_t n)
+{
+    memset(plan, 0, sizeof(*plan));
+    if (n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)) != 0)
+        return -1;
+
+    plan->n = n;
+    plan->half = n / 2;
+    uint32_t half = plan->half;
+
+    // Twiddle storage: 6 * m floats per radix-4 stage, m = len / 4
+    size_t tw_floats = 0;
+    for (uint32_t len = half; len >= 4; len /= 4)
+        tw_floats += 6 * (len / 4);
+
+    plan->twiddle = (float*)malloc((tw_floats + 1) * sizeof(float));
+    plan->split_re = (float*)malloc((half + 1) * sizeof(float));
+    plan->split_im = (float*)malloc((half + 1) * sizeof(float));
+    plan->re = (float*)malloc(half * sizeof(float));
+    plan->im = (float*)malloc(half * sizeof(float));
+    plan->tmp_re = (float*)malloc(half * sizeof(float));
+    plan->tmp_im = (float*)malloc(half * sizeof(float));
+    if (!plan->twiddle || !plan->split_re || !plan->split_im || !plan->re ||
+        !plan->im || !plan->tmp_re || !plan->tmp_im)
+    {
+        fft_plan_free(plan);
+        return -1;
+    }
+
+    float *tw = plan->twiddle;
+    for (uint32_t len = half; len >= 4; len /= 4)
+    {
+        uint32_t m = len / 4;
+        for (uint32_t p = 0; p < m; p++)
+        {
+            for (int k = 1; k <= 3; k++)
+            {
+                double angle = -2.0 * M_PI * (double)(k * p) / (double)len;
+                tw[(2 * (k - 1)) * m + p] = (float)cos(angle);
+                tw[(2 * (k - 1) + 1) * m + p] = (float)sin(angle);
+            }
+        }
+        tw += 6 * m;
+    }
+
+    for (uint32_t k = 0; k <= half; k++)
+    {
+        double angle = -2.0 * M_PI * (double)k / (double)n;
+        plan->split_re[k] = (float)cos(angle);
+        plan->split_im[k] = (float)sin(angle);
+    }
+    return 0;
+}
+
+void fft_plan_free(fft_plan_t *plan)
+{
+    free(plan->twiddle);
+    free(plan->split_re);
+    free(plan->split_im);
+    free(plan->re);
+    free(plan->im);
+    free(plan->tmp_re);
+    free(plan->tmp_im);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// In-place forward complex FFT of length plan->half
+void fft_complex(fft_plan_t *plan, float *re, float *im)
+{
+    float *xr = re, *xi = im;
+    float *yr = plan->tmp_re, *yi = plan->tmp_im;
+    const float *tw = plan->twiddle;
+    uint32_t s = 1;
+    uint32_t len = plan->half;
+
+    while (len >= 4)
+    {
+        if (s == 1)
+            radix4_first(len, tw, xr, xi, yr, yi);
+        else
+            radix4_stage(len, s, tw, xr, xi, yr, yi);
+
+        tw += 6 * (len / 4);
+        float *t;
+        t = xr; xr = yr; yr = t;
+        t = xi; xi = yi; yi = t;
+        len /= 4;
+        s *= 4;
+    }
+
+    if (len == 2)
+    {
+        radix2_last(s, xr, xi, yr, yi);
+        float *t;
+        t = xr; xr = yr; yr = t;
+        t = xi; xi = yi; yi = t;
+    }
+
+    if (xr != re)
+    {
+        memcpy(re, xr, plan->half * sizeof(float));
+        memcpy(im, xi, plan->half * sizeof(float));
+    }
+}
+
+// Power spectrum of n real samples
+void fft_real_power(fft_plan_t *plan, const float *x, float *power)
+{
+    uint32_t half = plan->half;
+    float *re = plan->re, *im = plan->im;
+
+    // Pack even samples as real and odd samples as imaginary parts
+    for (uint32_t k = 0; k < half; k++)
+    {
+        re[k] = x[2 * k];
+        im[k] = x[2 * k + 1];
+    }
+
+    fft_complex(plan, re, im);
+
+    // Split: X[k] = E[k] + W_n^k * O[k], with
+    // E = (Z[k] + conj(Z[half-k])) / 2, O = -i (Z[k] - conj(Z[half-k])) / 2
+    for (uint32_t k = 0; k <= half; k++)
+    {
+        uint32_t a = (k == half) ? 0 : k;
+        uint32_t b = (k == 0) ? 0 : half - k;
+        float zr = re[a], zi = im[a];
+        float cr = re[b], ci = -im[b];
+
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        float dr = 0.5f * (zr - cr), di = 0.5f * (zi - ci);
+        float or_ = di, oi = -dr;
+
+        float wr = plan->split_re[k], wi = plan->split_im[k];
+        float xr = er + (or_ * wr - oi * wi);
+        float xi = ei + (or_ * wi + oi * wr);
+        power[k] = xr * xr + xi * xi;
+    }
+}
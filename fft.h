@@ -0,0 +1,45 @@
+/*
+    Small single-precision FFT for spectral summaries.
+
+    Complex transforms use split arrays (re[], im[]) and a Stockham
+    autosort algorithm: radix-4 stages plus one radix-2 stage when the
+    size is an odd power of two, with no bit-reversal pass. Butterflies
+    run four lanes at a time with SSE or NEON when available and fall
+    back to portable C otherwise.
+
+    Real transforms of length n are computed as a complex transform of
+    length n/2 followed by a split step.
+*/
+
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <stdint.h>
+
+#define FFT_MIN_SIZE 16
+#define FFT_MAX_SIZE 65536
+
+typedef struct {
+    uint32_t n;        // real transform length
+    uint32_t half;     // complex transform length (n / 2)
+    float *twiddle;    // per-stage radix-4 twiddles
+    float *split_re;   // real split-step twiddles W_n^k, k = 0..half
+    float *split_im;
+    float *re;         // work buffers, half floats each
+    float *im;
+    float *tmp_re;
+    float *tmp_im;
+} fft_plan_t;
+
+// Prepare a plan for real transforms of length n (power of two,
+// FFT_MIN_SIZE..FFT_MAX_SIZE). Returns 0 on success.
+int fft_plan_init(fft_plan_t *plan, uint32_t n);
+void fft_plan_free(fft_plan_t *plan);
+
+// In-place forward complex FFT of length plan->half on split arrays
+void fft_complex(fft_plan_t *plan, float *re, float *im);
+
+// Power spectrum |X[k]|^2, k = 0..n/2, of n real samples
+void fft_real_power(fft_plan_t *plan, const float *x, float *power);
+
+#endif /* FFT_H_ */
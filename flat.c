@@ -0,0 +1,105 @@
+/*
+    Flat-signal elision (see flat.h)
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "flat.h"
+#include "config.h"
+#include "util.h"
+
+// Append a little-endian double to the buffer
+static uint8_t* put_f64(uint8_t *p, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return put_le(p, bits, 8);
+}
+
+// Set up from the "flat" config line
+int flat_configure(flat_t *fl, const uint8_t *channels, uint32_t num_channels)
+{
+    memset(fl, 0, sizeof(*fl));
+
+    const char *args = config_get("flat");
+    if (args == NULL)
+        return 0;
+
+    double band = config_arg_double(args, "band", 0.0);
+    uint32_t points = (uint32_t)config_arg_double(args, "points", FLAT_DEFAULT_POINTS);
+    if (band <= 0.0 || points == 0 || points > FLAT_MAX_POINTS || num_channels > FLAT_MAX_CHANNELS)
+    {
+        fprintf(stderr, "Error: Invalid flat settings (band > 0, 1 <= points <= %d)\n", FLAT_MAX_POINTS);
+        return -1;
+    }
+
+    fl->band = band;
+    fl->points = points;
+    fl->num_channels = num_channels;
+    memcpy(fl->channels, channels, num_channels);
+    fl->enabled = true;
+    return 0;
+}
+
+// Attach the descriptor to a flat chunk
+bool flat_process(flat_t *fl, sdat_chunk_t *chunk, const kernel_stats_t *st)
+{
+    if (!fl->enabled || (chunk->flags & SDAT_FLAG_EVENT) || chunk->sample_count == 0)
+        return false;
+
+    uint32_t nch = fl->num_channels;
+    uint32_t frame_count = chunk->sample_count / nch;
+    uint32_t points = fl->points < frame_count ? fl->points : frame_count;
+    double mean[FLAT_MAX_CHANNELS];
+    const double *min = st->min, *max = st->max;
+
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        if (max[ch] - min[ch] > fl->band)
+            return false;
+        mean[ch] = st->sum[ch] / frame_count;
+    }
+
+    uint8_t record[FLAT_MAX_CHANNELS * (FLAT_RECORD_HEADER_SIZE + FLAT_MAX_POINTS)];
+    uint8_t *p = record;
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        // Block means lie within [min, max], so +-127 steps cover the band
+        double span = fmax(max[ch] - mean[ch], mean[ch] - min[ch]);
+        float step = (float)(span / 127.0);
+        uint32_t step_bits;
+        memcpy(&step_bits, &step, sizeof(step_bits));
+
+        p = put_le(p, fl->channels[ch], 1);
+        p = put_le(p, 0, 1);
+        p = put_le(p, points, 2);
+        p = put_le(p, step_bits, 4);
+        p = put_f64(p, mean[ch]);
+        p = put_f64(p, min[ch]);
+        p = put_f64(p, max[ch]);
+
+        for (uint32_t k = 0; k < points; k++)
+        {
+            uint32_t first = (uint32_t)((uint64_t)frame_count * k / points);
+            uint32_t last = (uint32_t)((uint64_t)frame_count * (k + 1) / points);
+            double sum = 0.0;
+            for (uint32_t f = first; f < last; f++)
+                sum += chunk->samples[(size_t)f * nch + ch];
+            double q = step > 0.0f ? (sum / (last - first) - mean[ch]) / step : 0.0;
+            long r = lrint(q);
+            if (r > 127)
+                r = 127;
+            if (r < -127)
+                r = -127;
+            *p++ = (uint8_t)(int8_t)r;
+        }
+    }
+
+    if (sdat_chunk_add_ext(chunk, SDAT_EXT_FLAT, record, (uint32_t)(p - record)) != 0)
+        return false;
+
+    chunk->flags |= SDAT_FLAG_FLAT;
+    fl->elided_chunks++;
+    fl->elided_bytes += (uint64_t)chunk->sample_count * SDAT_RECORD_SIZE;
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+    Flat-signal elision. Chunks in which every channel stays within a
+    configured band (max - min) are dispatched without their payload;
+    instead they carry a compact descriptor and SDAT_FLAG_FLAT. Chunks
+    that overlap a detected event are always kept in full.
+
+    Stored as an SDAT_EXT_FLAT extension holding one record per channel
+    (little-endian):
+        channel u8, reserved u8, points u16, step f32,
+        mean f64, min f64, max f64, then points x int8
+    The int8 values are the means of points equal blocks of the chunk,
+    relative to mean, in units of step. A reader can rebuild the chunk as
+    a staircase (or interpolation) of those block means; the error is
+    bounded by the band.
+
+    Configuration:
+        flat = band=0.005 points=32
+    band is in the units of the samples after the DSP chain.
+*/
+
+#ifndef FLAT_H_
+#define FLAT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdat.h"
+#include "kernel.h"
+
+#define FLAT_MAX_CHANNELS 8
+#define FLAT_MAX_POINTS 256
+#define FLAT_DEFAULT_POINTS 32
+#define FLAT_RECORD_HEADER_SIZE 32
+
+typedef struct {
+    bool enabled;
+    double band;
+    uint32_t points;
+    uint32_t num_channels;
+    uint8_t channels[FLAT_MAX_CHANNELS];
+    uint64_t elided_chunks;
+    uint64_t elided_bytes;       // payload bytes not written
+} flat_t;
+
+// Set up from the "flat" config line for the given scan channels. Leaves
+// elision disabled if there is no such line. Returns 0 on success.
+int flat_configure(flat_t *fl, const uint8_t *channels, uint32_t num_channels);
+
+// If the chunk is flat by the stats of its payload (see kernel.h),
+// attach the descriptor and mark it so the sinks skip the payload. The
+// payload must still be interleaved. Returns true if the chunk was elided.
+bool flat_process(flat_t *fl, sdat_chunk_t *chunk, const kernel_stats_t *st);
+
+#endif /* FLAT_H_ */
@@ -0,0 +1,573 @@
+/*
+    sensor_join: joins the recordings of several loggers into one
+    time-aligned multichannel series
+
+    Usage:
+        sensor_join [-r HZ] [-w SEC] [-j THREADS] [-s STREAM] [-c CHANNELS]
+                    [-b START] [-e END] -o OUTPUT INPUT...
+            -r  output rate (default: the highest input rate)
+            -w  seconds of output per window (default 10)
+            -j  windows processed at once (default one per online core)
+            -s  stream to read from every input (default 0, the full-rate scan)
+            -c  scan channels of stream 0 chunks, e.g. 4 or 0,1 (default 4)
+            -b, -e  unix time span to join (default: where all inputs overlap)
+    An INPUT is anything reader.h accepts: a sink directory with its
+    archives, a .sdar archive, a segment file or a collector's chunks.dat.
+
+    Every input gets its own timestamp model (see timemodel.h), which maps
+    output times to fractional sample positions of that input, drift
+    included. A polyphase resampler (see resample.h) evaluates each input
+    at those positions on a common grid of multiples of 1/HZ seconds.
+
+    Output: SDAT chunks back to back, one per window, like a segment file.
+    Each is a stream 1 chunk named "join" whose columns are the channels
+    of the inputs in command-line order. seq_start is the index of the
+    first sample on the grid, so seq_start / HZ is its unix time. Samples
+    an input has no data for (gaps, the edges of a capture) are NaN.
+
+    Windows are independent: each worker thread takes the next window,
+    reads just the chunks it needs, and writes it at its own offset, so
+    memory is bounded by threads x window size however long the inputs.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sdat.h"
+#include "reader.h"
+#include "timemodel.h"
+#include "resample.h"
+
+#define JOIN_MAX_INPUTS SDAT_MAX_CHANNELS
+#define JOIN_MAX_THREADS 64
+#define JOIN_DEFAULT_WINDOW_SEC 10.0
+#define JOIN_DEFAULT_CHANNEL 4
+#define JOIN_STREAM 1
+#define JOIN_STREAM_NAME "join"
+
+// One recording
+typedef struct {
+    const char *path;
+    reader_t reader;
+    timemodel_t model;
+    resample_t *filters;        // one per distinct nominal rate
+    uint32_t *seg_filter;       // filter of each segment
+    uint32_t num_filters;
+    uint32_t max_frames;        // largest chunk
+    uint32_t column;            // first output column
+    uint64_t gap_frames;        // output frames without data
+} input_t;
+
+// Buffers of one worker thread for one input
+typedef struct {
+    double *decoded;            // one chunk, one channel after another
+    double *span;               // input samples around a window, per channel
+    size_t span_capacity;       // frames per channel
+} input_buf_t;
+
+typedef struct {
+    pthread_t thread;
+    input_buf_t bufs[JOIN_MAX_INPUTS];
+    sdat_chunk_t *chunk;
+    uint8_t *header;
+    int status;
+} worker_t;
+
+static input_t g_inputs[JOIN_MAX_INPUTS];
+static int g_num_inputs = 0;
+static uint32_t g_rate;                 // output rate
+static uint32_t g_columns;
+static uint64_t g_epoch;                // unix seconds, times are relative to it
+static uint64_t g_epoch_index;          // grid index of the epoch
+static uint64_t g_first_index;          // grid index of the first output sample
+static uint64_t g_total_frames;
+static uint64_t g_window_frames;
+static uint64_t g_num_windows;
+static uint64_t g_next_window = 0;      // taken with __atomic builtins
+static size_t g_chunk_bytes;            // every window but maybe the last
+static uint64_t g_boot_id;
+static int g_out_fd = -1;
+
+// Print command-line usage
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-r HZ] [-w SEC] [-j THREADS] [-s STREAM] [-c CHANNELS]\n", prog);
+    fprintf(stderr, "       %*s [-b START] [-e END] -o OUTPUT INPUT...\n", (int)strlen(prog), "");
+}
+
+// Random ID of this join, like a logger's boot ID
+static uint64_t generate_boot_id(void)
+{
+    uint64_t id = 0;
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom)
+    {
+        if (fread(&id, sizeof(id), 1, urandom) != 1)
+            id = 0;
+        fclose(urandom);
+    }
+    if (id == 0)
+        id = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid();
+    return id;
+}
+
+// Parse "4" or "0,1,2" into channels; returns the count or -1
+static int parse_channels(const char *text, uint8_t *channels)
+{
+    int count = 0;
+    const char *p = text;
+    while (*p != '\0')
+    {
+        char *end;
+        long ch = strtol(p, &end, 10);
+        if (end == p || ch < 0 || ch > 7 || count == SDAT_MAX_CHANNELS)
+            return -1;
+        channels[count++] = (uint8_t)ch;
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+            return -1;
+    }
+    return count;
+}
+
+// Design one filter per distinct input rate
+static int input_filters(input_t *in)
+{
+    in->filters = (resample_t*)calloc(in->model.count, sizeof(resample_t));
+    in->seg_filter = (uint32_t*)calloc(in->model.count, sizeof(uint32_t));
+    double *rates = (double*)calloc(in->model.count, sizeof(double));
+    int rc = in->filters != NULL && in->seg_filter != NULL && rates != NULL ? 0 : -1;
+
+    for (size_t s = 0; rc == 0 && s < in->model.count; s++)
+    {
+        double rate = in->model.segments[s].nominal_rate;
+        uint32_t f = 0;
+        while (f < in->num_filters && rates[f] != rate)
+            f++;
+        if (f == in->num_filters)
+        {
+            rc = resample_init(&in->filters[f], rate, g_rate);
+            rates[f] = rate;
+            in->num_filters++;
+        }
+        in->seg_filter[s] = f;
+    }
+    free(rates);
+    return rc;
+}
+
+// Time of a grid index, relative to the epoch
+static double grid_time(uint64_t index)
+{
+    return (double)(int64_t)(index - g_epoch_index) / g_rate;
+}
+
+// Copy the chunks of a segment that overlap [lo, hi) into the span buffer
+static int fill_span(const input_t *in, input_buf_t *buf, const timemodel_segment_t *seg,
+                     int64_t lo, int64_t hi)
+{
+    uint32_t nch = in->reader.num_channels;
+    size_t frames = (size_t)(hi - lo);
+    if (frames > buf->span_capacity)
+    {
+        double *span = (double*)realloc(buf->span, frames * nch * sizeof(double));
+        if (span == NULL)
+            return -1;
+        buf->span = span;
+        buf->span_capacity = frames;
+    }
+    for (size_t i = 0; i < frames * nch; i++)
+        buf->span[i] = NAN;
+
+    int64_t first = lo > (int64_t)seg->seq_first ? lo : (int64_t)seg->seq_first;
+    int64_t last = hi < (int64_t)seg->seq_end ? hi : (int64_t)seg->seq_end;
+    if (first >= last)
+        return 0;
+
+    for (size_t c = reader_find(&in->reader, seg->first_chunk, seg->last_chunk, (uint64_t)first);
+         c < seg->last_chunk && (int64_t)in->reader.chunks[c].seq_start < last; c++)
+    {
+        const reader_chunk_t *rc = &in->reader.chunks[c];
+        if (reader_load_planar(&in->reader, c, buf->decoded) != 0)
+            continue;   // reported; its samples stay NaN
+
+        // Copy the overlapping frames of each channel's row
+        int64_t from = (int64_t)rc->seq_start > first ? (int64_t)rc->seq_start : first;
+        int64_t to = (int64_t)(rc->seq_start + rc->frames) < last ? (int64_t)(rc->seq_start + rc->frames) : last;
+        for (uint32_t ch = 0; ch < nch; ch++)
+        {
+            memcpy(buf->span + (size_t)ch * frames + (from - lo),
+                   buf->decoded + (size_t)ch * rc->frames + (from - (int64_t)rc->seq_start),
+                   (size_t)(to - from) * sizeof(double));
+        }
+    }
+    return 0;
+}
+
+// Resample one input into its columns of a window
+static int join_input(input_t *in, input_buf_t *buf, uint64_t first_index, uint32_t frames, double *out)
+{
+    uint32_t nch = in->reader.num_channels;
+    uint64_t gaps = 0;
+    uint32_t f = 0;
+    long seg_index = -1;
+
+    while (f < frames)
+    {
+        double t = grid_time(first_index + f);
+        if (seg_index < 0 || t < in->model.segments[seg_index].t_first ||
+            t >= timemodel_time(&in->model.segments[seg_index], (double)in->model.segments[seg_index].seq_end))
+            seg_index = timemodel_find(&in->model, t);
+        if (seg_index < 0)
+        {
+            for (uint32_t ch = 0; ch < nch; ch++)
+                out[(size_t)f * g_columns + in->column + ch] = NAN;
+            gaps++;
+            f++;
+            continue;
+        }
+
+        // The frames of the window that fall in this segment
+        const timemodel_segment_t *seg = &in->model.segments[seg_index];
+        const resample_t *rs = &in->filters[in->seg_filter[seg_index]];
+        double t_end = timemodel_time(seg, (double)seg->seq_end);
+        uint32_t end = f + 1;
+        while (end < frames && grid_time(first_index + end) < t_end)
+            end++;
+
+        int64_t half = rs->taps / 2;
+        int64_t lo = (int64_t)floor(timemodel_position(seg, t)) - half + 1;
+        int64_t hi = (int64_t)floor(timemodel_position(seg, grid_time(first_index + end - 1))) + half + 1;
+        if (fill_span(in, buf, seg, lo, hi) != 0)
+            return -1;
+
+        size_t span_frames = (size_t)(hi - lo);
+        for (; f < end; f++)
+        {
+            double x = timemodel_position(seg, grid_time(first_index + f));
+            double i = floor(x);
+            int64_t base = (int64_t)i - half + 1 - lo;
+            bool missing = false;
+            for (uint32_t ch = 0; ch < nch; ch++)
+            {
+                double y = NAN;
+                if (base >= 0 && (size_t)base + rs->taps <= span_frames)
+                    y = resample_at(rs, buf->span + (size_t)ch * span_frames + base, x - i);
+                out[(size_t)f * g_columns + in->column + ch] = y;
+                missing |= isnan(y);
+            }
+            gaps += missing;
+        }
+    }
+    __atomic_add_fetch(&in->gap_frames, gaps, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Write all of buf at offset
+static int write_at(int fd, const uint8_t *buf, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Take windows until none are left
+static void* worker_thread(void *arg)
+{
+    worker_t *w = (worker_t*)arg;
+    sdat_chunk_t *chunk = w->chunk;
+
+    for (;;)
+    {
+        uint64_t window = __atomic_fetch_add(&g_next_window, 1, __ATOMIC_RELAXED);
+        if (window >= g_num_windows)
+            break;
+        uint64_t first = g_first_index + window * g_window_frames;
+        uint64_t left = g_total_frames - window * g_window_frames;
+        uint32_t frames = (uint32_t)(left < g_window_frames ? left : g_window_frames);
+
+        for (int m = 0; m < g_num_inputs && w->status == 0; m++)
+            w->status = join_input(&g_inputs[m], &w->bufs[m], first, frames, chunk->samples);
+
+        chunk->seq_start = first;
+        chunk->sample_count = frames * g_columns;
+        chunk->time_start = first / g_rate;
+        chunk->time_end = (first + frames - 1) / g_rate;
+        size_t header_len = sdat_encode_header(chunk, w->header);
+        uint64_t offset = window * g_chunk_bytes;
+        if (w->status == 0 &&
+            (write_at(g_out_fd, w->header, header_len, offset) != 0 ||
+             write_at(g_out_fd, (const uint8_t*)chunk->samples, sdat_payload_size(chunk), offset + header_len) != 0))
+        {
+            fprintf(stderr, "Error: Write failed: %s\n", strerror(errno));
+            w->status = -1;
+        }
+        if (w->status != 0)
+        {
+            // Stop the others too
+            __atomic_store_n(&g_next_window, g_num_windows, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Allocate the buffers of a worker
+static int worker_init(worker_t *w)
+{
+    memset(w, 0, sizeof(*w));
+    w->chunk = sdat_chunk_create((uint32_t)(g_window_frames * g_columns));
+    w->header = (uint8_t*)malloc(SDAT_MAX_HEADER_SIZE);
+    if (w->chunk == NULL || w->header == NULL)
+        return -1;
+
+    sdat_chunk_t *chunk = w->chunk;
+    chunk->stream = JOIN_STREAM;
+    strcpy(chunk->stream_name, JOIN_STREAM_NAME);
+    chunk->decimation = 1;
+    chunk->boot_id = g_boot_id;
+    chunk->sample_rate = g_rate;
+    chunk->num_channels = (uint8_t)g_columns;
+    for (int m = 0; m < g_num_inputs; m++)
+    {
+        const reader_t *rd = &g_inputs[m].reader;
+        memcpy(chunk->channels + g_inputs[m].column, rd->channels, rd->num_channels);
+        w->bufs[m].decoded = (double*)malloc((size_t)g_inputs[m].max_frames * rd->num_channels * sizeof(double));
+        if (w->bufs[m].decoded == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+// Free the buffers of a worker
+static void worker_free(worker_t *w)
+{
+    for (int m = 0; m < g_num_inputs; m++)
+    {
+        free(w->bufs[m].decoded);
+        free(w->bufs[m].span);
+    }
+    sdat_chunk_free(w->chunk);
+    free(w->header);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    double rate = 0.0, window_sec = JOIN_DEFAULT_WINDOW_SEC;
+    double begin = 0.0, end = 0.0;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int stream = 0;
+    uint8_t channels[SDAT_MAX_CHANNELS] = { JOIN_DEFAULT_CHANNEL };
+    int num_channels = 1;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        const char *opt = argv[arg];
+        bool has_value = arg + 1 < argc;
+        if (strcmp(opt, "-o") == 0 && has_value)
+            output = argv[++arg];
+        else if (strcmp(opt, "-r") == 0 && has_value)
+            rate = atof(argv[++arg]);
+        else if (strcmp(opt, "-w") == 0 && has_value)
+            window_sec = atof(argv[++arg]);
+        else if (strcmp(opt, "-j") == 0 && has_value)
+            num_threads = atol(argv[++arg]);
+        else if (strcmp(opt, "-s") == 0 && has_value)
+            stream = atoi(argv[++arg]);
+        else if (strcmp(opt, "-c") == 0 && has_value)
+            num_channels = parse_channels(argv[++arg], channels);
+        else if (strcmp(opt, "-b") == 0 && has_value)
+            begin = atof(argv[++arg]);
+        else if (strcmp(opt, "-e") == 0 && has_value)
+            end = atof(argv[++arg]);
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    g_num_inputs = argc - arg;
+    if (output == NULL || g_num_inputs < 1 || g_num_inputs > JOIN_MAX_INPUTS || num_channels < 1 ||
+        rate < 0.0 || rate != floor(rate) || window_sec <= 0.0 || stream < 0 || stream > 65535)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > JOIN_MAX_THREADS)
+        num_threads = JOIN_MAX_THREADS;
+
+    // List every input and find the common epoch
+    g_epoch = UINT64_MAX;
+    for (int m = 0; m < g_num_inputs; m++)
+    {
+        input_t *in = &g_inputs[m];
+        in->path = argv[arg + m];
+        if (reader_open(&in->reader, in->path, (uint16_t)stream, channels, (uint32_t)num_channels) != 0)
+            return 1;
+        in->column = g_columns;
+        g_columns += in->reader.num_channels;
+        for (size_t c = 0; c < in->reader.count; c++)
+        {
+            const reader_chunk_t *rc = &in->reader.chunks[c];
+            if (rc->time_start < g_epoch)
+                g_epoch = rc->time_start;
+            if (rc->frames > in->max_frames)
+                in->max_frames = rc->frames;
+            if (rate == 0.0 && rc->rate_hz > g_rate)
+                g_rate = rc->rate_hz;
+        }
+    }
+    if (rate > 0.0)
+        g_rate = (uint32_t)rate;
+    if (g_columns > SDAT_MAX_CHANNELS)
+    {
+        fprintf(stderr, "Error: %u channels in all, at most %d fit in one output\n", g_columns, SDAT_MAX_CHANNELS);
+        return 1;
+    }
+    g_epoch = g_epoch > 2 ? g_epoch - 2 : 0;
+    g_epoch_index = g_epoch * g_rate;
+
+    // Fit the timestamp models; the span is where all inputs have data
+    double t_begin = -INFINITY, t_end = INFINITY;
+    for (int m = 0; m < g_num_inputs; m++)
+    {
+        input_t *in = &g_inputs[m];
+        if (timemodel_build(&in->model, &in->reader, g_epoch) != 0 || in->model.count == 0 ||
+            input_filters(in) != 0)
+        {
+            fprintf(stderr, "Error: No usable timestamp model for %s\n", in->path);
+            return 1;
+        }
+        const timemodel_segment_t *first = &in->model.segments[0];
+        const timemodel_segment_t *last = &in->model.segments[in->model.count - 1];
+        t_begin = fmax(t_begin, first->t_first);
+        t_end = fmin(t_end, timemodel_time(last, (double)last->seq_end));
+
+        printf("Input %d: %s, %zu chunks, %u channels, %zu segments\n", m + 1, in->path,
+               in->reader.count, in->reader.num_channels, in->model.count);
+        for (size_t s = 0; s < in->model.count; s++)
+        {
+            const timemodel_segment_t *seg = &in->model.segments[s];
+            printf("  boot %016llx seq %llu..%llu: %.6f Hz (nominal %.0f), starts %.4f +- %.4f s\n",
+                   (unsigned long long)seg->boot_id, (unsigned long long)seg->seq_first,
+                   (unsigned long long)seg->seq_end, seg->rate, seg->nominal_rate,
+                   (double)g_epoch + seg->t_first, seg->uncertainty);
+        }
+    }
+    if (begin > 0.0)
+        t_begin = begin - (double)g_epoch;
+    if (end > 0.0)
+        t_end = end - (double)g_epoch;
+    if (!(t_end > t_begin) || t_begin < 0.0)
+    {
+        fprintf(stderr, "Error: The inputs have no time span in common\n");
+        return 1;
+    }
+
+    // Output grid and windows
+    g_first_index = g_epoch_index + (uint64_t)ceil(t_begin * g_rate);
+    uint64_t end_index = g_epoch_index + (uint64_t)ceil(t_end * g_rate);
+    g_total_frames = end_index > g_first_index ? end_index - g_first_index : 0;
+    g_window_frames = (uint64_t)ceil(window_sec * g_rate);
+    if (g_total_frames == 0 || g_window_frames * g_columns > UINT32_MAX / sizeof(double))
+    {
+        fprintf(stderr, "Error: Nothing to join, or the window is too large\n");
+        return 1;
+    }
+    g_num_windows = (g_total_frames + g_window_frames - 1) / g_window_frames;
+    g_boot_id = generate_boot_id();
+
+    worker_t *workers = (worker_t*)calloc((size_t)num_threads, sizeof(worker_t));
+    if (workers == NULL)
+        return 1;
+    for (long i = 0; i < num_threads; i++)
+    {
+        if (worker_init(&workers[i]) != 0)
+        {
+            fprintf(stderr, "Error: Out of memory for %ld workers\n", num_threads);
+            return 1;
+        }
+    }
+    g_chunk_bytes = sdat_encode_header(workers[0].chunk, workers[0].header) +
+                    (size_t)g_window_frames * g_columns * sizeof(double);
+
+    // Written as .part and renamed when complete, like the chunk files
+    char part_path[1024];
+    snprintf(part_path, sizeof(part_path), "%s.part", output);
+    g_out_fd = open(part_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (g_out_fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot create %s: %s\n", part_path, strerror(errno));
+        return 1;
+    }
+
+    printf("Joining %.3f s from %.3f at %u Hz: %u channels, %llu windows of %.1f s, %ld threads\n",
+           (double)g_total_frames / g_rate, (double)g_first_index / g_rate, g_rate, g_columns,
+           (unsigned long long)g_num_windows, window_sec, num_threads);
+    fflush(stdout);
+
+    int status = 0;
+    long started = 0;
+    for (; started < num_threads; started++)
+    {
+        if (pthread_create(&workers[started].thread, NULL, worker_thread, &workers[started]) != 0)
+            break;
+    }
+    if (started == 0)
+        status = -1;
+    for (long i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].status != 0)
+            status = -1;
+    }
+    for (long i = 0; i < num_threads; i++)
+        worker_free(&workers[i]);
+    free(workers);
+
+    if (status == 0 && (fsync(g_out_fd) != 0 || rename(part_path, output) != 0))
+    {
+        fprintf(stderr, "Error: Cannot complete %s: %s\n", output, strerror(errno));
+        status = -1;
+    }
+    close(g_out_fd);
+    if (status != 0)
+    {
+        unlink(part_path);
+        return 1;
+    }
+
+    for (int m = 0; m < g_num_inputs; m++)
+    {
+        input_t *in = &g_inputs[m];
+        printf("Input %d: %.2f%% of the output without data\n", m + 1,
+               100.0 * (double)in->gap_frames / (double)g_total_frames);
+        for (uint32_t f = 0; f < in->num_filters; f++)
+            resample_free(&in->filters[f]);
+        free(in->filters);
+        free(in->seg_filter);
+        timemodel_free(&in->model);
+        reader_close(&in->reader);
+    }
+    printf("Wrote %s\n", output);
+    return 0;
+}
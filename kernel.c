@@ -0,0 +1,188 @@
+/*
+    Specialized per-chunk kernels (see kernel.h)
+*/
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#include "kernel.h"
+#include "layout.h"
+
+// Start empty stats
+static void stats_init(kernel_stats_t *st, uint32_t nch)
+{
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        st->min[ch] = INFINITY;
+        st->max[ch] = -INFINITY;
+        st->sum[ch] = 0.0;
+    }
+    st->crc = 0;
+}
+
+/****************************************************************************
+ * CRC-32 of each sample inside the frame loop where the CPU has an
+ * instruction for zlib's polynomial (ARMv8 CRC extension); elsewhere zlib
+ * runs on each block right after it is written, while it is in cache.
+ ****************************************************************************/
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC_INLINE 1
+
+// Raw (inverted) CRC state after one sample
+static inline uint32_t crc_sample(uint32_t crc, double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return __crc32d(crc, bits);
+}
+#else
+#define CRC_INLINE 0
+
+static inline uint32_t crc_sample(uint32_t crc, double x)
+{
+    (void)x;
+    return crc;
+}
+#endif
+
+// One kernel per channel count and layout. The stats live in local arrays
+// of constant size, so they stay in registers across the frame loop. A
+// planar kernel splits each block with the SSE2/NEON layout kernels right
+// after taking its stats. With the CRC instructions it keeps one CRC per
+// row and combines them at the end; with zlib it takes the CRC of the
+// whole payload once it is written.
+#define FINISH_KERNEL(NCH, PLANAR, LAYOUT)                                                      \
+static void finish_##NCH##_##LAYOUT(const double *src, double *dst, uint32_t frames,            \
+                                    kernel_stats_t *st)                                         \
+{                                                                                               \
+    double lo[NCH], hi[NCH], sum[NCH];                                                          \
+    uint32_t crc[NCH];                                                                          \
+    for (int ch = 0; ch < NCH; ch++)                                                            \
+    {                                                                                           \
+        lo[ch] = INFINITY;                                                                      \
+        hi[ch] = -INFINITY;                                                                     \
+        sum[ch] = 0.0;                                                                          \
+        crc[ch] = CRC_INLINE ? 0xFFFFFFFFu : 0;                                                 \
+    }                                                                                           \
+    for (uint32_t first = 0; first < frames; first += KERNEL_BLOCK_FRAMES)                      \
+    {                                                                                           \
+        uint32_t last = frames - first > KERNEL_BLOCK_FRAMES ? first + KERNEL_BLOCK_FRAMES : frames;\
+        for (uint32_t f = first; f < last; f++)                                                 \
+        {                                                                                       \
+            for (int ch = 0; ch < NCH; ch++)                                                    \
+            {                                                                                   \
+                double x = src[(size_t)f * NCH + ch];                                           \
+                lo[ch] = x < lo[ch] ? x : lo[ch];                                               \
+                hi[ch] = x > hi[ch] ? x : hi[ch];                                               \
+                sum[ch] += x;                                                                   \
+                if (CRC_INLINE && !PLANAR)                                                      \
+                    crc[0] = crc_sample(crc[0], x);                                             \
+            }                                                                                   \
+        }                                                                                       \
+        if (PLANAR)                                                                             \
+        {                                                                                       \
+            /* The block is still in cache: split it into its rows */                           \
+            layout_deinterleave_rows(dst + first, frames, src + (size_t)first * NCH,            \
+                                     last - first, NCH);                                        \
+            for (int ch = 0; CRC_INLINE && ch < NCH; ch++)                                      \
+            {                                                                                   \
+                const double *row = dst + (size_t)ch * frames + first;                          \
+                for (uint32_t f = 0; f < last - first; f++)                                     \
+                    crc[ch] = crc_sample(crc[ch], row[f]);                                      \
+            }                                                                                   \
+        }                                                                                       \
+        else if (!CRC_INLINE)                                                                   \
+        {                                                                                       \
+            crc[0] = (uint32_t)crc32(crc[0], (const Bytef*)(src + (size_t)first * NCH),         \
+                                     (uInt)((last - first) * NCH * sizeof(double)));            \
+        }                                                                                       \
+    }                                                                                           \
+    for (int ch = 0; ch < NCH; ch++)                                                            \
+    {                                                                                           \
+        st->min[ch] = lo[ch];                                                                   \
+        st->max[ch] = hi[ch];                                                                   \
+        st->sum[ch] = sum[ch];                                                                  \
+        if (CRC_INLINE)                                                                         \
+            crc[ch] = ~crc[ch];                                                                 \
+        /* The rows follow each other in the payload */                                         \
+        if (CRC_INLINE && PLANAR && ch > 0)                                                     \
+            crc[0] = (uint32_t)crc32_combine(crc[0], crc[ch], (z_off_t)frames * sizeof(double));\
+    }                                                                                           \
+    /* zlib: the rows in one call, rather than per row and block and combined */                \
+    if (!CRC_INLINE && PLANAR)                                                                  \
+        crc[0] = (uint32_t)crc32(0L, (const Bytef*)dst,                                         \
+                                 (uInt)((size_t)frames * NCH * sizeof(double)));                \
+    st->crc = crc[0];                                                                           \
+}
+
+#define FINISH_KERNELS(NCH)                                                                     \
+FINISH_KERNEL(NCH, 0, interleaved)                                                              \
+FINISH_KERNEL(NCH, 1, planar)
+
+FINISH_KERNEL(1, 0, interleaved)
+FINISH_KERNELS(2)
+FINISH_KERNELS(3)
+FINISH_KERNELS(4)
+FINISH_KERNELS(5)
+FINISH_KERNELS(6)
+FINISH_KERNELS(7)
+FINISH_KERNELS(8)
+
+#if SDAT_MAX_CHANNELS != 8
+#error "kernel tables cover 1 to 8 channels"
+#endif
+
+static const kernel_t g_interleaved[SDAT_MAX_CHANNELS + 1] = {
+    { 0, false, NULL, NULL },
+    { 1, false, "f64x1 interleaved", finish_1_interleaved },
+    { 2, false, "f64x2 interleaved", finish_2_interleaved },
+    { 3, false, "f64x3 interleaved", finish_3_interleaved },
+    { 4, false, "f64x4 interleaved", finish_4_interleaved },
+    { 5, false, "f64x5 interleaved", finish_5_interleaved },
+    { 6, false, "f64x6 interleaved", finish_6_interleaved },
+    { 7, false, "f64x7 interleaved", finish_7_interleaved },
+    { 8, false, "f64x8 interleaved", finish_8_interleaved },
+};
+
+// One channel is the same in both layouts
+static const kernel_t g_planar[SDAT_MAX_CHANNELS + 1] = {
+    { 0, false, NULL, NULL },
+    { 1, false, "f64x1 interleaved", finish_1_interleaved },
+    { 2, true, "f64x2 planar", finish_2_planar },
+    { 3, true, "f64x3 planar", finish_3_planar },
+    { 4, true, "f64x4 planar", finish_4_planar },
+    { 5, true, "f64x5 planar", finish_5_planar },
+    { 6, true, "f64x6 planar", finish_6_planar },
+    { 7, true, "f64x7 planar", finish_7_planar },
+    { 8, true, "f64x8 planar", finish_8_planar },
+};
+
+// Kernels of one layout
+const kernel_t* kernel_table(bool planar)
+{
+    return planar ? g_planar : g_interleaved;
+}
+
+// The same pass with runtime channel count and layout
+void kernel_finish_generic(const double *src, double *dst, uint32_t frames, uint32_t num_channels,
+                           bool planar, kernel_stats_t *st)
+{
+    stats_init(st, num_channels);
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        for (uint32_t ch = 0; ch < num_channels; ch++)
+        {
+            double x = src[(size_t)f * num_channels + ch];
+            if (x < st->min[ch])
+                st->min[ch] = x;
+            if (x > st->max[ch])
+                st->max[ch] = x;
+            st->sum[ch] += x;
+            if (planar)
+                dst[(size_t)ch * frames + f] = x;
+        }
+    }
+    const double *payload = planar ? dst : src;
+    st->crc = (uint32_t)crc32(0L, (const Bytef*)payload, (uInt)((size_t)frames * num_channels * sizeof(double)));
+}
@@ -0,0 +1,65 @@
+/*
+    Specialized per-chunk kernels for the consumer's last pass.
+
+    Before a chunk is queued on the sinks, its payload is read once to
+    take the per-channel minimum, maximum and sum (for flat elision, see
+    flat.h), to compute the payload CRC-32 for the header, and, with
+    payload_layout = planar, to rewrite it one channel after another (see
+    layout.h). A generic loop does this with the channel count and layout
+    as runtime values, and in separate passes for the CRC.
+
+    Each (channel count, layout) pair gets its own kernel instead,
+    generated from one macro with both as constants. The inner channel
+    loop unrolls, the stats stay in registers, and the compiler vectorizes
+    across channels. The CRC is taken per sample inside the same loop
+    where the CPU has an instruction for zlib's polynomial (ARMv8 CRC
+    extension). Elsewhere the frames are processed in blocks of
+    KERNEL_BLOCK_FRAMES and zlib takes the CRC of each interleaved block
+    right after it is read, while it is still in cache; much smaller
+    blocks lose more to zlib's per-call overhead than they gain. A planar
+    payload's rows are only contiguous once all blocks are written, so
+    zlib takes its CRC in one call at the end. Planar kernels split each
+    block with the SSE2/NEON kernels of layout.c.
+
+    Payloads are float64 (record_size 8), the only SDAT sample format, so
+    the format is not a dimension of the table. kernel_table() is looked
+    up once when the layout is configured and indexed by channel count
+    per chunk. kernel_bench compares the kernels with the generic path.
+*/
+
+#ifndef KERNEL_H_
+#define KERNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdat.h"
+
+#define KERNEL_BLOCK_FRAMES 4096
+
+// What one pass learns about a payload
+typedef struct {
+    double min[SDAT_MAX_CHANNELS];      // NaN samples are skipped
+    double max[SDAT_MAX_CHANNELS];
+    double sum[SDAT_MAX_CHANNELS];
+    uint32_t crc;                       // CRC-32 (zlib) of the payload as written
+} kernel_stats_t;
+
+// Stats of frames interleaved samples at src. A planar kernel also writes
+// the channels one after another to dst, which must not overlap src.
+typedef void (*kernel_finish_fn)(const double *src, double *dst, uint32_t frames, kernel_stats_t *st);
+
+typedef struct {
+    uint32_t num_channels;
+    bool planar;                        // writes dst (false for one channel)
+    const char *name;
+    kernel_finish_fn finish;
+} kernel_t;
+
+// Kernels of one layout, indexed by channel count (1..SDAT_MAX_CHANNELS)
+const kernel_t* kernel_table(bool planar);
+
+// The same pass with runtime channel count and layout (the reference)
+void kernel_finish_generic(const double *src, double *dst, uint32_t frames, uint32_t num_channels,
+                           bool planar, kernel_stats_t *st);
+
+#endif /* KERNEL_H_ */
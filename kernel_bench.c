@@ -0,0 +1,145 @@
+/*
+    kernel_bench: the consumer's finishing kernels against the generic loop
+
+    Usage:
+        kernel_bench [-f FRAMES] [-t SECONDS]
+
+    For every channel count and layout, runs the specialized kernel (see
+    kernel.h) and kernel_finish_generic() over a payload of FRAMES frames
+    (default 20000, a 2 s chunk at 10 kHz) for SECONDS each (default 0.5,
+    best of 5 runs taken in turns with the other), checks that both give the same stats, CRC and output,
+    and prints the throughput of both in MB/s of payload.
+
+    Exit status: 0, or 1 if a kernel disagrees with the generic loop.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include "kernel.h"
+#include "util.h"
+
+#define DEFAULT_FRAMES 20000
+#define DEFAULT_SECONDS 0.5
+#define BENCH_TRIALS 5
+
+// Print command-line usage
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-f FRAMES] [-t SECONDS]\n", prog);
+}
+
+// MB/s of one run of a kernel (generic if kernel is NULL) for seconds
+static double measure(const kernel_t *kernel, const double *src, double *dst, uint32_t frames,
+                      uint32_t nch, bool planar, double seconds, kernel_stats_t *st)
+{
+    uint64_t runs = 0;
+    double start = now_mono(), elapsed;
+    do
+    {
+        if (kernel != NULL)
+            kernel->finish(src, dst, frames, st);
+        else
+            kernel_finish_generic(src, dst, frames, nch, planar, st);
+        runs++;
+        elapsed = now_mono() - start;
+    } while (elapsed < seconds);
+    return (double)runs * frames * nch * sizeof(double) / elapsed / 1e6;
+}
+
+// True if both passes agree
+static bool same_result(const kernel_stats_t *a, const kernel_stats_t *b, const double *dst_a,
+                        const double *dst_b, uint32_t frames, uint32_t nch, bool planar)
+{
+    if (a->crc != b->crc)
+        return false;
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        if (a->min[ch] != b->min[ch] || a->max[ch] != b->max[ch] || a->sum[ch] != b->sum[ch])
+            return false;
+    }
+    return !planar || memcmp(dst_a, dst_b, (size_t)frames * nch * sizeof(double)) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    long frames = DEFAULT_FRAMES;
+    double seconds = DEFAULT_SECONDS;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        const char *opt = argv[arg];
+        bool has_value = arg + 1 < argc;
+        if (strcmp(opt, "-f") == 0 && has_value)
+            frames = atol(argv[++arg]);
+        else if (strcmp(opt, "-t") == 0 && has_value)
+            seconds = atof(argv[++arg]);
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (arg != argc || frames < 1 || frames > 10000000 || seconds <= 0.0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    size_t samples = (size_t)frames * SDAT_MAX_CHANNELS;
+    double *src = (double*)malloc(samples * sizeof(double));
+    double *dst_generic = (double*)malloc(samples * sizeof(double));
+    double *dst_kernel = (double*)malloc(samples * sizeof(double));
+    if (src == NULL || dst_generic == NULL || dst_kernel == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    // A noisy signal, like a scan of sensors
+    srand(1);
+    for (size_t i = 0; i < samples; i++)
+        src[i] = sin((double)i * 0.01) + (rand() / (double)RAND_MAX - 0.5) * 0.1;
+
+    int status = 0;
+    printf("%ld frames per chunk\n", frames);
+    printf("%-20s %14s %14s %8s\n", "kernel", "generic MB/s", "kernel MB/s", "speedup");
+    for (int layout = 0; layout < 2; layout++)
+    {
+        bool planar = layout == 1;
+        const kernel_t *table = kernel_table(planar);
+        for (uint32_t nch = 1; nch <= SDAT_MAX_CHANNELS; nch++)
+        {
+            const kernel_t *kernel = &table[nch];
+            if (planar && !kernel->planar)
+                continue;   // one channel has a single layout
+            // Best of BENCH_TRIALS each, taken in turns so that other load
+            // on the machine hits both alike
+            kernel_stats_t st_generic, st_kernel;
+            double generic = 0.0, special = 0.0;
+            for (int trial = 0; trial < BENCH_TRIALS; trial++)
+            {
+                double rate = measure(NULL, src, dst_generic, (uint32_t)frames, nch, planar,
+                                      seconds / BENCH_TRIALS, &st_generic);
+                if (rate > generic)
+                    generic = rate;
+                rate = measure(kernel, src, dst_kernel, (uint32_t)frames, nch, planar,
+                               seconds / BENCH_TRIALS, &st_kernel);
+                if (rate > special)
+                    special = rate;
+            }
+            bool same = same_result(&st_generic, &st_kernel, dst_generic, dst_kernel, (uint32_t)frames, nch, planar);
+            printf("%-20s %14.0f %14.0f %7.2fx%s\n", kernel->name, generic, special, special / generic,
+                   same ? "" : "  MISMATCH");
+            if (!same)
+                status = 1;
+        }
+    }
+
+    free(src);
+    free(dst_generic);
+    free(dst_kernel);
+    return status;
+}
@@ -0,0 +1,246 @@
+/*
+    Payload layout (see layout.h)
+*/
+#include <string.h>
+#include "layout.h"
+
+/****************************************************************************
+ * Two frames per step. Each kernel returns the frames it converted; the
+ * plain loop below does the rest.
+ ****************************************************************************/
+#if defined(__aarch64__)
+#include <arm_neon.h>
+
+// vldNq/vstNq (de)interleave N channels of two frames in one instruction
+#define NEON_KERNELS(n)                                                              \
+static uint32_t split##n(double *dst, size_t stride, const double *src, uint32_t frames) \
+{                                                                                    \
+    uint32_t f = 0;                                                                  \
+    for (; f + 2 <= frames; f += 2)                                                  \
+    {                                                                                \
+        float64x2x##n##_t v = vld##n##q_f64(src + (size_t)n * f);                    \
+        for (int k = 0; k < n; k++)                                                  \
+            vst1q_f64(dst + (size_t)k * stride + f, v.val[k]);                       \
+    }                                                                                \
+    return f;                                                                        \
+}                                                                                    \
+static uint32_t merge##n(double *dst, const double *src, uint32_t frames)            \
+{                                                                                    \
+    uint32_t f = 0;                                                                  \
+    for (; f + 2 <= frames; f += 2)                                                  \
+    {                                                                                \
+        float64x2x##n##_t v;                                                         \
+        for (int k = 0; k < n; k++)                                                  \
+            v.val[k] = vld1q_f64(src + (size_t)k * frames + f);                      \
+        vst##n##q_f64(dst + (size_t)n * f, v);                                       \
+    }                                                                                \
+    return f;                                                                        \
+}
+
+NEON_KERNELS(2)
+NEON_KERNELS(3)
+NEON_KERNELS(4)
+
+// Any other count: two channels of two frames per step, transposed with
+// zip; with an odd count the last pair overlaps the one before it
+static uint32_t split_pairs(double *dst, size_t stride, const double *src, uint32_t frames, uint32_t nch)
+{
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        const double *p = src + (size_t)nch * f;
+        for (uint32_t ch = 0; ch < nch; ch += 2)
+        {
+            uint32_t c = ch + 2 <= nch ? ch : nch - 2;
+            float64x2_t v0 = vld1q_f64(p + c);                  // a0 b0
+            float64x2_t v1 = vld1q_f64(p + nch + c);            // a1 b1
+            vst1q_f64(dst + (size_t)c * stride + f, vzip1q_f64(v0, v1));
+            vst1q_f64(dst + (size_t)(c + 1) * stride + f, vzip2q_f64(v0, v1));
+        }
+    }
+    return f;
+}
+#define LAYOUT_KERNELS 1
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+static uint32_t split2(double *dst, size_t stride, const double *src, uint32_t frames)
+{
+    double *a = dst, *b = dst + stride;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        __m128d v0 = _mm_loadu_pd(src + 2 * (size_t)f);         // a0 b0
+        __m128d v1 = _mm_loadu_pd(src + 2 * (size_t)f + 2);     // a1 b1
+        _mm_storeu_pd(a + f, _mm_unpacklo_pd(v0, v1));
+        _mm_storeu_pd(b + f, _mm_unpackhi_pd(v0, v1));
+    }
+    return f;
+}
+
+static uint32_t split3(double *dst, size_t stride, const double *src, uint32_t frames)
+{
+    double *a = dst, *b = dst + stride, *c = dst + 2 * stride;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        const double *p = src + 3 * (size_t)f;
+        __m128d v0 = _mm_loadu_pd(p);                           // a0 b0
+        __m128d v1 = _mm_loadu_pd(p + 2);                       // c0 a1
+        __m128d v2 = _mm_loadu_pd(p + 4);                       // b1 c1
+        _mm_storeu_pd(a + f, _mm_shuffle_pd(v0, v1, 2));
+        _mm_storeu_pd(b + f, _mm_shuffle_pd(v0, v2, 1));
+        _mm_storeu_pd(c + f, _mm_shuffle_pd(v1, v2, 2));
+    }
+    return f;
+}
+
+static uint32_t split4(double *dst, size_t stride, const double *src, uint32_t frames)
+{
+    double *a = dst, *b = dst + stride, *c = dst + 2 * stride, *d = dst + 3 * stride;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        const double *p = src + 4 * (size_t)f;
+        __m128d v0 = _mm_loadu_pd(p);                           // a0 b0
+        __m128d v1 = _mm_loadu_pd(p + 2);                       // c0 d0
+        __m128d v2 = _mm_loadu_pd(p + 4);                       // a1 b1
+        __m128d v3 = _mm_loadu_pd(p + 6);                       // c1 d1
+        _mm_storeu_pd(a + f, _mm_unpacklo_pd(v0, v2));
+        _mm_storeu_pd(b + f, _mm_unpackhi_pd(v0, v2));
+        _mm_storeu_pd(c + f, _mm_unpacklo_pd(v1, v3));
+        _mm_storeu_pd(d + f, _mm_unpackhi_pd(v1, v3));
+    }
+    return f;
+}
+
+// Any other count: two channels of two frames per step; with an odd
+// count the last pair overlaps the one before it
+static uint32_t split_pairs(double *dst, size_t stride, const double *src, uint32_t frames, uint32_t nch)
+{
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        const double *p = src + (size_t)nch * f;
+        for (uint32_t ch = 0; ch < nch; ch += 2)
+        {
+            uint32_t c = ch + 2 <= nch ? ch : nch - 2;
+            __m128d v0 = _mm_loadu_pd(p + c);                   // a0 b0
+            __m128d v1 = _mm_loadu_pd(p + nch + c);             // a1 b1
+            _mm_storeu_pd(dst + (size_t)c * stride + f, _mm_unpacklo_pd(v0, v1));
+            _mm_storeu_pd(dst + (size_t)(c + 1) * stride + f, _mm_unpackhi_pd(v0, v1));
+        }
+    }
+    return f;
+}
+
+static uint32_t merge2(double *dst, const double *src, uint32_t frames)
+{
+    const double *a = src, *b = src + frames;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        __m128d va = _mm_loadu_pd(a + f);
+        __m128d vb = _mm_loadu_pd(b + f);
+        _mm_storeu_pd(dst + 2 * (size_t)f, _mm_unpacklo_pd(va, vb));
+        _mm_storeu_pd(dst + 2 * (size_t)f + 2, _mm_unpackhi_pd(va, vb));
+    }
+    return f;
+}
+
+static uint32_t merge3(double *dst, const double *src, uint32_t frames)
+{
+    const double *a = src, *b = src + frames, *c = src + 2 * (size_t)frames;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        __m128d va = _mm_loadu_pd(a + f);
+        __m128d vb = _mm_loadu_pd(b + f);
+        __m128d vc = _mm_loadu_pd(c + f);
+        double *p = dst + 3 * (size_t)f;
+        _mm_storeu_pd(p, _mm_unpacklo_pd(va, vb));              // a0 b0
+        _mm_storeu_pd(p + 2, _mm_shuffle_pd(vc, va, 2));        // c0 a1
+        _mm_storeu_pd(p + 4, _mm_unpackhi_pd(vb, vc));          // b1 c1
+    }
+    return f;
+}
+
+static uint32_t merge4(double *dst, const double *src, uint32_t frames)
+{
+    const double *a = src, *b = src + frames, *c = src + 2 * (size_t)frames, *d = src + 3 * (size_t)frames;
+    uint32_t f = 0;
+    for (; f + 2 <= frames; f += 2)
+    {
+        __m128d va = _mm_loadu_pd(a + f);
+        __m128d vb = _mm_loadu_pd(b + f);
+        __m128d vc = _mm_loadu_pd(c + f);
+        __m128d vd = _mm_loadu_pd(d + f);
+        double *p = dst + 4 * (size_t)f;
+        _mm_storeu_pd(p, _mm_unpacklo_pd(va, vb));
+        _mm_storeu_pd(p + 2, _mm_unpacklo_pd(vc, vd));
+        _mm_storeu_pd(p + 4, _mm_unpackhi_pd(va, vb));
+        _mm_storeu_pd(p + 6, _mm_unpackhi_pd(vc, vd));
+    }
+    return f;
+}
+#define LAYOUT_KERNELS 1
+#endif
+
+// Split interleaved frames into rows stride samples apart
+void layout_deinterleave_rows(double *dst, size_t stride, const double *src, uint32_t frames, uint32_t nch)
+{
+    uint32_t done = 0;
+    if (nch == 1)
+    {
+        memcpy(dst, src, (size_t)frames * sizeof(double));
+        return;
+    }
+#ifdef LAYOUT_KERNELS
+    if (nch == 2)
+        done = split2(dst, stride, src, frames);
+    else if (nch == 3)
+        done = split3(dst, stride, src, frames);
+    else if (nch == 4)
+        done = split4(dst, stride, src, frames);
+    else
+        done = split_pairs(dst, stride, src, frames, nch);
+#endif
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        double *row = dst + (size_t)ch * stride;
+        for (uint32_t f = done; f < frames; f++)
+            row[f] = src[(size_t)f * nch + ch];
+    }
+}
+
+// Split interleaved frames into rows
+void layout_deinterleave(double *dst, const double *src, uint32_t frames, uint32_t nch)
+{
+    layout_deinterleave_rows(dst, frames, src, frames, nch);
+}
+
+// Merge rows into interleaved frames
+void layout_interleave(double *dst, const double *src, uint32_t frames, uint32_t nch)
+{
+    uint32_t done = 0;
+    if (nch == 1)
+    {
+        memcpy(dst, src, (size_t)frames * sizeof(double));
+        return;
+    }
+#ifdef LAYOUT_KERNELS
+    if (nch == 2)
+        done = merge2(dst, src, frames);
+    else if (nch == 3)
+        done = merge3(dst, src, frames);
+    else if (nch == 4)
+        done = merge4(dst, src, frames);
+#endif
+    for (uint32_t ch = 0; ch < nch; ch++)
+    {
+        const double *row = src + (size_t)ch * frames;
+        for (uint32_t f = done; f < frames; f++)
+            dst[(size_t)f * nch + ch] = row[f];
+    }
+}
@@ -0,0 +1,40 @@
+/*
+    Payload layout: interleaved or planar.
+
+    The board delivers a scan interleaved, one frame of all channels after
+    another (a0 b0 c0 a1 b1 c1 ...). With
+
+        payload_layout = planar
+
+    the consumer rewrites each payload as one contiguous block per channel
+    (a0 a1 ... b0 b1 ... c0 c1 ...) just before it is queued on the sinks,
+    and sets SDAT_FLAG_PLANAR; the rewrite is part of its finishing pass
+    (see kernel.h). Analysis of one channel then reads a single contiguous
+    run instead of striding through every channel. The flag is per chunk,
+    so a reader handles both layouts (see reader.h).
+
+    The conversion kernels here move two frames per step with SSE2 or
+    AArch64 NEON registers. Splitting is specialised for 2, 3 and 4
+    channels, and other counts go two channels at a time; merging is
+    specialised for 2, 3 and 4 channels. The rest, and 32-bit ARM without
+    double-precision NEON, use a plain loop. The consumer's planar
+    kernels split each block of a payload with layout_deinterleave_rows().
+*/
+
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Split frames x nch interleaved samples into nch rows of frames
+void layout_deinterleave(double *dst, const double *src, uint32_t frames, uint32_t nch);
+
+// The same into nch rows that start stride samples apart (stride >= frames),
+// so a block of frames can go to its place in rows of a longer payload
+void layout_deinterleave_rows(double *dst, size_t stride, const double *src, uint32_t frames, uint32_t nch);
+
+// Merge nch rows of frames samples into frames x nch interleaved samples
+void layout_interleave(double *dst, const double *src, uint32_t frames, uint32_t nch);
+
+#endif /* LAYOUT_H_ */
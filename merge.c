@@ -0,0 +1,214 @@
+/*
+    Adaptive chunk merging (see merge.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+#include "merge.h"
+#include "spectrum.h"
+#include "anchor.h"
+#include "budget.h"
+#include "config.h"
+#include "util.h"
+
+// Parse the sink arguments
+int merge_init(merge_ctl_t *m, const char *args)
+{
+    memset(m, 0, sizeof(*m));
+    double max = config_arg_double(args, "merge", 1);
+    if (max < 1 || max > MERGE_MAX)
+    {
+        fprintf(stderr, "Error: Invalid merge=%g (1 to %d chunks)\n", max, MERGE_MAX);
+        return -1;
+    }
+    m->max = (uint32_t)max;
+    m->factor = 1;
+    return 0;
+}
+
+// Adjust the merge factor after a write
+void merge_update(merge_ctl_t *m, double write_sec, double data_sec, uint32_t queued, uint32_t depth)
+{
+    if (m->max <= 1 || data_sec <= 0.0)
+        return;
+
+    double ratio = write_sec / data_sec;
+    m->latency_ratio = m->latency_ratio > 0.0 ? 0.75 * m->latency_ratio + 0.25 * ratio : ratio;
+
+    bool backlog = queued * 100 >= depth * MERGE_QUEUE_PERCENT;
+    if ((m->latency_ratio > MERGE_SLOW_RATIO || backlog) && m->factor < m->max)
+    {
+        m->factor = m->factor * 2 < m->max ? m->factor * 2 : m->max;
+        printf("Sink backpressure: merging up to %u chunks per write\n", m->factor);
+    }
+    else if (queued == 0 && m->latency_ratio < MERGE_FAST_RATIO && m->factor > 1)
+    {
+        m->factor /= 2;
+        if (m->factor == 1)
+            printf("Sink caught up: writing chunks at their nominal size\n");
+    }
+}
+
+// Seconds of signal in a chunk
+double merge_chunk_seconds(const sdat_chunk_t *chunk)
+{
+    uint32_t nch = chunk->num_channels ? chunk->num_channels : 1;
+    return chunk->sample_rate > 0.0 ? (chunk->sample_count / nch) / chunk->sample_rate : 0.0;
+}
+
+// Extension records must match in type and length to be combined
+static bool ext_compatible(const sdat_chunk_t *a, const sdat_chunk_t *b)
+{
+    if (a->ext_len != b->ext_len)
+        return false;
+
+    for (uint32_t offset = 0; offset + SDAT_EXT_HEADER_SIZE <= a->ext_len; )
+    {
+        uint32_t type = (uint32_t)get_le(a->ext + offset, 2);
+        uint32_t length = (uint32_t)get_le(a->ext + offset + 4, 4);
+        if (type != SDAT_EXT_SPECTRUM || memcmp(a->ext + offset, b->ext + offset, SDAT_EXT_HEADER_SIZE) != 0)
+            return false;
+        offset += SDAT_EXT_HEADER_SIZE + length;
+    }
+    return true;
+}
+
+// Same source, next samples, both with a full payload
+bool merge_compatible(const sdat_chunk_t *prev, const sdat_chunk_t *next)
+{
+    uint32_t nch = prev->num_channels;
+    return nch > 0 &&
+           next->stream == prev->stream &&
+           next->boot_id == prev->boot_id &&
+           next->device_id == prev->device_id &&
+           next->sample_rate == prev->sample_rate &&
+           next->decimation == prev->decimation &&
+           next->num_channels == nch &&
+           memcmp(next->channels, prev->channels, nch) == 0 &&
+           next->seq_start == prev->seq_start + prev->sample_count / nch &&
+           !(prev->flags & SDAT_FLAG_FLAT) && !(next->flags & SDAT_FLAG_FLAT) &&
+           !(prev->flags & SDAT_FLAG_CAPTURE_END) &&
+           (prev->flags & SDAT_FLAG_PLANAR) == (next->flags & SDAT_FLAG_PLANAR) &&
+           ext_compatible(prev, next);
+}
+
+// Add an event, folding it into the same event carried by an earlier chunk
+static void add_event(sdat_chunk_t *chunk, const sdat_event_t *ev)
+{
+    for (uint32_t i = 0; i < chunk->event_count; i++)
+    {
+        sdat_event_t *have = &chunk->events[i];
+        if (have->onset == ev->onset && have->channel == ev->channel)
+        {
+            // The later chunk saw more of it
+            have->duration = ev->duration;
+            have->kinds |= ev->kinds;
+            if (ev->peak > have->peak)
+                have->peak = ev->peak;
+            return;
+        }
+    }
+    if (chunk->event_count < SDAT_MAX_EVENTS)
+        chunk->events[chunk->event_count++] = *ev;
+}
+
+// Add an anchor; neighbours carried by both chunks are added once. A full
+// table is thinned to half, so a long merge keeps them evenly spread.
+static void add_anchor(sdat_chunk_t *chunk, const sdat_anchor_t *a)
+{
+    uint32_t n = chunk->anchor_count;
+    if (n > 0 && a->index <= chunk->anchors[n - 1].index)
+        return;
+    if (n == SDAT_MAX_ANCHORS)
+        chunk->anchor_count = anchor_thin(chunk->anchors, n, SDAT_MAX_ANCHORS / 2);
+    chunk->anchors[chunk->anchor_count++] = *a;
+}
+
+// Combine contiguous chunks
+sdat_chunk_t* merge_chunks(sdat_chunk_t *const *chunks, uint32_t count)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; i++)
+        total += chunks[i]->sample_count;
+    if (total > UINT32_MAX)
+        return NULL;
+
+    size_t bytes = sdat_chunk_footprint((uint32_t)total);
+    if (budget_reserve(BUDGET_QUEUES, bytes, "merged chunk") != 0)
+        return NULL;
+    sdat_chunk_t *merged = sdat_chunk_create((uint32_t)total);
+    if (merged == NULL)
+    {
+        budget_release(BUDGET_QUEUES, bytes);
+        return NULL;
+    }
+
+    // Metadata of the first chunk, extensions copied record by record
+    const sdat_chunk_t *first = chunks[0];
+    memcpy(merged, first, offsetof(sdat_chunk_t, ext));
+    merged->event_count = 0;
+    merged->anchor_count = 0;
+    merged->sample_count = 0;
+    for (uint32_t offset = 0; offset + SDAT_EXT_HEADER_SIZE <= first->ext_len; )
+    {
+        uint32_t length = (uint32_t)get_le(first->ext + offset + 4, 4);
+        sdat_chunk_add_ext(merged, (uint16_t)get_le(first->ext + offset, 2),
+                           first->ext + offset + SDAT_EXT_HEADER_SIZE, length);
+        offset += SDAT_EXT_HEADER_SIZE + length;
+    }
+
+    uint32_t nch = first->num_channels;
+    size_t total_frames = (size_t)(total / nch);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const sdat_chunk_t *c = chunks[i];
+        if (c->flags & SDAT_FLAG_PLANAR)
+        {
+            // Each channel's block continues the same block of the last chunk
+            size_t frames = c->sample_count / nch;
+            size_t done = merged->sample_count / nch;
+            for (uint32_t ch = 0; ch < nch; ch++)
+                memcpy(merged->samples + ch * total_frames + done, c->samples + ch * frames, frames * sizeof(double));
+        }
+        else
+        {
+            memcpy(merged->samples + merged->sample_count, c->samples, (size_t)c->sample_count * sizeof(double));
+        }
+        merged->sample_count += c->sample_count;
+        // How the chunk was closed is decided by the last one
+        merged->flags &= ~(SDAT_FLAG_PARTIAL | SDAT_FLAG_CAPTURE_END);
+        merged->flags |= c->flags;
+        merged->time_end = c->time_end;
+        for (uint32_t e = 0; e < c->event_count; e++)
+            add_event(merged, &c->events[e]);
+        for (uint32_t a = 0; a < c->anchor_count; a++)
+            add_anchor(merged, &c->anchors[a]);
+
+        // Spectra are the only extensions merge_compatible() lets through
+        for (uint32_t offset = 0; i > 0 && offset + SDAT_EXT_HEADER_SIZE <= c->ext_len; )
+        {
+            uint32_t length = (uint32_t)get_le(c->ext + offset + 4, 4);
+            if (spectrum_merge(merged->ext + offset + SDAT_EXT_HEADER_SIZE,
+                               c->ext + offset + SDAT_EXT_HEADER_SIZE, length) != 0)
+            {
+                merge_free(merged);
+                return NULL;
+            }
+            offset += SDAT_EXT_HEADER_SIZE + length;
+        }
+    }
+    // The CRC covers the payload as merged
+    merged->payload_crc = (uint32_t)crc32(0L, (const Bytef*)merged->samples,
+                                          (uInt)((size_t)merged->sample_count * sizeof(double)));
+    merged->refcount = 1;
+    return merged;
+}
+
+// Free a merged chunk and its reservation
+void merge_free(sdat_chunk_t *merged)
+{
+    budget_release(BUDGET_QUEUES, sdat_chunk_footprint(merged->capacity));
+    sdat_chunk_free(merged);
+}
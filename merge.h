@@ -0,0 +1,68 @@
+/*
+    Adaptive chunk merging under storage backpressure.
+
+    Every chunk costs a sink a fixed overhead on top of its data (for the
+    file sink an open, a rename and a directory update), which a slow SD
+    card makes worse exactly when it is already behind. A sink with
+    merging enabled combines consecutive chunks waiting in its queue into
+    one larger chunk, so a backlog is written as fewer, larger files, and
+    goes back to the nominal chunk size once it has caught up.
+
+    A feedback controller per sink sets how many chunks may be merged. It
+    doubles the factor (up to the configured maximum) while writes take
+    more than MERGE_SLOW_RATIO of the chunk duration or the queue is at
+    least MERGE_QUEUE_PERCENT full, and halves it once the queue is empty
+    and writes take less than MERGE_FAST_RATIO. Only chunks that are
+    already queued are merged, so merging never holds a chunk back.
+
+    A merged chunk is an ordinary self-describing SDAT chunk. Chunks are
+    merged only if they continue each other (same stream, boot, rate and
+    channels, contiguous seq, one payload layout), neither has an elided
+    payload and the first does not end a capture. Their events are
+    combined, and spectrum extensions are averaged weighted by their
+    segment counts.
+
+    Sink argument:
+        merge=<max chunks>      default 1 (off), at most MERGE_MAX
+*/
+
+#ifndef MERGE_H_
+#define MERGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdat.h"
+
+#define MERGE_MAX 16
+#define MERGE_SLOW_RATIO 0.5        // write time / chunk duration that grows the factor
+#define MERGE_FAST_RATIO 0.1        // ... and below which an empty queue shrinks it
+#define MERGE_QUEUE_PERCENT 25
+
+typedef struct {
+    uint32_t max;               // 1 = merging off
+    uint32_t factor;            // chunks that may be merged now
+    double latency_ratio;       // smoothed write time / chunk duration
+    uint64_t merged;            // chunks written as part of a merged chunk
+} merge_ctl_t;
+
+// Parse merge= from sink arguments. Returns -1 if invalid.
+int merge_init(merge_ctl_t *m, const char *args);
+
+// Feed back one write: how long it took, the duration of the data it
+// wrote, and the queue left behind
+void merge_update(merge_ctl_t *m, double write_sec, double data_sec, uint32_t queued, uint32_t depth);
+
+// Seconds of signal in a chunk
+double merge_chunk_seconds(const sdat_chunk_t *chunk);
+
+// True if next continues prev and both may share one chunk
+bool merge_compatible(const sdat_chunk_t *prev, const sdat_chunk_t *next);
+
+// Combine count compatible chunks into a new chunk (reserved in the
+// memory budget). NULL if it cannot be built; the sources are unchanged.
+sdat_chunk_t* merge_chunks(sdat_chunk_t *const *chunks, uint32_t count);
+
+// Free a chunk from merge_chunks()
+void merge_free(sdat_chunk_t *merged);
+
+#endif /* MERGE_H_ */
@@ -0,0 +1,176 @@
+/*
+    Token-bucket pacing for sink writes (see pace.h)
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pace.h"
+#include "config.h"
+#include "util.h"
+
+static int g_ring_fill = 0;
+static int g_queue_fill = 0;
+static uint64_t g_waited_us = 0;
+static uint64_t g_bypassed = 0;
+
+// Parse the sink arguments
+int pace_init(pace_t *p, const char *args)
+{
+    char value[32];
+
+    memset(p, 0, sizeof(*p));
+    if (!config_arg(args, "pace", value, sizeof(value)) || strcmp(value, "off") == 0)
+        return 0;
+
+    if (strcmp(value, "auto") == 0)
+    {
+        p->automatic = true;
+    }
+    else
+    {
+        char *end;
+        double kb_per_sec = strtod(value, &end);
+        if (end == value || *end != '\0' || kb_per_sec <= 0.0)
+        {
+            fprintf(stderr, "Error: Invalid pace \"%s\" (off, auto or KB/s)\n", value);
+            return -1;
+        }
+        p->rate = kb_per_sec * 1024.0;
+    }
+
+    double burst_kb = config_arg_double(args, "burst", PACE_DEFAULT_BURST_KB);
+    if (burst_kb * 1024.0 < PACE_SLICE_BYTES)
+    {
+        fprintf(stderr, "Error: Invalid burst %.0f KB (at least %d KB)\n", burst_kb, PACE_SLICE_BYTES / 1024);
+        return -1;
+    }
+    p->burst = burst_kb * 1024.0;
+    p->tokens = p->burst;
+    p->last_refill = now_mono();
+    p->window_start = p->last_refill;
+    p->enabled = true;
+    return 0;
+}
+
+// Follow the data rate arriving at the sink. The estimate rises at once
+// and decays slowly, so a rate increase is never paced too tightly.
+static void measure(pace_t *p, size_t len)
+{
+    double now = now_mono();
+
+    // Time without writes (capture stopped) is not part of the data rate
+    if (now - p->last_write > PACE_WINDOW_SEC)
+    {
+        p->window_start = now;
+        p->window_bytes = 0;
+    }
+    p->last_write = now;
+    p->window_bytes += len;
+    double elapsed = now - p->window_start;
+    if (elapsed < PACE_WINDOW_SEC)
+        return;
+
+    double rate = PACE_HEADROOM * p->window_bytes / elapsed;
+    p->rate = rate > p->rate ? rate : 0.5 * (p->rate + rate);
+    p->window_start = now;
+    p->window_bytes = 0;
+}
+
+// Take tokens for bytes, sleeping until the bucket covers them
+static void take(pace_t *p, size_t bytes)
+{
+    double now = now_mono();
+    p->tokens += (now - p->last_refill) * p->rate;
+    if (p->tokens > p->burst)
+        p->tokens = p->burst;
+    p->last_refill = now;
+
+    // Going negative is the debt the refill pays back before the next slice
+    p->tokens -= (double)bytes;
+    if (p->tokens >= 0.0)
+        return;
+
+    double wait = -p->tokens / p->rate;
+    struct timespec ts;
+    ts.tv_sec = (time_t)wait;
+    ts.tv_nsec = (long)((wait - (double)ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+    __atomic_add_fetch(&g_waited_us, (uint64_t)(wait * 1e6), __ATOMIC_RELAXED);
+}
+
+// True while a backlog builds up behind the sinks
+static bool backlogged(void)
+{
+    return __atomic_load_n(&g_ring_fill, __ATOMIC_RELAXED) >= PACE_BYPASS_PERCENT ||
+           __atomic_load_n(&g_queue_fill, __ATOMIC_RELAXED) >= PACE_BYPASS_PERCENT;
+}
+
+// Write in slices, each waiting for its tokens
+int pace_write(pace_t *p, int fd, const void *data, size_t len)
+{
+    const uint8_t *ptr = (const uint8_t*)data;
+
+    if (p->enabled && p->automatic)
+        measure(p, len);
+
+    while (len > 0)
+    {
+        size_t slice = len < PACE_SLICE_BYTES ? len : PACE_SLICE_BYTES;
+        bool paced = p->enabled && p->rate > 0.0;
+        if (paced && backlogged())
+        {
+            paced = false;
+            __atomic_add_fetch(&g_bypassed, 1, __ATOMIC_RELAXED);
+        }
+        if (paced)
+            take(p, slice);
+
+        // The slice is paid for: an interrupted or short write is retried
+        // without taking its tokens again
+        size_t written = 0;
+        while (written < slice)
+        {
+            ssize_t n = write(fd, ptr + written, slice - written);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            written += (size_t)n;
+        }
+
+        // Start writeback now instead of letting dirty pages pile up
+        if (paced)
+            sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        ptr += slice;
+        len -= slice;
+    }
+    return 0;
+}
+
+// Backlog of the consumer's ring
+void pace_set_ring_fill(int percent)
+{
+    __atomic_store_n(&g_ring_fill, percent, __ATOMIC_RELAXED);
+}
+
+// Backlog of the fullest blocking sink queue
+void pace_set_queue_fill(int percent)
+{
+    __atomic_store_n(&g_queue_fill, percent, __ATOMIC_RELAXED);
+}
+
+// Totals for STATUS
+void pace_status(char *buf, size_t len)
+{
+    snprintf(buf, len, "waited=%.3fs,bypassed=%llu",
+             __atomic_load_n(&g_waited_us, __ATOMIC_RELAXED) / 1e6,
+             (unsigned long long)__atomic_load_n(&g_bypassed, __ATOMIC_RELAXED));
+}
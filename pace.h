@@ -0,0 +1,62 @@
+/*
+    Token-bucket pacing for sink writes.
+
+    Writing a whole chunk at once every couple of seconds hits the storage
+    in bursts that stall other I/O on the box and trigger SD card garbage
+    collection. A paced sink writes each chunk in slices, each slice
+    taking tokens from a bucket that refills at the pacing rate, and
+    starts writeback of every slice right away so dirty pages leave the
+    cache as steadily as they arrive.
+
+    With pace=auto the rate follows the measured data rate of the sink
+    (times PACE_HEADROOM, so pacing never falls behind). Pacing is
+    bypassed while the consumer's ring or a sink queue is half full, so a
+    backlog is never made worse by waiting for tokens.
+
+    Sink arguments (file and segment sinks):
+        pace=off|auto|<KB/s>    default off
+        burst=<KB>              tokens that may be spent at once, default 256
+*/
+
+#ifndef PACE_H_
+#define PACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PACE_DEFAULT_BURST_KB 256
+#define PACE_SLICE_BYTES (64 * 1024)
+#define PACE_HEADROOM 2.0           // auto rate = data rate x headroom
+#define PACE_WINDOW_SEC 4.0         // data rate measurement window
+#define PACE_BYPASS_PERCENT 50      // ring or queue fill that turns pacing off
+
+typedef struct {
+    bool enabled;
+    bool automatic;             // rate follows the measured data rate
+    double rate;                // bytes per second, 0 = not known yet
+    double burst;               // bytes
+    double tokens;
+    double last_refill;         // monotonic seconds
+
+    // Data rate measurement for pace=auto
+    double window_start;
+    uint64_t window_bytes;
+    double last_write;          // monotonic seconds, idle gaps restart the window
+} pace_t;
+
+// Parse pace= and burst= from sink arguments. Returns -1 if invalid.
+int pace_init(pace_t *p, const char *args);
+
+// Write len bytes to fd, pacing if enabled. Returns 0, or -1 on error.
+int pace_write(pace_t *p, int fd, const void *data, size_t len);
+
+// Backlog reported by the consumer (ring) and the sink queues, in percent
+// of their capacity; either one at PACE_BYPASS_PERCENT bypasses pacing
+void pace_set_ring_fill(int percent);
+void pace_set_queue_fill(int percent);
+
+// Totals over all paced sinks for STATUS: "waited=<s>,bypassed=<slices>"
+void pace_status(char *buf, size_t len);
+
+#endif /* PACE_H_ */
@@ -0,0 +1,660 @@
+/*
+    Reader for stored SDAT chunks (see reader.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "reader.h"
+#include "compact.h"
+#include "flat.h"
+#include "layout.h"
+#include "anchor.h"
+#include "util.h"
+
+#define ARCHIVE_ENTRY_SIZE 46       // fixed part of an archive index entry
+#define ANCHOR_RECORD_SIZE 20
+#define READER_PATH_LEN 1024
+
+// Little-endian double
+static double get_f64(const uint8_t *p)
+{
+    uint64_t bits = get_le(p, 8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Read exactly len bytes at offset
+static int read_at(int fd, void *buf, size_t len, uint64_t offset)
+{
+    uint8_t *p = (uint8_t*)buf;
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Remember a file; returns its index or -1
+static int add_file(reader_t *rd, const char *path)
+{
+    char **files = (char**)realloc(rd->files, (rd->num_files + 1) * sizeof(char*));
+    if (files == NULL)
+        return -1;
+    rd->files = files;
+    rd->files[rd->num_files] = strdup(path);
+    if (rd->files[rd->num_files] == NULL)
+        return -1;
+    return (int)rd->num_files++;
+}
+
+// Append a listed chunk
+static int add_chunk(reader_t *rd, const reader_chunk_t *c)
+{
+    if (rd->count == rd->capacity)
+    {
+        size_t capacity = rd->capacity ? rd->capacity * 2 : 1024;
+        reader_chunk_t *chunks = (reader_chunk_t*)realloc(rd->chunks, capacity * sizeof(reader_chunk_t));
+        if (chunks == NULL)
+            return -1;
+        rd->chunks = chunks;
+        rd->capacity = capacity;
+    }
+    rd->chunks[rd->count++] = *c;
+    return 0;
+}
+
+// Size of the header and extensions, 0 if buf is no SDAT header
+static size_t header_length(const uint8_t *buf, size_t len)
+{
+    if (len < SDAT_HEADER_SIZE || memcmp(buf, SDAT_MAGIC, 4) != 0)
+        return 0;
+    uint16_t version = (uint16_t)get_le(buf + 4, 2);
+    if (version < 2)
+        return version == 1 ? SDAT_HEADER_SIZE : 0;
+    if (len < SDAT_HEADER_V2_SIZE)
+        return 0;
+    return SDAT_HEADER_V2_SIZE + (size_t)get_le(buf + 60, 4);
+}
+
+// Find an extension; returns its body or NULL
+static const uint8_t* find_ext(const uint8_t *buf, size_t header_len, uint16_t type, uint32_t *ext_len)
+{
+    size_t pos = SDAT_HEADER_V2_SIZE;
+    while (header_len > SDAT_HEADER_V2_SIZE && pos + SDAT_EXT_HEADER_SIZE <= header_len)
+    {
+        uint16_t t = (uint16_t)get_le(buf + pos, 2);
+        uint32_t len = (uint32_t)get_le(buf + pos + 4, 4);
+        pos += SDAT_EXT_HEADER_SIZE;
+        if (len > header_len - pos)
+            return NULL;
+        if (t == type)
+        {
+            *ext_len = len;
+            return buf + pos;
+        }
+        pos += len;
+    }
+    return NULL;
+}
+
+// List one chunk from its header (len bytes of it are in buf). Returns the
+// chunk size, 0 for no chunk, and sets *matches if it belongs to the stream.
+static uint32_t parse_header(reader_t *rd, const uint8_t *buf, size_t len, reader_chunk_t *c, bool *matches)
+{
+    *matches = false;
+    size_t header_len = header_length(buf, len);
+    if (header_len == 0 || header_len > len)
+        return 0;
+
+    uint32_t sample_count = (uint32_t)get_le(buf + 32, 4);
+    memset(c, 0, sizeof(*c));
+    c->boot_id = get_le(buf + 10, 8);
+    c->seq_start = get_le(buf + 18, 8);
+    c->rate_hz = (uint32_t)get_le(buf + 26, 4);
+    c->time_start = get_le(buf + 36, 8);
+    c->flags = header_len > SDAT_HEADER_SIZE ? (uint32_t)get_le(buf + 56, 4) : 0;
+    uint64_t payload = (c->flags & SDAT_FLAG_FLAT) ? 0 : (uint64_t)sample_count * get_le(buf + 30, 2);
+    if (header_len + payload > UINT32_MAX)
+        return 0;
+    c->size = (uint32_t)(header_len + payload);
+
+    uint16_t stream = 0;
+    uint32_t num_channels = rd->num_channels;
+    uint32_t decimation = 1;
+    uint32_t ext_len;
+    const uint8_t *ext = find_ext(buf, header_len, SDAT_EXT_STREAM, &ext_len);
+    if (ext != NULL && ext_len >= 9)
+    {
+        stream = (uint16_t)get_le(ext, 2);
+        decimation = (uint32_t)get_le(ext + 4, 4);
+        uint32_t name_len = (uint32_t)get_le(ext + 2, 2);
+        if (9 + name_len <= ext_len)
+        {
+            num_channels = ext[8 + name_len];
+            if (num_channels > SDAT_MAX_CHANNELS || 9 + name_len + num_channels > ext_len)
+                num_channels = 0;
+        }
+        if (stream == rd->stream && rd->count == 0 && num_channels > 0)
+        {
+            rd->num_channels = num_channels;
+            memcpy(rd->channels, ext + 9 + name_len, num_channels);
+            rd->decimation = decimation > 0 ? decimation : 1;
+        }
+    }
+    if (stream != rd->stream)
+        return c->size;
+
+    if (num_channels == 0 || num_channels != rd->num_channels || sample_count % num_channels != 0)
+    {
+        fprintf(stderr, "Warning: Skipped chunk seq=%llu with %u samples (expected %u channels)\n",
+                (unsigned long long)c->seq_start, sample_count, rd->num_channels);
+        return c->size;
+    }
+    c->frames = sample_count / num_channels;
+
+    // The last anchor inside the chunk, for the timestamp model
+    const uint8_t *anchors = find_ext(buf, header_len, SDAT_EXT_ANCHORS, &ext_len);
+    uint64_t first = c->seq_start * rd->decimation, end = (c->seq_start + c->frames) * rd->decimation;
+    for (uint32_t k = 0; anchors != NULL && k < ext_len / ANCHOR_RECORD_SIZE; k++)
+    {
+        const uint8_t *a = anchors + (size_t)k * ANCHOR_RECORD_SIZE;
+        uint64_t index = get_le(a, 8);
+        if (index >= first && index < end)
+        {
+            c->anchor_index = index;
+            c->anchor_ns = (int64_t)get_le(a + 8, 8);
+            c->anchor_flags |= (uint16_t)get_le(a + 18, 2);
+        }
+    }
+    *matches = true;
+    return c->size;
+}
+
+// List the chunks stored back to back in a file
+static int scan_file(reader_t *rd, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    int file = add_file(rd, path);
+    if (fstat(fd, &st) != 0 || file < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *buf = (uint8_t*)malloc(SDAT_MAX_HEADER_SIZE);
+    int rc = buf != NULL ? 0 : -1;
+    uint64_t offset = 0;
+    while (buf != NULL && offset < (uint64_t)st.st_size)
+    {
+        size_t want = (uint64_t)st.st_size - offset < SDAT_MAX_HEADER_SIZE ?
+                      (size_t)((uint64_t)st.st_size - offset) : SDAT_MAX_HEADER_SIZE;
+        reader_chunk_t c;
+        bool matches;
+        uint32_t size = read_at(fd, buf, want, offset) == 0 ? parse_header(rd, buf, want, &c, &matches) : 0;
+        if (size == 0)
+        {
+            fprintf(stderr, "Warning: %s: no SDAT chunk at offset %llu, rest skipped\n", path,
+                    (unsigned long long)offset);
+            break;
+        }
+        if (offset + size > (uint64_t)st.st_size)
+            break;  // still being written (.part)
+        c.file = (uint32_t)file;
+        c.offset = offset;
+        c.stored = size;
+        if (matches && add_chunk(rd, &c) != 0)
+            break;
+        offset += size;
+    }
+    free(buf);
+    close(fd);
+    return rc;
+}
+
+// List the chunks in a compacted archive
+static int scan_archive(reader_t *rd, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    uint8_t header[COMPACT_HEADER_SIZE];
+    if (fd < 0 || read_at(fd, header, sizeof(header), 0) != 0 ||
+        memcmp(header, COMPACT_MAGIC, 4) != 0 || get_le(header + 4, 2) != COMPACT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a readable archive\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    uint32_t entries = (uint32_t)get_le(header + 8, 4);
+    uint64_t index_offset = get_le(header + 16, 8);
+    uint64_t index_size = get_le(header + 24, 8);
+    int file = add_file(rd, path);
+    uint8_t *index = index_size <= UINT32_MAX ? (uint8_t*)malloc(index_size ? index_size : 1) : NULL;
+    uint8_t *member = (uint8_t*)malloc(SDAT_MAX_HEADER_SIZE);
+    uint8_t *head = (uint8_t*)malloc(SDAT_MAX_HEADER_SIZE);
+    int rc = 0;
+    if (file < 0 || index == NULL || member == NULL || head == NULL ||
+        read_at(fd, index, index_size, index_offset) != 0)
+    {
+        fprintf(stderr, "Error: Cannot read the index of %s\n", path);
+        rc = -1;
+    }
+
+    const uint8_t *p = index;
+    for (uint32_t i = 0; rc == 0 && i < entries; i++)
+    {
+        if (p + ARCHIVE_ENTRY_SIZE > index + index_size)
+            break;
+        uint64_t offset = get_le(p, 8);
+        uint32_t stored = (uint32_t)get_le(p + 8, 4);
+        p += ARCHIVE_ENTRY_SIZE + get_le(p + 44, 2);
+
+        // Inflate just enough of the member for its header
+        size_t in_len = stored < SDAT_MAX_HEADER_SIZE ? stored : SDAT_MAX_HEADER_SIZE;
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (read_at(fd, member, in_len, offset) != 0 || inflateInit(&zs) != Z_OK)
+            continue;
+        zs.next_in = member;
+        zs.avail_in = (uInt)in_len;
+        zs.next_out = head;
+        zs.avail_out = SDAT_MAX_HEADER_SIZE;
+        inflate(&zs, Z_SYNC_FLUSH);
+        size_t head_len = SDAT_MAX_HEADER_SIZE - zs.avail_out;
+        inflateEnd(&zs);
+
+        reader_chunk_t c;
+        bool matches;
+        if (parse_header(rd, head, head_len, &c, &matches) == 0 || !matches)
+            continue;
+        c.file = (uint32_t)file;
+        c.offset = offset;
+        c.stored = stored;
+        if (add_chunk(rd, &c) != 0)
+            rc = -1;
+    }
+    free(index);
+    free(member);
+    free(head);
+    close(fd);
+    return rc;
+}
+
+// Whether name ends with suffix
+static bool has_suffix(const char *name, const char *suffix)
+{
+    size_t n = strlen(name), s = strlen(suffix);
+    return n >= s && strcmp(name + n - s, suffix) == 0;
+}
+
+// List every stored form of chunks in a directory
+static int scan_dir(reader_t *rd, const char *dir, bool archives_only)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return archives_only ? 0 : -1;
+
+    struct dirent *de;
+    int rc = 0;
+    while (rc == 0 && (de = readdir(d)) != NULL)
+    {
+        char path[READER_PATH_LEN];
+        const char *name = de->d_name;
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (has_suffix(name, ".sdar"))
+            rc = scan_archive(rd, path);
+        else if (archives_only)
+            continue;
+        else if ((strncmp(name, "chunk_", 6) == 0 && has_suffix(name, "_.bin")) ||
+                 (strncmp(name, "segment_", 8) == 0 && (has_suffix(name, ".log") || has_suffix(name, ".log.part"))) ||
+                 strcmp(name, "chunks.dat") == 0)
+            rc = scan_file(rd, path);
+    }
+    closedir(d);
+    if (rc == 0 && !archives_only)
+    {
+        char path[READER_PATH_LEN];
+        snprintf(path, sizeof(path), "%s/archive", dir);
+        rc = scan_dir(rd, path, true);
+    }
+    return rc;
+}
+
+// Order by boot and seq_start
+static int compare_chunks(const void *a, const void *b)
+{
+    const reader_chunk_t *x = (const reader_chunk_t*)a;
+    const reader_chunk_t *y = (const reader_chunk_t*)b;
+    if (x->boot_id != y->boot_id)
+        return x->boot_id < y->boot_id ? -1 : 1;
+    if (x->seq_start != y->seq_start)
+        return x->seq_start < y->seq_start ? -1 : 1;
+    return 0;
+}
+
+// A run of chunks of one boot
+typedef struct {
+    size_t first;
+    size_t count;
+    uint64_t time_start;
+} boot_run_t;
+
+// Order boots by when they were recorded
+static int compare_runs(const void *a, const void *b)
+{
+    const boot_run_t *x = (const boot_run_t*)a;
+    const boot_run_t *y = (const boot_run_t*)b;
+    if (x->time_start != y->time_start)
+        return x->time_start < y->time_start ? -1 : 1;
+    return x->first < y->first ? -1 : 1;
+}
+
+// Sort, drop duplicates and put the boots in time order
+static int sort_chunks(reader_t *rd)
+{
+    if (rd->count == 0)
+        return 0;
+    qsort(rd->chunks, rd->count, sizeof(reader_chunk_t), compare_chunks);
+
+    size_t kept = 1;
+    for (size_t i = 1; i < rd->count; i++)
+    {
+        if (compare_chunks(&rd->chunks[i], &rd->chunks[kept - 1]) != 0)
+            rd->chunks[kept++] = rd->chunks[i];
+    }
+    rd->count = kept;
+
+    size_t num_runs = 0;
+    boot_run_t *runs = (boot_run_t*)malloc(rd->count * sizeof(boot_run_t));
+    reader_chunk_t *sorted = (reader_chunk_t*)malloc(rd->count * sizeof(reader_chunk_t));
+    if (runs == NULL || sorted == NULL)
+    {
+        free(runs);
+        free(sorted);
+        return -1;
+    }
+    for (size_t i = 0; i < rd->count; i++)
+    {
+        if (i == 0 || rd->chunks[i].boot_id != rd->chunks[i - 1].boot_id)
+            runs[num_runs++] = (boot_run_t){ i, 0, rd->chunks[i].time_start };
+        runs[num_runs - 1].count++;
+    }
+    qsort(runs, num_runs, sizeof(boot_run_t), compare_runs);
+
+    size_t pos = 0;
+    for (size_t r = 0; r < num_runs; r++)
+    {
+        memcpy(sorted + pos, rd->chunks + runs[r].first, runs[r].count * sizeof(reader_chunk_t));
+        pos += runs[r].count;
+    }
+    free(rd->chunks);
+    free(runs);
+    rd->chunks = sorted;
+    rd->capacity = rd->count;
+    return 0;
+}
+
+// List the chunks of one stream under path
+int reader_open(reader_t *rd, const char *path, uint16_t stream,
+                const uint8_t *channels, uint32_t num_channels)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->stream = stream;
+    rd->decimation = 1;
+    if (stream == 0)
+    {
+        if (num_channels == 0 || num_channels > SDAT_MAX_CHANNELS)
+        {
+            fprintf(stderr, "Error: 1 to %d scan channels expected\n", SDAT_MAX_CHANNELS);
+            return -1;
+        }
+        rd->num_channels = num_channels;
+        memcpy(rd->channels, channels, num_channels);
+    }
+
+    struct stat st;
+    int rc;
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode))
+        rc = scan_dir(rd, path, false);
+    else if (has_suffix(path, ".sdar"))
+        rc = scan_archive(rd, path);
+    else
+        rc = scan_file(rd, path);
+
+    if (rc == 0)
+        rc = sort_chunks(rd);
+    if (rc == 0 && rd->count == 0)
+    {
+        fprintf(stderr, "Error: No chunks of stream %u in %s\n", stream, path);
+        rc = -1;
+    }
+    if (rc != 0)
+        reader_close(rd);
+    return rc;
+}
+
+// Rebuild a flat chunk as a staircase of its block means
+static int load_flat(const reader_t *rd, const reader_chunk_t *c, const uint8_t *buf,
+                     size_t header_len, bool planar, double *out)
+{
+    size_t frame_step = planar ? 1 : rd->num_channels;
+    size_t channel_step = planar ? c->frames : 1;
+    uint32_t ext_len;
+    const uint8_t *p = find_ext(buf, header_len, SDAT_EXT_FLAT, &ext_len);
+    if (p == NULL)
+        return -1;
+    const uint8_t *end = p + ext_len;
+
+    for (uint32_t ch = 0; ch < rd->num_channels; ch++)
+    {
+        if (p + FLAT_RECORD_HEADER_SIZE > end)
+            return -1;
+        uint32_t points = (uint32_t)get_le(p + 2, 2);
+        uint32_t step_bits = (uint32_t)get_le(p + 4, 4);
+        float step;
+        memcpy(&step, &step_bits, sizeof(step));
+        double mean = get_f64(p + 8);
+        const int8_t *q = (const int8_t*)(p + FLAT_RECORD_HEADER_SIZE);
+        if (points == 0 || p + FLAT_RECORD_HEADER_SIZE + points > end)
+            return -1;
+
+        for (uint32_t k = 0; k < points; k++)
+        {
+            uint32_t first = (uint32_t)((uint64_t)c->frames * k / points);
+            uint32_t last = (uint32_t)((uint64_t)c->frames * (k + 1) / points);
+            double value = mean + q[k] * (double)step;
+            for (uint32_t f = first; f < last; f++)
+                out[f * frame_step + ch * channel_step] = value;
+        }
+        p += FLAT_RECORD_HEADER_SIZE + points;
+    }
+    return 0;
+}
+
+// Copy a payload to out in the requested layout
+static int load_payload(const reader_t *rd, const reader_chunk_t *c, const uint8_t *payload,
+                        uint32_t crc, bool planar, double *out)
+{
+    size_t bytes = (size_t)c->frames * rd->num_channels * sizeof(double);
+    if (crc != 0 && (uint32_t)crc32(0L, payload, (uInt)bytes) != crc)
+    {
+        fprintf(stderr, "Error: Payload CRC mismatch in chunk seq=%llu\n", (unsigned long long)c->seq_start);
+        return -1;
+    }
+    if (planar == ((c->flags & SDAT_FLAG_PLANAR) != 0) || rd->num_channels == 1)
+    {
+        memcpy(out, payload, bytes);
+        return 0;
+    }
+
+    // Convert from an aligned copy: the payload follows the header at any
+    // byte offset
+    double *copy = (double*)malloc(bytes);
+    if (copy == NULL)
+        return -1;
+    memcpy(copy, payload, bytes);
+    if (planar)
+        layout_deinterleave(out, copy, c->frames, rd->num_channels);
+    else
+        layout_interleave(out, copy, c->frames, rd->num_channels);
+    free(copy);
+    return 0;
+}
+
+// Read a whole chunk, inflating an archive member. Returns c->size bytes
+// to free(), or NULL.
+static uint8_t* read_chunk(const reader_t *rd, const reader_chunk_t *c)
+{
+    const char *path = rd->files[c->file];
+    uint8_t *stored = (uint8_t*)malloc(c->stored);
+    uint8_t *buf = NULL;
+    int fd = open(path, O_RDONLY);
+
+    if (stored != NULL && fd >= 0 && read_at(fd, stored, c->stored, c->offset) == 0)
+    {
+        if (has_suffix(path, ".sdar"))
+        {
+            // Archive member
+            uLongf size = c->size;
+            buf = (uint8_t*)malloc(c->size);
+            if (buf != NULL && (uncompress(buf, &size, stored, c->stored) != Z_OK || size != c->size))
+            {
+                free(buf);
+                buf = NULL;
+            }
+        }
+        else
+        {
+            buf = stored;
+            stored = NULL;
+        }
+    }
+    free(stored);
+    if (fd >= 0)
+        close(fd);
+    return buf;
+}
+
+// Decode the samples of one chunk in either layout
+static int load_chunk(const reader_t *rd, size_t index, bool planar, double *out)
+{
+    const reader_chunk_t *c = &rd->chunks[index];
+    uint8_t *buf = read_chunk(rd, c);
+    size_t header_len = buf != NULL ? header_length(buf, c->size) : 0;
+    size_t samples = (size_t)c->frames * rd->num_channels;
+    int rc = -1;
+
+    if (header_len == 0)
+        rc = -1;
+    else if (c->flags & SDAT_FLAG_FLAT)
+        rc = load_flat(rd, c, buf, header_len, planar, out);
+    else if (header_len + samples * sizeof(double) <= c->size)
+    {
+        rc = load_payload(rd, c, buf + header_len, (uint32_t)get_le(buf + 52, 4), planar, out);
+    }
+    if (rc != 0)
+    {
+        fprintf(stderr, "Error: Cannot read chunk seq=%llu from %s\n", (unsigned long long)c->seq_start,
+                rd->files[c->file]);
+    }
+    free(buf);
+    return rc;
+}
+
+// Decode one chunk, frames interleaved
+int reader_load(const reader_t *rd, size_t index, double *out)
+{
+    return load_chunk(rd, index, false, out);
+}
+
+// Decode one chunk, one channel after another
+int reader_load_planar(const reader_t *rd, size_t index, double *out)
+{
+    return load_chunk(rd, index, true, out);
+}
+
+// Time every frame of one chunk from its anchors
+int reader_times(const reader_t *rd, size_t index, int64_t origin_ns, double *out)
+{
+    const reader_chunk_t *c = &rd->chunks[index];
+    uint8_t *buf = read_chunk(rd, c);
+    size_t header_len = buf != NULL ? header_length(buf, c->size) : 0;
+    uint32_t ext_len = 0;
+    const uint8_t *p = header_len > 0 ? find_ext(buf, header_len, SDAT_EXT_ANCHORS, &ext_len) : NULL;
+    uint32_t count = p != NULL ? ext_len / ANCHOR_RECORD_SIZE : 0;
+    sdat_anchor_t *anchors = (sdat_anchor_t*)malloc((count ? count : 1) * sizeof(sdat_anchor_t));
+    int rc = -1;
+
+    if (buf == NULL)
+    {
+        fprintf(stderr, "Error: Cannot read chunk seq=%llu from %s\n", (unsigned long long)c->seq_start,
+                rd->files[c->file]);
+    }
+    else if (anchors != NULL && count > 0)
+    {
+        for (uint32_t k = 0; k < count; k++, p += ANCHOR_RECORD_SIZE)
+        {
+            anchors[k].index = get_le(p, 8);
+            anchors[k].time_ns = (int64_t)get_le(p + 8, 8);
+            anchors[k].status = (uint16_t)get_le(p + 16, 2);
+            anchors[k].flags = (uint16_t)get_le(p + 18, 2);
+        }
+        rc = anchor_times(anchors, count, c->seq_start * rd->decimation, rd->decimation, c->frames,
+                          (double)c->rate_hz * rd->decimation, origin_ns, out);
+    }
+    free(anchors);
+    free(buf);
+    return rc;
+}
+
+// First chunk in [first, last) whose samples end after seq
+size_t reader_find(const reader_t *rd, size_t first, size_t last, uint64_t seq)
+{
+    while (first < last)
+    {
+        size_t mid = first + (last - first) / 2;
+        if (rd->chunks[mid].seq_start + rd->chunks[mid].frames <= seq)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+// Free the listing
+void reader_close(reader_t *rd)
+{
+    for (size_t i = 0; i < rd->num_files; i++)
+        free(rd->files[i]);
+    free(rd->files);
+    free(rd->chunks);
+    memset(rd, 0, sizeof(*rd));
+}
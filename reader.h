@@ -0,0 +1,91 @@
+/*
+    Reader for stored SDAT chunks, shared by the offline tools.
+
+    An input path is one of:
+        a directory   chunk files chunk_<seq>_.bin of a file sink, segment
+                      files segment_<seq>.log[.part] of a segment sink, a
+                      collector's chunks.dat, and the compacted .sdar
+                      archives in <dir>/archive (see compact.h)
+        a .sdar file  one compacted archive
+        another file  SDAT chunks back to back (a segment file, or the
+                      chunks.dat of a collector device)
+    Only the chunks of one stream are listed. A chunk found twice (same
+    boot_id and seq_start, e.g. as a file and in an archive) is listed
+    once. Chunks are sorted by boot, boots in the order they were
+    recorded, and by seq_start within a boot.
+
+    Payloads are returned in the layout the caller asks for, interleaved
+    or planar, converting chunks stored the other way (see layout.h).
+
+    The full-rate stream (0) does not record its scan channels, so the
+    caller supplies them; derived streams carry theirs in the stream
+    extension.
+
+    Chunks with a timestamp anchor table (see anchor.h) time every frame
+    with reader_times().
+*/
+
+#ifndef READER_H_
+#define READER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdat.h"
+
+// One listed chunk
+typedef struct {
+    uint64_t boot_id;
+    uint64_t seq_start;
+    uint64_t time_start;        // unix seconds when the chunk was closed
+    uint32_t frames;            // samples per channel
+    uint32_t rate_hz;
+    uint32_t flags;             // SDAT_FLAG_*
+    uint32_t file;              // index into reader_t.files
+    uint64_t offset;            // of the chunk, or of its archive member
+    uint32_t stored;            // bytes at offset (compressed in an archive)
+    uint32_t size;              // bytes of the chunk
+    uint64_t anchor_index;      // full-rate frame of its last anchor inside it
+    int64_t anchor_ns;          // host time of that frame, 0 without anchors
+    uint16_t anchor_flags;      // SDAT_ANCHOR_* of all its anchors inside it
+} reader_chunk_t;
+
+typedef struct {
+    uint16_t stream;
+    uint32_t decimation;                    // seq_start * decimation = full-rate frame
+    uint32_t num_channels;
+    uint8_t channels[SDAT_MAX_CHANNELS];    // hardware channel of each column
+    char **files;
+    size_t num_files;
+    reader_chunk_t *chunks;
+    size_t count;
+    size_t capacity;
+} reader_t;
+
+// List the chunks of one stream under path. channels are the scan
+// channels of stream 0 chunks. Returns 0, or -1 with the error reported.
+int reader_open(reader_t *rd, const char *path, uint16_t stream,
+                const uint8_t *channels, uint32_t num_channels);
+
+// Decode the samples of chunk index into out (frames x num_channels
+// interleaved doubles); flat chunks are rebuilt from their descriptor and
+// planar payloads re-interleaved. Safe to call from several threads.
+// Returns 0 or -1.
+int reader_load(const reader_t *rd, size_t index, double *out);
+
+// As reader_load(), but out holds num_channels rows of frames doubles,
+// whatever layout the chunk was stored in
+int reader_load_planar(const reader_t *rd, size_t index, double *out);
+
+// Time of every frame of chunk index, in seconds after origin_ns (unix
+// ns), interpolated between the anchors it carries. Safe to call from
+// several threads. Returns 0, or -1 if the chunk has no anchors (written
+// before they were added) or cannot be read.
+int reader_times(const reader_t *rd, size_t index, int64_t origin_ns, double *out);
+
+// First chunk in [first, last), all of one boot, whose samples end after
+// seq; last if there is none
+size_t reader_find(const reader_t *rd, size_t first, size_t last, uint64_t seq);
+
+void reader_close(reader_t *rd);
+
+#endif /* READER_H_ */
@@ -0,0 +1,97 @@
+/*
+    Polyphase resampler (see resample.h)
+*/
+#include <stdlib.h>
+#include <math.h>
+#include "resample.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Modified Bessel function of the first kind, order 0
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+            break;
+    }
+    return sum;
+}
+
+// Design the filter bank
+int resample_init(resample_t *rs, double in_rate, double out_rate)
+{
+    // Cutoff in cycles per input sample
+    double fc = 0.5 * RESAMPLE_PASSBAND * (out_rate < in_rate ? out_rate / in_rate : 1.0);
+    uint32_t half = (uint32_t)ceil(RESAMPLE_ZERO_CROSSINGS / (2.0 * fc));
+    half = (half + 1) & ~1u;                // taps a multiple of 4
+    if (half > RESAMPLE_MAX_TAPS / 2)
+        half = RESAMPLE_MAX_TAPS / 2;
+    rs->taps = 2 * half;
+    rs->bank = (double*)malloc((size_t)(RESAMPLE_PHASES + 1) * rs->taps * sizeof(double));
+    if (rs->bank == NULL)
+        return -1;
+
+    double i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+    for (uint32_t p = 0; p <= RESAMPLE_PHASES; p++)
+    {
+        double *h = rs->bank + (size_t)p * rs->taps;
+        double frac = (double)p / RESAMPLE_PHASES;
+        double sum = 0.0;
+        for (uint32_t k = 0; k < rs->taps; k++)
+        {
+            // Distance of tap k from the output position, in input samples
+            double d = (double)k - (double)(half - 1) - frac;
+            double x = 2.0 * fc * d;
+            double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double r = d / half;
+            double window = fabs(r) < 1.0 ? bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1.0 - r * r)) / i0_beta : 0.0;
+            h[k] = 2.0 * fc * sinc * window;
+            sum += h[k];
+        }
+        // Unity gain at DC for every branch
+        for (uint32_t k = 0; k < rs->taps; k++)
+            h[k] /= sum;
+    }
+    return 0;
+}
+
+// Output sample at input position i + frac
+double resample_at(const resample_t *rs, const double *in, double frac)
+{
+    double phase = frac * RESAMPLE_PHASES;
+    uint32_t p = (uint32_t)phase;
+    if (p >= RESAMPLE_PHASES)
+        p = RESAMPLE_PHASES - 1;
+    double a = phase - p;
+    const double *h0 = rs->bank + (size_t)p * rs->taps;
+    const double *h1 = h0 + rs->taps;
+
+    // Four partial sums per branch, so the loop vectorizes without
+    // reassociating a single sum
+    double s0[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double s1[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (uint32_t k = 0; k < rs->taps; k += 4)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            s0[j] += in[k + j] * h0[k + j];
+            s1[j] += in[k + j] * h1[k + j];
+        }
+    }
+    double y0 = (s0[0] + s0[1]) + (s0[2] + s0[3]);
+    double y1 = (s1[0] + s1[1]) + (s1[2] + s1[3]);
+    return y0 + a * (y1 - y0);
+}
+
+// Free the filter bank
+void resample_free(resample_t *rs)
+{
+    free(rs->bank);
+    rs->bank = NULL;
+}
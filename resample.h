@@ -0,0 +1,47 @@
+/*
+    Polyphase resampler for arbitrary, slowly drifting ratios.
+
+    The prototype low-pass is a Kaiser-windowed sinc. Its impulse response
+    is tabulated at RESAMPLE_PHASES fractional offsets, the polyphase
+    branches. An output sample at the fractional input position x = i + f
+    is the dot product of the taps input samples around i with the branch
+    for f, interpolated linearly between the two nearest branches. The
+    position is given per output sample, so a ratio that changes with a
+    drifting clock costs nothing extra.
+
+    The cutoff is RESAMPLE_PASSBAND times the lower of the two Nyquist
+    frequencies. When decimating, the kernel widens by the ratio, so the
+    tap count grows with it (up to RESAMPLE_MAX_TAPS).
+
+    Kernels work on one channel's samples stored contiguously, so the dot
+    products are vectorized by the compiler (NEON/SSE).
+*/
+
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RESAMPLE_PHASES 256
+#define RESAMPLE_ZERO_CROSSINGS 16      // sinc lobes on each side
+#define RESAMPLE_MAX_TAPS 1024
+#define RESAMPLE_PASSBAND 0.9
+#define RESAMPLE_KAISER_BETA 8.0
+
+typedef struct {
+    uint32_t taps;              // per branch, even
+    double *bank;               // (RESAMPLE_PHASES + 1) branches of taps
+} resample_t;
+
+// Design the filter bank for in_rate -> out_rate. Returns 0 or -1.
+int resample_init(resample_t *rs, double in_rate, double out_rate);
+
+// Output sample at input position i + frac (0 <= frac < 1). in points at
+// sample i - taps / 2 + 1 and holds taps samples. A NaN among them (a
+// gap) makes the result NaN.
+double resample_at(const resample_t *rs, const double *in, double frac);
+
+void resample_free(resample_t *rs);
+
+#endif /* RESAMPLE_H_ */
@@ -0,0 +1,215 @@
+/*
+    Acquisition schedule (see schedule.h)
+*/
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "schedule.h"
+#include "config.h"
+#include "util.h"
+
+// Wall-clock time in seconds
+static double now_epoch(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Arm the timer for the earliest pending window. Caller holds the mutex.
+static void arm_timer(schedule_t *sc)
+{
+    double now = now_epoch();
+    double next = 0.0;
+
+    if (sc->every > 0.0)
+        next = (floor(now / sc->every) + 1.0) * sc->every;
+    if (sc->start_at > 0.0 && (next == 0.0 || sc->start_at < next))
+        next = sc->start_at > now ? sc->start_at : now;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next > 0.0)
+    {
+        its.it_value.tv_sec = (time_t)next;
+        its.it_value.tv_nsec = (long)((next - floor(next)) * 1e9);
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;  // zero would disarm
+    }
+    timerfd_settime(sc->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    sc->next_start = next;
+}
+
+// Create the descriptors and apply the "schedule" config line
+int schedule_init(schedule_t *sc)
+{
+    memset(sc, 0, sizeof(*sc));
+    sc->stop_after = SCHEDULE_UNLIMITED;
+    sc->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    sc->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sc->timer_fd < 0 || sc->wake_fd < 0)
+    {
+        perror("schedule");
+        schedule_destroy(sc);
+        return -1;
+    }
+    pthread_mutex_init(&sc->mutex, NULL);
+
+    const char *args = config_get("schedule");
+    if (args != NULL && schedule_set_duty(sc, args) != 0)
+        fprintf(stderr, "Error: Ignoring invalid schedule \"%s\"\n", args);
+    return 0;
+}
+
+// Close the descriptors
+void schedule_destroy(schedule_t *sc)
+{
+    if (sc->timer_fd >= 0)
+        close(sc->timer_fd);
+    if (sc->wake_fd >= 0)
+        close(sc->wake_fd);
+    sc->timer_fd = -1;
+    sc->wake_fd = -1;
+}
+
+// Set or clear the duty cycle
+int schedule_set_duty(schedule_t *sc, const char *args)
+{
+    double every = 0.0;
+    double duration = 0.0;
+
+    while (*args == ' ' || *args == '\t')
+        args++;
+    if (strcmp(args, "off") != 0)
+    {
+        char value[32];
+        every = config_arg(args, "every", value, sizeof(value)) ? parse_seconds(value) : -1.0;
+        duration = config_arg(args, "duration", value, sizeof(value)) ? parse_seconds(value) : -1.0;
+        if (every <= 0.0 || duration <= 0.0 || duration > every)
+            return -1;
+    }
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->every = every;
+    sc->duration = duration;
+    arm_timer(sc);
+    pthread_mutex_unlock(&sc->mutex);
+    schedule_wake(sc);
+    return 0;
+}
+
+// Arm a one-shot window
+int schedule_set_start_at(schedule_t *sc, const char *when)
+{
+    double at = when[0] == '+' ? parse_seconds(when + 1) : parse_seconds(when);
+    if (at < 0.0)
+        return -1;
+    if (when[0] == '+')
+        at += now_epoch();
+
+    pthread_mutex_lock(&sc->mutex);
+    sc->start_at = at;
+    arm_timer(sc);
+    pthread_mutex_unlock(&sc->mutex);
+    schedule_wake(sc);
+    return 0;
+}
+
+// Limit the current or next capture
+void schedule_set_stop_after(schedule_t *sc, uint64_t frames)
+{
+    __atomic_store_n(&sc->stop_after, frames, __ATOMIC_RELEASE);
+}
+
+// Block on the timer and the wake descriptor
+schedule_event_t schedule_wait(schedule_t *sc, int timeout_ms)
+{
+    struct pollfd fds[2] = {
+        { .fd = sc->timer_fd, .events = POLLIN },
+        { .fd = sc->wake_fd, .events = POLLIN }
+    };
+    uint64_t count;
+
+    if (poll(fds, 2, timeout_ms) <= 0)
+        return SCHEDULE_WAKE;
+    if (fds[1].revents & POLLIN)
+        read(sc->wake_fd, &count, sizeof(count));
+    if (!(fds[0].revents & POLLIN) || read(sc->timer_fd, &count, sizeof(count)) != sizeof(count))
+        return SCHEDULE_WAKE;
+
+    // Which window fired decides its length; then arm the next one
+    pthread_mutex_lock(&sc->mutex);
+    double now = now_epoch();
+    double fired_at = sc->next_start;
+    sc->fired_periodic = !(sc->start_at > 0.0 && sc->start_at <= now);
+    if (!sc->fired_periodic)
+        sc->start_at = 0.0;
+    arm_timer(sc);
+
+    // A window that passed while the producer was busy capturing is missed
+    bool missed = sc->fired_periodic && now >= fired_at + sc->duration;
+    if (!missed)
+        sc->windows++;
+    pthread_mutex_unlock(&sc->mutex);
+    return missed ? SCHEDULE_WAKE : SCHEDULE_FIRE;
+}
+
+// Interrupt schedule_wait()
+void schedule_wake(schedule_t *sc)
+{
+    uint64_t one = 1;
+    if (sc->wake_fd >= 0)
+        write(sc->wake_fd, &one, sizeof(one));
+}
+
+// Frames the capture starting now may run for
+uint64_t schedule_take_limit(schedule_t *sc, double rate, bool from_timer)
+{
+    uint64_t limit = SCHEDULE_UNLIMITED;
+
+    pthread_mutex_lock(&sc->mutex);
+    if (from_timer && sc->fired_periodic && sc->duration > 0.0)
+        limit = (uint64_t)llround(sc->duration * rate);
+    pthread_mutex_unlock(&sc->mutex);
+
+    uint64_t stop_after = schedule_take_stop_after(sc);
+    return stop_after < limit ? stop_after : limit;
+}
+
+// Consume a pending STOP_AFTER
+uint64_t schedule_take_stop_after(schedule_t *sc)
+{
+    if (__atomic_load_n(&sc->stop_after, __ATOMIC_ACQUIRE) == SCHEDULE_UNLIMITED)
+        return SCHEDULE_UNLIMITED;
+    return __atomic_exchange_n(&sc->stop_after, SCHEDULE_UNLIMITED, __ATOMIC_ACQ_REL);
+}
+
+// Summary for STATUS
+void schedule_status(schedule_t *sc, char *buf, size_t len)
+{
+    pthread_mutex_lock(&sc->mutex);
+    int n;
+    if (sc->every > 0.0)
+        n = snprintf(buf, len, "every=%gs duration=%gs", sc->every, sc->duration);
+    else
+        n = snprintf(buf, len, "off");
+    if (sc->next_start > 0.0 && n >= 0 && (size_t)n < len)
+    {
+        time_t t = (time_t)sc->next_start;
+        struct tm tm;
+        char when[32];
+        gmtime_r(&t, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        n += snprintf(buf + n, len - n, " next=%s", when);
+    }
+    if (n >= 0 && (size_t)n < len)
+        snprintf(buf + n, len - n, " windows=%llu", (unsigned long long)sc->windows);
+    pthread_mutex_unlock(&sc->mutex);
+}
@@ -0,0 +1,94 @@
+/*
+    Acquisition schedule for duty-cycled and timed captures.
+
+    The producer sleeps in schedule_wait() while idle: a timerfd fires at
+    the start of the next window (absolute CLOCK_REALTIME), and an eventfd
+    wakes it early when a command changes the state. There is no idle
+    polling.
+
+    Windows:
+        SCHEDULE every=60s duration=10s   capture duration out of every
+                                          period, aligned to the wall clock
+                                          (e.g. at :00 of every minute)
+        START_AT <time>                   start once at an epoch time or
+                                          +seconds from now
+        STOP_AFTER <samples>              end the current (or next) capture
+                                          after exactly that many samples
+                                          per channel
+    Windows of known length use finite hardware scans, so the MCC 118
+    stops on the exact sample.
+
+    Configuration (applied at startup):
+        schedule = every=60s duration=10s
+*/
+
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SCHEDULE_UNLIMITED UINT64_MAX
+
+typedef enum {
+    SCHEDULE_WAKE,      // a command changed the state
+    SCHEDULE_FIRE       // a window starts now
+} schedule_event_t;
+
+typedef struct {
+    int timer_fd;
+    int wake_fd;
+    pthread_mutex_t mutex;
+
+    // Duty cycle, 0 = off
+    double every;           // seconds
+    double duration;        // seconds
+
+    // One-shot start, 0 = none
+    double start_at;        // epoch seconds
+
+    // Sample limit for the current or next capture
+    uint64_t stop_after;    // frames, SCHEDULE_UNLIMITED = none
+
+    double next_start;      // epoch seconds the timer is armed for, 0 = none
+    bool fired_periodic;    // the last window started from the duty cycle
+    uint64_t windows;       // windows started by the timer
+} schedule_t;
+
+// Create the timer and wake descriptors. Returns 0 on success.
+int schedule_init(schedule_t *sc);
+void schedule_destroy(schedule_t *sc);
+
+// Parse "every=60s duration=10s" (s, m, h suffixes) and arm the timer.
+// "off" clears the duty cycle. Returns 0 on success, -1 on bad arguments.
+int schedule_set_duty(schedule_t *sc, const char *args);
+
+// Arm a one-shot start: epoch seconds, or "+N" seconds from now
+int schedule_set_start_at(schedule_t *sc, const char *when);
+
+// Limit the current or next capture to frames samples per channel
+void schedule_set_stop_after(schedule_t *sc, uint64_t frames);
+
+// Sleep up to timeout_ms (-1 = no limit) until a window starts or
+// schedule_wake() is called. A window start re-arms the timer for the
+// next one. An event loop polling timer_fd and wake_fd itself passes 0.
+schedule_event_t schedule_wait(schedule_t *sc, int timeout_ms);
+
+// Interrupt schedule_wait() after a state change
+void schedule_wake(schedule_t *sc);
+
+// Length in frames of a capture starting now at rate: the duty-cycle
+// duration if the timer started it, capped by a pending STOP_AFTER.
+// SCHEDULE_UNLIMITED for an open-ended capture.
+uint64_t schedule_take_limit(schedule_t *sc, double rate, bool from_timer);
+
+// Pending STOP_AFTER for a capture already running, SCHEDULE_UNLIMITED
+// if none
+uint64_t schedule_take_stop_after(schedule_t *sc);
+
+// One-line summary for STATUS
+void schedule_status(schedule_t *sc, char *buf, size_t len);
+
+#endif /* SCHEDULE_H_ */
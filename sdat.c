@@ -0,0 +1,174 @@
+/*
+    SDAT chunk format (see sdat.h)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "sdat.h"
+#include "util.h"
+
+// Allocate a chunk with room for capacity samples
+sdat_chunk_t* sdat_chunk_create(uint32_t capacity)
+{
+    sdat_chunk_t *chunk = (sdat_chunk_t*)calloc(1, sizeof(sdat_chunk_t));
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->samples = (double*)malloc((size_t)capacity * sizeof(double));
+    if (chunk->samples == NULL && capacity > 0)
+    {
+        free(chunk);
+        return NULL;
+    }
+    chunk->capacity = capacity;
+    chunk->decimation = 1;
+    return chunk;
+}
+
+// Worst-case heap footprint of a chunk
+size_t sdat_chunk_footprint(uint32_t capacity)
+{
+    return sizeof(sdat_chunk_t) + (size_t)capacity * sizeof(double) + SDAT_MAX_HEADER_SIZE;
+}
+
+// Free a chunk
+void sdat_chunk_free(sdat_chunk_t *chunk)
+{
+    if (chunk == NULL)
+        return;
+    free(chunk->samples);
+    free(chunk->ext);
+    free(chunk);
+}
+
+// Clear metadata so a chunk buffer can be filled again
+void sdat_chunk_reset(sdat_chunk_t *chunk)
+{
+    chunk->flags = 0;
+    chunk->event_count = 0;
+    chunk->anchor_count = 0;
+    chunk->ext_len = 0;
+    chunk->sample_count = 0;
+    chunk->payload_crc = 0;
+}
+
+// Append a little-endian double to the buffer
+static uint8_t* put_f64(uint8_t *p, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return put_le(p, bits, 8);
+}
+
+// Start an extension record; returns where its body begins
+static uint8_t* put_ext(uint8_t *p, uint16_t type, uint32_t length)
+{
+    p = put_le(p, type, 2);
+    p = put_le(p, 0, 2);
+    return put_le(p, length, 4);
+}
+
+// Append an extension record to the chunk
+int sdat_chunk_add_ext(sdat_chunk_t *chunk, uint16_t type, const void *body, uint32_t length)
+{
+    // Leave room for full events, anchors and stream extensions
+    size_t limit = SDAT_MAX_HEADER_SIZE - SDAT_HEADER_V2_SIZE -
+                   (SDAT_EXT_HEADER_SIZE + SDAT_MAX_EVENTS * 24) -
+                   (SDAT_EXT_HEADER_SIZE + SDAT_MAX_ANCHORS * 20) -
+                   (SDAT_EXT_HEADER_SIZE + 9 + SDAT_MAX_STREAM_NAME + SDAT_MAX_CHANNELS);
+    size_t needed = (size_t)chunk->ext_len + SDAT_EXT_HEADER_SIZE + length;
+    if (needed > limit)
+        return -1;
+
+    if (needed > chunk->ext_capacity)
+    {
+        uint8_t *ext = (uint8_t*)realloc(chunk->ext, limit);
+        if (ext == NULL)
+            return -1;
+        chunk->ext = ext;
+        chunk->ext_capacity = (uint32_t)limit;
+    }
+
+    uint8_t *e = put_ext(chunk->ext + chunk->ext_len, type, length);
+    memcpy(e, body, length);
+    chunk->ext_len = (uint32_t)needed;
+    return 0;
+}
+
+// Serialize the header and extensions of a chunk
+size_t sdat_encode_header(const sdat_chunk_t *chunk, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint8_t *ext_start = buf + SDAT_HEADER_V2_SIZE;
+    uint8_t *e = ext_start;
+
+    // Extensions first, so ext_size is known for the fixed header
+    if (chunk->event_count > 0)
+    {
+        e = put_ext(e, SDAT_EXT_EVENTS, chunk->event_count * 24);
+        for (uint32_t i = 0; i < chunk->event_count; i++)
+        {
+            const sdat_event_t *ev = &chunk->events[i];
+            e = put_le(e, ev->onset, 8);
+            e = put_le(e, ev->duration, 4);
+            e = put_le(e, ev->channel, 1);
+            e = put_le(e, ev->kinds, 1);
+            e = put_le(e, 0, 2);
+            e = put_f64(e, ev->peak);
+        }
+    }
+    if (chunk->anchor_count > 0)
+    {
+        e = put_ext(e, SDAT_EXT_ANCHORS, chunk->anchor_count * 20);
+        for (uint32_t i = 0; i < chunk->anchor_count; i++)
+        {
+            const sdat_anchor_t *a = &chunk->anchors[i];
+            e = put_le(e, a->index, 8);
+            e = put_le(e, (uint64_t)a->time_ns, 8);
+            e = put_le(e, a->status, 2);
+            e = put_le(e, a->flags, 2);
+        }
+    }
+    if (chunk->stream != 0)
+    {
+        size_t name_len = strlen(chunk->stream_name);
+        e = put_ext(e, SDAT_EXT_STREAM, (uint32_t)(9 + name_len + chunk->num_channels));
+        e = put_le(e, chunk->stream, 2);
+        e = put_le(e, name_len, 2);
+        e = put_le(e, chunk->decimation, 4);
+        memcpy(e, chunk->stream_name, name_len);
+        e += name_len;
+        e = put_le(e, chunk->num_channels, 1);
+        memcpy(e, chunk->channels, chunk->num_channels);
+        e += chunk->num_channels;
+    }
+    if (chunk->ext_len > 0)
+    {
+        memcpy(e, chunk->ext, chunk->ext_len);
+        e += chunk->ext_len;
+    }
+
+    memcpy(p, SDAT_MAGIC, 4);
+    p += 4;
+    p = put_le(p, SDAT_VERSION, 2);                        // version
+    p = put_le(p, chunk->device_id, 4);                    // device_id
+    p = put_le(p, chunk->boot_id, 8);                      // boot_id
+    p = put_le(p, chunk->seq_start, 8);                    // seq_start
+    p = put_le(p, (uint32_t)chunk->sample_rate, 4);        // sample_rate_hz
+    p = put_le(p, SDAT_RECORD_SIZE, 2);                    // record_size
+    p = put_le(p, chunk->sample_count, 4);                 // sample_count
+    p = put_le(p, chunk->time_start, 8);                   // sensor_time_start
+    p = put_le(p, chunk->time_end, 8);                     // sensor_time_end
+    p = put_le(p, chunk->payload_crc, 4);                  // payload_crc32
+    p = put_le(p, chunk->flags, 4);                        // flags
+    p = put_le(p, (uint32_t)(e - ext_start), 4);           // ext_size
+
+    return (size_t)(e - buf);
+}
+
+// Size of the payload following the header
+size_t sdat_payload_size(const sdat_chunk_t *chunk)
+{
+    if (chunk->flags & SDAT_FLAG_FLAT)
+        return 0;
+    return (size_t)chunk->sample_count * SDAT_RECORD_SIZE;
+}
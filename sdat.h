@@ -0,0 +1,153 @@
+/*
+    SDAT chunk format shared by the logger, its output sinks and tools.
+
+    Header (little-endian, packed):
+        magic[4] "SDAT", version u16, device_id u32, boot_id u64,
+        seq_start u64, sample_rate_hz u32, record_size u16,
+        sample_count u32, sensor_time_start u64, sensor_time_end u64,
+        payload_crc32 u32                                 (56 bytes, v1)
+        flags u32, ext_size u32                           (v2 and later)
+    Extensions (v2): ext_size bytes of records, each
+        type u16, reserved u16, length u32, then length bytes
+    Payload: sample_count x record_size bytes of samples (doubles),
+    interleaved by frame, or one channel after another when
+    SDAT_FLAG_PLANAR is set (see layout.h); nothing when SDAT_FLAG_FLAT is
+    set (see flat.h)
+
+    payload_crc32 is the zlib CRC-32 of the payload bytes as written, or
+    0 if none was taken (older writers, elided payloads).
+
+    Readers skip extension types they do not know.
+*/
+
+#ifndef SDAT_H_
+#define SDAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SDAT_MAGIC "SDAT"
+#define SDAT_VERSION 2
+#define SDAT_HEADER_SIZE 56        // v1 fixed header
+#define SDAT_HEADER_V2_SIZE 64     // v1 fields + flags + ext_size
+#define SDAT_EXT_HEADER_SIZE 8
+#define SDAT_MAX_HEADER_SIZE 16384 // fixed header plus all extensions
+#define SDAT_RECORD_SIZE 8  // sizeof(double) = 8 bytes per sample
+
+// Header flags
+#define SDAT_FLAG_EVENT 0x00000001u     // an event is active somewhere in the chunk
+#define SDAT_FLAG_FLAT 0x00000002u      // payload elided, see the flat extension
+#define SDAT_FLAG_PARTIAL 0x00000004u   // closed before its nominal length; the next
+                                        // chunk still starts at seq_start + frames
+#define SDAT_FLAG_CAPTURE_END 0x00000008u // last chunk of a capture, a gap may follow
+#define SDAT_FLAG_PLANAR 0x00000010u    // payload holds one block per channel (see layout.h)
+
+// Extension types
+#define SDAT_EXT_EVENTS 1               // sdat_event_t records, 24 bytes each
+#define SDAT_EXT_SPECTRUM 2             // per-channel power spectra (see spectrum.h)
+#define SDAT_EXT_FLAT 3                 // flat-chunk descriptor (see flat.h)
+#define SDAT_EXT_STREAM 4               // stream id, decimation and name
+#define SDAT_EXT_ANCHORS 5              // sdat_anchor_t records, 20 bytes each (see anchor.h)
+
+#define SDAT_MAX_STREAM_NAME 16
+#define SDAT_MAX_CHANNELS 8
+
+// Event detector kinds (bit mask)
+#define SDAT_EVENT_STA_LTA 0x01
+#define SDAT_EVENT_THRESHOLD 0x02
+#define SDAT_EVENT_SLOPE 0x04
+
+#define SDAT_MAX_EVENTS 32
+
+// Anchor flags: the anchor starts a new piece of the sample clock, so
+// times are not interpolated back across it
+#define SDAT_ANCHOR_START 0x0001        // first read of a scan
+#define SDAT_ANCHOR_GAP 0x0002          // samples were lost since the previous anchor
+#define SDAT_ANCHOR_OVERRUN 0x0004      // the device reported an overrun on this read
+#define SDAT_ANCHOR_BREAK (SDAT_ANCHOR_START | SDAT_ANCHOR_GAP | SDAT_ANCHOR_OVERRUN)
+
+#define SDAT_MAX_ANCHORS 64
+
+// Derived streams (stream != 0) carry a stream extension: stream u16,
+// name length u16, decimation u32, the name, then channel count u8 and
+// the hardware channel of each interleaved column. Their seq_start counts
+// samples of that stream; seq_start * decimation is the sample index in
+// the full-rate timebase shared by all streams and by event onsets.
+
+// An event overlapping the chunk. Encoded as onset u64, duration u32,
+// channel u8, kinds u8, reserved u16, peak f64. Sample indices use the
+// same numbering as seq_start.
+typedef struct {
+    uint64_t onset;          // first triggered sample
+    uint32_t duration;       // samples, 0 while the event is still open
+    uint8_t channel;         // hardware channel
+    uint8_t kinds;           // SDAT_EVENT_* that fired
+    double peak;             // largest |value| seen so far
+} sdat_event_t;
+
+// The host clock right after a device read delivered the sample at index.
+// Encoded as index u64, time_ns i64, status u16, flags u16. The index is
+// in the full-rate timebase, like event onsets, for every stream.
+typedef struct {
+    uint64_t index;          // last frame of the read
+    int64_t time_ns;         // CLOCK_REALTIME, ns since the epoch
+    uint16_t status;         // device status word of the read
+    uint16_t flags;          // SDAT_ANCHOR_*
+} sdat_anchor_t;
+
+// One chunk of samples on its way to the output sinks. Chunks are shared
+// between sink workers and freed when the last reference is released.
+typedef struct sdat_chunk {
+    uint16_t stream;         // 0 = the full-rate scan, else a derived stream
+    uint32_t decimation;     // seq_start * decimation = full-rate sample index
+    char stream_name[SDAT_MAX_STREAM_NAME];
+    uint8_t num_channels;    // columns of interleaved samples (derived streams)
+    uint8_t channels[SDAT_MAX_CHANNELS];
+    uint32_t device_id;
+    uint64_t boot_id;
+    uint64_t seq_start;
+    double sample_rate;
+    uint32_t sample_count;
+    uint64_t time_start;
+    uint64_t time_end;
+    uint32_t flags;          // SDAT_FLAG_*
+    uint32_t payload_crc;    // CRC-32 (zlib) of the payload, 0 if not taken
+    uint32_t event_count;
+    sdat_event_t events[SDAT_MAX_EVENTS];
+    uint32_t anchor_count;
+    sdat_anchor_t anchors[SDAT_MAX_ANCHORS];   // by index, see anchor.h
+    uint8_t *ext;            // further encoded extension records
+    uint32_t ext_len;
+    uint32_t ext_capacity;
+    uint64_t commit_token;   // opaque value handed back when all sinks are done
+    int refcount;
+    int write_failed;        // set by a sink that could not write the chunk
+    uint32_t capacity;       // allocated samples
+    double *samples;
+} sdat_chunk_t;
+
+// Allocate a chunk with room for capacity samples
+sdat_chunk_t* sdat_chunk_create(uint32_t capacity);
+
+// Free a chunk that was never dispatched (the sinks free dispatched ones)
+void sdat_chunk_free(sdat_chunk_t *chunk);
+
+// Worst-case heap footprint of a chunk of capacity samples, extensions
+// included (for the memory budget)
+size_t sdat_chunk_footprint(uint32_t capacity);
+
+// Clear metadata so a chunk buffer can be filled again
+void sdat_chunk_reset(sdat_chunk_t *chunk);
+
+// Append an extension record (type, body) to the chunk. Returns 0 on
+// success, -1 if it would not fit in SDAT_MAX_HEADER_SIZE.
+int sdat_chunk_add_ext(sdat_chunk_t *chunk, uint16_t type, const void *body, uint32_t length);
+
+// Serialize the header and extensions of a chunk into buf, which must hold
+// SDAT_MAX_HEADER_SIZE bytes. Returns the number of bytes written.
+size_t sdat_encode_header(const sdat_chunk_t *chunk, uint8_t *buf);
+
+// Size of the payload following the header (0 for elided flat chunks)
+size_t sdat_payload_size(const sdat_chunk_t *chunk);
+
+#endif /* SDAT_H_ */
@@ -1,7 +1,8 @@
 #!/usr/bin/env python3
 """
 Send commands to the sensor controller via Unix domain socket.
-Commands: START, STOP, STATUS, SET_RATE <value>
+Commands: START, STOP, STATUS, SET_RATE <value>, SUBSCRIBE, TRIGGER [seconds],
+          SCHEDULE every=<time> duration=<time>, START_AT <time>, STOP_AFTER <samples>
 """
 
 import socket
@@ -17,6 +18,16 @@ def send_command(command):
             # Send command with newline
             client.sendall((command + "\n").encode())
             
+            # SUBSCRIBE keeps the connection open: print events as they arrive
+            if command.split()[0] == "SUBSCRIBE":
+                print(f"Sent: {command}")
+                while True:
+                    chunk = client.recv(1024)
+                    if not chunk:
+                        break
+                    print(chunk.decode(), end="", flush=True)
+                return ""
+            
             # Receive response (read until connection closes)
             response = b""
             while True:
@@ -36,6 +47,8 @@ def send_command(command):
         print(f"Error: Connection refused to {SOCKET_PATH}")
         print("Make sure the sensor controller is running.")
         sys.exit(1)
+    except KeyboardInterrupt:
+        sys.exit(0)
     except Exception as e:
         print(f"Error: {e}")
         sys.exit(1)
@@ -47,6 +60,11 @@ if __name__ == "__main__":
         print("  python3 send_command.py STOP")
         print("  python3 send_command.py STATUS")
         print("  python3 send_command.py SET_RATE 10000")
+        print("  python3 send_command.py SUBSCRIBE")
+        print("  python3 send_command.py TRIGGER 5")
+        print("  python3 send_command.py SCHEDULE every=60s duration=10s")
+        print("  python3 send_command.py START_AT +30")
+        print("  python3 send_command.py STOP_AFTER 10000")
         sys.exit(1)
     
     command = " ".join(sys.argv[1:])
@@ -0,0 +1,343 @@
+/*
+    Control socket client (see sensorctl.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sensorctl.h"
+#include "util.h"
+
+#define RECV_BUF_SIZE (4 * SENSORCTL_MAX_REPLY)
+
+struct sensorctl {
+    int fd;
+    int timeout_ms;
+    unsigned pending;               // commands sent, reply not yet read
+    char path[108];                 // sizeof(sun_path)
+    size_t len;                     // bytes received, not yet returned
+    char buf[RECV_BUF_SIZE];
+};
+
+// Connect a stream socket to path
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// Send all of data
+static int send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Classify a reply line
+static int reply_code(const char *reply)
+{
+    return strncmp(reply, "ERROR", 5) == 0 ? SENSORCTL_REFUSED : SENSORCTL_OK;
+}
+
+// Connect and switch the connection to session mode
+static int session_open(sensorctl_t *ctl)
+{
+    ctl->fd = connect_socket(ctl->path);
+    if (ctl->fd < 0)
+        return -1;
+    ctl->pending = 0;
+    ctl->len = 0;
+
+    char reply[SENSORCTL_MAX_REPLY];
+    if (sensorctl_send(ctl, "SESSION") != 0 || sensorctl_recv(ctl, reply, sizeof(reply)) != SENSORCTL_OK)
+    {
+        int saved = errno;
+        close(ctl->fd);
+        ctl->fd = -1;
+        errno = saved ? saved : EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+// Connect to the logger and open a session
+sensorctl_t* sensorctl_open(const char *path)
+{
+    if (path == NULL)
+        path = SENSORCTL_DEFAULT_PATH;
+    if (strlen(path) >= sizeof(((sensorctl_t*)0)->path))
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    sensorctl_t *ctl = (sensorctl_t*)calloc(1, sizeof(*ctl));
+    if (ctl == NULL)
+        return NULL;
+    strcpy(ctl->path, path);
+    ctl->timeout_ms = SENSORCTL_TIMEOUT_MS;
+    if (session_open(ctl) != 0)
+    {
+        int saved = errno;
+        free(ctl);
+        errno = saved;
+        return NULL;
+    }
+    return ctl;
+}
+
+// Close the connection and free the handle
+void sensorctl_close(sensorctl_t *ctl)
+{
+    if (ctl == NULL)
+        return;
+    if (ctl->fd >= 0)
+        close(ctl->fd);
+    free(ctl);
+}
+
+// Reply timeout, 0 = none
+void sensorctl_set_timeout(sensorctl_t *ctl, int timeout_ms)
+{
+    ctl->timeout_ms = timeout_ms;
+}
+
+// Send one command line
+int sensorctl_send(sensorctl_t *ctl, const char *command)
+{
+    char line[SENSORCTL_MAX_REPLY];
+    int n = snprintf(line, sizeof(line), "%s\n", command);
+    if (ctl->fd < 0 || n < 0 || (size_t)n >= sizeof(line) || strchr(command, '\n') != NULL)
+    {
+        errno = ctl->fd < 0 ? ENOTCONN : EINVAL;
+        return -1;
+    }
+    if (send_all(ctl->fd, line, (size_t)n) != 0)
+        return -1;
+    ctl->pending++;
+    return 0;
+}
+
+// Drop a broken connection; the next sensorctl_command() reconnects
+static int connection_lost(sensorctl_t *ctl, int error)
+{
+    if (ctl->fd >= 0)
+        close(ctl->fd);
+    ctl->fd = -1;
+    ctl->pending = 0;
+    ctl->len = 0;
+    errno = error;
+    return -1;
+}
+
+// Next reply line
+int sensorctl_recv(sensorctl_t *ctl, char *reply, size_t len)
+{
+    for (;;)
+    {
+        char *newline = memchr(ctl->buf, '\n', ctl->len);
+        if (newline != NULL)
+        {
+            size_t line_len = (size_t)(newline - ctl->buf);
+            size_t copy = line_len < len - 1 ? line_len : len - 1;
+            memcpy(reply, ctl->buf, copy);
+            reply[copy] = '\0';
+            ctl->len -= line_len + 1;
+            memmove(ctl->buf, newline + 1, ctl->len);
+            if (ctl->pending > 0)
+                ctl->pending--;
+            return reply_code(reply);
+        }
+        if (ctl->fd < 0)
+        {
+            errno = ENOTCONN;
+            return -1;
+        }
+        if (ctl->len == sizeof(ctl->buf))
+            return connection_lost(ctl, EMSGSIZE);
+
+        struct pollfd pfd = { .fd = ctl->fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, ctl->timeout_ms > 0 ? ctl->timeout_ms : -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+            return -1;
+        if (ready == 0)
+        {
+            // The reply may still come: later replies would be out of step
+            return connection_lost(ctl, ETIMEDOUT);
+        }
+
+        ssize_t n = recv(ctl->fd, ctl->buf + ctl->len, sizeof(ctl->buf) - ctl->len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return connection_lost(ctl, n == 0 ? ECONNRESET : errno);
+        ctl->len += (size_t)n;
+    }
+}
+
+// Replies outstanding
+unsigned sensorctl_pending(const sensorctl_t *ctl)
+{
+    return ctl->pending;
+}
+
+// True if the logger closed the connection (restart) while it sat idle
+static bool idle_connection_closed(sensorctl_t *ctl)
+{
+    struct pollfd pfd = { .fd = ctl->fd, .events = POLLIN };
+    if (poll(&pfd, 1, 0) <= 0)
+        return false;
+
+    char byte;
+    return recv(ctl->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) <= 0;
+}
+
+// Send a command and wait for its reply
+int sensorctl_command(sensorctl_t *ctl, const char *command, char *reply, size_t len)
+{
+    // Reconnecting is only safe while no reply is outstanding
+    if (ctl->pending == 0 && ctl->len == 0 && (ctl->fd < 0 || idle_connection_closed(ctl)))
+    {
+        if (ctl->fd >= 0)
+            close(ctl->fd);
+        if (session_open(ctl) != 0)
+            return -1;
+    }
+
+    if (sensorctl_send(ctl, command) != 0)
+        return connection_lost(ctl, errno);
+    // Earlier pipelined replies are skipped
+    int code;
+    do
+    {
+        code = sensorctl_recv(ctl, reply, len);
+    } while (code >= 0 && ctl->pending > 0);
+    return code;
+}
+
+// One command on its own connection, reply read until the logger closes it
+int sensorctl_oneshot(const char *path, const char *command, char *reply, size_t len)
+{
+    int fd = connect_socket(path ? path : SENSORCTL_DEFAULT_PATH);
+    if (fd < 0)
+        return -1;
+
+    size_t used = 0;
+    int result = send_all(fd, command, strlen(command));
+    while (result == 0 && used < len - 1)
+    {
+        ssize_t n = recv(fd, reply + used, len - 1 - used, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            result = -1;
+        if (n <= 0)
+            break;
+        used += (size_t)n;
+    }
+    close(fd);
+
+    reply[used] = '\0';
+    if (used > 0 && reply[used - 1] == '\n')
+        reply[used - 1] = '\0';
+    if (result != 0)
+        return -1;
+    if (used == 0)
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    return reply_code(reply);
+}
+
+// Find "key=" at the start of a field
+static const char* find_field(const char *reply, const char *key)
+{
+    size_t key_len = strlen(key);
+    const char *p = reply;
+
+    while ((p = strstr(p, key)) != NULL)
+    {
+        bool at_start = p == reply || (p >= reply + 2 && (p[-1] == ' ') && (p[-2] == ',' || p[-2] == ':'));
+        if (at_start && p[key_len] == '=')
+            return p + key_len + 1;
+        p += key_len;
+    }
+    return NULL;
+}
+
+// Copy the value of key
+bool sensorctl_field(const char *reply, const char *key, char *out, size_t len)
+{
+    const char *value = find_field(reply, key);
+    if (value == NULL)
+        return false;
+
+    const char *end = strstr(value, ", ");
+    size_t value_len = end ? (size_t)(end - value) : strcspn(value, "\r\n");
+    if (value_len >= len)
+        value_len = len - 1;
+    memcpy(out, value, value_len);
+    out[value_len] = '\0';
+    return true;
+}
+
+// Numeric value of key
+double sensorctl_field_double(const char *reply, const char *key, double def)
+{
+    char value[64];
+    if (!sensorctl_field(reply, key, value, sizeof(value)))
+        return def;
+
+    char *end;
+    double number = strtod(value, &end);
+    return end == value ? def : number;
+}
+
+// Decode a FETCH frame header
+bool sensorctl_frame(const uint8_t *buf, sensorctl_frame_t *frame)
+{
+    if (memcmp(buf, "SFRM", 4) != 0)
+        return false;
+    frame->kind = (uint16_t)get_le(buf + 4, 2);
+    frame->id = get_le(buf + 8, 8);
+    frame->offset = get_le(buf + 16, 8);
+    frame->length = get_le(buf + 24, 8);
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+    Client library for the logger's control socket.
+
+    send_command.py opens a connection per command; a monitoring agent
+    polling STATUS pays for a connect, a logger-side accept and a close
+    every time. A sensorctl_t keeps one connection open in session mode
+    (see "SESSION" in the README): every command is one line and is
+    answered by one line, in order. Commands can be pipelined: queue
+    several with sensorctl_send() and collect the replies with
+    sensorctl_recv() afterwards.
+
+    Reply codes: SENSORCTL_OK for "OK:", "STATUS:" and event lines,
+    SENSORCTL_REFUSED for "ERROR:", -1 for a connection error or timeout
+    (errno set). After a connection error the handle can be reused:
+    sensorctl_command() reconnects when the logger has closed the
+    connection and no reply is outstanding.
+
+    A FETCH transfer (see fetch.h) is read from a connection of its own;
+    sensorctl_frame() decodes its little-endian frame headers.
+
+    The library has no dependency on the logger and is also built as
+    libsensorctl.so for the Python bindings (sensorctl.py).
+*/
+
+#ifndef SENSORCTL_H_
+#define SENSORCTL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SENSORCTL_DEFAULT_PATH "/tmp/sensor_ctrl.sock"
+#define SENSORCTL_MAX_REPLY 4096        // longest reply line (STATUS)
+#define SENSORCTL_TIMEOUT_MS 5000       // default wait for a reply
+#define SENSORCTL_OK 0
+#define SENSORCTL_REFUSED 1
+#define SENSORCTL_FRAME_SIZE 32         // FETCH frame header
+
+typedef struct sensorctl sensorctl_t;
+
+// A FETCH frame header: kind 1 = chunk, 2 = segment, 0 = end of transfer
+typedef struct {
+    uint16_t kind;
+    uint64_t id;                        // chunk seq_start; items sent for the end frame
+    uint64_t offset;                    // byte position of the payload in the item
+    uint64_t length;                    // payload bytes that follow the header
+} sensorctl_frame_t;
+
+// Connect to the logger at path (NULL for the default) and open a
+// session. NULL on failure, with errno set.
+sensorctl_t* sensorctl_open(const char *path);
+
+// Close the connection and free the handle
+void sensorctl_close(sensorctl_t *ctl);
+
+// Reply timeout in milliseconds, 0 to wait forever (SUBSCRIBE)
+void sensorctl_set_timeout(sensorctl_t *ctl, int timeout_ms);
+
+// Send one command without waiting for its reply. Returns 0 or -1.
+int sensorctl_send(sensorctl_t *ctl, const char *command);
+
+// Next reply line, without the newline, in the order of the commands.
+// Returns SENSORCTL_OK, SENSORCTL_REFUSED or -1.
+int sensorctl_recv(sensorctl_t *ctl, char *reply, size_t len);
+
+// Replies still outstanding for commands sent
+unsigned sensorctl_pending(const sensorctl_t *ctl);
+
+// Send a command and wait for its reply
+int sensorctl_command(sensorctl_t *ctl, const char *command, char *reply, size_t len);
+
+// One command over a connection of its own, as send_command.py does
+int sensorctl_oneshot(const char *path, const char *command, char *reply, size_t len);
+
+// Value of "key=value" in a reply such as STATUS (fields are separated
+// by ", "). Copies it to out and returns true if the key is present.
+bool sensorctl_field(const char *reply, const char *key, char *out, size_t len);
+
+// Numeric field, def if missing. Units after the number are ignored.
+double sensorctl_field_double(const char *reply, const char *key, double def);
+
+// Decode the SENSORCTL_FRAME_SIZE bytes of a FETCH frame header. Returns
+// false if they do not start with the frame magic.
+bool sensorctl_frame(const uint8_t *buf, sensorctl_frame_t *frame);
+
+#endif /* SENSORCTL_H_ */
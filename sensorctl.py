@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Python bindings for libsensorctl, the control socket client library.
+
+One SensorCtl keeps a session open to the logger, so polling STATUS costs
+a round trip on an open connection instead of a new connection (and, with
+send_command.py, a new interpreter) per command.
+
+    with SensorCtl() as ctl:
+        reply = ctl.command("STATUS")
+        rate = ctl.field_double(reply, "rate")
+
+        # Pipelined: send several, then read the replies in order
+        ctl.send("STATUS")
+        ctl.send("SET_RATE 1000")
+        replies = [ctl.recv(), ctl.recv()]
+
+command() and recv() raise SensorCtlRefused for ERROR replies and OSError
+when the logger cannot be reached. The library is looked up next to this
+file first (make builds libsensorctl.so there), then on the system path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+import sys
+
+SOCKET_PATH = "/tmp/sensor_ctrl.sock"
+MAX_REPLY = 4096  # SENSORCTL_MAX_REPLY
+FRAME_SIZE = 32  # SENSORCTL_FRAME_SIZE
+OK = 0
+REFUSED = 1
+
+
+class SensorCtlRefused(Exception):
+    """The logger answered with ERROR."""
+
+
+class Frame(ctypes.Structure):
+    """A FETCH frame header (sensorctl_frame_t)."""
+    _fields_ = [("kind", ctypes.c_uint16), ("id", ctypes.c_uint64),
+                ("offset", ctypes.c_uint64), ("length", ctypes.c_uint64)]
+
+
+def _load_library():
+    here = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libsensorctl.so")
+    name = here if os.path.exists(here) else ctypes.util.find_library("sensorctl")
+    if name is None:
+        raise OSError("libsensorctl.so not found (run make)")
+    lib = ctypes.CDLL(name, use_errno=True)
+
+    lib.sensorctl_open.argtypes = [ctypes.c_char_p]
+    lib.sensorctl_open.restype = ctypes.c_void_p
+    lib.sensorctl_close.argtypes = [ctypes.c_void_p]
+    lib.sensorctl_close.restype = None
+    lib.sensorctl_set_timeout.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.sensorctl_set_timeout.restype = None
+    lib.sensorctl_send.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.sensorctl_send.restype = ctypes.c_int
+    lib.sensorctl_recv.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.sensorctl_recv.restype = ctypes.c_int
+    lib.sensorctl_pending.argtypes = [ctypes.c_void_p]
+    lib.sensorctl_pending.restype = ctypes.c_uint
+    lib.sensorctl_command.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.sensorctl_command.restype = ctypes.c_int
+    lib.sensorctl_field.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.sensorctl_field.restype = ctypes.c_bool
+    lib.sensorctl_field_double.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_double]
+    lib.sensorctl_field_double.restype = ctypes.c_double
+    lib.sensorctl_frame.argtypes = [ctypes.c_char_p, ctypes.POINTER(Frame)]
+    lib.sensorctl_frame.restype = ctypes.c_bool
+    return lib
+
+
+_lib = _load_library()
+
+
+def _raise_errno():
+    err = ctypes.get_errno()
+    raise OSError(err, os.strerror(err))
+
+
+class SensorCtl:
+    """A session on the logger's control socket."""
+
+    def __init__(self, path=SOCKET_PATH, timeout_ms=None):
+        self._handle = _lib.sensorctl_open(path.encode())
+        if not self._handle:
+            _raise_errno()
+        if timeout_ms is not None:
+            _lib.sensorctl_set_timeout(self._handle, timeout_ms)
+
+    def close(self):
+        if self._handle:
+            _lib.sensorctl_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def _check(self, code, reply):
+        if code < 0:
+            _raise_errno()
+        text = reply.value.decode()
+        if code == REFUSED:
+            raise SensorCtlRefused(text)
+        return text
+
+    def command(self, command):
+        """Send a command and return its reply line."""
+        reply = ctypes.create_string_buffer(MAX_REPLY)
+        code = _lib.sensorctl_command(self._handle, command.encode(), reply, MAX_REPLY)
+        return self._check(code, reply)
+
+    def send(self, command):
+        """Send a command without waiting for the reply."""
+        if _lib.sensorctl_send(self._handle, command.encode()) != 0:
+            _raise_errno()
+
+    def recv(self):
+        """Next reply line, in the order the commands were sent."""
+        reply = ctypes.create_string_buffer(MAX_REPLY)
+        code = _lib.sensorctl_recv(self._handle, reply, MAX_REPLY)
+        return self._check(code, reply)
+
+    @property
+    def pending(self):
+        """Replies still outstanding."""
+        return _lib.sensorctl_pending(self._handle)
+
+    @staticmethod
+    def field(reply, key):
+        """Value of key=value in a reply, or None."""
+        out = ctypes.create_string_buffer(MAX_REPLY)
+        if not _lib.sensorctl_field(reply.encode(), key.encode(), out, MAX_REPLY):
+            return None
+        return out.value.decode()
+
+    @staticmethod
+    def field_double(reply, key, default=None):
+        """Numeric value of key, or default."""
+        if SensorCtl.field(reply, key) is None:
+            return default
+        return _lib.sensorctl_field_double(reply.encode(), key.encode(), 0.0)
+
+    @staticmethod
+    def frame(header):
+        """Decode the FRAME_SIZE bytes of a FETCH frame header, or None."""
+        frame = Frame()
+        if len(header) < FRAME_SIZE or not _lib.sensorctl_frame(bytes(header), ctypes.byref(frame)):
+            return None
+        return frame
+
+    def status(self):
+        """STATUS as a dict of field strings."""
+        reply = self.command("STATUS")
+        body = reply.split(":", 1)[1] if ":" in reply else reply
+        fields = {}
+        for part in body.split(", "):
+            key, sep, value = part.strip().partition("=")
+            if sep:
+                fields[key] = value
+        return fields
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python3 sensorctl.py COMMAND [ARGS...]")
+        sys.exit(1)
+    try:
+        with SensorCtl() as ctl:
+            print(ctl.command(" ".join(sys.argv[1:])))
+    except SensorCtlRefused as e:
+        print(e)
+        sys.exit(1)
+    except OSError as e:
+        print(f"Error: {SOCKET_PATH}: {e.strerror}")
+        sys.exit(2)
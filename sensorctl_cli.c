@@ -0,0 +1,308 @@
+/*
+    sensorctl: command-line client for the logger's control socket
+
+    Usage:
+        sensorctl [-s SOCKET] COMMAND [ARGS...]
+            send one command and print the reply
+        sensorctl [-s SOCKET] -f KEY COMMAND [ARGS...]
+            print only the value of one field of the reply
+        sensorctl [-s SOCKET] -
+            commands from stdin, one per line, pipelined over one connection
+        sensorctl [-s SOCKET] -w SECONDS [COMMAND [ARGS...]]
+            repeat a command (default STATUS) on one connection
+        sensorctl [-s SOCKET] -b COUNT [-d DEPTH] [COMMAND [ARGS...]]
+            control-plane latency benchmark (default STATUS)
+
+    Exit status: 0 for OK replies, 1 if the logger answered ERROR, 2 if it
+    could not be reached.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "sensorctl.h"
+#include "util.h"
+
+#define EXIT_REFUSED 1
+#define EXIT_UNREACHABLE 2
+#define DEFAULT_BENCH_DEPTH 16
+
+// Print command-line usage
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s SOCKET] COMMAND [ARGS...]\n", prog);
+    fprintf(stderr, "       %s [-s SOCKET] -f KEY COMMAND [ARGS...]   print one field of the reply\n", prog);
+    fprintf(stderr, "       %s [-s SOCKET] -                          pipeline commands from stdin\n", prog);
+    fprintf(stderr, "       %s [-s SOCKET] -w SECONDS [COMMAND]       repeat a command (default STATUS)\n", prog);
+    fprintf(stderr, "       %s [-s SOCKET] -b COUNT [-d DEPTH] [COMMAND]  latency benchmark\n", prog);
+}
+
+// Join arguments into one command line
+static int join_command(int argc, char **argv, char *out, size_t len)
+{
+    size_t used = 0;
+    out[0] = '\0';
+    for (int i = 0; i < argc; i++)
+    {
+        int n = snprintf(out + used, len - used, "%s%s", i > 0 ? " " : "", argv[i]);
+        if (n < 0 || (size_t)n >= len - used)
+            return -1;
+        used += (size_t)n;
+    }
+    return 0;
+}
+
+// Report a failed connection or request
+static int unreachable(const char *path)
+{
+    fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+    return EXIT_UNREACHABLE;
+}
+
+// Print a reply, or just one of its fields. Returns the exit status.
+static int print_reply(const char *reply, int code, const char *field)
+{
+    char value[SENSORCTL_MAX_REPLY];
+    if (field == NULL || code != SENSORCTL_OK)
+        printf("%s\n", reply);
+    else if (sensorctl_field(reply, field, value, sizeof(value)))
+        printf("%s\n", value);
+    else
+    {
+        fprintf(stderr, "Error: No field \"%s\" in: %s\n", field, reply);
+        return EXIT_REFUSED;
+    }
+    return code == SENSORCTL_REFUSED ? EXIT_REFUSED : 0;
+}
+
+// Print events until the logger closes the subscription
+static int subscribe(sensorctl_t *ctl, const char *path)
+{
+    char line[SENSORCTL_MAX_REPLY];
+    sensorctl_set_timeout(ctl, 0);
+    int code = sensorctl_command(ctl, "SUBSCRIBE", line, sizeof(line));
+    if (code < 0)
+        return unreachable(path);
+    printf("%s\n", line);
+    if (code == SENSORCTL_REFUSED)
+        return EXIT_REFUSED;
+
+    fflush(stdout);
+    while (sensorctl_recv(ctl, line, sizeof(line)) >= 0)
+    {
+        printf("%s\n", line);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// Send every line of stdin without waiting, then print the replies in order
+static int run_pipeline(sensorctl_t *ctl, const char *path)
+{
+    char line[SENSORCTL_MAX_REPLY];
+    char reply[SENSORCTL_MAX_REPLY];
+    int status = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (strncmp(line, "SUBSCRIBE", 9) == 0)
+        {
+            fprintf(stderr, "Error: SUBSCRIBE cannot be pipelined\n");
+            return EXIT_REFUSED;
+        }
+        if (sensorctl_send(ctl, line) != 0)
+            return unreachable(path);
+    }
+
+    while (sensorctl_pending(ctl) > 0)
+    {
+        int code = sensorctl_recv(ctl, reply, sizeof(reply));
+        if (code < 0)
+            return unreachable(path);
+        printf("%s\n", reply);
+        if (code == SENSORCTL_REFUSED)
+            status = EXIT_REFUSED;
+    }
+    return status;
+}
+
+// Repeat a command, reconnecting if the logger restarts
+static int run_watch(sensorctl_t *ctl, const char *path, const char *command, const char *field,
+                     double interval)
+{
+    char reply[SENSORCTL_MAX_REPLY];
+    struct timespec ts;
+    ts.tv_sec = (time_t)interval;
+    ts.tv_nsec = (long)((interval - (double)ts.tv_sec) * 1e9);
+
+    for (;;)
+    {
+        int code = sensorctl_command(ctl, command, reply, sizeof(reply));
+        if (code < 0)
+            fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        else
+            print_reply(reply, code, field);
+        fflush(stdout);
+        nanosleep(&ts, NULL);
+    }
+    return 0;
+}
+
+// Compare doubles for qsort
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Print latency percentiles in microseconds (sorts samples)
+static void print_latency(const char *label, double *samples, int count, double elapsed)
+{
+    qsort(samples, (size_t)count, sizeof(double), compare_double);
+    printf("%-22s min=%8.1f p50=%8.1f p99=%8.1f max=%8.1f us  %9.0f cmd/s\n", label,
+           samples[0] * 1e6, samples[count / 2] * 1e6, samples[(int)(count * 0.99)] * 1e6,
+           samples[count - 1] * 1e6, count / elapsed);
+}
+
+// Time COUNT commands three ways: a connection per command, one session
+// waiting for every reply, and one session with DEPTH commands in flight
+static int run_bench(sensorctl_t *ctl, const char *path, const char *command, int count, int depth)
+{
+    char reply[SENSORCTL_MAX_REPLY];
+    double *samples = (double*)malloc((size_t)count * sizeof(double));
+    double *sent_at = (double*)malloc((size_t)depth * sizeof(double));
+    if (samples == NULL || sent_at == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(samples);
+        free(sent_at);
+        return EXIT_REFUSED;
+    }
+
+    printf("Benchmark: %d x \"%s\" on %s\n", count, command, path);
+
+    double start = now_mono();
+    for (int i = 0; i < count; i++)
+    {
+        double t0 = now_mono();
+        if (sensorctl_oneshot(path, command, reply, sizeof(reply)) < 0)
+            goto failed;
+        samples[i] = now_mono() - t0;
+    }
+    print_latency("connect per command", samples, count, now_mono() - start);
+
+    start = now_mono();
+    for (int i = 0; i < count; i++)
+    {
+        double t0 = now_mono();
+        if (sensorctl_command(ctl, command, reply, sizeof(reply)) < 0)
+            goto failed;
+        samples[i] = now_mono() - t0;
+    }
+    print_latency("session", samples, count, now_mono() - start);
+
+    // Keep depth commands in flight; replies come back in order
+    int sent = 0;
+    int received = 0;
+    start = now_mono();
+    while (received < count)
+    {
+        while (sent < count && sent - received < depth)
+        {
+            sent_at[sent % depth] = now_mono();
+            if (sensorctl_send(ctl, command) != 0)
+                goto failed;
+            sent++;
+        }
+        if (sensorctl_recv(ctl, reply, sizeof(reply)) < 0)
+            goto failed;
+        samples[received] = now_mono() - sent_at[received % depth];
+        received++;
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "pipelined (depth %d)", depth);
+    print_latency(label, samples, count, now_mono() - start);
+
+    free(samples);
+    free(sent_at);
+    return 0;
+
+failed:
+    free(samples);
+    free(sent_at);
+    return unreachable(path);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = SENSORCTL_DEFAULT_PATH;
+    const char *field = NULL;
+    double watch = 0.0;
+    int bench = 0;
+    int depth = DEFAULT_BENCH_DEPTH;
+    bool from_stdin = false;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        const char *opt = argv[arg];
+        bool has_value = arg + 1 < argc;
+        if (strcmp(opt, "-") == 0)
+            from_stdin = true;
+        else if (strcmp(opt, "-s") == 0 && has_value)
+            path = argv[++arg];
+        else if (strcmp(opt, "-f") == 0 && has_value)
+            field = argv[++arg];
+        else if (strcmp(opt, "-w") == 0 && has_value)
+            watch = atof(argv[++arg]);
+        else if (strcmp(opt, "-b") == 0 && has_value)
+            bench = atoi(argv[++arg]);
+        else if (strcmp(opt, "-d") == 0 && has_value)
+            depth = atoi(argv[++arg]);
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_REFUSED;
+        }
+    }
+
+    char command[SENSORCTL_MAX_REPLY];
+    if (join_command(argc - arg, argv + arg, command, sizeof(command)) != 0 ||
+        (command[0] == '\0' && !from_stdin && watch <= 0.0 && bench <= 0) ||
+        (from_stdin && command[0] != '\0') || bench < 0 || depth < 1 || watch < 0.0)
+    {
+        print_usage(argv[0]);
+        return EXIT_REFUSED;
+    }
+    if (command[0] == '\0')
+        strcpy(command, "STATUS");
+
+    sensorctl_t *ctl = sensorctl_open(path);
+    if (ctl == NULL)
+        return unreachable(path);
+
+    int status;
+    char reply[SENSORCTL_MAX_REPLY];
+    if (from_stdin)
+        status = run_pipeline(ctl, path);
+    else if (bench > 0)
+        status = run_bench(ctl, path, command, bench, depth);
+    else if (watch > 0.0)
+        status = run_watch(ctl, path, command, field, watch);
+    else if (strcmp(command, "SUBSCRIBE") == 0)
+        status = subscribe(ctl, path);
+    else
+    {
+        int code = sensorctl_command(ctl, command, reply, sizeof(reply));
+        status = code < 0 ? unreachable(path) : print_reply(reply, code, field);
+    }
+
+    sensorctl_close(ctl);
+    return status;
+}
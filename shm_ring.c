@@ -0,0 +1,305 @@
+/*
+    Shared-memory sample ring (see shm_ring.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm_ring.h"
+
+// Map an open shm descriptor and fill in the ring handle
+static int map_ring(shm_ring_t *ring, int fd, size_t size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+
+    ring->hdr = (shm_ring_header_t*)addr;
+    ring->data = (double*)((uint8_t*)addr + sizeof(shm_ring_header_t));
+    ring->map_size = size;
+    ring->fd = fd;
+    return 0;
+}
+
+// Create (or replace) the ring
+int shm_ring_create(shm_ring_t *ring, const char *name, uint64_t capacity, uint64_t boot_id)
+{
+    size_t size = sizeof(shm_ring_header_t) + capacity * sizeof(double);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    // Always start from a fresh segment: a writer still attached to an old
+    // one notices through shm_ring_replaced() and re-attaches.
+    shm_unlink(name);
+    // Owner only: anyone who can map the ring can rewrite its samples and
+    // its head, tail and seq_counter
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        perror("shm_open");
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    if (map_ring(ring, fd, size) != 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    shm_ring_header_t *hdr = ring->hdr;
+    hdr->version = SHM_RING_VERSION;
+    hdr->capacity = capacity;
+    hdr->boot_id = boot_id;
+    hdr->producer_pid = (int32_t)getpid();
+    hdr->writer_pid = 0;
+    hdr->head = 0;
+    hdr->dropped = 0;
+    hdr->tail = 0;
+    hdr->seq_counter = 0;
+    hdr->write_errors = 0;
+    hdr->capture_enabled = 0;
+    hdr->scan_rate = 0.0;
+    hdr->anchors.head = 0;
+
+    // Publish the magic last so an attaching writer never sees a
+    // half-initialized header.
+    __atomic_store_n(&hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Map an existing ring
+static int open_ring(shm_ring_t *ring, const char *name)
+{
+    struct stat st;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shm_ring_header_t))
+    {
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (map_ring(ring, fd, (size_t)st.st_size) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    shm_ring_header_t *hdr = ring->hdr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+        hdr->version != SHM_RING_VERSION ||
+        sizeof(shm_ring_header_t) + hdr->capacity * sizeof(double) > ring->map_size)
+    {
+        shm_ring_close(ring, false);
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+// Attach to an existing ring
+int shm_ring_attach(shm_ring_t *ring, const char *name)
+{
+    if (open_ring(ring, name) != 0)
+        return -1;
+    ring->hdr->writer_pid = (int32_t)getpid();
+    return 0;
+}
+
+// Take over an existing ring as its producer
+int shm_ring_adopt(shm_ring_t *ring, const char *name)
+{
+    if (open_ring(ring, name) != 0)
+        return -1;
+    ring->hdr->producer_pid = (int32_t)getpid();
+    return 0;
+}
+
+// Unmap the ring
+void shm_ring_close(shm_ring_t *ring, bool unlink_name)
+{
+    if (ring->hdr)
+    {
+        munmap(ring->hdr, ring->map_size);
+        ring->hdr = NULL;
+        ring->data = NULL;
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (unlink_name && ring->name[0])
+        shm_unlink(ring->name);
+}
+
+// Check whether the shared-memory name was recreated by a new producer
+bool shm_ring_replaced(const shm_ring_t *ring)
+{
+    struct stat mapped, current;
+
+    int fd = shm_open(ring->name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;  // Producer gone; keep draining what is mapped
+
+    bool replaced = false;
+    if (fstat(ring->fd, &mapped) == 0 && fstat(fd, &current) == 0)
+        replaced = (mapped.st_ino != current.st_ino);
+    close(fd);
+    return replaced;
+}
+
+// Producer: append samples, dropping oldest data if full
+uint64_t shm_ring_write(shm_ring_t *ring, const double *samples, size_t count)
+{
+    shm_ring_header_t *hdr = ring->hdr;
+    uint64_t cap = hdr->capacity;
+    uint64_t dropped = 0;
+
+    // Keep only the newest samples if a single write exceeds the ring
+    if (count > cap)
+    {
+        dropped += count - cap;
+        samples += count - cap;
+        count = (size_t)cap;
+    }
+
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    uint64_t new_head = head + count;
+
+    // Make room by pushing the tail forward. The writer may commit
+    // concurrently, so only ever move the tail forward.
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    while (new_head - tail > cap)
+    {
+        uint64_t new_tail = new_head - cap;
+        if (__atomic_compare_exchange_n(&hdr->tail, &tail, new_tail, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            dropped += new_tail - tail;
+            break;
+        }
+    }
+
+    // The tail move must be visible before the old slots are overwritten so
+    // that a reader copying them can detect the overwrite.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    size_t pos = (size_t)(head % cap);
+    size_t first = (pos + count <= cap) ? count : (size_t)(cap - pos);
+    memcpy(ring->data + pos, samples, first * sizeof(double));
+    if (count > first)
+        memcpy(ring->data, samples + first, (count - first) * sizeof(double));
+
+    __atomic_store_n(&hdr->head, new_head, __ATOMIC_RELEASE);
+    if (dropped)
+        __atomic_fetch_add(&hdr->dropped, dropped, __ATOMIC_RELAXED);
+
+    return dropped;
+}
+
+// Consumer: copy samples starting at *cursor
+size_t shm_ring_read(shm_ring_t *ring, uint64_t *cursor, double *samples, size_t count, uint64_t *lost)
+{
+    shm_ring_header_t *hdr = ring->hdr;
+    uint64_t cap = hdr->capacity;
+    uint64_t pos_idx = *cursor;
+
+    *lost = 0;
+
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    if (pos_idx < tail)
+    {
+        *lost += tail - pos_idx;
+        pos_idx = tail;
+    }
+
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    if (head <= pos_idx)
+    {
+        *cursor = pos_idx;
+        return 0;
+    }
+
+    size_t n = (head - pos_idx < count) ? (size_t)(head - pos_idx) : count;
+    size_t pos = (size_t)(pos_idx % cap);
+    size_t first = (pos + n <= cap) ? n : (size_t)(cap - pos);
+    memcpy(samples, ring->data + pos, first * sizeof(double));
+    if (n > first)
+        memcpy(samples + first, ring->data, (n - first) * sizeof(double));
+
+    // Anything the producer dropped while we were copying may be torn
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    if (tail > pos_idx)
+    {
+        uint64_t torn = tail - pos_idx;
+        if (torn >= n)
+        {
+            *lost += torn;
+            *cursor = tail;
+            return 0;
+        }
+        memmove(samples, samples + torn, (n - torn) * sizeof(double));
+        *lost += torn;
+        pos_idx += torn;
+        n -= (size_t)torn;
+    }
+
+    *cursor = pos_idx + n;
+    return n;
+}
+
+// Consumer: commit everything before cursor. seq_counter is only
+// published by the commit that moves the tail, so a commit that arrives
+// after a later one cannot wind it back.
+void shm_ring_commit(shm_ring_t *ring, uint64_t cursor, uint64_t seq_counter)
+{
+    shm_ring_header_t *hdr = ring->hdr;
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+
+    while (tail < cursor)
+    {
+        if (__atomic_compare_exchange_n(&hdr->tail, &tail, cursor, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&hdr->seq_counter, seq_counter, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+}
+
+// Samples written but not yet committed
+uint64_t shm_ring_pending(const shm_ring_t *ring)
+{
+    uint64_t head = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
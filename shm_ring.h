@@ -0,0 +1,103 @@
+/*
+    Shared-memory sample ring used to split acquisition and writing into
+    separate processes.
+
+    The acquisition process creates the ring and is its only producer.
+    A writer process attaches to it and is its only consumer. Positions are
+    64-bit monotonically increasing sample indices, so a restarted writer
+    resumes exactly at the last committed index. The segment is created
+    mode 0600, so both processes must run as the same user.
+
+    Overflow policy matches the in-process ring: when the ring is full the
+    producer advances the tail and drops the oldest samples.
+
+    The header also holds the producer's timestamp anchors, keyed by ring
+    position (see anchor.h).
+*/
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "anchor.h"
+
+#define SHM_RING_DEFAULT_NAME "/sensor_ring"
+#define SHM_RING_MAGIC 0x53524E47u  // "SRNG"
+#define SHM_RING_VERSION 2
+
+// Header at the start of the shared segment. head and tail live on their
+// own cache lines because they are written by different processes.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;          // ring size in samples
+    uint64_t boot_id;           // boot ID of the acquisition process
+    int32_t producer_pid;
+    int32_t writer_pid;
+    uint8_t pad0[64 - 32];
+
+    uint64_t head;              // next sample index to be written (producer)
+    uint64_t dropped;           // samples dropped on overflow (producer)
+    uint8_t pad1[64 - 16];
+
+    uint64_t tail;              // first sample index not yet committed (writer)
+    uint64_t seq_counter;       // chunk sequence counter at tail (writer)
+    uint64_t write_errors;      // chunks the writer failed to write (writer)
+    uint8_t pad2[64 - 24];
+
+    // Acquisition state published by the control thread of the producer
+    uint32_t capture_enabled;
+    uint32_t channel_mask;      // hardware channels interleaved in each frame
+    double scan_rate;
+    uint8_t pad3[64 - 16];
+
+    anchor_ring_t anchors;      // pushed by the producer before their samples
+} shm_ring_header_t;
+
+typedef struct {
+    shm_ring_header_t *hdr;
+    double *data;
+    size_t map_size;
+    int fd;
+    char name[64];
+} shm_ring_t;
+
+// Create (or replace) the ring. Called by the acquisition process.
+int shm_ring_create(shm_ring_t *ring, const char *name, uint64_t capacity, uint64_t boot_id);
+
+// Attach to an existing ring. Called by the writer process.
+int shm_ring_attach(shm_ring_t *ring, const char *name);
+
+// Take over an existing ring as its producer, keeping its contents and
+// positions. Called by a process that replaces the acquisition process in
+// place (see upgrade.h); an attached writer keeps reading.
+int shm_ring_adopt(shm_ring_t *ring, const char *name);
+
+// Unmap the ring. If unlink is set, the shared-memory name is removed too.
+void shm_ring_close(shm_ring_t *ring, bool unlink_name);
+
+// True if the name now refers to a different segment than the one mapped
+// (the acquisition process was restarted and recreated the ring).
+bool shm_ring_replaced(const shm_ring_t *ring);
+
+// Producer: append samples, dropping the oldest data if the ring is full.
+// Returns the number of samples dropped to make room.
+uint64_t shm_ring_write(shm_ring_t *ring, const double *samples, size_t count);
+
+// Consumer: copy up to count samples starting at *cursor. On return *cursor
+// is advanced past the copied samples. If the producer overwrote samples
+// before they could be read, *cursor skips ahead and *lost reports how many
+// samples were skipped.
+size_t shm_ring_read(shm_ring_t *ring, uint64_t *cursor, double *samples, size_t count, uint64_t *lost);
+
+// Consumer: mark everything before cursor as committed to storage and
+// publish the sequence counter that goes with it. Does nothing if the
+// tail is already at or past cursor.
+void shm_ring_commit(shm_ring_t *ring, uint64_t cursor, uint64_t seq_counter);
+
+// Samples written but not yet committed by the writer
+uint64_t shm_ring_pending(const shm_ring_t *ring);
+
+#endif /* SHM_RING_H_ */
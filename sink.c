@@ -0,0 +1,400 @@
+/*
+    Output sinks for finished chunks (see sink.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "sink.h"
+#include "config.h"
+#include "pace.h"
+#include "merge.h"
+#include "util.h"
+
+typedef struct {
+    const sink_ops_t *ops;
+    void *ctx;
+    void *dl_handle;
+    char type[32];
+    char args[CONFIG_MAX_VALUE];
+
+    // Bounded chunk queue drained by the worker thread
+    sdat_chunk_t **queue;
+    uint32_t depth;
+    uint32_t head;
+    uint32_t count;
+    bool block_when_full;
+    bool stopping;
+    int fill;                   // percent of depth, read without the mutex
+    merge_ctl_t merge;          // chunk merging under backpressure
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    // Statistics
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t errors;
+} sink_t;
+
+static sink_t g_sinks[SINK_MAX];
+static int g_sink_count = 0;
+static sink_done_fn g_done_fn = NULL;
+static int g_pending = 0;       // chunks queued or being written, all sinks
+
+// Drop one reference; the last one reports completion and frees the chunk
+static void chunk_release(sdat_chunk_t *chunk)
+{
+    if (__atomic_sub_fetch(&chunk->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (g_done_fn)
+            g_done_fn(chunk, !__atomic_load_n(&chunk->write_failed, __ATOMIC_RELAXED));
+        sdat_chunk_free(chunk);
+    }
+}
+
+// Record a queue's fill and report the fullest blocking queue to the
+// pacer. Caller holds s->mutex.
+static void update_fill(sink_t *s)
+{
+    __atomic_store_n(&s->fill, (int)(s->count * 100 / s->depth), __ATOMIC_RELAXED);
+
+    int fullest = 0;
+    for (int i = 0; i < g_sink_count; i++)
+    {
+        int fill = __atomic_load_n(&g_sinks[i].fill, __ATOMIC_RELAXED);
+        if (g_sinks[i].block_when_full && fill > fullest)
+            fullest = fill;
+    }
+    pace_set_queue_fill(fullest);
+}
+
+// Resolve the callbacks for a sink type, loading a plugin if needed
+static const sink_ops_t* resolve_ops(sink_t *s)
+{
+    if (strcmp(s->type, "file") == 0)
+        return &sink_file_ops;
+    if (strcmp(s->type, "segment") == 0)
+        return &sink_segment_ops;
+    if (strcmp(s->type, "socket") == 0)
+        return &sink_socket_ops;
+    if (strcmp(s->type, "shm") == 0)
+        return &sink_shm_ops;
+
+    if (strcmp(s->type, "plugin") == 0)
+    {
+        char path[256];
+        if (!config_arg(s->args, "path", path, sizeof(path)))
+        {
+            fprintf(stderr, "Error: plugin sink requires path=<shared object>\n");
+            return NULL;
+        }
+        s->dl_handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (s->dl_handle == NULL)
+        {
+            fprintf(stderr, "Error: Failed to load sink plugin: %s\n", dlerror());
+            return NULL;
+        }
+        const sink_ops_t *ops = (const sink_ops_t*)dlsym(s->dl_handle, SINK_PLUGIN_SYMBOL);
+        if (ops == NULL || ops->chunk == NULL)
+        {
+            fprintf(stderr, "Error: %s does not export a valid %s\n", path, SINK_PLUGIN_SYMBOL);
+            dlclose(s->dl_handle);
+            s->dl_handle = NULL;
+            return NULL;
+        }
+        return ops;
+    }
+
+    fprintf(stderr, "Error: Unknown sink type: %s\n", s->type);
+    return NULL;
+}
+
+// Add a sink from a spec
+int sink_add(const char *spec)
+{
+    if (g_sink_count >= SINK_MAX)
+    {
+        fprintf(stderr, "Error: Too many sinks (max %d)\n", SINK_MAX);
+        return -1;
+    }
+
+    sink_t *s = &g_sinks[g_sink_count];
+    memset(s, 0, sizeof(*s));
+
+    while (isspace((unsigned char)*spec))
+        spec++;
+    size_t type_len = strcspn(spec, " \t");
+    if (type_len == 0 || type_len >= sizeof(s->type))
+    {
+        fprintf(stderr, "Error: Invalid sink spec: %s\n", spec);
+        return -1;
+    }
+    memcpy(s->type, spec, type_len);
+    strncpy(s->args, spec + type_len, sizeof(s->args) - 1);
+
+    s->ops = resolve_ops(s);
+    if (s->ops == NULL)
+        return -1;
+
+    // Durable sinks block by default, streaming sinks drop
+    char policy[16];
+    bool streaming = (s->ops == &sink_socket_ops || s->ops == &sink_shm_ops);
+    s->block_when_full = !streaming;
+    if (config_arg(s->args, "policy", policy, sizeof(policy)))
+        s->block_when_full = (strcmp(policy, "block") == 0);
+
+    s->depth = (uint32_t)config_arg_double(s->args, "queue", SINK_DEFAULT_QUEUE);
+    if (s->depth == 0)
+        s->depth = 1;
+    if (merge_init(&s->merge, s->args) != 0)
+        return -1;
+
+    g_sink_count++;
+    return 0;
+}
+
+// Take the chunk at the head of the queue. Caller holds s->mutex.
+static sdat_chunk_t* dequeue(sink_t *s)
+{
+    sdat_chunk_t *chunk = s->queue[s->head];
+    s->head = (s->head + 1) % s->depth;
+    s->count--;
+    return chunk;
+}
+
+// Worker thread: drain the queue into the sink
+static void* sink_worker(void *arg)
+{
+    sink_t *s = (sink_t*)arg;
+    sdat_chunk_t *batch[MERGE_MAX];
+
+    pthread_mutex_lock(&s->mutex);
+    for (;;)
+    {
+        while (s->count == 0 && !s->stopping)
+            pthread_cond_wait(&s->not_empty, &s->mutex);
+        if (s->count == 0 && s->stopping)
+            break;
+
+        // Under backpressure, take the queued chunks that continue this one
+        uint32_t n = 0;
+        batch[n++] = dequeue(s);
+        while (n < s->merge.factor && s->count > 0 && merge_compatible(batch[n - 1], s->queue[s->head]))
+            batch[n++] = dequeue(s);
+        update_fill(s);
+        bool idle = (s->count == 0);
+        pthread_cond_broadcast(&s->not_full);
+        pthread_mutex_unlock(&s->mutex);
+
+        // Written as one chunk, or one by one if it could not be merged
+        double started = now_mono();
+        double data_sec = 0.0;
+        sdat_chunk_t *merged = (n > 1) ? merge_chunks(batch, n) : NULL;
+        int rc = 0;
+        if (merged != NULL)
+        {
+            data_sec = merge_chunk_seconds(merged);
+            rc = s->ops->chunk(s->ctx, merged);
+            merge_free(merged);
+            for (uint32_t i = 0; rc != 0 && i < n; i++)
+                __atomic_store_n(&batch[i]->write_failed, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                data_sec += merge_chunk_seconds(batch[i]);
+                if (s->ops->chunk(s->ctx, batch[i]) != 0)
+                {
+                    __atomic_store_n(&batch[i]->write_failed, 1, __ATOMIC_RELAXED);
+                    rc = -1;
+                }
+            }
+        }
+        if (rc == 0 && idle && s->ops->flush && s->ops->flush(s->ctx) != 0)
+        {
+            for (uint32_t i = 0; i < n; i++)
+                __atomic_store_n(&batch[i]->write_failed, 1, __ATOMIC_RELAXED);
+            rc = -1;
+        }
+
+        // Release before counting so the chunks are fully committed
+        // by the time the write shows up in STATUS
+        for (uint32_t i = 0; i < n; i++)
+            chunk_release(batch[i]);
+        __atomic_sub_fetch(&g_pending, (int)n, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock(&s->mutex);
+        if (rc == 0)
+            s->written += n;
+        else
+            s->errors += n;
+        if (merged != NULL)
+            s->merge.merged += n;
+        merge_update(&s->merge, now_mono() - started, data_sec, s->count, s->depth);
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    return NULL;
+}
+
+// Open all sinks and start their workers
+int sink_start_all(sink_done_fn done)
+{
+    g_done_fn = done;
+
+    for (int i = 0; i < g_sink_count; i++)
+    {
+        sink_t *s = &g_sinks[i];
+
+        if (s->ops->open && s->ops->open(&s->ctx, s->args) != 0)
+        {
+            fprintf(stderr, "Error: Failed to open %s sink\n", s->type);
+            return -1;
+        }
+
+        s->queue = (sdat_chunk_t**)calloc(s->depth, sizeof(sdat_chunk_t*));
+        if (s->queue == NULL)
+            return -1;
+        pthread_mutex_init(&s->mutex, NULL);
+        pthread_cond_init(&s->not_empty, NULL);
+        pthread_cond_init(&s->not_full, NULL);
+
+        if (pthread_create(&s->tid, NULL, sink_worker, s) != 0)
+        {
+            fprintf(stderr, "Error: Failed to create %s sink worker\n", s->type);
+            return -1;
+        }
+        printf("Sink started: %s%s (queue=%u, policy=%s)\n", s->type, s->args,
+               s->depth, s->block_when_full ? "block" : "drop");
+    }
+    return 0;
+}
+
+// Queue a chunk on every sink
+int sink_dispatch(sdat_chunk_t *chunk)
+{
+    int queued = 0;
+
+    // One reference per sink plus one held while dispatching
+    chunk->refcount = g_sink_count + 1;
+
+    for (int i = 0; i < g_sink_count; i++)
+    {
+        sink_t *s = &g_sinks[i];
+
+        pthread_mutex_lock(&s->mutex);
+        while (s->count == s->depth && s->block_when_full && !s->stopping)
+            pthread_cond_wait(&s->not_full, &s->mutex);
+
+        if (s->count == s->depth || s->stopping)
+        {
+            s->dropped++;
+            pthread_mutex_unlock(&s->mutex);
+            chunk_release(chunk);
+            continue;
+        }
+
+        s->queue[(s->head + s->count) % s->depth] = chunk;
+        s->count++;
+        __atomic_add_fetch(&g_pending, 1, __ATOMIC_RELEASE);
+        update_fill(s);
+        pthread_cond_signal(&s->not_empty);
+        pthread_mutex_unlock(&s->mutex);
+        queued++;
+    }
+
+    chunk_release(chunk);
+    return queued > 0 ? 0 : -1;
+}
+
+// Drain the queues, flush and close every sink
+void sink_stop_all(void)
+{
+    // Nothing waits for the rest, so drain it unpaced
+    pace_set_queue_fill(100);
+    for (int i = 0; i < g_sink_count; i++)
+    {
+        sink_t *s = &g_sinks[i];
+        if (s->queue == NULL)
+            continue;
+
+        pthread_mutex_lock(&s->mutex);
+        s->stopping = true;
+        pthread_cond_broadcast(&s->not_empty);
+        pthread_cond_broadcast(&s->not_full);
+        pthread_mutex_unlock(&s->mutex);
+        pthread_join(s->tid, NULL);
+
+        if (s->ops->flush)
+            s->ops->flush(s->ctx);
+        if (s->ops->close)
+            s->ops->close(s->ctx);
+        if (s->dl_handle)
+            dlclose(s->dl_handle);
+
+        free(s->queue);
+        s->queue = NULL;
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->not_empty);
+        pthread_cond_destroy(&s->not_full);
+    }
+    g_sink_count = 0;
+}
+
+// Number of configured sinks
+int sink_count(void)
+{
+    return g_sink_count;
+}
+
+// True if no sink has a chunk queued or in progress
+bool sink_idle(void)
+{
+    return __atomic_load_n(&g_pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+// Most chunks held by the sinks at once
+uint32_t sink_max_queued(void)
+{
+    uint32_t deepest = 0;
+    for (int i = 0; i < g_sink_count; i++)
+    {
+        if (g_sinks[i].depth > deepest)
+            deepest = g_sinks[i].depth;
+    }
+    return g_sink_count > 0 ? deepest + (uint32_t)g_sink_count : 0;
+}
+
+// One-line summary of every sink for STATUS
+void sink_status(char *buf, size_t len)
+{
+    size_t used = 0;
+    buf[0] = '\0';
+
+    for (int i = 0; i < g_sink_count && used < len; i++)
+    {
+        sink_t *s = &g_sinks[i];
+        pthread_mutex_lock(&s->mutex);
+        int n = snprintf(buf + used, len - used, "%s%s(q=%u,ok=%llu,drop=%llu,err=%llu",
+                         i ? "," : "", s->type, s->count,
+                         (unsigned long long)s->written,
+                         (unsigned long long)s->dropped,
+                         (unsigned long long)s->errors);
+        if (n >= 0 && (size_t)n < len - used && s->merge.max > 1)
+            n += snprintf(buf + used + n, len - used - n, ",merge=%u,merged=%llu",
+                          s->merge.factor, (unsigned long long)s->merge.merged);
+        if (n >= 0 && (size_t)n < len - used)
+            n += snprintf(buf + used + n, len - used - n, ")");
+        pthread_mutex_unlock(&s->mutex);
+        if (n < 0)
+            break;
+        used += (size_t)n;
+    }
+}
@@ -0,0 +1,85 @@
+/*
+    Output sinks for finished chunks.
+
+    The consumer hands every finished chunk to sink_dispatch(). Each
+    configured sink has its own worker thread and bounded queue, so a slow
+    sink (a stalled SD card, a dead network peer) never delays the consumer
+    or the other sinks.
+
+    A sink implements four callbacks:
+        open   parse its argument string and allocate its context
+        chunk  write one chunk
+        flush  make written chunks durable/visible (called when idle)
+        close  flush and release everything
+
+    Built-in sinks: file, segment, socket, shm. Other sinks can be loaded
+    from a shared object exporting a sink_ops_t named SINK_PLUGIN_SYMBOL.
+
+    Configuration ("sink" lines in the config file):
+        sink = file dir=/data/DAD_Files pace=auto
+        sink = segment dir=/data/segments max_mb=64
+        sink = socket addr=tcp:10.0.0.5:9000 queue=64 policy=drop
+        sink = shm name=/sensor_chunks slots=8 slot_kb=512 mode=0640
+        sink = plugin path=/usr/local/lib/mysink.so <plugin arguments>
+    Common arguments: queue=<chunks> and policy=block|drop (what happens
+    when that sink's queue is full), and merge=<max chunks> to merge
+    queued chunks while the sink is behind (see merge.h). The file and
+    segment sinks also take pace= and burst= (see pace.h).
+*/
+
+#ifndef SINK_H_
+#define SINK_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdat.h"
+
+#define SINK_MAX 8
+#define SINK_DEFAULT_QUEUE 16
+#define SINK_PLUGIN_SYMBOL "sensor_sink_ops"
+
+typedef struct {
+    const char *name;
+    int (*open)(void **ctx, const char *args);
+    int (*chunk)(void *ctx, const sdat_chunk_t *chunk);
+    int (*flush)(void *ctx);
+    void (*close)(void *ctx);
+} sink_ops_t;
+
+// Called once every sink is done with a chunk. written is false if a sink
+// failed to write it; a chunk a full queue dropped counts as done.
+typedef void (*sink_done_fn)(const sdat_chunk_t *chunk, bool written);
+
+// Built-in sinks (sink_builtin.c)
+extern const sink_ops_t sink_file_ops;
+extern const sink_ops_t sink_segment_ops;
+extern const sink_ops_t sink_socket_ops;
+extern const sink_ops_t sink_shm_ops;
+
+// Add a sink from a spec: "<type> [name=value ...]"
+int sink_add(const char *spec);
+
+// Open all sinks and start their workers
+int sink_start_all(sink_done_fn done);
+
+// Queue a chunk on every sink. Takes ownership of the chunk.
+int sink_dispatch(sdat_chunk_t *chunk);
+
+// Drain the queues, flush and close every sink
+void sink_stop_all(void);
+
+// Number of configured sinks
+int sink_count(void);
+
+// True if no sink has a chunk queued or being written (for background
+// work that must not compete with live writes)
+bool sink_idle(void);
+
+// Most chunks the sinks can hold at once (the deepest queue plus the one
+// each worker is writing); chunks are shared between sinks
+uint32_t sink_max_queued(void);
+
+// One-line summary of every sink for STATUS
+void sink_status(char *buf, size_t len);
+
+#endif /* SINK_H_ */
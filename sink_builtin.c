@@ -0,0 +1,524 @@
+/*
+    Built-in output sinks: file, segment, socket, shm (see sink.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sink.h"
+#include "config.h"
+#include "pace.h"
+
+#define SEGMENT_DEFAULT_MAX_MB 64
+#define SOCKET_RETRY_SEC 1
+#define SHM_SINK_DEFAULT_NAME "/sensor_chunks"
+#define SHM_SINK_DEFAULT_SLOTS 8
+#define SHM_SINK_DEFAULT_SLOT_KB 512
+#define SHM_SINK_DEFAULT_MODE "0600"
+#define SHM_SINK_MAGIC 0x534B4843u  // "CHKS"
+
+/****************************************************************************
+ * file: one chunk_<seq>_.bin per chunk, written as .part then renamed.
+ * Derived streams go to <dir>/<stream>/ with an index.csv per stream.
+ ****************************************************************************/
+typedef struct {
+    char dir[512];
+    pace_t pace;
+} file_sink_t;
+
+static int file_open(void **ctx, const char *args)
+{
+    file_sink_t *fs = (file_sink_t*)calloc(1, sizeof(file_sink_t));
+    if (fs == NULL)
+        return -1;
+    if (!config_arg(args, "dir", fs->dir, sizeof(fs->dir)))
+        strcpy(fs->dir, ".");
+    if (pace_init(&fs->pace, args) != 0)
+    {
+        free(fs);
+        return -1;
+    }
+    *ctx = fs;
+    return 0;
+}
+
+// Append a line for a derived stream chunk to <stream dir>/index.csv
+static void file_index(const char *dir, const sdat_chunk_t *chunk, const char *filename)
+{
+    char path[600];
+    snprintf(path, sizeof(path), "%s/index.csv", dir);
+
+    bool created = access(path, F_OK) != 0;
+    FILE *f = fopen(path, "a");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (created)
+        fprintf(f, "seq_start,sample_count,decimation,full_rate_index,flags,file\n");
+    fprintf(f, "%llu,%u,%u,%llu,%u,%s\n",
+            (unsigned long long)chunk->seq_start, chunk->sample_count, chunk->decimation,
+            (unsigned long long)(chunk->seq_start * chunk->decimation), chunk->flags,
+            strrchr(filename, '/') + 1);
+    fclose(f);
+}
+
+static int file_chunk(void *ctx, const sdat_chunk_t *chunk)
+{
+    file_sink_t *fs = (file_sink_t*)ctx;
+    char dir[560];
+    char filename_part[600];
+    char filename_final[600];
+    uint8_t header[SDAT_MAX_HEADER_SIZE];
+
+    // Derived streams go to a subdirectory per stream
+    if (chunk->stream != 0)
+    {
+        snprintf(dir, sizeof(dir), "%s/%s", fs->dir, chunk->stream_name);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "Error: Failed to create %s: %s\n", dir, strerror(errno));
+            return -1;
+        }
+    }
+    else
+    {
+        snprintf(dir, sizeof(dir), "%s", fs->dir);
+    }
+
+    // Format: chunk_<sequence>_.bin.part
+    snprintf(filename_part, sizeof(filename_part),
+             "%s/chunk_%llu_.bin.part",
+             dir, (unsigned long long)chunk->seq_start);
+    snprintf(filename_final, sizeof(filename_final),
+             "%s/chunk_%llu_.bin",
+             dir, (unsigned long long)chunk->seq_start);
+
+    int fd = open(filename_part, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Failed to open file %s: %s\n",
+                filename_part, strerror(errno));
+        return -1;
+    }
+
+    size_t header_len = sdat_encode_header(chunk, header);
+    size_t payload_len = sdat_payload_size(chunk);
+    bool ok = pace_write(&fs->pace, fd, header, header_len) == 0 &&
+              pace_write(&fs->pace, fd, chunk->samples, payload_len) == 0;
+
+    if (close(fd) != 0 || !ok)
+    {
+        fprintf(stderr, "Error: Failed to write %s: %s\n", filename_part, strerror(errno));
+        unlink(filename_part);
+        return -1;
+    }
+
+    // Atomic rename: .part -> .bin
+    if (rename(filename_part, filename_final) != 0)
+    {
+        fprintf(stderr, "Error: Failed to rename %s to %s: %s\n",
+                filename_part, filename_final, strerror(errno));
+        unlink(filename_part);  // Clean up
+        return -1;
+    }
+
+    if (chunk->stream != 0)
+        file_index(dir, chunk, filename_final);
+    return 0;
+}
+
+static void file_close(void *ctx)
+{
+    free(ctx);
+}
+
+const sink_ops_t sink_file_ops = {
+    "file", file_open, file_chunk, NULL, file_close
+};
+
+/****************************************************************************
+ * segment: chunks appended back to back to segment_<seq>.log.part,
+ * renamed to segment_<seq>.log once the segment reaches max_mb
+ ****************************************************************************/
+typedef struct {
+    char dir[512];
+    size_t max_bytes;
+    int fd;
+    size_t size;
+    char path_part[600];
+    char path_final[600];
+    pace_t pace;
+} segment_sink_t;
+
+static int segment_seal(segment_sink_t *ss)
+{
+    int rc = 0;
+
+    if (ss->fd < 0)
+        return 0;
+    if (fdatasync(ss->fd) != 0)
+        rc = -1;
+    close(ss->fd);
+    ss->fd = -1;
+
+    if (rename(ss->path_part, ss->path_final) != 0)
+    {
+        fprintf(stderr, "Error: Failed to rename %s to %s: %s\n",
+                ss->path_part, ss->path_final, strerror(errno));
+        rc = -1;
+    }
+    return rc;
+}
+
+static int segment_open(void **ctx, const char *args)
+{
+    segment_sink_t *ss = (segment_sink_t*)calloc(1, sizeof(segment_sink_t));
+    if (ss == NULL)
+        return -1;
+    if (!config_arg(args, "dir", ss->dir, sizeof(ss->dir)))
+        strcpy(ss->dir, ".");
+    ss->max_bytes = (size_t)(config_arg_double(args, "max_mb", SEGMENT_DEFAULT_MAX_MB) * 1024 * 1024);
+    ss->fd = -1;
+    if (pace_init(&ss->pace, args) != 0)
+    {
+        free(ss);
+        return -1;
+    }
+
+    if (mkdir(ss->dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: Failed to create segment directory %s: %s\n", ss->dir, strerror(errno));
+        free(ss);
+        return -1;
+    }
+    *ctx = ss;
+    return 0;
+}
+
+static int segment_chunk(void *ctx, const sdat_chunk_t *chunk)
+{
+    segment_sink_t *ss = (segment_sink_t*)ctx;
+    uint8_t header[SDAT_MAX_HEADER_SIZE];
+
+    if (ss->fd >= 0 && ss->size >= ss->max_bytes)
+        segment_seal(ss);
+
+    if (ss->fd < 0)
+    {
+        snprintf(ss->path_part, sizeof(ss->path_part), "%s/segment_%llu.log.part",
+                 ss->dir, (unsigned long long)chunk->seq_start);
+        snprintf(ss->path_final, sizeof(ss->path_final), "%s/segment_%llu.log",
+                 ss->dir, (unsigned long long)chunk->seq_start);
+        ss->fd = open(ss->path_part, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (ss->fd < 0)
+        {
+            fprintf(stderr, "Error: Failed to open segment %s: %s\n", ss->path_part, strerror(errno));
+            return -1;
+        }
+        ss->size = 0;
+    }
+
+    size_t header_len = sdat_encode_header(chunk, header);
+    size_t payload_len = sdat_payload_size(chunk);
+    if (pace_write(&ss->pace, ss->fd, header, header_len) != 0 ||
+        pace_write(&ss->pace, ss->fd, chunk->samples, payload_len) != 0)
+    {
+        fprintf(stderr, "Error: Failed to append to %s: %s\n", ss->path_part, strerror(errno));
+        return -1;
+    }
+    ss->size += header_len + payload_len;
+    return 0;
+}
+
+static int segment_flush(void *ctx)
+{
+    segment_sink_t *ss = (segment_sink_t*)ctx;
+    if (ss->fd >= 0 && fdatasync(ss->fd) != 0)
+        return -1;
+    return 0;
+}
+
+static void segment_close(void *ctx)
+{
+    segment_sink_t *ss = (segment_sink_t*)ctx;
+    segment_seal(ss);
+    free(ss);
+}
+
+const sink_ops_t sink_segment_ops = {
+    "segment", segment_open, segment_chunk, segment_flush, segment_close
+};
+
+/****************************************************************************
+ * socket: chunks streamed as header + payload to a unix or tcp peer.
+ * Reconnects at most once per SOCKET_RETRY_SEC; chunks are dropped while
+ * the peer is unreachable.
+ ****************************************************************************/
+typedef struct {
+    char addr[256];
+    int fd;
+    time_t last_attempt;
+} socket_sink_t;
+
+static int socket_connect(socket_sink_t *ks)
+{
+    int fd = -1;
+
+    if (strncmp(ks->addr, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strncpy(sa.sun_path, ks->addr + 5, sizeof(sa.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    else if (strncmp(ks->addr, "tcp:", 4) == 0)
+    {
+        char host[256];
+        strncpy(host, ks->addr + 4, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        char *port = strrchr(host, ':');
+        if (port == NULL)
+            return -1;
+        *port++ = '\0';
+
+        struct addrinfo hints, *res = NULL, *ai;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port, &hints, &res) != 0)
+            return -1;
+        for (ai = res; ai != NULL; ai = ai->ai_next)
+        {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0)
+                continue;
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+                break;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+    }
+
+    ks->fd = fd;
+    return fd >= 0 ? 0 : -1;
+}
+
+static int socket_open(void **ctx, const char *args)
+{
+    socket_sink_t *ks = (socket_sink_t*)calloc(1, sizeof(socket_sink_t));
+    if (ks == NULL)
+        return -1;
+    if (!config_arg(args, "addr", ks->addr, sizeof(ks->addr)) ||
+        (strncmp(ks->addr, "unix:", 5) != 0 && strncmp(ks->addr, "tcp:", 4) != 0))
+    {
+        fprintf(stderr, "Error: socket sink requires addr=unix:<path> or addr=tcp:<host>:<port>\n");
+        free(ks);
+        return -1;
+    }
+    ks->fd = -1;
+    *ctx = ks;
+    return 0;
+}
+
+static int socket_send_all(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int socket_chunk(void *ctx, const sdat_chunk_t *chunk)
+{
+    socket_sink_t *ks = (socket_sink_t*)ctx;
+    uint8_t header[SDAT_MAX_HEADER_SIZE];
+
+    if (ks->fd < 0)
+    {
+        time_t now = time(NULL);
+        if (now - ks->last_attempt < SOCKET_RETRY_SEC)
+            return -1;
+        ks->last_attempt = now;
+        if (socket_connect(ks) != 0)
+            return -1;
+        printf("Socket sink: connected to %s\n", ks->addr);
+    }
+
+    size_t header_len = sdat_encode_header(chunk, header);
+    if (socket_send_all(ks->fd, header, header_len) != 0 ||
+        socket_send_all(ks->fd, chunk->samples, sdat_payload_size(chunk)) != 0)
+    {
+        fprintf(stderr, "Warning: Socket sink lost connection to %s: %s\n", ks->addr, strerror(errno));
+        close(ks->fd);
+        ks->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void socket_close(void *ctx)
+{
+    socket_sink_t *ks = (socket_sink_t*)ctx;
+    if (ks->fd >= 0)
+        close(ks->fd);
+    free(ks);
+}
+
+const sink_ops_t sink_socket_ops = {
+    "socket", socket_open, socket_chunk, NULL, socket_close
+};
+
+/****************************************************************************
+ * shm: the most recent chunks published in a shared-memory slot ring.
+ *
+ * Layout: shm_sink_header_t, then slots of slot_size bytes. Each slot
+ * starts with shm_sink_slot_t followed by the encoded chunk. Readers copy
+ * a slot and accept it if its seqlock is even and unchanged afterwards.
+ ****************************************************************************/
+typedef struct {
+    uint32_t magic;
+    uint32_t slots;
+    uint64_t slot_size;
+    uint64_t published;   // total chunks published; newest is published - 1
+} shm_sink_header_t;
+
+typedef struct {
+    uint64_t seqlock;     // odd while the slot is being written
+    uint64_t length;      // encoded chunk bytes following this struct
+} shm_sink_slot_t;
+
+typedef struct {
+    char name[64];
+    shm_sink_header_t *hdr;
+    size_t map_size;
+} shm_sink_t;
+
+static int shm_sink_open(void **ctx, const char *args)
+{
+    shm_sink_t *ms = (shm_sink_t*)calloc(1, sizeof(shm_sink_t));
+    if (ms == NULL)
+        return -1;
+    if (!config_arg(args, "name", ms->name, sizeof(ms->name)))
+        strcpy(ms->name, SHM_SINK_DEFAULT_NAME);
+    uint32_t slots = (uint32_t)config_arg_double(args, "slots", SHM_SINK_DEFAULT_SLOTS);
+    uint64_t slot_size = (uint64_t)(config_arg_double(args, "slot_kb", SHM_SINK_DEFAULT_SLOT_KB) * 1024);
+    if (slots == 0 || slot_size <= sizeof(shm_sink_slot_t) + SDAT_MAX_HEADER_SIZE)
+    {
+        fprintf(stderr, "Error: Invalid shm sink geometry\n");
+        free(ms);
+        return -1;
+    }
+    ms->map_size = sizeof(shm_sink_header_t) + (size_t)slots * slot_size;
+
+    // Owner only unless mode= lets readers in (the umask still applies)
+    char value[16];
+    char *end;
+    if (!config_arg(args, "mode", value, sizeof(value)))
+        strcpy(value, SHM_SINK_DEFAULT_MODE);
+    long mode = strtol(value, &end, 8);
+    if (end == value || *end != '\0' || mode < 0 || mode > 0777)
+    {
+        fprintf(stderr, "Error: Invalid shm sink mode \"%s\"\n", value);
+        free(ms);
+        return -1;
+    }
+
+    shm_unlink(ms->name);
+    int fd = shm_open(ms->name, O_CREAT | O_EXCL | O_RDWR, (mode_t)mode);
+    if (fd < 0 || ftruncate(fd, (off_t)ms->map_size) != 0)
+    {
+        fprintf(stderr, "Error: Failed to create shm sink %s: %s\n", ms->name, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        free(ms);
+        return -1;
+    }
+    void *addr = mmap(NULL, ms->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap");
+        shm_unlink(ms->name);
+        free(ms);
+        return -1;
+    }
+
+    ms->hdr = (shm_sink_header_t*)addr;
+    ms->hdr->slots = slots;
+    ms->hdr->slot_size = slot_size;
+    ms->hdr->published = 0;
+    __atomic_store_n(&ms->hdr->magic, SHM_SINK_MAGIC, __ATOMIC_RELEASE);
+    *ctx = ms;
+    return 0;
+}
+
+static int shm_sink_chunk(void *ctx, const sdat_chunk_t *chunk)
+{
+    shm_sink_t *ms = (shm_sink_t*)ctx;
+    shm_sink_header_t *hdr = ms->hdr;
+    uint8_t header[SDAT_MAX_HEADER_SIZE];
+    size_t header_len = sdat_encode_header(chunk, header);
+    size_t payload_len = sdat_payload_size(chunk);
+
+    if (sizeof(shm_sink_slot_t) + header_len + payload_len > hdr->slot_size)
+    {
+        fprintf(stderr, "Warning: Chunk seq=%llu too large for shm sink slot\n",
+                (unsigned long long)chunk->seq_start);
+        return -1;
+    }
+
+    uint64_t n = hdr->published;
+    uint8_t *base = (uint8_t*)hdr + sizeof(shm_sink_header_t) + (n % hdr->slots) * hdr->slot_size;
+    shm_sink_slot_t *slot = (shm_sink_slot_t*)base;
+    uint8_t *data = base + sizeof(shm_sink_slot_t);
+
+    __atomic_store_n(&slot->seqlock, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(data, header, header_len);
+    memcpy(data + header_len, chunk->samples, payload_len);
+    slot->length = header_len + payload_len;
+    __atomic_store_n(&slot->seqlock, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->published, n + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void shm_sink_close(void *ctx)
+{
+    shm_sink_t *ms = (shm_sink_t*)ctx;
+    munmap(ms->hdr, ms->map_size);
+    shm_unlink(ms->name);
+    free(ms);
+}
+
+const sink_ops_t sink_shm_ops = {
+    "shm", shm_sink_open, shm_sink_chunk, NULL, shm_sink_close
+};
@@ -0,0 +1,150 @@
+/*
+    Versioned capture settings (see snapshot.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "snapshot.h"
+
+// Replaced snapshots still guarded by a hazard; one per reader at most
+#define SNAPSHOT_MAX_RETIRED (SNAPSHOT_MAX_READERS + 1)
+
+static snapshot_t *g_current = NULL;
+static uint64_t g_generation = 0;
+static snapshot_t *g_hazards[SNAPSHOT_MAX_READERS];
+static snapshot_t *g_retired[SNAPSHOT_MAX_RETIRED];
+static int g_retired_count = 0;
+static pthread_mutex_t g_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Free retired snapshots no reader is copying. Caller holds the writer lock.
+static void reclaim(void)
+{
+    for (int i = 0; i < g_retired_count; )
+    {
+        bool guarded = false;
+        for (int r = 0; r < SNAPSHOT_MAX_READERS; r++)
+        {
+            if (__atomic_load_n(&g_hazards[r], __ATOMIC_SEQ_CST) == g_retired[i])
+                guarded = true;
+        }
+        if (guarded)
+        {
+            i++;
+            continue;
+        }
+        free(g_retired[i]);
+        g_retired[i] = g_retired[--g_retired_count];
+    }
+}
+
+// Replace the current snapshot. Caller holds the writer lock.
+static void publish(snapshot_t *next)
+{
+    snapshot_t *prev = g_current;
+    next->generation = prev ? prev->generation + 1 : 1;
+    __atomic_store_n(&g_current, next, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&g_generation, next->generation, __ATOMIC_RELEASE);
+    if (prev)
+    {
+        g_retired[g_retired_count++] = prev;
+        reclaim();
+    }
+}
+
+// Copy of the current snapshot for a writer to modify
+static snapshot_t* next_snapshot(void)
+{
+    snapshot_t *next = (snapshot_t*)malloc(sizeof(*next));
+    if (next == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate settings snapshot\n");
+        return NULL;
+    }
+    *next = *g_current;
+    return next;
+}
+
+// Publish the first snapshot
+int snapshot_init(bool capture_enabled, double scan_rate)
+{
+    snapshot_t *first = (snapshot_t*)calloc(1, sizeof(*first));
+    if (first == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate settings snapshot\n");
+        return -1;
+    }
+    first->capture_enabled = capture_enabled;
+    first->scan_rate = scan_rate;
+
+    pthread_mutex_lock(&g_writer_mutex);
+    publish(first);
+    pthread_mutex_unlock(&g_writer_mutex);
+    return 0;
+}
+
+// Release every snapshot once no reader is left
+void snapshot_free(void)
+{
+    pthread_mutex_lock(&g_writer_mutex);
+    for (int i = 0; i < g_retired_count; i++)
+        free(g_retired[i]);
+    g_retired_count = 0;
+    free(g_current);
+    g_current = NULL;
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Switch capture on or off
+bool snapshot_set_capture(bool enabled)
+{
+    pthread_mutex_lock(&g_writer_mutex);
+    bool previous = g_current->capture_enabled;
+    snapshot_t *next = previous != enabled ? next_snapshot() : NULL;
+    if (next)
+    {
+        next->capture_enabled = enabled;
+        publish(next);
+    }
+    pthread_mutex_unlock(&g_writer_mutex);
+    return previous;
+}
+
+// Change the scan rate
+void snapshot_set_rate(double scan_rate)
+{
+    pthread_mutex_lock(&g_writer_mutex);
+    snapshot_t *next = next_snapshot();
+    if (next)
+    {
+        next->scan_rate = scan_rate;
+        publish(next);
+    }
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Refresh the reader's copy if the generation moved
+const snapshot_t* snapshot_get(snapshot_t *cache, snapshot_reader_t reader)
+{
+    if (__atomic_load_n(&g_generation, __ATOMIC_RELAXED) == cache->generation)
+        return cache;
+
+    // Announce the pointer, then check it is still current before copying
+    snapshot_t *p;
+    do
+    {
+        p = __atomic_load_n(&g_current, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&g_hazards[reader], p, __ATOMIC_SEQ_CST);
+    } while (p != __atomic_load_n(&g_current, __ATOMIC_SEQ_CST));
+    *cache = *p;
+    __atomic_store_n(&g_hazards[reader], NULL, __ATOMIC_RELEASE);
+    return cache;
+}
+
+// Copy the current snapshot under the writer lock
+void snapshot_copy(snapshot_t *out)
+{
+    pthread_mutex_lock(&g_writer_mutex);
+    *out = *g_current;
+    pthread_mutex_unlock(&g_writer_mutex);
+}
@@ -0,0 +1,47 @@
+/*
+    Capture settings (capture on/off, scan rate) published as immutable,
+    versioned snapshots, RCU style.
+
+    Writers are rare (control commands, schedule windows) and serialized
+    by a mutex: each change publishes a modified copy through an atomic
+    pointer and then advances a generation counter. Readers keep their own
+    copy and, in their hot loops, only do a relaxed load of the generation;
+    the snapshot is copied again only when it moved. A hazard slot per
+    reader keeps a replaced snapshot alive while it is being copied, so
+    the writer can free old snapshots without waiting on anyone.
+*/
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    SNAPSHOT_READER_PRODUCER,
+    SNAPSHOT_READER_CONSUMER,
+    SNAPSHOT_MAX_READERS
+} snapshot_reader_t;
+
+typedef struct {
+    uint64_t generation;    // 0 = never read
+    bool capture_enabled;
+    double scan_rate;
+} snapshot_t;
+
+// Publish the first snapshot
+int snapshot_init(bool capture_enabled, double scan_rate);
+void snapshot_free(void);
+
+// Switch capture on or off. Returns the previous setting.
+bool snapshot_set_capture(bool enabled);
+void snapshot_set_rate(double scan_rate);
+
+// Hot path: refresh cache if the generation moved and return it. Each
+// reader slot belongs to one thread.
+const snapshot_t* snapshot_get(snapshot_t *cache, snapshot_reader_t reader);
+
+// Copy the current snapshot (takes the writer lock; for cold paths)
+void snapshot_copy(snapshot_t *out);
+
+#endif /* SNAPSHOT_H_ */
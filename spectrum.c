@@ -0,0 +1,217 @@
+/*
+    Per-chunk spectral summary (see spectrum.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "spectrum.h"
+#include "budget.h"
+#include "config.h"
+#include "util.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Set up from the "spectrum" config line
+int spectrum_configure(spectrum_t *sp, const uint8_t *channels, uint32_t num_channels, double sample_rate)
+{
+    spectrum_free(sp);
+
+    const char *args = config_get("spectrum");
+    if (args == NULL)
+        return 0;
+
+    uint32_t nfft = (uint32_t)config_arg_double(args, "nfft", SPECTRUM_DEFAULT_NFFT);
+    double overlap = config_arg_double(args, "overlap", SPECTRUM_DEFAULT_OVERLAP);
+    if (nfft < FFT_MIN_SIZE || nfft > SPECTRUM_MAX_NFFT || (nfft & (nfft - 1)) != 0 ||
+        overlap < 0.0 || overlap >= 1.0 || num_channels > SPECTRUM_MAX_CHANNELS || sample_rate <= 0.0)
+    {
+        fprintf(stderr, "Error: Invalid spectrum settings (nfft must be a power of two in %d..%d, "
+                "0 <= overlap < 1)\n", FFT_MIN_SIZE, SPECTRUM_MAX_NFFT);
+        return -1;
+    }
+
+    uint32_t bins = nfft / 2 + 1;
+    size_t record_bytes = num_channels * (SPECTRUM_RECORD_HEADER_SIZE + bins * 2);
+    size_t bytes = 4 * nfft * sizeof(float) +  // FFT plan (twiddles and work buffers)
+                   2 * nfft * sizeof(float) + bins * (sizeof(float) + sizeof(double)) + record_bytes;
+    if (budget_reserve(BUDGET_ANALYSIS, bytes, "spectrum workspace") != 0)
+        return -1;
+    sp->reserved = bytes;
+    if (fft_plan_init(&sp->plan, nfft) != 0)
+    {
+        spectrum_free(sp);
+        return -1;
+    }
+    sp->window = (float*)malloc(nfft * sizeof(float));
+    sp->segment = (float*)malloc(nfft * sizeof(float));
+    sp->power = (float*)malloc(bins * sizeof(float));
+    sp->accum = (double*)malloc(bins * sizeof(double));
+    sp->record = (uint8_t*)malloc(record_bytes);
+    if (!sp->window || !sp->segment || !sp->power || !sp->accum || !sp->record)
+    {
+        spectrum_free(sp);
+        return -1;
+    }
+
+    // Periodic Hann window
+    double sum_w2 = 0.0;
+    for (uint32_t i = 0; i < nfft; i++)
+    {
+        double w = 0.5 - 0.5 * cos(2.0 * M_PI * i / nfft);
+        sp->window[i] = (float)w;
+        sum_w2 += w * w;
+    }
+
+    sp->nfft = nfft;
+    sp->hop = (uint32_t)(nfft * (1.0 - overlap));
+    if (sp->hop == 0)
+        sp->hop = 1;
+    sp->num_channels = num_channels;
+    memcpy(sp->channels, channels, num_channels);
+    sp->scale = 1.0 / (sample_rate * sum_w2);
+    sp->bin_hz = sample_rate / nfft;
+    sp->enabled = true;
+    return 0;
+}
+
+// Release buffers
+void spectrum_free(spectrum_t *sp)
+{
+    if (sp->plan.n != 0)
+        fft_plan_free(&sp->plan);
+    free(sp->window);
+    free(sp->segment);
+    free(sp->power);
+    free(sp->accum);
+    free(sp->record);
+    budget_release(BUDGET_ANALYSIS, sp->reserved);
+    memset(sp, 0, sizeof(*sp));
+}
+
+// Welch average over one channel of an interleaved chunk; returns segments
+static uint32_t welch(spectrum_t *sp, const double *frames, uint32_t frame_count, uint32_t ch)
+{
+    uint32_t nch = sp->num_channels;
+    uint32_t nfft = sp->nfft;
+    uint32_t bins = nfft / 2 + 1;
+    uint32_t segments = 0;
+
+    memset(sp->accum, 0, bins * sizeof(double));
+    for (uint32_t start = 0; start + nfft <= frame_count; start += sp->hop)
+    {
+        const double *x = frames + (size_t)start * nch + ch;
+        double mean = 0.0;
+        for (uint32_t i = 0; i < nfft; i++)
+            mean += x[(size_t)i * nch];
+        mean /= nfft;
+
+        for (uint32_t i = 0; i < nfft; i++)
+            sp->segment[i] = (float)(x[(size_t)i * nch] - mean) * sp->window[i];
+
+        fft_real_power(&sp->plan, sp->segment, sp->power);
+        for (uint32_t k = 0; k < bins; k++)
+            sp->accum[k] += sp->power[k];
+        segments++;
+    }
+    return segments;
+}
+
+// Compute the spectra of a chunk and attach them as an extension
+void spectrum_process(spectrum_t *sp, sdat_chunk_t *chunk)
+{
+    if (!sp->enabled)
+        return;
+
+    uint32_t frame_count = chunk->sample_count / sp->num_channels;
+    uint32_t bins = sp->nfft / 2 + 1;
+    uint8_t *p = sp->record;
+    float bin_hz = (float)sp->bin_hz;
+    uint32_t bin_bits;
+    memcpy(&bin_bits, &bin_hz, sizeof(bin_bits));
+
+    for (uint32_t ch = 0; ch < sp->num_channels; ch++)
+    {
+        uint32_t segments = welch(sp, chunk->samples, frame_count, ch);
+        if (segments == 0)
+            return;  // chunk shorter than one segment
+
+        p = put_le(p, sp->channels[ch], 1);
+        p = put_le(p, 0, 1);
+        p = put_le(p, sp->nfft, 2);
+        p = put_le(p, bins, 2);
+        p = put_le(p, segments, 2);
+        p = put_le(p, bin_bits, 4);
+
+        // One-sided density: double every bin except DC and Nyquist
+        double scale = sp->scale / segments;
+        for (uint32_t k = 0; k < bins; k++)
+        {
+            double psd = sp->accum[k] * scale;
+            if (k != 0 && k != bins - 1)
+                psd *= 2.0;
+            double cdb = 1000.0 * log10(psd + 1e-30);
+            if (cdb > INT16_MAX)
+                cdb = INT16_MAX;
+            if (cdb < INT16_MIN)
+                cdb = INT16_MIN;
+            p = put_le(p, (uint16_t)(int16_t)lrint(cdb), 2);
+        }
+    }
+
+    if (sdat_chunk_add_ext(chunk, SDAT_EXT_SPECTRUM, sp->record, (uint32_t)(p - sp->record)) != 0)
+        fprintf(stderr, "Warning: Spectrum does not fit in the chunk header, skipped\n");
+}
+
+// Read a little-endian 16-bit value
+static uint32_t get_le16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+// Average two spectrum extension bodies, weighted by segments
+int spectrum_merge(uint8_t *into, const uint8_t *from, uint32_t length)
+{
+    // Check every record lines up before changing anything
+    uint32_t offset = 0;
+    while (offset < length)
+    {
+        const uint8_t *a = into + offset;
+        const uint8_t *b = from + offset;
+        if (offset + SPECTRUM_RECORD_HEADER_SIZE > length ||
+            memcmp(a, b, 6) != 0 || memcmp(a + 8, b + 8, 4) != 0)  // all but segments
+            return -1;
+        offset += SPECTRUM_RECORD_HEADER_SIZE + get_le16(a + 4) * 2;
+    }
+    if (offset != length)
+        return -1;
+
+    for (offset = 0; offset < length; )
+    {
+        uint8_t *a = into + offset;
+        const uint8_t *b = from + offset;
+        uint32_t bins = get_le16(a + 4);
+        double wa = get_le16(a + 6);
+        double wb = get_le16(b + 6);
+        uint32_t segments = get_le16(a + 6) + get_le16(b + 6);
+        put_le(a + 6, segments > UINT16_MAX ? UINT16_MAX : segments, 2);
+
+        for (uint32_t k = 0; k < bins; k++)
+        {
+            uint8_t *pa = a + SPECTRUM_RECORD_HEADER_SIZE + k * 2;
+            const uint8_t *pb = b + SPECTRUM_RECORD_HEADER_SIZE + k * 2;
+            double psd = (wa * pow(10.0, (int16_t)get_le16(pa) / 1000.0) +
+                          wb * pow(10.0, (int16_t)get_le16(pb) / 1000.0)) / (wa + wb);
+            double cdb = 1000.0 * log10(psd + 1e-30);
+            if (cdb > INT16_MAX)
+                cdb = INT16_MAX;
+            if (cdb < INT16_MIN)
+                cdb = INT16_MIN;
+            put_le(pa, (uint16_t)(int16_t)lrint(cdb), 2);
+        }
+        offset += SPECTRUM_RECORD_HEADER_SIZE + bins * 2;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+    Per-chunk spectral summary computed by the consumer just before a chunk
+    is dispatched, so spectrograms can be drawn from headers alone.
+
+    For every channel the chunk's samples are cut into Hann-windowed,
+    mean-removed segments of nfft samples with the given overlap, and their
+    power spectra are averaged (Welch's method). The result is a one-sided
+    power spectral density in units^2/Hz.
+
+    Stored as an SDAT_EXT_SPECTRUM extension holding one record per channel
+    (little-endian):
+        channel u8, reserved u8, nfft u16, bins u16, segments u16,
+        bin_hz f32, then bins x int16 PSD in 0.01 dB re 1 unit^2/Hz
+    with bins = nfft/2 + 1 (DC to Nyquist).
+
+    Configuration:
+        spectrum = nfft=256 overlap=0.5
+    nfft must be a power of two between 16 and SPECTRUM_MAX_NFFT.
+*/
+
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fft.h"
+#include "sdat.h"
+
+#define SPECTRUM_MAX_CHANNELS 8
+#define SPECTRUM_MAX_NFFT 1024
+#define SPECTRUM_DEFAULT_NFFT 256
+#define SPECTRUM_DEFAULT_OVERLAP 0.5
+#define SPECTRUM_RECORD_HEADER_SIZE 12
+
+typedef struct {
+    bool enabled;
+    uint32_t nfft;
+    uint32_t hop;                // samples between segment starts
+    uint32_t num_channels;
+    uint8_t channels[SPECTRUM_MAX_CHANNELS];
+    double scale;                // 1 / (fs * sum(w^2))
+    double bin_hz;
+    fft_plan_t plan;
+    float *window;               // nfft
+    float *segment;              // nfft
+    float *power;                // nfft/2 + 1
+    double *accum;               // nfft/2 + 1
+    uint8_t *record;             // encoded extension body for all channels
+    size_t reserved;             // bytes reserved in the memory budget
+} spectrum_t;
+
+// Set up from the "spectrum" config line for the given scan channels and
+// rate. Leaves the stage disabled if there is no such line. Returns 0 on
+// success, -1 on invalid settings.
+int spectrum_configure(spectrum_t *sp, const uint8_t *channels, uint32_t num_channels, double sample_rate);
+
+// Release buffers
+void spectrum_free(spectrum_t *sp);
+
+// Compute the spectra of a chunk and attach them as an extension
+void spectrum_process(spectrum_t *sp, sdat_chunk_t *chunk);
+
+// Average the SDAT_EXT_SPECTRUM body from into into, weighted by segment
+// counts (for merged chunks). Both must hold the same channels and
+// layout; returns -1, leaving into unchanged, if they do not.
+int spectrum_merge(uint8_t *into, const uint8_t *from, uint32_t length);
+
+#endif /* SPECTRUM_H_ */
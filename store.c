@@ -0,0 +1,373 @@
+/*
+    Per-device chunk store (see store.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "store.h"
+#include "util.h"
+
+#define STORE_PATH_LEN 640
+#define STORE_MIN_KEYS 1024
+
+// Identity of a chunk for deduplication
+typedef struct {
+    uint64_t boot_id;
+    uint64_t seq_start;
+    uint16_t stream;
+    bool used;
+} store_key_t;
+
+struct store_device {
+    uint32_t device_id;
+    pthread_mutex_t mutex;
+    int data_fd;
+    int index_fd;
+    uint64_t data_size;
+    uint64_t entries;
+    bool dirty;                     // appended since the last sync
+    store_key_t *keys;              // open addressing, at most half full
+    size_t capacity;
+    uint64_t stored;
+    uint64_t duplicates;
+};
+
+static char g_root[512];
+static store_device_t *g_devices[STORE_MAX_DEVICES];
+static int g_num_devices = 0;
+static pthread_mutex_t g_store_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Use dir as the store root
+int store_init(const char *dir)
+{
+    if (strlen(dir) >= sizeof(g_root))
+    {
+        fprintf(stderr, "Error: Store path too long: %s\n", dir);
+        return -1;
+    }
+    strcpy(g_root, dir);
+    if (mkdir(g_root, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: Failed to create store %s: %s\n", g_root, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Decode one index record
+void store_decode_entry(const uint8_t *record, store_entry_t *entry)
+{
+    entry->boot_id = get_le(record, 8);
+    entry->seq_start = get_le(record + 8, 8);
+    entry->time_start = get_le(record + 16, 8);
+    entry->offset = get_le(record + 24, 8);
+    entry->length = (uint32_t)get_le(record + 32, 4);
+    entry->sample_count = (uint32_t)get_le(record + 36, 4);
+    entry->stream = (uint16_t)get_le(record + 40, 2);
+    entry->flags = (uint32_t)get_le(record + 44, 4);
+}
+
+// Encode one index record
+static void encode_entry(const store_entry_t *entry, uint8_t *record)
+{
+    uint8_t *p = record;
+    p = put_le(p, entry->boot_id, 8);
+    p = put_le(p, entry->seq_start, 8);
+    p = put_le(p, entry->time_start, 8);
+    p = put_le(p, entry->offset, 8);
+    p = put_le(p, entry->length, 4);
+    p = put_le(p, entry->sample_count, 4);
+    p = put_le(p, entry->stream, 2);
+    p = put_le(p, 0, 2);
+    put_le(p, entry->flags, 4);
+}
+
+// Slot of a key: its own if stored, else the free one to use
+static store_key_t* find_key(store_device_t *dev, const store_entry_t *entry)
+{
+    uint64_t h = entry->boot_id ^ (entry->seq_start * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)entry->stream << 48);
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+
+    size_t mask = dev->capacity - 1;
+    for (size_t i = (size_t)h & mask; ; i = (i + 1) & mask)
+    {
+        store_key_t *key = &dev->keys[i];
+        if (!key->used || (key->boot_id == entry->boot_id && key->seq_start == entry->seq_start &&
+                           key->stream == entry->stream))
+            return key;
+    }
+}
+
+// Remember a key, growing the table to stay at most half full
+static int add_key(store_device_t *dev, const store_entry_t *entry)
+{
+    if ((dev->entries + 1) * 2 > dev->capacity)
+    {
+        size_t old_capacity = dev->capacity;
+        store_key_t *old = dev->keys;
+        size_t capacity = old_capacity * 2;
+        store_key_t *keys = (store_key_t*)calloc(capacity, sizeof(store_key_t));
+        if (keys == NULL)
+            return -1;
+        dev->keys = keys;
+        dev->capacity = capacity;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (!old[i].used)
+                continue;
+            store_entry_t moved = { .boot_id = old[i].boot_id, .seq_start = old[i].seq_start,
+                                    .stream = old[i].stream };
+            *find_key(dev, &moved) = old[i];
+        }
+        free(old);
+    }
+
+    store_key_t *key = find_key(dev, entry);
+    key->boot_id = entry->boot_id;
+    key->seq_start = entry->seq_start;
+    key->stream = entry->stream;
+    key->used = true;
+    return 0;
+}
+
+// Load the index, cutting off what a crash left half written
+static int recover_device(store_device_t *dev)
+{
+    struct stat data_st, index_st;
+    if (fstat(dev->data_fd, &data_st) != 0 || fstat(dev->index_fd, &index_st) != 0)
+        return -1;
+
+    uint64_t data_size = (uint64_t)data_st.st_size;
+    uint64_t records = (uint64_t)index_st.st_size / STORE_INDEX_SIZE;
+    uint64_t data_end = 0;
+    uint8_t block[STORE_INDEX_SIZE * 256];
+
+    dev->entries = 0;
+    while (dev->entries < records)
+    {
+        uint64_t want = records - dev->entries < 256 ? records - dev->entries : 256;
+        ssize_t n = pread(dev->index_fd, block, want * STORE_INDEX_SIZE,
+                          (off_t)(dev->entries * STORE_INDEX_SIZE));
+        if (n < (ssize_t)STORE_INDEX_SIZE)
+            break;
+
+        bool cut = false;
+        for (ssize_t i = 0; i + STORE_INDEX_SIZE <= n; i += STORE_INDEX_SIZE)
+        {
+            store_entry_t entry;
+            store_decode_entry(block + i, &entry);
+            if (entry.offset != data_end || entry.offset + entry.length > data_size)
+            {
+                cut = true;
+                break;
+            }
+            if (add_key(dev, &entry) != 0)
+                return -1;
+            dev->entries++;
+            data_end = entry.offset + entry.length;
+        }
+        if (cut)
+            break;
+    }
+
+    if ((uint64_t)index_st.st_size != dev->entries * STORE_INDEX_SIZE || data_size != data_end)
+    {
+        printf("Store: device %u: cut off an interrupted write (%llu index, %llu data bytes)\n",
+               dev->device_id, (unsigned long long)index_st.st_size - dev->entries * STORE_INDEX_SIZE,
+               (unsigned long long)(data_size - data_end));
+        if (ftruncate(dev->index_fd, (off_t)(dev->entries * STORE_INDEX_SIZE)) != 0 ||
+            ftruncate(dev->data_fd, (off_t)data_end) != 0)
+            return -1;
+    }
+    dev->data_size = data_end;
+    return 0;
+}
+
+// Open the files of one device
+static store_device_t* open_device(uint32_t device_id)
+{
+    char path[STORE_PATH_LEN];
+    store_device_t *dev = (store_device_t*)calloc(1, sizeof(store_device_t));
+    if (dev == NULL)
+        return NULL;
+    dev->device_id = device_id;
+    dev->data_fd = -1;
+    dev->index_fd = -1;
+    dev->capacity = STORE_MIN_KEYS;
+    dev->keys = (store_key_t*)calloc(dev->capacity, sizeof(store_key_t));
+    if (dev->keys == NULL)
+    {
+        free(dev);
+        return NULL;
+    }
+    pthread_mutex_init(&dev->mutex, NULL);
+
+    snprintf(path, sizeof(path), "%s/device_%u", g_root, device_id);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        goto failed;
+    snprintf(path, sizeof(path), "%s/device_%u/%s", g_root, device_id, STORE_DATA_FILE);
+    dev->data_fd = open(path, O_RDWR | O_CREAT, 0644);
+    snprintf(path, sizeof(path), "%s/device_%u/%s", g_root, device_id, STORE_INDEX_FILE);
+    dev->index_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (dev->data_fd < 0 || dev->index_fd < 0 || recover_device(dev) != 0)
+        goto failed;
+
+    printf("Store: device %u opened, %llu chunks\n", device_id, (unsigned long long)dev->entries);
+    return dev;
+
+failed:
+    fprintf(stderr, "Error: Failed to open store of device %u: %s\n", device_id, strerror(errno));
+    if (dev->data_fd >= 0)
+        close(dev->data_fd);
+    if (dev->index_fd >= 0)
+        close(dev->index_fd);
+    free(dev->keys);
+    free(dev);
+    return NULL;
+}
+
+// Find or open the store of a device
+store_device_t* store_device(uint32_t device_id)
+{
+    store_device_t *dev = NULL;
+    pthread_mutex_lock(&g_store_mutex);
+    for (int i = 0; i < g_num_devices && dev == NULL; i++)
+    {
+        if (g_devices[i]->device_id == device_id)
+            dev = g_devices[i];
+    }
+    if (dev == NULL && g_num_devices < STORE_MAX_DEVICES)
+    {
+        dev = open_device(device_id);
+        if (dev != NULL)
+            g_devices[g_num_devices++] = dev;
+    }
+    else if (dev == NULL)
+    {
+        fprintf(stderr, "Error: More than %d devices\n", STORE_MAX_DEVICES);
+    }
+    pthread_mutex_unlock(&g_store_mutex);
+    return dev;
+}
+
+// Write all of buf at offset
+static int write_at(int fd, const uint8_t *buf, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, buf, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+// Append a chunk and its index record
+int store_append(store_device_t *dev, const uint8_t *chunk, store_entry_t *entry)
+{
+    uint8_t record[STORE_INDEX_SIZE];
+    int rc = 1;
+
+    pthread_mutex_lock(&dev->mutex);
+    if (find_key(dev, entry)->used)
+    {
+        dev->duplicates++;
+        pthread_mutex_unlock(&dev->mutex);
+        return 0;
+    }
+
+    entry->offset = dev->data_size;
+    encode_entry(entry, record);
+    if (write_at(dev->data_fd, chunk, entry->length, entry->offset) != 0 ||
+        write_at(dev->index_fd, record, sizeof(record), dev->entries * STORE_INDEX_SIZE) != 0 ||
+        add_key(dev, entry) != 0)
+    {
+        // Nothing half written stays behind
+        fprintf(stderr, "Error: Store of device %u: %s\n", dev->device_id, strerror(errno));
+        if (ftruncate(dev->data_fd, (off_t)dev->data_size) != 0 ||
+            ftruncate(dev->index_fd, (off_t)(dev->entries * STORE_INDEX_SIZE)) != 0)
+            fprintf(stderr, "Error: Store of device %u could not be rolled back\n", dev->device_id);
+        rc = -1;
+    }
+    else
+    {
+        dev->data_size += entry->length;
+        dev->entries++;
+        dev->stored++;
+        dev->dirty = true;
+    }
+    pthread_mutex_unlock(&dev->mutex);
+    return rc;
+}
+
+// Flush the devices written since the last sync
+void store_sync(void)
+{
+    pthread_mutex_lock(&g_store_mutex);
+    int count = g_num_devices;
+    pthread_mutex_unlock(&g_store_mutex);
+
+    for (int i = 0; i < count; i++)
+    {
+        store_device_t *dev = g_devices[i];
+        pthread_mutex_lock(&dev->mutex);
+        if (dev->dirty)
+        {
+            // Data first, so a synced index never points past it
+            fdatasync(dev->data_fd);
+            fdatasync(dev->index_fd);
+            dev->dirty = false;
+        }
+        pthread_mutex_unlock(&dev->mutex);
+    }
+}
+
+// Sync and close every device
+void store_close(void)
+{
+    store_sync();
+    pthread_mutex_lock(&g_store_mutex);
+    for (int i = 0; i < g_num_devices; i++)
+    {
+        store_device_t *dev = g_devices[i];
+        close(dev->data_fd);
+        close(dev->index_fd);
+        pthread_mutex_destroy(&dev->mutex);
+        free(dev->keys);
+        free(dev);
+    }
+    g_num_devices = 0;
+    pthread_mutex_unlock(&g_store_mutex);
+}
+
+// Totals over all devices
+void store_status(char *buf, size_t len)
+{
+    uint64_t stored = 0, duplicates = 0;
+    pthread_mutex_lock(&g_store_mutex);
+    int count = g_num_devices;
+    for (int i = 0; i < count; i++)
+    {
+        pthread_mutex_lock(&g_devices[i]->mutex);
+        stored += g_devices[i]->stored;
+        duplicates += g_devices[i]->duplicates;
+        pthread_mutex_unlock(&g_devices[i]->mutex);
+    }
+    pthread_mutex_unlock(&g_store_mutex);
+    snprintf(buf, len, "devices=%d, stored=%llu, duplicates=%llu", count,
+             (unsigned long long)stored, (unsigned long long)duplicates);
+}
@@ -0,0 +1,72 @@
+/*
+    Per-device chunk store of the collector (see collector.c).
+
+    Layout, one directory per logger:
+        <dir>/device_<device_id>/chunks.dat    SDAT chunks back to back,
+                                               exactly as received
+        <dir>/device_<device_id>/chunks.idx    one STORE_INDEX_SIZE record
+                                               per chunk in chunks.dat
+    Index record (little-endian):
+        boot_id u64, seq_start u64, time_start u64, offset u64,
+        length u32, sample_count u32, stream u16, reserved u16, flags u32
+    A chunk is identified by (boot_id, stream, seq_start). A logger that
+    resends chunks after a reconnect, or two connections of the same
+    logger, never store one twice.
+
+    Crash safety: the chunk is appended to chunks.dat before its index
+    record. On open, index records past the end of chunks.dat and data
+    past the last indexed chunk are cut off, so the index never points at
+    a partial chunk.
+*/
+
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STORE_INDEX_SIZE 48
+#define STORE_MAX_DEVICES 256
+#define STORE_DATA_FILE "chunks.dat"
+#define STORE_INDEX_FILE "chunks.idx"
+
+typedef struct store_device store_device_t;
+
+// Identity and placement of one stored chunk
+typedef struct {
+    uint64_t boot_id;
+    uint64_t seq_start;
+    uint64_t time_start;
+    uint64_t offset;            // in chunks.dat
+    uint32_t length;            // header, extensions and payload
+    uint32_t sample_count;
+    uint16_t stream;
+    uint32_t flags;
+} store_entry_t;
+
+// Use dir as the store root (created if missing). Returns 0 or -1.
+int store_init(const char *dir);
+
+// The store of one logger, opened (and recovered) on first use.
+// Safe to call from several threads. NULL on error (reported).
+store_device_t* store_device(uint32_t device_id);
+
+// Append one chunk unless it is already stored. entry describes it;
+// offset is filled in. Returns 1 if stored, 0 if it was a duplicate,
+// -1 on a write error (nothing stored, the chunk can be retried).
+int store_append(store_device_t *dev, const uint8_t *chunk, store_entry_t *entry);
+
+// Flush appended chunks of every device to storage
+void store_sync(void);
+
+// Sync and close every device
+void store_close(void);
+
+// Decode one index record
+void store_decode_entry(const uint8_t *record, store_entry_t *entry);
+
+// Totals for the log: devices, chunks stored and duplicates dropped
+void store_status(char *buf, size_t len);
+
+#endif /* STORE_H_ */
@@ -0,0 +1,199 @@
+/*
+    Timestamp model of a recording (see timemodel.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "timemodel.h"
+
+// Width of the offsets that put every chunk of the segment in its second
+// for the given seconds per sample; *offset is the middle of them
+static double feasible_width(const reader_t *rd, uint64_t epoch, const timemodel_segment_t *seg,
+                             double period, double *offset)
+{
+    double lo = -INFINITY, hi = INFINITY;
+    for (size_t i = seg->first_chunk; i < seg->last_chunk; i++)
+    {
+        const reader_chunk_t *c = &rd->chunks[i];
+        double x = (double)(c->seq_start + c->frames - seg->seq_first);
+        double second = (double)(int64_t)(c->time_start - epoch);
+        lo = fmax(lo, second - period * x);
+        hi = fmin(hi, second + 1.0 - period * x);
+    }
+    *offset = 0.5 * (lo + hi);
+    return hi - lo;
+}
+
+// Fit a segment through the anchors of its chunks (the last one of each;
+// a short chunk at the end of a capture may have none). Returns false if
+// no chunk has one.
+static bool fit_anchors(const reader_t *rd, uint64_t epoch, timemodel_segment_t *seg)
+{
+    size_t n = 0;
+    double mean_x = 0.0, mean_y = 0.0;
+    for (size_t i = seg->first_chunk; i < seg->last_chunk; i++)
+    {
+        const reader_chunk_t *c = &rd->chunks[i];
+        if (c->anchor_ns == 0)
+            continue;
+        mean_x += (double)c->anchor_index / rd->decimation - (double)seg->seq_first;
+        mean_y += (double)(c->anchor_ns - (int64_t)epoch * 1000000000) * 1e-9;
+        n++;
+    }
+    if (n == 0)
+        return false;
+    mean_x /= (double)n;
+    mean_y /= (double)n;
+
+    // Centred sums, so the squares do not swamp the slope
+    double sxx = 0.0, sxy = 0.0;
+    for (size_t i = seg->first_chunk; i < seg->last_chunk; i++)
+    {
+        const reader_chunk_t *c = &rd->chunks[i];
+        if (c->anchor_ns == 0)
+            continue;
+        double x = (double)c->anchor_index / rd->decimation - (double)seg->seq_first - mean_x;
+        double y = (double)(c->anchor_ns - (int64_t)epoch * 1000000000) * 1e-9 - mean_y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double period = 1.0 / seg->nominal_rate;
+    double tolerance = TIMEMODEL_MAX_RATE_ERROR + 1.0 / seg->nominal_rate;
+    double span = (double)(seg->seq_end - seg->seq_first) / seg->nominal_rate;
+    if (span >= TIMEMODEL_MIN_FIT_SEC && sxx > 0.0 && fabs(sxy / sxx - period) <= period * tolerance)
+        period = sxy / sxx;
+
+    seg->rate = 1.0 / period;
+    seg->t_first = mean_y - period * mean_x;
+    seg->uncertainty = 0.0;
+    for (size_t i = seg->first_chunk; i < seg->last_chunk; i++)
+    {
+        const reader_chunk_t *c = &rd->chunks[i];
+        if (c->anchor_ns == 0)
+            continue;
+        double x = (double)c->anchor_index / rd->decimation - (double)seg->seq_first;
+        double y = (double)(c->anchor_ns - (int64_t)epoch * 1000000000) * 1e-9;
+        seg->uncertainty = fmax(seg->uncertainty, fabs(y - (seg->t_first + period * x)));
+    }
+    return true;
+}
+
+// Fit t_first and rate of a segment to its chunks
+static void fit_segment(const reader_t *rd, uint64_t epoch, timemodel_segment_t *seg)
+{
+    if (fit_anchors(rd, epoch, seg))
+        return;
+
+    const reader_chunk_t *first = &rd->chunks[seg->first_chunk];
+    const reader_chunk_t *last = &rd->chunks[seg->last_chunk - 1];
+    double span = (double)(last->seq_start + last->frames - first->seq_start) / seg->nominal_rate;
+
+    // The width is concave in the period: ternary search for its maximum
+    double period = 1.0 / seg->nominal_rate;
+    if (span >= TIMEMODEL_MIN_FIT_SEC)
+    {
+        // Headers carry the rate cut to whole Hz
+        double tolerance = TIMEMODEL_MAX_RATE_ERROR + 1.0 / seg->nominal_rate;
+        double a = period / (1.0 + tolerance), b = period / (1.0 - tolerance);
+        double unused;
+        for (int k = 0; k < 200 && b - a > period * 1e-12; k++)
+        {
+            double m1 = a + (b - a) / 3.0, m2 = b - (b - a) / 3.0;
+            if (feasible_width(rd, epoch, seg, m1, &unused) < feasible_width(rd, epoch, seg, m2, &unused))
+                a = m1;
+            else
+                b = m2;
+        }
+        period = 0.5 * (a + b);
+    }
+
+    double offset;
+    double width = feasible_width(rd, epoch, seg, period, &offset);
+    seg->rate = 1.0 / period;
+    seg->t_first = offset;
+    seg->uncertainty = width > 0.0 ? 0.5 * width : 0.0;
+}
+
+// Split the chunks into segments and fit each one
+int timemodel_build(timemodel_t *tm, const reader_t *rd, uint64_t epoch)
+{
+    memset(tm, 0, sizeof(*tm));
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < rd->count; i++)
+    {
+        const reader_chunk_t *c = &rd->chunks[i];
+        timemodel_segment_t *seg = tm->count > 0 ? &tm->segments[tm->count - 1] : NULL;
+        bool same = seg != NULL && c->boot_id == seg->boot_id &&
+                    c->rate_hz == (uint32_t)seg->nominal_rate &&
+                    !(rd->chunks[i - 1].flags & SDAT_FLAG_CAPTURE_END) &&
+                    !(c->anchor_flags & SDAT_ANCHOR_BREAK);
+        if (same)
+        {
+            // Missing chunks inside a segment are just gaps
+            seg->last_chunk = i + 1;
+            seg->seq_end = c->seq_start + c->frames;
+            continue;
+        }
+        if (c->rate_hz == 0)
+            continue;
+
+        if (tm->count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            timemodel_segment_t *segments = (timemodel_segment_t*)realloc(tm->segments,
+                                                                          capacity * sizeof(timemodel_segment_t));
+            if (segments == NULL)
+            {
+                timemodel_free(tm);
+                return -1;
+            }
+            tm->segments = segments;
+        }
+        seg = &tm->segments[tm->count++];
+        memset(seg, 0, sizeof(*seg));
+        seg->boot_id = c->boot_id;
+        seg->first_chunk = i;
+        seg->last_chunk = i + 1;
+        seg->seq_first = c->seq_start;
+        seg->seq_end = c->seq_start + c->frames;
+        seg->nominal_rate = c->rate_hz;
+    }
+
+    for (size_t s = 0; s < tm->count; s++)
+        fit_segment(rd, epoch, &tm->segments[s]);
+    return 0;
+}
+
+// Segment whose samples span time t
+long timemodel_find(const timemodel_t *tm, double t)
+{
+    for (size_t s = 0; s < tm->count; s++)
+    {
+        const timemodel_segment_t *seg = &tm->segments[s];
+        if (t >= seg->t_first && t < timemodel_time(seg, (double)seg->seq_end))
+            return (long)s;
+    }
+    return -1;
+}
+
+// Time of a (fractional) sample index
+double timemodel_time(const timemodel_segment_t *seg, double seq)
+{
+    return seg->t_first + (seq - (double)seg->seq_first) / seg->rate;
+}
+
+// Fractional sample index at time t
+double timemodel_position(const timemodel_segment_t *seg, double t)
+{
+    return (double)seg->seq_first + (t - seg->t_first) * seg->rate;
+}
+
+// Free the segments
+void timemodel_free(timemodel_t *tm)
+{
+    free(tm->segments);
+    memset(tm, 0, sizeof(*tm));
+}
@@ -0,0 +1,78 @@
+/*
+    Timestamp model of a recording: the time of every sample index.
+
+    The chunks of a recording split into segments, each one boot, one
+    capture and one rate. Within a segment the time of a sample is linear
+    in its index:
+        t(seq) = t_first + (seq - seq_first) / rate
+    where rate is the effective rate against the host clock. It differs
+    from the nominal rate by the error of the board's clock, which is what
+    drifts two loggers apart.
+
+    Chunk headers only carry time_start, the whole second in which the
+    chunk was closed, just after its last sample was taken. So each chunk
+    bounds the time of its end to one second. t_first is the middle of the
+    offsets that satisfy the bounds of all chunks of the segment, and the
+    rate is the one that leaves the widest such range: as the chunk ends
+    fall at different places within their seconds, the bounds of many
+    chunks narrow the time down to well under a second. The model times
+    the closing of chunks, so it runs late by the logger's dispatch
+    latency (milliseconds).
+
+    Chunks written with timestamp anchors (see anchor.h) know the host
+    time of one frame each to the latency of a device read. A segment
+    with anchors is a least-squares line through them instead, and its
+    uncertainty the largest residual. An anchor that breaks the clock (a
+    restarted scan, lost samples) also starts a new segment.
+
+    A segment shorter than TIMEMODEL_MIN_FIT_SEC keeps the nominal rate;
+    the rate is searched within TIMEMODEL_MAX_RATE_ERROR of the nominal
+    one, plus the whole Hz the header rate may have been cut by.
+
+    Times are seconds relative to an epoch (unix seconds) chosen by the
+    caller, so doubles keep sub-microsecond resolution.
+*/
+
+#ifndef TIMEMODEL_H_
+#define TIMEMODEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "reader.h"
+
+#define TIMEMODEL_MIN_FIT_SEC 300.0
+#define TIMEMODEL_MAX_RATE_ERROR 0.001      // relative
+
+// One linear piece
+typedef struct {
+    uint64_t boot_id;
+    size_t first_chunk;         // [first_chunk, last_chunk) in the reader
+    size_t last_chunk;
+    uint64_t seq_first;
+    uint64_t seq_end;           // one past the last sample
+    double nominal_rate;        // from the chunk headers
+    double rate;                // effective samples per second
+    double t_first;             // time of seq_first
+    double uncertainty;         // +- seconds of t_first the bounds allow
+} timemodel_segment_t;
+
+typedef struct {
+    timemodel_segment_t *segments;
+    size_t count;
+} timemodel_t;
+
+// Split the chunks of rd into segments and fit each one. Returns 0 or -1.
+int timemodel_build(timemodel_t *tm, const reader_t *rd, uint64_t epoch);
+
+// Segment whose samples span time t, or -1
+long timemodel_find(const timemodel_t *tm, double t);
+
+// Time of a (fractional) sample index
+double timemodel_time(const timemodel_segment_t *seg, double seq);
+
+// Fractional sample index at time t
+double timemodel_position(const timemodel_segment_t *seg, double t);
+
+void timemodel_free(timemodel_t *tm);
+
+#endif /* TIMEMODEL_H_ */
@@ -0,0 +1,102 @@
+/*
+    Zero-gap binary upgrade (see upgrade.h)
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include "upgrade.h"
+
+static char *g_args[UPGRADE_MAX_ARGS + 3];  // plus --takeover FD and NULL
+static int g_num_args = 0;
+static char g_self[UPGRADE_PATH_MAX];
+
+// Save the command line, without an earlier --takeover
+void upgrade_init(int argc, char **argv)
+{
+    for (int i = 0; i < argc && g_num_args < UPGRADE_MAX_ARGS; i++)
+    {
+        if (strcmp(argv[i], "--takeover") == 0)
+        {
+            i++;
+            continue;
+        }
+        g_args[g_num_args++] = argv[i];
+    }
+    g_args[g_num_args] = NULL;
+
+    // Resolved now: the file may be replaced by the time UPGRADE comes
+    char resolved[PATH_MAX];
+    if (strchr(argv[0], '/') != NULL && realpath(argv[0], resolved) != NULL)
+    {
+        strncpy(g_self, resolved, sizeof(g_self) - 1);
+        return;
+    }
+    ssize_t n = readlink("/proc/self/exe", g_self, sizeof(g_self) - 1);
+    g_self[n > 0 ? n : 0] = '\0';
+}
+
+// Binary the logger was started from
+const char* upgrade_self_path(void)
+{
+    return g_self;
+}
+
+// Hand the state over through a pipe and exec the new binary
+int upgrade_exec(const char *path, const upgrade_state_t *state)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    // The state is far smaller than a pipe buffer, so this never blocks
+    ssize_t n = write(fds[1], state, sizeof(*state));
+    close(fds[1]);
+    if (n != (ssize_t)sizeof(*state))
+    {
+        fprintf(stderr, "Error: Could not write the upgrade state\n");
+        close(fds[0]);
+        return -1;
+    }
+
+    char fd_arg[16];
+    snprintf(fd_arg, sizeof(fd_arg), "%d", fds[0]);
+    g_args[g_num_args] = "--takeover";
+    g_args[g_num_args + 1] = fd_arg;
+    g_args[g_num_args + 2] = NULL;
+
+    fflush(stdout);
+    fflush(stderr);
+    execv(path, g_args);
+
+    fprintf(stderr, "Error: Failed to exec %s: %s\n", path, strerror(errno));
+    g_args[g_num_args] = NULL;
+    close(fds[0]);
+    return -1;
+}
+
+// Read the state written by upgrade_exec()
+int upgrade_receive(int fd, upgrade_state_t *state)
+{
+    ssize_t n;
+    do
+    {
+        n = read(fd, state, sizeof(*state));
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+
+    if (n != (ssize_t)sizeof(*state) || state->magic != UPGRADE_MAGIC ||
+        state->version != UPGRADE_VERSION)
+    {
+        fprintf(stderr, "Error: No valid upgrade state on descriptor %d\n", fd);
+        return -1;
+    }
+    return 0;
+}
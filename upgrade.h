@@ -0,0 +1,74 @@
+/*
+    Zero-gap binary upgrade.
+
+    "UPGRADE [path]" replaces the running logger (combined or acquire mode)
+    with a new binary, by default the one it was started from, without
+    closing the control socket and without losing samples:
+        1. the old process stops its threads. The scan stops right after
+           its last read, everything read is written (the last chunk is
+           flagged PARTIAL but not CAPTURE_END) and the sinks are flushed.
+        2. it writes an upgrade_state_t to a pipe and execs the new binary
+           with its own arguments plus "--takeover FD". The listening socket
+           stays open across exec, so clients that connect meanwhile wait in
+           its backlog instead of being refused.
+        3. the new process reads the state, keeps the boot ID, sequence
+           counter, capture state and rate, adopts the shared-memory ring
+           (acquire mode; an attached writer never notices) and resumes the
+           scan.
+
+    The synthetic source (see device.h) resumes at the frame where the old
+    process stopped reading, so no sample is lost or repeated. An MCC 118
+    scan runs in the daqhats library of the old process and ends with it:
+    the new process starts a new scan and reports the frames missed between
+    the two (about the takeover time times the rate).
+
+    Schedules (SCHEDULE, START_AT, STOP_AFTER) and detector state are not
+    carried over.
+*/
+
+#ifndef UPGRADE_H_
+#define UPGRADE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UPGRADE_MAGIC 0x52475055u  // "UPGR"
+#define UPGRADE_VERSION 1
+#define UPGRADE_PATH_MAX 512
+#define UPGRADE_MAX_ARGS 32
+
+// Everything the new process needs to continue the capture
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t socket_fd;              // listening control socket, still open
+    uint64_t boot_id;
+    uint64_t seq_counter;
+    bool capture_enabled;
+    double scan_rate;
+    // Scan at the time it was stopped
+    bool scan_active;
+    uint8_t source;                 // device_source_t
+    uint8_t address;
+    double scan_t0;                 // synthetic: monotonic time of frame 0
+    uint64_t scan_frames;           // synthetic: frames read
+    uint64_t frames_left;           // SCHEDULE_UNLIMITED if open-ended
+    double stopped_at;              // monotonic time the scan was stopped
+    double requested_at;            // monotonic time UPGRADE was received
+} upgrade_state_t;
+
+// Remember the command line for the exec. Call first thing in main().
+void upgrade_init(int argc, char **argv);
+
+// Binary the logger was started from
+const char* upgrade_self_path(void);
+
+// Exec path with the saved arguments and "--takeover FD", where FD reads
+// back state. Returns only on failure (-1, reported).
+int upgrade_exec(const char *path, const upgrade_state_t *state);
+
+// Read the state handed over on fd and close it. Returns 0 or -1 (reported).
+int upgrade_receive(int fd, upgrade_state_t *state);
+
+#endif /* UPGRADE_H_ */
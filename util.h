@@ -0,0 +1,60 @@
+/*
+    Small helpers shared by the logger and its tools: little-endian field
+    access for the SDAT, SDAR and wire formats, the monotonic clock and
+    duration parsing for config values.
+
+    All static inline, so every program that includes this header gets
+    its own copy and no object file has to be linked.
+*/
+
+#ifndef UTIL_H_
+#define UTIL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Append a little-endian value to the buffer
+static inline uint8_t* put_le(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(value >> (8 * i));
+    return p + bytes;
+}
+
+// Read a little-endian value
+static inline uint64_t get_le(const uint8_t *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+// Monotonic time in seconds
+static inline double now_mono(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parse "30", "30s", "5m", "12h" or "7d" into seconds, -1 if invalid
+static inline double parse_seconds(const char *text)
+{
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0.0)
+        return -1.0;
+    if (*end == 'm')
+        value *= 60.0;
+    else if (*end == 'h')
+        value *= 3600.0;
+    else if (*end == 'd')
+        value *= 86400.0;
+    if (*end == 's' || *end == 'm' || *end == 'h' || *end == 'd')
+        end++;
+    return *end == '\0' ? value : -1.0;
+}
+
+#endif /* UTIL_H_ */
@@ -0,0 +1,394 @@
+/*
+    Virtual streams (see vstream.h)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "vstream.h"
+#include "budget.h"
+#include "config.h"
+
+// Stream names become directory names, so keep them plain
+static bool valid_name(const char *name)
+{
+    if (name[0] == '\0' || strcmp(name, "low") == 0 || strcmp(name, "events") == 0)
+        return false;
+    for (const char *p = name; *p; p++)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-')
+            return false;
+    }
+    return true;
+}
+
+// Parse one "stream" line
+static int parse_stream(vstream_t *vs, const char *args)
+{
+    char value[128];
+
+    memset(vs, 0, sizeof(*vs));
+    if (!config_arg(args, "name", vs->name, sizeof(vs->name)) || !valid_name(vs->name))
+    {
+        fprintf(stderr, "Error: stream needs name=<letters, digits, _ or -> other than low/events\n");
+        return -1;
+    }
+
+    if (!config_arg(args, "ch", value, sizeof(value)))
+    {
+        fprintf(stderr, "Error: stream %s needs ch=<channel>[,<channel>...]\n", vs->name);
+        return -1;
+    }
+    char *save = NULL;
+    for (char *tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        int ch = atoi(tok);
+        if (ch < 0 || ch > 7 || vs->num_channels >= VSTREAM_MAX_CHANNELS)
+        {
+            fprintf(stderr, "Error: stream %s has an invalid channel list\n", vs->name);
+            return -1;
+        }
+        vs->channels[vs->num_channels++] = (uint8_t)ch;
+    }
+
+    double rate = config_arg_double(args, "rate", 0.0);
+    if (rate < 1.0 || rate != (double)(uint32_t)rate)
+    {
+        fprintf(stderr, "Error: stream %s needs an integer rate in Hz\n", vs->name);
+        return -1;
+    }
+    vs->rate = (uint32_t)rate;
+    vs->lp = config_arg_double(args, "lp", 0.0);
+    vs->order = (uint32_t)config_arg_double(args, "order", VSTREAM_DEFAULT_ORDER);
+    return 0;
+}
+
+// Parse the "stream" config lines
+int vstream_load(vstream_set_t *set)
+{
+    memset(set, 0, sizeof(*set));
+
+    const char *args;
+    int iter = 0;
+    while ((args = config_next("stream", &iter)) != NULL)
+    {
+        if (set->num_streams >= VSTREAM_MAX_STREAMS)
+        {
+            fprintf(stderr, "Error: At most %d streams can be defined\n", VSTREAM_MAX_STREAMS);
+            return -1;
+        }
+        vstream_t *vs = &set->streams[set->num_streams];
+        if (parse_stream(vs, args) != 0)
+            return -1;
+        for (uint32_t i = 0; i < set->num_streams; i++)
+        {
+            if (strcmp(set->streams[i].name, vs->name) == 0)
+            {
+                fprintf(stderr, "Error: Duplicate stream name %s\n", vs->name);
+                return -1;
+            }
+        }
+        set->num_streams++;
+    }
+    return (int)set->num_streams;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b != 0)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Scan needed by the loaded streams
+int vstream_scan_plan(const vstream_set_t *set, uint8_t *channels, uint32_t *num_channels, double *rate)
+{
+    uint8_t mask = 0;
+    uint64_t lcm = 1;
+
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        const vstream_t *vs = &set->streams[i];
+        for (uint32_t c = 0; c < vs->num_channels; c++)
+            mask |= (uint8_t)(1u << vs->channels[c]);
+        lcm = lcm / gcd(lcm, vs->rate) * vs->rate;
+        if (lcm > (uint64_t)VSTREAM_MAX_SCAN_RATE)
+            break;
+    }
+
+    *num_channels = 0;
+    for (uint8_t ch = 0; ch < 8; ch++)
+    {
+        if (mask & (1u << ch))
+            channels[(*num_channels)++] = ch;
+    }
+
+    if ((double)lcm * *num_channels > VSTREAM_MAX_SCAN_RATE)
+    {
+        fprintf(stderr, "Error: Streams need %u channels at %llu Hz or more, above the %.0f samples/s "
+                "of the MCC 118\n", *num_channels, (unsigned long long)lcm, VSTREAM_MAX_SCAN_RATE);
+        return -1;
+    }
+    *rate = (double)lcm;
+    return 0;
+}
+
+// Prepare one stream for the scan; returns -1 if the scan cannot serve it
+static int configure_stream(vstream_t *vs, const uint8_t *channels, uint32_t num_channels,
+                            double scan_rate, double chunk_sec)
+{
+    for (uint32_t c = 0; c < vs->num_channels; c++)
+    {
+        uint32_t col;
+        for (col = 0; col < num_channels && channels[col] != vs->channels[c]; col++)
+            ;
+        if (col == num_channels)
+        {
+            fprintf(stderr, "Error: stream %s: channel %u is not in the scan\n", vs->name, vs->channels[c]);
+            return -1;
+        }
+        vs->columns[c] = (uint8_t)col;
+    }
+
+    double ratio = scan_rate / vs->rate;
+    vs->decimation = (uint32_t)(ratio + 0.5);
+    if (vs->decimation == 0 || ratio - vs->decimation > 1e-9 || vs->decimation - ratio > 1e-9)
+    {
+        fprintf(stderr, "Error: stream %s: %u Hz does not divide the scan rate %.2f Hz\n",
+                vs->name, vs->rate, scan_rate);
+        return -1;
+    }
+
+    double lp = vs->lp;
+    if (lp <= 0.0 && vs->decimation > 1)
+        lp = VSTREAM_DEFAULT_LP_FRACTION * vs->rate;
+    memset(&vs->filter, 0, sizeof(vs->filter));
+    if (lp > 0.0 && dsp_configure_lowpass(&vs->filter, vs->num_channels, scan_rate, lp, vs->order) != 0)
+    {
+        fprintf(stderr, "Error: stream %s: invalid low-pass (lp=%.2f, order=%u)\n", vs->name, lp, vs->order);
+        return -1;
+    }
+
+    vs->chunk_frames = (uint32_t)(chunk_sec * vs->rate);
+    if (vs->chunk_frames == 0)
+        vs->chunk_frames = 1;
+    printf("Stream %s: %u channel(s) at %u Hz (1/%u of the scan), low-pass %.2f Hz\n",
+           vs->name, vs->num_channels, vs->rate, vs->decimation, lp);
+    return 0;
+}
+
+// Prepare every stream for a scan
+int vstream_configure(vstream_set_t *set, const uint8_t *channels, uint32_t num_channels,
+                      double scan_rate, double chunk_sec, vstream_fn fn, void *user)
+{
+    vstream_release(set);
+    set->scan_channels = num_channels;
+    set->fn = fn;
+    set->user = user;
+
+    int result = 0;
+    size_t bytes = 0;
+    uint32_t scan_frames = (uint32_t)(chunk_sec * scan_rate);
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        vstream_t *vs = &set->streams[i];
+        vs->decimation = 0;
+        if (configure_stream(vs, channels, num_channels, scan_rate, chunk_sec) != 0)
+        {
+            vs->decimation = 0;
+            result = -1;
+            continue;
+        }
+
+        // Work space for one scan chunk plus the chunk being filled
+        bytes += (size_t)scan_frames * vs->num_channels * sizeof(double) +
+                 sdat_chunk_footprint(vs->chunk_frames * vs->num_channels);
+    }
+
+    if (bytes > 0 && budget_reserve(BUDGET_HISTORY, bytes, "stream buffers") != 0)
+    {
+        for (uint32_t i = 0; i < set->num_streams; i++)
+            set->streams[i].decimation = 0;
+        return -1;
+    }
+    set->reserved = bytes;
+    return result;
+}
+
+// True if any stream is active
+bool vstream_enabled(const vstream_set_t *set)
+{
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        if (set->streams[i].decimation > 0)
+            return true;
+    }
+    return false;
+}
+
+// Hand a finished chunk to the callback
+static void emit(vstream_set_t *set, vstream_t *vs)
+{
+    if (vs->chunk == NULL || vs->chunk->sample_count == 0)
+        return;
+    vs->chunks++;
+    set->fn(vs->chunk, set->user);
+    vs->chunk = NULL;
+}
+
+// Start a chunk for a stream
+static sdat_chunk_t* new_chunk(const vstream_set_t *set, const vstream_t *vs)
+{
+    sdat_chunk_t *chunk = sdat_chunk_create(vs->chunk_frames * vs->num_channels);
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Error: Failed to allocate chunk for stream %s\n", vs->name);
+        return NULL;
+    }
+    chunk->stream = (uint16_t)(VSTREAM_FIRST_ID + (vs - set->streams));
+    chunk->decimation = vs->decimation;
+    chunk->sample_rate = vs->rate;
+    strcpy(chunk->stream_name, vs->name);
+    chunk->num_channels = (uint8_t)vs->num_channels;
+    memcpy(chunk->channels, vs->channels, vs->num_channels);
+    return chunk;
+}
+
+// Copy the source's events on this stream's channels
+static void merge_events(sdat_chunk_t *dst, const sdat_chunk_t *src, const vstream_t *vs)
+{
+    for (uint32_t k = 0; k < src->event_count; k++)
+    {
+        const sdat_event_t *ev = &src->events[k];
+        if (memchr(vs->channels, ev->channel, vs->num_channels) == NULL)
+            continue;
+
+        uint32_t i;
+        for (i = 0; i < dst->event_count; i++)
+        {
+            if (dst->events[i].onset == ev->onset && dst->events[i].channel == ev->channel)
+                break;
+        }
+        if (i == dst->event_count && dst->event_count >= SDAT_MAX_EVENTS)
+            continue;
+        dst->events[i] = *ev;
+        if (i == dst->event_count)
+            dst->event_count++;
+        dst->flags |= SDAT_FLAG_EVENT;
+    }
+}
+
+// Pick, filter and decimate one stream from a scan chunk
+static void process_stream(vstream_set_t *set, vstream_t *vs, const sdat_chunk_t *src, uint32_t frames)
+{
+    uint32_t scan_nch = set->scan_channels;
+    uint32_t nch = vs->num_channels;
+    uint64_t start = src->seq_start;
+
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        const double *in = src->samples + (size_t)f * scan_nch;
+        double *out = vs->work + (size_t)f * nch;
+        for (uint32_t c = 0; c < nch; c++)
+            out[c] = in[vs->columns[c]];
+    }
+    if (dsp_enabled(&vs->filter))
+        dsp_process(&vs->filter, vs->work, frames);
+
+    // Keep frames whose scan index is a multiple of the decimation
+    uint32_t d = vs->decimation;
+    uint32_t first = (uint32_t)((d - start % d) % d);
+    for (uint32_t f = first; f < frames; f += d)
+    {
+        uint64_t index = (start + f) / d;
+
+        // A jump in the scan (restart, new boot) starts a new chunk
+        if (vs->chunk && vs->chunk->seq_start + vs->chunk->sample_count / nch != index)
+            emit(set, vs);
+        if (vs->chunk == NULL)
+        {
+            vs->chunk = new_chunk(set, vs);
+            if (vs->chunk == NULL)
+                return;
+            vs->chunk->seq_start = index;
+            vs->chunk->time_start = src->time_start;
+        }
+
+        sdat_chunk_t *chunk = vs->chunk;
+        memcpy(chunk->samples + chunk->sample_count, vs->work + (size_t)f * nch, nch * sizeof(double));
+        chunk->sample_count += nch;
+        chunk->device_id = src->device_id;
+        chunk->boot_id = src->boot_id;
+        chunk->time_end = src->time_end;
+
+        if (chunk->sample_count >= vs->chunk_frames * nch)
+        {
+            merge_events(chunk, src, vs);
+            emit(set, vs);
+        }
+    }
+    if (vs->chunk)
+        merge_events(vs->chunk, src, vs);
+}
+
+// Derive every stream from one scan chunk
+void vstream_process(vstream_set_t *set, const sdat_chunk_t *src)
+{
+    uint32_t frames = src->sample_count / set->scan_channels;
+
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        vstream_t *vs = &set->streams[i];
+        if (vs->decimation == 0 || frames == 0)
+            continue;
+
+        // Work space grows with the largest source chunk seen
+        if (frames > vs->work_frames)
+        {
+            free(vs->work);
+            vs->work = (double*)malloc((size_t)frames * vs->num_channels * sizeof(double));
+            vs->work_frames = vs->work ? frames : 0;
+            if (vs->work == NULL)
+            {
+                fprintf(stderr, "Error: Failed to allocate work buffer for stream %s\n", vs->name);
+                continue;
+            }
+        }
+        process_stream(set, vs, src, frames);
+    }
+}
+
+// First scan frame of the chunks still being filled
+uint64_t vstream_pending(const vstream_set_t *set)
+{
+    uint64_t pending = UINT64_MAX;
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        const vstream_t *vs = &set->streams[i];
+        if (vs->decimation > 0 && vs->chunk != NULL && vs->chunk->seq_start * vs->decimation < pending)
+            pending = vs->chunk->seq_start * vs->decimation;
+    }
+    return pending;
+}
+
+// Hand over pending chunks and release buffers
+void vstream_release(vstream_set_t *set)
+{
+    for (uint32_t i = 0; i < set->num_streams; i++)
+    {
+        vstream_t *vs = &set->streams[i];
+        if (set->fn != NULL)
+            emit(set, vs);
+        sdat_chunk_free(vs->chunk);
+        vs->chunk = NULL;
+        free(vs->work);
+        vs->work = NULL;
+        vs->work_frames = 0;
+    }
+    budget_release(BUDGET_HISTORY, set->reserved);
+    set->reserved = 0;
+}
@@ -0,0 +1,95 @@
+/*
+    Virtual streams: several channel subsets at different rates derived
+    from the single hardware scan of the MCC 118.
+
+    Each stream picks its channels from every scan frame, runs them
+    through its own anti-aliasing low-pass and keeps every n-th frame,
+    where n = scan rate / stream rate. The scan covers the union of all
+    stream channels at the least common multiple of the stream rates, so
+    every stream gets an exact integer decimation.
+
+    Streams write their own chunk series (stream ids from
+    VSTREAM_FIRST_ID) with their own seq numbering. seq_start times the
+    decimation is the frame index of the hardware scan, the timebase shared
+    with event onsets and the dual-rate streams.
+
+    Configuration, one "stream" line per stream:
+        stream = name=vib ch=4 rate=10000 lp=4000
+        stream = name=slow ch=0,1 rate=100
+    lp is the low-pass cutoff in Hz (default 0.4 x rate when decimating,
+    none otherwise) and order its even order (default 8).
+*/
+
+#ifndef VSTREAM_H_
+#define VSTREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdat.h"
+#include "dsp.h"
+
+#define VSTREAM_MAX_STREAMS 8
+#define VSTREAM_MAX_CHANNELS 8
+#define VSTREAM_FIRST_ID 16
+#define VSTREAM_DEFAULT_ORDER 8
+#define VSTREAM_DEFAULT_LP_FRACTION 0.4
+#define VSTREAM_MAX_SCAN_RATE 100000.0  // MCC 118 aggregate limit, samples/s
+
+// Receives every finished chunk of a stream; takes ownership
+typedef void (*vstream_fn)(sdat_chunk_t *chunk, void *user);
+
+typedef struct {
+    char name[SDAT_MAX_STREAM_NAME];
+    uint32_t num_channels;
+    uint8_t channels[VSTREAM_MAX_CHANNELS];    // hardware channels
+    uint8_t columns[VSTREAM_MAX_CHANNELS];     // positions in the scan frame
+    uint32_t rate;
+    double lp;                                  // 0 = no filter
+    uint32_t order;
+
+    uint32_t decimation;
+    uint32_t chunk_frames;
+    dsp_chain_t filter;
+    double *work;                               // picked and filtered frames
+    uint32_t work_frames;
+    sdat_chunk_t *chunk;
+    uint64_t chunks;
+} vstream_t;
+
+typedef struct {
+    uint32_t num_streams;
+    vstream_t streams[VSTREAM_MAX_STREAMS];
+    uint32_t scan_channels;                     // frame width of the scan
+    size_t reserved;                            // bytes reserved in the memory budget
+    vstream_fn fn;
+    void *user;
+} vstream_set_t;
+
+// Parse the "stream" config lines. Returns the number of streams (0 if
+// none are configured) or -1 on invalid definitions.
+int vstream_load(vstream_set_t *set);
+
+// Scan needed by the loaded streams: the sorted union of their channels
+// and the least common multiple of their rates. Returns -1 if that
+// exceeds the MCC 118 aggregate rate.
+int vstream_scan_plan(const vstream_set_t *set, uint8_t *channels, uint32_t *num_channels, double *rate);
+
+// Prepare every stream for a scan of the given channels and rate, with
+// chunks of chunk_sec seconds. Streams the scan cannot serve are reported
+// and skipped. Returns 0 on success.
+int vstream_configure(vstream_set_t *set, const uint8_t *channels, uint32_t num_channels,
+                      double scan_rate, double chunk_sec, vstream_fn fn, void *user);
+
+// True if any stream is active
+bool vstream_enabled(const vstream_set_t *set);
+
+// Derive every stream from one scan chunk. Does not keep src.
+void vstream_process(vstream_set_t *set, const sdat_chunk_t *src);
+
+// First scan frame held in a chunk not yet handed over, or UINT64_MAX
+uint64_t vstream_pending(const vstream_set_t *set);
+
+// Hand over pending chunks and release buffers (definitions are kept)
+void vstream_release(vstream_set_t *set);
+
+#endif /* VSTREAM_H_ */